@@ -4,25 +4,34 @@
 #include <asterisk/channel.h>
 #include <asterisk/cli.h>
 #include <asterisk/devicestate.h>
+#include <asterisk/manager.h>
 #include <asterisk/module.h>
+#include <asterisk/network.h>
 #include <asterisk/rtp_engine.h>
 #include <asterisk/sched.h>
 
 #include "device/sccp_channel_tech.h"
 #include "device/sccp_rtp_glue.h"
+#include "sccp_capture.h"
 #include "sccp_debug.h"
 #include "sccp_config.h"
 #include "sccp_device.h"
+#include "sccp_devstate_cache.h"
 #include "sccp_device_registry.h"
+#include "sccp_lock_profile.h"
+#include "sccp_metrics.h"
 #include "sccp_msg.h"
+#include "sccp_msg_stats.h"
+#include "sccp_rtp_pool.h"
+#include "sccp_sched.h"
 #include "sccp_server.h"
+#include "sccp_session.h"
 #include "sccp_utils.h"
 
 #ifndef VERSION
 #define VERSION "unknown"
 #endif
 
-struct ast_sched_context *sccp_sched;
 const struct ast_module_info *sccp_module_info;
 
 static struct sccp_device_registry *global_registry;
@@ -45,6 +54,7 @@ enum find_line_result {
  */
 static enum find_line_result find_line(const char *name, struct sccp_line **result)
 {
+	struct sccp_config_reader reader;
 	struct sccp_cfg *cfg;
 	struct sccp_line_cfg *line_cfg;
 
@@ -53,9 +63,9 @@ static enum find_line_result find_line(const char *name, struct sccp_line **resu
 		return LINE_FOUND;
 	}
 
-	cfg = sccp_config_get();
+	cfg = sccp_config_read_begin(&reader);
 	line_cfg = sccp_cfg_find_line(cfg, name);
-	ao2_ref(cfg, -1);
+	sccp_config_read_end(&reader);
 	if (line_cfg) {
 		ao2_ref(line_cfg, -1);
 		return LINE_NOT_REGISTERED;
@@ -94,15 +104,21 @@ static struct ast_channel *channel_tech_requester(const char *type, struct ast_f
 static int channel_tech_devicestate(const char *data)
 {
 	struct sccp_line *line;
-	char *name = ast_strdupa(data);
-	char *ptr;
+	size_t len = strcspn(data, "/");
+	unsigned int gen;
+	char *name;
 	int state;
 
-	ptr = strchr(name, '/');
-	if (ptr) {
-		*ptr = '\0';
+	state = sccp_devstate_cache_get(data, len);
+	if (state != SCCP_DEVSTATE_CACHE_MISS) {
+		return state;
 	}
 
+	gen = sccp_devstate_cache_generation();
+
+	name = ast_alloca(len + 1);
+	ast_copy_string(name, data, len + 1);
+
 	switch (find_line(name, &line)) {
 	case LINE_FOUND:
 		state = sccp_channel_tech_devicestate(line);
@@ -110,6 +126,7 @@ static int channel_tech_devicestate(const char *data)
 		break;
 	case LINE_NOT_REGISTERED:
 		state = AST_DEVICE_UNAVAILABLE;
+		sccp_devstate_cache_set_if_unknown(name, len, state, gen);
 		break;
 	case LINE_NOT_FOUND:
 		state = AST_DEVICE_INVALID;
@@ -220,15 +237,19 @@ static char *cli_reset_device(struct ast_cli_entry *e, int cmd, struct ast_cli_a
 static char *cli_set_debug(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	const char *what;
+	const char *target;
+	int remove = 0;
+	int ret = 0;
 
 	switch (cmd) {
 	case CLI_INIT:
-		e->command = "sccp set debug {off|on|ip|device}";
+		e->command = "sccp set debug {off|on|ip|device|message}";
 		e->usage =
-			"Usage: sccp set debug {off|on|ip addr|device name}\n"
-			"       Globally disables dumping of SCCP packets,\n"
-			"       or enables it either globally or for a (single)\n"
-			"       IP address or device name.\n";
+			"Usage: sccp set debug {off|on|ip <addr[/prefix]> [off]|device <name> [off]|message <name|id> [off]}\n"
+			"       Globally disables dumping of SCCP packets, or enables it\n"
+			"       either globally or for a set of IP prefixes and device names.\n"
+			"       Message types restrict the messages dumped to the ones\n"
+			"       added, else all but the keep alives are dumped.\n";
 		return NULL;
 	case CLI_GENERATE:
 		if (a->pos == 4 && !strcasecmp(a->argv[3], "device")) {
@@ -240,23 +261,179 @@ static char *cli_set_debug(struct ast_cli_entry *e, int cmd, struct ast_cli_args
 
 	what = a->argv[e->args - 1];
 
-	if (!strcasecmp(what, "on")) {
+	if (!strcasecmp(what, "on") && a->argc == e->args) {
 		sccp_debug_enable();
 		ast_cli(a->fd, "SCCP debugging enabled\n");
-	} else if (!strcasecmp(what, "off")) {
+		return CLI_SUCCESS;
+	} else if (!strcasecmp(what, "off") && a->argc == e->args) {
 		sccp_debug_disable();
 		ast_cli(a->fd, "SCCP debugging disabled\n");
-	} else if (!strcasecmp(what, "device") && a->argc == e->args + 1) {
-		sccp_debug_enable_device_name(a->argv[e->args]);
-		ast_cli(a->fd, "SCCP debugging enabled for device: %s\n", a->argv[e->args]);
-	} else if (!strcasecmp(what, "ip") && a->argc == e->args + 1) {
-		sccp_debug_enable_ip(a->argv[e->args]);
-		ast_cli(a->fd, "SCCP debugging enabled for IP: %s\n", a->argv[e->args]);
+		return CLI_SUCCESS;
+	}
+
+	if (a->argc == e->args + 2 && !strcasecmp(a->argv[e->args + 1], "off")) {
+		remove = 1;
+	} else if (a->argc != e->args + 1) {
+		return CLI_SHOWUSAGE;
+	}
+
+	target = a->argv[e->args];
+
+	if (!strcasecmp(what, "device")) {
+		sccp_debug_set_device_name(target, remove);
+	} else if (!strcasecmp(what, "ip")) {
+		ret = sccp_debug_set_ip(target, remove);
+	} else if (!strcasecmp(what, "message")) {
+		ret = sccp_debug_set_msg(target, remove);
 	} else {
 		return CLI_SHOWUSAGE;
 	}
 
-	sccp_server_reload_debug(global_server);
+	if (ret) {
+		ast_cli(a->fd, "Invalid %s: %s\n", what, target);
+		return CLI_FAILURE;
+	}
+
+	ast_cli(a->fd, "SCCP debugging %s for %s: %s\n", remove ? "disabled" : "enabled", what, target);
+
+	return CLI_SUCCESS;
+}
+
+static char *cli_set_lock_profile(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	const char *what;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "sccp set lockprofile {on|off|reset}";
+		e->usage =
+			"Usage: sccp set lockprofile {on|off|reset}\n"
+			"       Enable or disable the profiling of the device, registry and\n"
+			"       sync queue locks, or reset the profiling stats.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != e->args) {
+		return CLI_SHOWUSAGE;
+	}
+
+	what = a->argv[e->args - 1];
+	if (!strcasecmp(what, "on")) {
+		sccp_lock_profile_enable();
+		ast_cli(a->fd, "Lock profiling enabled\n");
+	} else if (!strcasecmp(what, "off")) {
+		sccp_lock_profile_disable();
+		ast_cli(a->fd, "Lock profiling disabled\n");
+	} else if (!strcasecmp(what, "reset")) {
+		sccp_lock_profile_reset();
+		ast_cli(a->fd, "Lock profiling stats reset\n");
+	} else {
+		return CLI_SHOWUSAGE;
+	}
+
+	return CLI_SUCCESS;
+}
+
+static int lock_site_stats_cmp(const void *a, const void *b)
+{
+	const struct sccp_lock_site_stats *stats_a = a;
+	const struct sccp_lock_site_stats *stats_b = b;
+
+	/* by total wait time, descending */
+	if (stats_a->wait.total != stats_b->wait.total) {
+		return stats_a->wait.total < stats_b->wait.total ? 1 : -1;
+	}
+
+	if (stats_a->hold.total != stats_b->hold.total) {
+		return stats_a->hold.total < stats_b->hold.total ? 1 : -1;
+	}
+
+	return 0;
+}
+
+#define LOCK_PROFILE_DEFAULT_COUNT 20
+
+static char *cli_show_lock_profile(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+#define FORMAT_STRING  "%-10.10s %-40.40s %10s %12s %10s %10s %10s %10s\n"
+#define FORMAT_STRING2 "%-10.10s %-40.40s %10u %12llu %10llu %10u %10llu %10u\n"
+	struct sccp_lock_site_stats *stats;
+	const struct sccp_lock_site_stats *site_stats;
+	unsigned int wait_count;
+	unsigned int hold_count;
+	unsigned int count = LOCK_PROFILE_DEFAULT_COUNT;
+	size_t n;
+	size_t i;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "sccp show lockprofile";
+		e->usage =
+			"Usage: sccp show lockprofile [<count>]\n"
+			"       Show the most contended lock acquisition sites, i.e. the\n"
+			"       functions that waited the longest for the profiled locks.\n"
+			"       Times are in microseconds.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc == 4) {
+		if (sscanf(a->argv[3], "%u", &count) != 1 || !count) {
+			return CLI_SHOWUSAGE;
+		}
+	} else if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (sccp_lock_profile_take_stats(&stats, &n)) {
+		return CLI_FAILURE;
+	}
+
+	qsort(stats, n, sizeof(*stats), lock_site_stats_cmp);
+
+	ast_cli(a->fd, "Lock profiling: %s\n\n", sccp_lock_profile_enabled() ? "enabled" : "disabled");
+	ast_cli(a->fd, FORMAT_STRING, "Lock", "Site", "Count", "Wait total", "Wait avg", "Wait p99", "Hold avg", "Hold p99");
+	for (i = 0; i < n && i < count; i++) {
+		site_stats = &stats[i];
+		wait_count = sccp_histogram_count(&site_stats->wait);
+		hold_count = sccp_histogram_count(&site_stats->hold);
+		ast_cli(a->fd, FORMAT_STRING2, sccp_lock_class_str(site_stats->class), site_stats->site, wait_count,
+				(unsigned long long) site_stats->wait.total,
+				wait_count ? (unsigned long long) (site_stats->wait.total / wait_count) : 0ULL,
+				sccp_histogram_percentile(&site_stats->wait, 99),
+				hold_count ? (unsigned long long) (site_stats->hold.total / hold_count) : 0ULL,
+				sccp_histogram_percentile(&site_stats->hold, 99));
+	}
+
+	ast_free(stats);
+
+	return CLI_SUCCESS;
+
+#undef FORMAT_STRING
+#undef FORMAT_STRING2
+}
+
+static char *cli_show_debug(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "sccp show debug";
+		e->usage =
+			"Usage: sccp show debug\n"
+			"       Show the SCCP debugging filters.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	sccp_debug_show(a->fd);
 
 	return CLI_SUCCESS;
 }
@@ -285,6 +462,25 @@ static char *cli_show_config(struct ast_cli_entry *e, int cmd, struct ast_cli_ar
 	ast_cli(a->fd, "guest = %s\n", AST_CLI_YESNO(cfg->general_cfg->guest_device_cfg));
 	ast_cli(a->fd, "max_guests = %u\n\n", cfg->general_cfg->max_guests);
 
+	ast_cli(a->fd, "Pre-apply: %d us with %u thread(s)\n", cfg->pre_apply_time, cfg->pre_apply_workers);
+	ast_cli(a->fd, "Sharing: %u distinct strings for %u references, %u distinct formats for %u lines, %u speeddials merged, ~%zu bytes saved\n",
+			cfg->sharing.strings,
+			cfg->sharing.string_refs,
+			cfg->sharing.caps,
+			cfg->sharing.caps_refs,
+			cfg->sharing.speeddials_merged,
+			cfg->sharing.saved);
+	if (cfg->changes.all) {
+		ast_cli(a->fd, "Last change: full reload, diff computed in %d us\n\n", cfg->changes.diff_time);
+	} else {
+		ast_cli(a->fd, "Last change: %u added, %u modified, %u removed, %u unchanged devices, diff computed in %d us\n\n",
+				cfg->changes.devices_added,
+				cfg->changes.devices_modified,
+				cfg->changes.devices_removed,
+				cfg->changes.devices_unchanged,
+				cfg->changes.diff_time);
+	}
+
 	ast_cli(a->fd, FORMAT_STRING2, "Device", "Line", "Voicemail", "Speeddials");
 	iter = ao2_iterator_init(cfg->devices_cfg, 0);
 	while ((device_cfg = ao2_iterator_next(&iter))) {
@@ -308,12 +504,111 @@ static char *cli_show_config(struct ast_cli_entry *e, int cmd, struct ast_cli_ar
 #undef FORMAT_STRING2
 }
 
+static char *cli_show_config_cache(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct sccp_config_cache_status status;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "sccp show config cache";
+		e->usage = "Usage: sccp show config cache\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	sccp_config_cache_get_status(&status);
+
+	ast_cli(a->fd,
+			"Cache file:            %s\n"
+			"Cache size:            %zu\n"
+			"Cacheable:             %s\n"
+			"Valid:                 %s\n"
+			"Loaded from cache:     %s\n"
+			"Load time:             %d ms\n"
+			"Last write time:       %d ms\n"
+			"Writes:                %u\n"
+			"Write failures:        %u\n",
+			status.path,
+			status.size,
+			AST_CLI_YESNO(status.cacheable),
+			AST_CLI_YESNO(status.valid),
+			AST_CLI_YESNO(status.loaded),
+			status.load_time / 1000,
+			status.write_time / 1000,
+			status.writes,
+			status.write_failures);
+
+	return CLI_SUCCESS;
+}
+
+static const char * const device_filter_keys[] = { "ip", "type", "proto", "line", NULL };
+
+/*!
+ * \brief Parse a device filter given as a key/value pair, i.e. "ip" "10.4.0.0/16".
+ *
+ * \note For a "line" filter, the filter references the value string.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+static int parse_device_filter(const char *key, const char *value, struct sccp_device_filter *filter)
+{
+	char *addr;
+	char *prefix_len;
+	int proto_version;
+
+	if (!strcasecmp(key, "ip")) {
+		addr = ast_strdupa(value);
+		prefix_len = strchr(addr, '/');
+		filter->u.ip.prefix_len = 32;
+		if (prefix_len) {
+			*prefix_len++ = '\0';
+			if (sscanf(prefix_len, "%u", &filter->u.ip.prefix_len) != 1 || filter->u.ip.prefix_len > 32) {
+				return -1;
+			}
+		}
+
+		if (!inet_aton(addr, &filter->u.ip.addr)) {
+			return -1;
+		}
+
+		filter->type = SCCP_DEVICE_FILTER_IP;
+	} else if (!strcasecmp(key, "type")) {
+		if (sccp_device_type_from_str(value, &filter->u.device_type)) {
+			return -1;
+		}
+
+		filter->type = SCCP_DEVICE_FILTER_TYPE;
+	} else if (!strcasecmp(key, "proto")) {
+		if (sscanf(value, "%d", &proto_version) != 1 || proto_version < 0 || proto_version > UINT8_MAX) {
+			return -1;
+		}
+
+		filter->u.proto_version = proto_version;
+		filter->type = SCCP_DEVICE_FILTER_PROTO;
+	} else if (!strcasecmp(key, "line")) {
+		filter->u.line_name = value;
+		filter->type = SCCP_DEVICE_FILTER_LINE;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+#define SNAPSHOT_PAGE_SIZE 64
+
 static char *cli_show_devices(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 #define FORMAT_STRING  "%-16.16s %-16.16s %-6.6s %-6.6s %-6.6s %-25.25s\n"
 #define FORMAT_STRING2 "%-16.16s %-16.16s %-6.6s %-6.6s %-6u %-25.25s\n"
+	struct sccp_device_snapshot page[SNAPSHOT_PAGE_SIZE];
 	struct sccp_device_snapshot *snapshots;
+	struct sccp_device_filter filter;
+	char after[SCCP_DEVICE_NAME_MAX] = "";
 	size_t n;
+	size_t n_total = 0;
 	size_t n_guests = 0;
 	size_t i;
 
@@ -321,29 +616,62 @@ static char *cli_show_devices(struct ast_cli_entry *e, int cmd, struct ast_cli_a
 	case CLI_INIT:
 		e->command = "sccp show devices";
 		e->usage =
-			"Usage: sccp show devices\n"
-			"       Show the connected devices.\n";
+			"Usage: sccp show devices [{ip <addr[/prefix]>|type <type>|proto <version>|line <name>}]\n"
+			"       Show the connected devices, optionally only those matching\n"
+			"       an IP prefix, a device type, a protocol version or owning a line.\n";
 		return NULL;
 	case CLI_GENERATE:
+		if (a->pos == 3) {
+			return ast_cli_complete(a->word, device_filter_keys, a->n);
+		}
+
 		return NULL;
 	}
 
-	if (sccp_device_registry_take_snapshots(global_registry, &snapshots, &n)) {
-		return CLI_FAILURE;
+	if (a->argc == 5) {
+		if (parse_device_filter(a->argv[3], a->argv[4], &filter)) {
+			return CLI_SHOWUSAGE;
+		}
+	} else if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
 	}
 
 	ast_cli(a->fd, FORMAT_STRING, "Device", "IP", "Guest", "Type", "Proto", "Capabilities");
-	for (i = 0; i < n; i++) {
-		ast_cli(a->fd, FORMAT_STRING2, snapshots[i].name, snapshots[i].ipaddr, AST_CLI_YESNO(snapshots[i].guest),
-				sccp_device_type_str(snapshots[i].type), snapshots[i].proto_version, snapshots[i].capabilities);
-		if (snapshots[i].guest) {
-			n_guests++;
+
+	do {
+		if (a->argc == 5) {
+			if (sccp_device_registry_take_filtered_snapshots(global_registry, &filter, &snapshots, &n)) {
+				return CLI_FAILURE;
+			}
+		} else {
+			if (sccp_device_registry_take_snapshots_page(global_registry, after, page, ARRAY_LEN(page), &n)) {
+				return CLI_FAILURE;
+			}
+
+			snapshots = page;
+		}
+
+		for (i = 0; i < n; i++) {
+			ast_cli(a->fd, FORMAT_STRING2, snapshots[i].name, snapshots[i].ipaddr, AST_CLI_YESNO(snapshots[i].guest),
+					sccp_device_type_str(snapshots[i].type), snapshots[i].proto_version, snapshots[i].capabilities);
+			if (snapshots[i].guest) {
+				n_guests++;
+			}
 		}
-	}
 
-	ast_cli(a->fd, "Total: %zu connected device(s) (%zu guests)\n", n, n_guests);
+		n_total += n;
 
-	ast_free(snapshots);
+		if (snapshots != page) {
+			ast_free(snapshots);
+			break;
+		}
+
+		if (n) {
+			ast_copy_string(after, page[n - 1].name, sizeof(after));
+		}
+	} while (n == ARRAY_LEN(page));
+
+	ast_cli(a->fd, "Total: %zu connected device(s) (%zu guests)\n", n_total, n_guests);
 
 	return CLI_SUCCESS;
 
@@ -351,6 +679,279 @@ static char *cli_show_devices(struct ast_cli_entry *e, int cmd, struct ast_cli_a
 #undef FORMAT_STRING2
 }
 
+static void format_time(time_t t, char *buf, size_t size)
+{
+	struct timeval tv = {.tv_sec = t, .tv_usec = 0};
+	struct ast_tm tm;
+
+	if (!t) {
+		ast_copy_string(buf, "-", size);
+		return;
+	}
+
+	ast_localtime(&tv, &tm, NULL);
+	ast_strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+static char *cli_show_device(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct sccp_device_snapshot snapshot;
+	struct sccp_device *device;
+	const struct sccp_device_stats *stats = &snapshot.stats;
+	char registration_time[64];
+	char last_keepalive[64];
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "sccp show device";
+		e->usage =
+			"Usage: sccp show device <device>\n"
+			"       Show the details, traffic and health stats of a connected device.\n";
+		return NULL;
+	case CLI_GENERATE:
+		if (a->pos == 3) {
+			return sccp_device_registry_complete(global_registry, a->word, a->n);
+		}
+
+		return NULL;
+	}
+
+	if (a->argc != 4) {
+		return CLI_SHOWUSAGE;
+	}
+
+	device = sccp_device_registry_find(global_registry, a->argv[3]);
+	if (!device) {
+		ast_cli(a->fd, "No such device: %s\n", a->argv[3]);
+		return CLI_FAILURE;
+	}
+
+	sccp_device_take_snapshot(device, &snapshot);
+	ao2_ref(device, -1);
+
+	format_time(stats->registration_time, registration_time, sizeof(registration_time));
+	format_time(stats->last_keepalive, last_keepalive, sizeof(last_keepalive));
+
+	ast_cli(a->fd,
+			"Name:                %s\n"
+			"IP:                  %s\n"
+			"Guest:               %s\n"
+			"Type:                %s\n"
+			"Proto:               %u\n"
+			"Capabilities:        %s\n"
+			"Registered:          %s\n"
+			"Last keepalive:      %s\n"
+			"Keepalive interval:  %u ms (jitter %u ms)\n"
+			"Messages in:         %u (%llu bytes)\n"
+			"Messages out:        %u (%llu bytes)\n"
+			"Outbound high-water: %zu bytes\n"
+			"Send stalls:         %u\n"
+			"Calls placed:        %u\n"
+			"Calls received:      %u\n",
+			snapshot.name, snapshot.ipaddr, AST_CLI_YESNO(snapshot.guest), sccp_device_type_str(snapshot.type),
+			snapshot.proto_version, snapshot.capabilities, registration_time, last_keepalive,
+			stats->keepalive_interval, stats->keepalive_jitter,
+			stats->session.msgs_in, (unsigned long long) stats->session.bytes_in,
+			stats->session.msgs_out, (unsigned long long) stats->session.bytes_out,
+			stats->session.outbound_highwater, stats->session.send_stalls,
+			stats->calls_placed, stats->calls_received);
+
+	return CLI_SUCCESS;
+}
+
+static const char * const capture_option_keys[] = { "size", "files", "device", "ip", "message", NULL };
+
+static char *cli_capture_start(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct sccp_capture_params params = {
+		.max_size = 0,
+		.max_files = 1,
+		.filter.type = SCCP_CAPTURE_FILTER_NONE,
+	};
+	struct in_addr addr;
+	unsigned int size;
+	int msg_id;
+	int i;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "sccp capture start";
+		e->usage =
+			"Usage: sccp capture start <file> [size <MB>] [files <n>] [{device <name>|ip <addr>|message <id>}]\n"
+			"       Start capturing the SCCP messages to a pcap file, relative to the\n"
+			"       log directory unless absolute. With a size, the file is rotated\n"
+			"       once it reaches it, keeping up to n files. With a single file, the\n"
+			"       default, the messages past the size are dropped instead.\n";
+		return NULL;
+	case CLI_GENERATE:
+		if (a->pos >= 4 && a->pos % 2 == 0) {
+			return ast_cli_complete(a->word, capture_option_keys, a->n);
+		} else if (a->pos >= 5 && !strcasecmp(a->argv[a->pos - 1], "device")) {
+			return sccp_device_registry_complete(global_registry, a->word, a->n);
+		}
+
+		return NULL;
+	}
+
+	if (a->argc < 4 || a->argc % 2) {
+		return CLI_SHOWUSAGE;
+	}
+
+	params.path = a->argv[3];
+
+	for (i = 4; i < a->argc; i += 2) {
+		if (!strcasecmp(a->argv[i], "size")) {
+			if (sscanf(a->argv[i + 1], "%u", &size) != 1 || !size) {
+				return CLI_SHOWUSAGE;
+			}
+
+			params.max_size = (size_t) size * 1024 * 1024;
+		} else if (!strcasecmp(a->argv[i], "files")) {
+			if (sscanf(a->argv[i + 1], "%u", &params.max_files) != 1 || !params.max_files) {
+				return CLI_SHOWUSAGE;
+			}
+		} else if (!strcasecmp(a->argv[i], "device")) {
+			params.filter.type = SCCP_CAPTURE_FILTER_DEVICE;
+			ast_copy_string(params.filter.u.device, a->argv[i + 1], sizeof(params.filter.u.device));
+		} else if (!strcasecmp(a->argv[i], "ip")) {
+			if (!inet_aton(a->argv[i + 1], &addr)) {
+				return CLI_SHOWUSAGE;
+			}
+
+			params.filter.type = SCCP_CAPTURE_FILTER_IP;
+			params.filter.u.ip = addr.s_addr;
+		} else if (!strcasecmp(a->argv[i], "message")) {
+			if (sscanf(a->argv[i + 1], "%i", &msg_id) != 1 || msg_id < 0) {
+				return CLI_SHOWUSAGE;
+			}
+
+			params.filter.type = SCCP_CAPTURE_FILTER_MSG;
+			params.filter.u.msg_id = msg_id;
+		} else {
+			return CLI_SHOWUSAGE;
+		}
+	}
+
+	if (sccp_capture_start(&params)) {
+		ast_cli(a->fd, "Could not start the capture\n");
+		return CLI_FAILURE;
+	}
+
+	return CLI_SUCCESS;
+}
+
+static char *cli_capture_stop(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "sccp capture stop";
+		e->usage =
+			"Usage: sccp capture stop\n"
+			"       Stop capturing the SCCP messages.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	sccp_capture_stop();
+
+	return CLI_SUCCESS;
+}
+
+static void capture_filter_str(const struct sccp_capture_filter *filter, char *buf, size_t size)
+{
+	struct in_addr addr;
+
+	switch (filter->type) {
+	case SCCP_CAPTURE_FILTER_NONE:
+		ast_copy_string(buf, "none", size);
+		break;
+	case SCCP_CAPTURE_FILTER_DEVICE:
+		snprintf(buf, size, "device %s", filter->u.device);
+		break;
+	case SCCP_CAPTURE_FILTER_IP:
+		addr.s_addr = filter->u.ip;
+		snprintf(buf, size, "ip %s", ast_inet_ntoa(addr));
+		break;
+	case SCCP_CAPTURE_FILTER_MSG:
+		snprintf(buf, size, "message 0x%04X (%s)", filter->u.msg_id, sccp_msg_id_str(filter->u.msg_id));
+		break;
+	}
+}
+
+static char *cli_show_capture(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct sccp_capture_stats stats;
+	char filter[64];
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "sccp show capture";
+		e->usage =
+			"Usage: sccp show capture\n"
+			"       Show the status of the capture of the SCCP messages.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	sccp_capture_take_stats(&stats);
+	capture_filter_str(&stats.filter, filter, sizeof(filter));
+
+	ast_cli(a->fd, "Running: %s\n", AST_CLI_YESNO(stats.running));
+	ast_cli(a->fd, "File: %s\n", stats.path);
+	ast_cli(a->fd, "Filter: %s\n", filter);
+	ast_cli(a->fd, "Packets: %u\n", stats.packets);
+	ast_cli(a->fd, "Bytes: %zu\n", stats.bytes);
+	ast_cli(a->fd, "Dropped: %u\n", stats.dropped);
+	ast_cli(a->fd, "Rotations: %u\n", stats.rotations);
+
+	return CLI_SUCCESS;
+}
+
+static char *cli_show_flight_recorder(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct sccp_device *device;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "sccp show flightrecorder";
+		e->usage =
+			"Usage: sccp show flightrecorder <device>\n"
+			"       Show the last messages received from and transmitted to a device.\n";
+		return NULL;
+	case CLI_GENERATE:
+		if (a->pos == 3) {
+			return sccp_device_registry_complete(global_registry, a->word, a->n);
+		}
+
+		return NULL;
+	}
+
+	if (a->argc != 4) {
+		return CLI_SHOWUSAGE;
+	}
+
+	device = sccp_device_registry_find(global_registry, a->argv[3]);
+	if (!device) {
+		ast_cli(a->fd, "Device %s is not connected\n", a->argv[3]);
+		return CLI_FAILURE;
+	}
+
+	sccp_session_dump_flight_recorder(sccp_device_session(device), a->fd, "on demand");
+	ao2_ref(device, -1);
+
+	return CLI_SUCCESS;
+}
+
 static char *cli_show_version(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	switch (cmd) {
@@ -367,9 +968,76 @@ static char *cli_show_version(struct ast_cli_entry *e, int cmd, struct ast_cli_a
 	return CLI_SUCCESS;
 }
 
+static void show_msg_stats_line(int fd, const char *name, const struct sccp_msg_stats *stats, unsigned int slot)
+{
+#define FORMAT_STRING "%-32.32s %10u %12llu %10u %12llu %10s %8s %8s\n"
+	const struct sccp_histogram *hist = slot < SCCP_MSG_COUNT ? &stats->handle[slot] : NULL;
+	unsigned int count = hist ? sccp_histogram_count(hist) : 0;
+	char avg[16] = "-";
+	char p50[16] = "-";
+	char p99[16] = "-";
+
+	if (!stats->msgs_in[slot] && !stats->msgs_out[slot]) {
+		return;
+	}
+
+	if (count) {
+		snprintf(avg, sizeof(avg), "%llu", (unsigned long long) (hist->total / count));
+		snprintf(p50, sizeof(p50), "%u", sccp_histogram_percentile(hist, 50));
+		snprintf(p99, sizeof(p99), "%u", sccp_histogram_percentile(hist, 99));
+	}
+
+	ast_cli(fd, FORMAT_STRING, name, stats->msgs_in[slot], (unsigned long long) stats->bytes_in[slot],
+			stats->msgs_out[slot], (unsigned long long) stats->bytes_out[slot], avg, p50, p99);
+#undef FORMAT_STRING
+}
+
+static void show_msg_stats(int fd)
+{
+	struct sccp_msg_stats *stats;
+	const struct sccp_msg_desc *desc;
+	unsigned int count;
+	uint32_t msg_id;
+
+	stats = ast_malloc(sizeof(*stats));
+	if (!stats) {
+		return;
+	}
+
+	sccp_msg_stats_take(stats);
+
+	ast_cli(fd, "\n%-32s %10s %12s %10s %12s %10s %8s %8s\n", "Message", "In", "Bytes in", "Out", "Bytes out",
+			"Avg (us)", "p50", "p99");
+	for (msg_id = 0; msg_id < SCCP_MSG_ID_LIMIT; msg_id++) {
+		desc = sccp_msg_desc_get(msg_id);
+		if (desc) {
+			show_msg_stats_line(fd, desc->name, stats, desc->index);
+		}
+	}
+
+	show_msg_stats_line(fd, "unknown", stats, SCCP_MSG_STATS_UNKNOWN);
+
+	count = sccp_histogram_count(&stats->transmit);
+	ast_cli(fd, "Socket writes: %u, %llu us avg, p50 %u us, p90 %u us, p99 %u us\n", count,
+			count ? (unsigned long long) (stats->transmit.total / count) : 0ULL, sccp_histogram_percentile(&stats->transmit, 50),
+			sccp_histogram_percentile(&stats->transmit, 90), sccp_histogram_percentile(&stats->transmit, 99));
+
+	ast_free(stats);
+}
+
 static char *cli_show_stats(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	struct sccp_stat stat;
+	struct sccp_devstate_cache_stats devstate_stats;
+	struct sccp_config_realtime_stats realtime_stats;
+	struct sccp_device_task_stats task_stats;
+	struct sccp_device_task_stat *task_stat;
+	struct sccp_device_lock_stats lock_stats;
+	struct sccp_rtp_pool_stats rtp_pool_stats;
+	struct sccp_sched_stats sched_stats;
+	unsigned int rtp_pool_requests;
+	unsigned int realtime_requests;
+	int i;
 	struct timeval tmp_tv = {.tv_usec = 0};
 	struct ast_tm tm;
 	char device_fault_last[64] = "-";
@@ -378,12 +1046,23 @@ static char *cli_show_stats(struct ast_cli_entry *e, int cmd, struct ast_cli_arg
 	switch (cmd) {
 	case CLI_INIT:
 		e->command = "sccp show stats";
-		e->usage = "Usage: sccp show stats\n";
+		e->usage =
+			"Usage: sccp show stats [reset]\n"
+			"       Show the module stats, then optionally reset the message stats,\n"
+			"       i.e. the per message type counters and handling times.\n";
 		return NULL;
 	case CLI_GENERATE:
 		return NULL;
 	}
 
+	if (a->argc == 4) {
+		if (strcasecmp(a->argv[3], "reset")) {
+			return CLI_SHOWUSAGE;
+		}
+	} else if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
 	sccp_stat_take_snapshot(&stat);
 
 	if (stat.device_fault_count) {
@@ -402,21 +1081,244 @@ static char *cli_show_stats(struct ast_cli_entry *e, int cmd, struct ast_cli_arg
 			"Device fault:          %d\n"
 			"Last device fault:     %s\n"
 			"Device panic:          %d\n"
-			"Last device panic:     %s\n",
-			stat.device_fault_count, device_fault_last, stat.device_panic_count, device_panic_last);
+			"Last device panic:     %s\n"
+			"Connections:           %d (%d sessions)\n"
+			"Registrations:         %d (%d rejected)\n"
+			"Reloads:               %d, last %u us, max %u us\n",
+			stat.device_fault_count, device_fault_last, stat.device_panic_count, device_panic_last,
+			stat.connection_count, stat.session_count, stat.registration_count, stat.registration_reject_count,
+			stat.reload_count, stat.reload_time_last, stat.reload_time_max);
+
+	sccp_devstate_cache_take_stats(&devstate_stats);
+
+	ast_cli(a->fd,
+			"Devstate cache hits:   %lu\n"
+			"Devstate cache misses: %lu\n"
+			"Devstate cache lines:  %d\n",
+			devstate_stats.hits, devstate_stats.misses, devstate_stats.entries);
+
+	sccp_config_realtime_take_stats(&realtime_stats);
+	realtime_requests = realtime_stats.cache.hits + realtime_stats.cache.misses;
+
+	ast_cli(a->fd,
+			"Realtime cache hits:   %u (%u%%)\n"
+			"Realtime cache misses: %u (%u expired, %u evicted)\n"
+			"Realtime cache size:   %zu/%zu, ttl %d s\n"
+			"Realtime lookups:      %u (%u found)\n"
+			"Realtime lookup time:  %llu us avg, %d us max\n",
+			realtime_stats.cache.hits, realtime_requests ? realtime_stats.cache.hits * 100 / realtime_requests : 0,
+			realtime_stats.cache.misses, realtime_stats.cache.expirations, realtime_stats.cache.evictions,
+			realtime_stats.cache.entries, realtime_stats.cache.capacity, realtime_stats.cache.ttl,
+			realtime_stats.lookups, realtime_stats.lookups_found,
+			realtime_stats.lookups ? realtime_stats.lookup_time_total / realtime_stats.lookups : 0ULL, realtime_stats.lookup_time_max);
+
+	sccp_device_take_task_stats(&task_stats);
+
+	ast_cli(a->fd, "\n%-20s %10s %10s %12s %12s\n", "Task", "Count", "Offloaded", "Avg (us)", "Max (us)");
+	for (i = 0; i < SCCP_DEVICE_TASK_TYPE_COUNT; i++) {
+		task_stat = &task_stats.types[i];
+		ast_cli(a->fd, "%-20s %10u %10u %12llu %12u\n", sccp_device_task_type_str(i), task_stat->count, task_stat->offloaded,
+				task_stat->count ? task_stat->time_total / task_stat->count : 0ULL, task_stat->time_max);
+	}
+
+	ast_cli(a->fd, "Offloaded batches: %u, queue wait %llu us avg, %u us max\n", task_stats.batches_offloaded,
+			task_stats.batches_offloaded ? task_stats.batches_wait_total / task_stats.batches_offloaded : 0ULL, task_stats.batches_wait_max);
+
+	sccp_device_take_lock_stats(&lock_stats);
+
+	ast_cli(a->fd, "Device lock held: %u times, %llu us avg, %u us max\n", lock_stats.count,
+			lock_stats.count ? lock_stats.time_total / lock_stats.count : 0ULL, lock_stats.time_max);
+
+	sccp_rtp_pool_take_stats(&rtp_pool_stats);
+	rtp_pool_requests = rtp_pool_stats.hits + rtp_pool_stats.misses;
+
+	ast_cli(a->fd, "RTP pool: %zu idle for %zu address(es), size %zu, %u hits (%u%%), %u misses\n",
+			rtp_pool_stats.idle, rtp_pool_stats.addrs, rtp_pool_stats.size, rtp_pool_stats.hits,
+			rtp_pool_requests ? rtp_pool_stats.hits * 100 / rtp_pool_requests : 0, rtp_pool_stats.misses);
+
+	sccp_sched_take_stats(&sched_stats);
+
+	for (i = 0; i < (int) sched_stats.shard_count; i++) {
+		ast_cli(a->fd, "Scheduler %d: %u RTP instances (highwater %u)\n", i, sched_stats.instances[i], sched_stats.highwater[i]);
+	}
+
+	show_msg_stats(a->fd);
+
+	if (a->argc == 4) {
+		sccp_msg_stats_reset();
+		ast_cli(a->fd, "Message stats reset\n");
+	}
+
+	return CLI_SUCCESS;
+}
+
+static char *cli_prune_realtime(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "sccp prune realtime";
+		e->usage =
+			"Usage: sccp prune realtime [<device>]\n"
+			"       Remove one or all realtime devices from the realtime cache.\n"
+			"       Registered devices keep their config until they register again.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc > 4) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (a->argc == 4) {
+		sccp_config_realtime_invalidate(a->argv[3]);
+	} else {
+		sccp_config_realtime_invalidate(NULL);
+	}
 
 	return CLI_SUCCESS;
 }
 
 static struct ast_cli_entry cli_entries[] = {
+	AST_CLI_DEFINE(cli_capture_start, "Start capturing SCCP messages to a pcap file"),
+	AST_CLI_DEFINE(cli_capture_stop, "Stop capturing SCCP messages"),
+	AST_CLI_DEFINE(cli_prune_realtime, "Prune the SCCP realtime cache"),
 	AST_CLI_DEFINE(cli_reset_device, "Reset SCCP device"),
 	AST_CLI_DEFINE(cli_set_debug, "Enable/Disable SCCP debugging"),
+	AST_CLI_DEFINE(cli_set_lock_profile, "Enable/Disable SCCP lock profiling"),
+	AST_CLI_DEFINE(cli_show_capture, "Show the SCCP capture status"),
 	AST_CLI_DEFINE(cli_show_config, "Show the module configuration"),
+	AST_CLI_DEFINE(cli_show_config_cache, "Show the configuration cache status"),
+	AST_CLI_DEFINE(cli_show_debug, "Show the SCCP debugging filters"),
+	AST_CLI_DEFINE(cli_show_device, "Show the details of a connected device"),
 	AST_CLI_DEFINE(cli_show_devices, "Show the connected devices"),
+	AST_CLI_DEFINE(cli_show_flight_recorder, "Show the last messages of a device"),
+	AST_CLI_DEFINE(cli_show_lock_profile, "Show the most contended lock sites"),
 	AST_CLI_DEFINE(cli_show_stats, "Show the module stats"),
 	AST_CLI_DEFINE(cli_show_version, "Show the module version"),
 };
 
+static void manager_append_device(struct mansession *s, const char *idtext, const struct sccp_device_snapshot *snapshot)
+{
+	astman_append(s,
+			"Event: SCCPDeviceEntry\r\n"
+			"%s"
+			"Device: %s\r\n"
+			"IPAddress: %s\r\n"
+			"Guest: %s\r\n"
+			"Type: %s\r\n"
+			"Proto: %u\r\n"
+			"Capabilities: %s\r\n"
+			"\r\n",
+			idtext, snapshot->name, snapshot->ipaddr, AST_YESNO(snapshot->guest),
+			sccp_device_type_str(snapshot->type), snapshot->proto_version, snapshot->capabilities);
+}
+
+static int manager_show_filtered_devices(struct mansession *s, const struct message *m, const char *idtext, struct sccp_device_filter *filter)
+{
+	struct sccp_device_snapshot *snapshots;
+	size_t n;
+	size_t i;
+
+	if (sccp_device_registry_take_filtered_snapshots(global_registry, filter, &snapshots, &n)) {
+		astman_send_error(s, m, "Could not take device snapshots");
+		return 0;
+	}
+
+	astman_send_listack(s, m, "Device list will follow", "start");
+	for (i = 0; i < n; i++) {
+		manager_append_device(s, idtext, &snapshots[i]);
+	}
+
+	astman_send_list_complete_start(s, m, "SCCPDeviceListComplete", n);
+	astman_send_list_complete_end(s);
+
+	ast_free(snapshots);
+
+	return 0;
+}
+
+/*
+ * Without a filter, the devices are streamed one page at a time, in name order. The
+ * optional After and Limit headers can be used to fetch the list in multiple actions,
+ * the NextAfter header of the completion event giving the After value of the next one.
+ */
+static int manager_show_devices(struct mansession *s, const struct message *m)
+{
+	struct sccp_device_snapshot page[SNAPSHOT_PAGE_SIZE];
+	struct sccp_device_filter filter;
+	const char *id = astman_get_header(m, "ActionID");
+	const char *value;
+	char idtext[256] = "";
+	char after[SCCP_DEVICE_NAME_MAX];
+	unsigned int limit = 0;
+	size_t page_limit;
+	size_t count = 0;
+	size_t n;
+	size_t i;
+	int has_filter = 0;
+
+	if (!ast_strlen_zero(id)) {
+		snprintf(idtext, sizeof(idtext), "ActionID: %s\r\n", id);
+	}
+
+	for (i = 0; device_filter_keys[i]; i++) {
+		value = astman_get_header(m, device_filter_keys[i]);
+		if (ast_strlen_zero(value)) {
+			continue;
+		}
+
+		if (has_filter || parse_device_filter(device_filter_keys[i], value, &filter)) {
+			astman_send_error(s, m, "Invalid device filter");
+			return 0;
+		}
+
+		has_filter = 1;
+	}
+
+	if (has_filter) {
+		return manager_show_filtered_devices(s, m, idtext, &filter);
+	}
+
+	value = astman_get_header(m, "Limit");
+	if (!ast_strlen_zero(value) && sscanf(value, "%u", &limit) != 1) {
+		astman_send_error(s, m, "Invalid limit");
+		return 0;
+	}
+
+	ast_copy_string(after, astman_get_header(m, "After"), sizeof(after));
+
+	astman_send_listack(s, m, "Device list will follow", "start");
+
+	do {
+		page_limit = ARRAY_LEN(page);
+		if (limit && limit - count < page_limit) {
+			page_limit = limit - count;
+		}
+
+		if (!page_limit || sccp_device_registry_take_snapshots_page(global_registry, after, page, page_limit, &n)) {
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			manager_append_device(s, idtext, &page[i]);
+		}
+
+		count += n;
+		if (n) {
+			ast_copy_string(after, page[n - 1].name, sizeof(after));
+		}
+	} while (n == page_limit);
+
+	astman_send_list_complete_start(s, m, "SCCPDeviceListComplete", count);
+	if (limit && count == limit) {
+		astman_append(s, "NextAfter: %s\r\n", after);
+	}
+	astman_send_list_complete_end(s);
+
+	return 0;
+}
+
 static int register_sccp_tech(void)
 {
 	sccp_tech.capabilities = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
@@ -453,49 +1355,71 @@ static int load_module(void)
 		goto fail2;
 	}
 
+	if (sccp_devstate_cache_init()) {
+		goto fail2;
+	}
+
+	/* without the pool, the device tasks are executed by the session threads */
+	sccp_device_task_pool_init();
+
 	cfg = sccp_config_get();
 	global_registry = sccp_device_registry_create(cfg);
 	if (!global_registry) {
-		goto fail2;
+		goto fail3;
 	}
 
-	sccp_sched = ast_sched_context_create();
-	if (!sccp_sched) {
-		goto fail3;
+	if (sccp_sched_init()) {
+		goto fail4;
 	}
 
+	if (sccp_rtp_pool_init()) {
+		goto fail5;
+	}
+
+	sccp_rtp_pool_set_size(cfg->general_cfg->rtp_pool_size);
+
 	global_server = sccp_server_create(cfg, global_registry);
 	if (!global_server) {
-		goto fail4;
+		goto fail6;
 	}
 
 	if (register_sccp_tech()) {
-		goto fail5;
+		goto fail7;
 	}
 
 	if (ast_rtp_glue_register(&sccp_rtp_glue)) {
-		goto fail6;
+		goto fail8;
 	}
 
 	if (sccp_server_start(global_server)) {
-		goto fail7;
+		goto fail9;
 	}
 
 	ast_cli_register_multiple(cli_entries, ARRAY_LEN(cli_entries));
+	ast_manager_register("SCCPShowDevices", EVENT_FLAG_SYSTEM | EVENT_FLAG_REPORTING, manager_show_devices, "List the connected SCCP devices");
+	/* the metrics are optional, the module works fine without them */
+	sccp_metrics_register(global_registry);
 	ao2_ref(cfg, -1);
 
 	return AST_MODULE_LOAD_SUCCESS;
 
-fail7:
+fail9:
 	ast_rtp_glue_unregister(&sccp_rtp_glue);
-fail6:
+fail8:
 	unregister_sccp_tech();
-fail5:
+fail7:
 	sccp_server_destroy(global_server);
+fail6:
+	sccp_rtp_pool_destroy();
+fail5:
+	sccp_sched_destroy();
 fail4:
-	ast_sched_context_destroy(sccp_sched);
-fail3:
 	sccp_device_registry_destroy(global_registry);
+fail3:
+	sccp_device_task_pool_destroy();
+	/* once every thread taking a profiled lock has stopped */
+	sccp_lock_profile_destroy();
+	sccp_devstate_cache_destroy();
 fail2:
 	ao2_cleanup(cfg);
 	sccp_config_destroy();
@@ -506,13 +1430,23 @@ fail1:
 
 static int unload_module(void)
 {
+	sccp_metrics_unregister();
+	ast_manager_unregister("SCCPShowDevices");
 	ast_cli_unregister_multiple(cli_entries, ARRAY_LEN(cli_entries));
 
 	ast_rtp_glue_unregister(&sccp_rtp_glue);
 	unregister_sccp_tech();
 	sccp_server_destroy(global_server);
-	ast_sched_context_destroy(sccp_sched);
+	sccp_capture_stop();
+	sccp_debug_destroy();
+	sccp_msg_stats_destroy();
+	sccp_rtp_pool_destroy();
+	sccp_sched_destroy();
 	sccp_device_registry_destroy(global_registry);
+	sccp_device_task_pool_destroy();
+	/* once every thread taking a profiled lock has stopped */
+	sccp_lock_profile_destroy();
+	sccp_devstate_cache_destroy();
 	sccp_config_destroy();
 
 	return 0;
@@ -521,15 +1455,38 @@ static int unload_module(void)
 static int reload(void)
 {
 	struct sccp_cfg *cfg;
+	struct timeval start = ast_tvnow();
 	int ret = 0;
 
-	if (sccp_config_reload()) {
+	switch (sccp_config_reload()) {
+	case 0:
+		break;
+	case SCCP_CONFIG_UNCHANGED:
+		ast_verb(2, "SCCP config unchanged, nothing to reload\n");
+		return 0;
+	default:
 		return -1;
 	}
 
+	sccp_devstate_cache_invalidate();
+
 	cfg = sccp_config_get();
+	sccp_rtp_pool_set_size(cfg->general_cfg->rtp_pool_size);
 	ret |= sccp_server_reload_config(global_server, cfg);
 	ret |= sccp_device_registry_reload_config(global_registry, cfg);
+	sccp_stat_on_reload(ast_tvdiff_us(ast_tvnow(), start));
+
+	if (cfg->changes.all) {
+		ast_verb(2, "SCCP config reloaded in %d ms (full reload)\n", (int) ast_tvdiff_ms(ast_tvnow(), start));
+	} else {
+		ast_verb(2, "SCCP config reloaded in %d ms (%u added, %u modified, %u removed, %u unchanged devices)\n",
+				(int) ast_tvdiff_ms(ast_tvnow(), start),
+				cfg->changes.devices_added,
+				cfg->changes.devices_modified,
+				cfg->changes.devices_removed,
+				cfg->changes.devices_unchanged);
+	}
+
 	ao2_ref(cfg, -1);
 
 	return ret ? -1 : 0;
@@ -10,7 +10,6 @@
 #define SCCP_BUCKETS 563
 
 extern struct ast_channel_tech sccp_tech;
-extern struct ast_sched_context *sccp_sched;
 extern const struct ast_module_info *sccp_module_info;
 
 #endif /* SCCP_H_ */
@@ -0,0 +1,579 @@
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+
+#include <asterisk.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/lock.h>
+#include <asterisk/network.h>
+#include <asterisk/paths.h>
+#include <asterisk/utils.h>
+
+#include "sccp_capture.h"
+#include "sccp_msg.h"
+#include "sccp_utils.h"
+
+/* messages waiting for the writer thread, above which new messages are dropped */
+#define CAPTURE_MAX_QUEUED 4096
+
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_SNAPLEN 65535
+#define PCAP_LINKTYPE_RAW 101
+
+#define IP_HEADER_LEN 20
+#define TCP_HEADER_LEN 20
+#define TCP_FLAG_PSH 0x08
+#define TCP_FLAG_ACK 0x10
+
+struct pcap_file_header {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+struct pcap_record_header {
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t incl_len;
+	uint32_t orig_len;
+};
+
+struct capture_node {
+	struct capture_node *next;
+	struct timeval tv;
+	struct sockaddr_in src;
+	struct sockaddr_in dst;
+	uint32_t seq;
+	uint32_t ack;
+	size_t len;
+	unsigned char data[];
+};
+
+/*
+ * A capture, from its start to its stop. Messages are pushed by the session threads on
+ * an intrusive MPSC queue, and popped by the writer thread.
+ *
+ * The running capture is published as a global object: a session thread holds a
+ * reference while it pushes a message, so the queue and the semaphore outlive every
+ * push, even one racing with the stop. The path, the limits and the filter are never
+ * modified once published. The file and the counters other than dropped are only
+ * touched by the writer thread.
+ */
+struct capture {
+	int stopping;
+	pthread_t thread;
+	sem_t sem;
+	int sem_initialized;
+
+	struct capture_node *head;
+	struct capture_node *tail;
+	struct capture_node stub;
+	unsigned int queued;
+
+	char path[256];
+	size_t max_size;
+	unsigned int max_files;
+	struct sccp_capture_filter filter;
+
+	FILE *file;
+	size_t file_size;
+	uint16_t ip_id;
+
+	unsigned int packets;
+	unsigned int dropped;
+	unsigned int rotations;
+	size_t bytes;
+};
+
+static AO2_GLOBAL_OBJ_STATIC(global_capture);
+/* checked before taking a reference on the global capture, which takes a lock */
+static int capture_running;
+
+/*
+ * The running capture, or else the last one, kept for its stats. Protected by
+ * capture_lock, which also serializes starting and stopping.
+ */
+AST_MUTEX_DEFINE_STATIC(capture_lock);
+static struct capture *last_capture;
+
+static struct capture_node *capture_queue_pop(struct capture *capture);
+
+static void capture_destructor(void *obj)
+{
+	struct capture *capture = obj;
+	struct capture_node *node;
+
+	/* messages pushed after the writer thread exited */
+	while ((node = capture_queue_pop(capture))) {
+		ast_free(node);
+	}
+
+	if (capture->sem_initialized) {
+		sem_destroy(&capture->sem);
+	}
+
+	if (capture->file) {
+		fclose(capture->file);
+	}
+}
+
+static void capture_queue_init(struct capture *capture)
+{
+	capture->stub.next = NULL;
+	capture->head = &capture->stub;
+	capture->tail = &capture->stub;
+}
+
+static void capture_queue_push(struct capture *capture, struct capture_node *node)
+{
+	struct capture_node *prev;
+
+	node->next = NULL;
+	prev = __atomic_exchange_n(&capture->head, node, __ATOMIC_ACQ_REL);
+	/* the queue is broken between the exchange and this store, pop waits it out */
+	__atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+/*
+ * Must only be called by the writer thread, or once no message can be pushed anymore.
+ *
+ * Return NULL if the queue is empty, or if a push is still in progress.
+ */
+static struct capture_node *capture_queue_pop(struct capture *capture)
+{
+	struct capture_node *tail = capture->tail;
+	struct capture_node *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+	if (tail == &capture->stub) {
+		if (!next) {
+			return NULL;
+		}
+
+		capture->tail = next;
+		tail = next;
+		next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	}
+
+	if (next) {
+		capture->tail = next;
+		return tail;
+	}
+
+	if (tail != __atomic_load_n(&capture->head, __ATOMIC_ACQUIRE)) {
+		return NULL;
+	}
+
+	capture_queue_push(capture, &capture->stub);
+
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next) {
+		capture->tail = next;
+		return tail;
+	}
+
+	return NULL;
+}
+
+static uint16_t ip_checksum(const uint8_t *buf, size_t len)
+{
+	uint32_t sum = 0;
+	size_t i;
+
+	for (i = 0; i + 1 < len; i += 2) {
+		sum += (buf[i] << 8) | buf[i + 1];
+	}
+
+	while (sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+
+	return htons(~sum & 0xffff);
+}
+
+static void build_ip_tcp_headers(uint8_t *buf, const struct capture_node *node, uint16_t id)
+{
+	uint8_t *ip = buf;
+	uint8_t *tcp = buf + IP_HEADER_LEN;
+	uint16_t u16;
+	uint32_t u32;
+
+	memset(buf, 0, IP_HEADER_LEN + TCP_HEADER_LEN);
+
+	ip[0] = 0x45;
+	u16 = htons(IP_HEADER_LEN + TCP_HEADER_LEN + node->len);
+	memcpy(&ip[2], &u16, sizeof(u16));
+	u16 = htons(id);
+	memcpy(&ip[4], &u16, sizeof(u16));
+	/* don't fragment */
+	ip[6] = 0x40;
+	ip[8] = 64;
+	ip[9] = IPPROTO_TCP;
+	memcpy(&ip[12], &node->src.sin_addr.s_addr, 4);
+	memcpy(&ip[16], &node->dst.sin_addr.s_addr, 4);
+	u16 = ip_checksum(ip, IP_HEADER_LEN);
+	memcpy(&ip[10], &u16, sizeof(u16));
+
+	/* the TCP checksum is left to zero, which Wireshark doesn't verify by default */
+	memcpy(&tcp[0], &node->src.sin_port, 2);
+	memcpy(&tcp[2], &node->dst.sin_port, 2);
+	u32 = htonl(node->seq);
+	memcpy(&tcp[4], &u32, sizeof(u32));
+	u32 = htonl(node->ack);
+	memcpy(&tcp[8], &u32, sizeof(u32));
+	tcp[12] = (TCP_HEADER_LEN / 4) << 4;
+	tcp[13] = TCP_FLAG_PSH | TCP_FLAG_ACK;
+	u16 = htons(0xffff);
+	memcpy(&tcp[14], &u16, sizeof(u16));
+}
+
+static FILE *capture_file_open(const char *path)
+{
+	struct pcap_file_header header = {
+		.magic = PCAP_MAGIC,
+		.version_major = 2,
+		.version_minor = 4,
+		.thiszone = 0,
+		.sigfigs = 0,
+		.snaplen = PCAP_SNAPLEN,
+		.linktype = PCAP_LINKTYPE_RAW,
+	};
+	FILE *file;
+
+	file = fopen(path, "w");
+	if (!file) {
+		ast_log(LOG_ERROR, "sccp capture open failed: fopen %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	if (fwrite(&header, sizeof(header), 1, file) != 1) {
+		ast_log(LOG_ERROR, "sccp capture open failed: fwrite %s: %s\n", path, strerror(errno));
+		fclose(file);
+		return NULL;
+	}
+
+	return file;
+}
+
+/*
+ * Shift path.1 ... path.(n-2) and path by one, dropping the oldest, then start a new
+ * file at path.
+ */
+static void capture_file_rotate(struct capture *capture)
+{
+	char from[sizeof(capture->path) + 16];
+	char to[sizeof(capture->path) + 16];
+	unsigned int i;
+
+	fclose(capture->file);
+	capture->file = NULL;
+
+	for (i = capture->max_files - 1; i > 0; i--) {
+		if (i == 1) {
+			ast_copy_string(from, capture->path, sizeof(from));
+		} else {
+			snprintf(from, sizeof(from), "%s.%u", capture->path, i - 1);
+		}
+
+		snprintf(to, sizeof(to), "%s.%u", capture->path, i);
+		if (rename(from, to) && errno != ENOENT) {
+			ast_log(LOG_WARNING, "sccp capture rotate: rename %s: %s\n", from, strerror(errno));
+		}
+	}
+
+	capture->file = capture_file_open(capture->path);
+	capture->file_size = sizeof(struct pcap_file_header);
+	__atomic_add_fetch(&capture->rotations, 1, __ATOMIC_RELAXED);
+}
+
+static void capture_write(struct capture *capture, const struct capture_node *node)
+{
+	struct pcap_record_header record;
+	uint8_t headers[IP_HEADER_LEN + TCP_HEADER_LEN];
+	size_t len = MIN(node->len, PCAP_SNAPLEN - sizeof(headers));
+	size_t record_len = sizeof(record) + sizeof(headers) + len;
+
+	if (capture->file && capture->max_size && capture->file_size + record_len > capture->max_size
+			&& capture->file_size > sizeof(struct pcap_file_header)) {
+		if (capture->max_files == 1) {
+			/* rotating would truncate the only file, so it is full for good */
+			__atomic_add_fetch(&capture->dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+
+		capture_file_rotate(capture);
+	}
+
+	if (!capture->file) {
+		__atomic_add_fetch(&capture->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	record.ts_sec = node->tv.tv_sec;
+	record.ts_usec = node->tv.tv_usec;
+	record.incl_len = sizeof(headers) + len;
+	record.orig_len = sizeof(headers) + node->len;
+
+	build_ip_tcp_headers(headers, node, capture->ip_id++);
+
+	if (fwrite(&record, sizeof(record), 1, capture->file) != 1 ||
+			fwrite(headers, sizeof(headers), 1, capture->file) != 1 ||
+			fwrite(node->data, len, 1, capture->file) != 1) {
+		ast_log(LOG_ERROR, "sccp capture write failed: fwrite: %s\n", strerror(errno));
+		fclose(capture->file);
+		capture->file = NULL;
+		return;
+	}
+
+	capture->file_size += record_len;
+	__atomic_add_fetch(&capture->packets, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&capture->bytes, record_len, __ATOMIC_RELAXED);
+}
+
+static void *capture_run(void *data)
+{
+	struct capture *capture = data;
+	struct capture_node *node;
+
+	for (;;) {
+		node = capture_queue_pop(capture);
+		if (node) {
+			capture_write(capture, node);
+			ast_free(node);
+			__atomic_sub_fetch(&capture->queued, 1, __ATOMIC_SEQ_CST);
+			continue;
+		}
+
+		if (capture->file) {
+			fflush(capture->file);
+		}
+
+		/*
+		 * A message pushed once queued has dropped to zero is freed with the capture,
+		 * the session thread pushing it holding a reference.
+		 */
+		if (__atomic_load_n(&capture->stopping, __ATOMIC_SEQ_CST) && !__atomic_load_n(&capture->queued, __ATOMIC_SEQ_CST)) {
+			break;
+		}
+
+		while (sem_wait(&capture->sem) && errno == EINTR) {
+			continue;
+		}
+	}
+
+	if (capture->file) {
+		fclose(capture->file);
+		capture->file = NULL;
+	}
+
+	return NULL;
+}
+
+int sccp_capture_start(const struct sccp_capture_params *params)
+{
+	struct capture *capture;
+	int ret;
+
+	if (!params) {
+		ast_log(LOG_ERROR, "sccp capture start failed: params is null\n");
+		return -1;
+	}
+
+	if (!params->path || ast_strlen_zero(params->path)) {
+		ast_log(LOG_ERROR, "sccp capture start failed: path is empty\n");
+		return -1;
+	}
+
+	ast_mutex_lock(&capture_lock);
+
+	if (__atomic_load_n(&capture_running, __ATOMIC_RELAXED)) {
+		ast_log(LOG_WARNING, "sccp capture start failed: capture already running\n");
+		goto unlock;
+	}
+
+	capture = ao2_alloc_options(sizeof(*capture), capture_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!capture) {
+		goto unlock;
+	}
+
+	if (params->path[0] == '/') {
+		ast_copy_string(capture->path, params->path, sizeof(capture->path));
+	} else {
+		snprintf(capture->path, sizeof(capture->path), "%s/%s", ast_config_AST_LOG_DIR, params->path);
+	}
+
+	capture->thread = AST_PTHREADT_NULL;
+	capture->max_size = params->max_size;
+	capture->max_files = MAX(params->max_files, 1);
+	capture->filter = params->filter;
+	capture_queue_init(capture);
+
+	capture->file = capture_file_open(capture->path);
+	if (!capture->file) {
+		goto fail;
+	}
+
+	capture->file_size = sizeof(struct pcap_file_header);
+
+	if (sem_init(&capture->sem, 0, 0)) {
+		ast_log(LOG_ERROR, "sccp capture start failed: sem_init: %s\n", strerror(errno));
+		goto fail;
+	}
+
+	capture->sem_initialized = 1;
+
+	/* the writer thread uses the reference of last_capture, kept until it is joined */
+	ret = ast_pthread_create_background(&capture->thread, NULL, capture_run, capture);
+	if (ret) {
+		ast_log(LOG_ERROR, "sccp capture start failed: pthread create: %s\n", strerror(ret));
+		capture->thread = AST_PTHREADT_NULL;
+		goto fail;
+	}
+
+	ao2_global_obj_replace_unref(global_capture, capture);
+	__atomic_store_n(&capture_running, 1, __ATOMIC_RELEASE);
+
+	ao2_cleanup(last_capture);
+	last_capture = capture;
+
+	ast_mutex_unlock(&capture_lock);
+
+	return 0;
+
+fail:
+	ao2_ref(capture, -1);
+unlock:
+	ast_mutex_unlock(&capture_lock);
+
+	return -1;
+}
+
+void sccp_capture_stop(void)
+{
+	struct capture *capture;
+	int ret;
+
+	ast_mutex_lock(&capture_lock);
+
+	if (!__atomic_load_n(&capture_running, __ATOMIC_RELAXED)) {
+		ast_mutex_unlock(&capture_lock);
+		return;
+	}
+
+	__atomic_store_n(&capture_running, 0, __ATOMIC_RELAXED);
+	/* the sessions that already hold a reference might still push messages */
+	ao2_global_obj_release(global_capture);
+
+	capture = last_capture;
+	__atomic_store_n(&capture->stopping, 1, __ATOMIC_SEQ_CST);
+	sem_post(&capture->sem);
+
+	ret = pthread_join(capture->thread, NULL);
+	if (ret) {
+		ast_log(LOG_ERROR, "sccp capture stop failed: pthread_join: %s\n", strerror(ret));
+	}
+
+	capture->thread = AST_PTHREADT_NULL;
+
+	ast_mutex_unlock(&capture_lock);
+}
+
+static int capture_filter_match(const struct sccp_capture_filter *filter, const char *device_name, const struct sockaddr_in *remote, const void *msg, size_t len)
+{
+	uint32_t msg_id;
+
+	switch (filter->type) {
+	case SCCP_CAPTURE_FILTER_NONE:
+		return 1;
+	case SCCP_CAPTURE_FILTER_DEVICE:
+		return device_name && !strcmp(device_name, filter->u.device);
+	case SCCP_CAPTURE_FILTER_IP:
+		return remote->sin_addr.s_addr == filter->u.ip;
+	case SCCP_CAPTURE_FILTER_MSG:
+		if (len < SCCP_MSG_HEADER_LEN) {
+			return 0;
+		}
+
+		memcpy(&msg_id, (const char *) msg + 8, sizeof(msg_id));
+		return letohl(msg_id) == filter->u.msg_id;
+	}
+
+	return 0;
+}
+
+void sccp_capture_msg(enum sccp_capture_dir dir, const char *device_name, const struct sockaddr_in *local, const struct sockaddr_in *remote,
+		uint32_t seq, uint32_t ack, const void *msg, size_t len)
+{
+	struct capture *capture;
+	struct capture_node *node;
+
+	if (!__atomic_load_n(&capture_running, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	capture = ao2_global_obj_ref(global_capture);
+	if (!capture) {
+		return;
+	}
+
+	if (!capture_filter_match(&capture->filter, device_name, remote, msg, len)) {
+		goto end;
+	}
+
+	if (__atomic_add_fetch(&capture->queued, 1, __ATOMIC_SEQ_CST) > CAPTURE_MAX_QUEUED) {
+		__atomic_add_fetch(&capture->dropped, 1, __ATOMIC_RELAXED);
+		goto unqueue;
+	}
+
+	node = ast_malloc(sizeof(*node) + len);
+	if (!node) {
+		__atomic_add_fetch(&capture->dropped, 1, __ATOMIC_RELAXED);
+		goto unqueue;
+	}
+
+	node->tv = ast_tvnow();
+	if (dir == SCCP_CAPTURE_IN) {
+		node->src = *remote;
+		node->dst = *local;
+	} else {
+		node->src = *local;
+		node->dst = *remote;
+	}
+	node->seq = seq;
+	node->ack = ack;
+	node->len = len;
+	memcpy(node->data, msg, len);
+
+	capture_queue_push(capture, node);
+	sem_post(&capture->sem);
+
+	goto end;
+
+unqueue:
+	__atomic_sub_fetch(&capture->queued, 1, __ATOMIC_SEQ_CST);
+	/* the writer might be waiting for queued to drop to zero */
+	sem_post(&capture->sem);
+end:
+	ao2_ref(capture, -1);
+}
+
+void sccp_capture_take_stats(struct sccp_capture_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	ast_mutex_lock(&capture_lock);
+	stats->running = __atomic_load_n(&capture_running, __ATOMIC_RELAXED);
+	if (last_capture) {
+		ast_copy_string(stats->path, last_capture->path, sizeof(stats->path));
+		stats->filter = last_capture->filter;
+		stats->packets = __atomic_load_n(&last_capture->packets, __ATOMIC_RELAXED);
+		stats->dropped = __atomic_load_n(&last_capture->dropped, __ATOMIC_RELAXED);
+		stats->rotations = __atomic_load_n(&last_capture->rotations, __ATOMIC_RELAXED);
+		stats->bytes = __atomic_load_n(&last_capture->bytes, __ATOMIC_RELAXED);
+	}
+	ast_mutex_unlock(&capture_lock);
+}
@@ -0,0 +1,86 @@
+#ifndef SCCP_CAPTURE_H_
+#define SCCP_CAPTURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct sockaddr_in;
+
+enum sccp_capture_dir {
+	SCCP_CAPTURE_IN,
+	SCCP_CAPTURE_OUT,
+};
+
+enum sccp_capture_filter_type {
+	SCCP_CAPTURE_FILTER_NONE,
+	SCCP_CAPTURE_FILTER_DEVICE,
+	SCCP_CAPTURE_FILTER_IP,
+	SCCP_CAPTURE_FILTER_MSG,
+};
+
+struct sccp_capture_filter {
+	enum sccp_capture_filter_type type;
+	union {
+		char device[16];
+		uint32_t ip;
+		uint32_t msg_id;
+	} u;
+};
+
+struct sccp_capture_params {
+	/* path of the capture file; older files get a .1, .2, ... suffix */
+	const char *path;
+	/* size of a file before rotating, in bytes */
+	size_t max_size;
+	/* number of files kept, current file included; with a single file, the messages
+	 * past max_size are dropped instead of rotating */
+	unsigned int max_files;
+	struct sccp_capture_filter filter;
+};
+
+struct sccp_capture_stats {
+	int running;
+	char path[256];
+	struct sccp_capture_filter filter;
+	unsigned int packets;
+	unsigned int dropped;
+	unsigned int rotations;
+	size_t bytes;
+};
+
+/*!
+ * \brief Start capturing the SCCP messages to a pcap file.
+ *
+ * The messages are queued without blocking by the session threads, and a writer
+ * thread writes them as TCP segments, with synthesized IPv4 and TCP headers, that
+ * the Wireshark skinny dissector can decode.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure, e.g. if a capture is already running
+ */
+int sccp_capture_start(const struct sccp_capture_params *params);
+
+/*!
+ * \brief Stop the capture, once the queued messages are written.
+ */
+void sccp_capture_stop(void);
+
+/*!
+ * \brief Capture a message, if a capture is running and the message passes the filter.
+ *
+ * \param device_name the name of the device of the session, or NULL
+ * \param seq the TCP sequence number of the message, i.e. the number of bytes sent in
+ *        the same direction before it
+ * \param ack the number of bytes sent in the other direction
+ *
+ * \note Never blocks. Messages are dropped if the writer thread can't keep up.
+ */
+void sccp_capture_msg(enum sccp_capture_dir dir, const char *device_name, const struct sockaddr_in *local, const struct sockaddr_in *remote,
+		uint32_t seq, uint32_t ack, const void *msg, size_t len);
+
+/*!
+ * \brief Take a snapshot of the capture stats.
+ */
+void sccp_capture_take_stats(struct sccp_capture_stats *stats);
+
+#endif /* SCCP_CAPTURE_H_ */
@@ -1,21 +1,40 @@
+#include <limits.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <asterisk.h>
 #include <asterisk/acl.h>
 #include <asterisk/astobj2.h>
 #include <asterisk/config_options.h>
 #include <asterisk/linkedlists.h>
+#include <asterisk/paths.h>
 #include <asterisk/strings.h>
+#include <asterisk/time.h>
+#include <asterisk/utils.h>
 
 #include "sccp.h"
 #include "sccp_config.h"
+#include "sccp_config_cache.h"
+#include "sccp_lru_cache.h"
 
 #define DEVICE_CFG_NAME_GUEST "guest"
 
+/* below this number of devices per worker, it's not worth starting a thread */
+#define PRE_APPLY_MIN_DEVICES_PER_WORKER 2048
+#define PRE_APPLY_MAX_WORKERS 8
+
+#define REALTIME_DEVICES_FAMILY "sccpdevices"
+#define REALTIME_LINES_FAMILY "sccplines"
+
 static void sccp_device_cfg_free_internal(struct sccp_device_cfg *device_cfg);
 static void sccp_device_cfg_free_speeddials(struct sccp_device_cfg *device_cfg);
 static void sccp_line_cfg_free_internal(struct sccp_line_cfg *line_cfg);
 static void sccp_general_cfg_free_internal(struct sccp_general_cfg *general_cfg);
 static struct sccp_speeddial_cfg *sccp_cfg_find_speeddial(struct sccp_cfg *cfg, const char *name);
+static uint64_t hash_device_cfg(struct sccp_device_cfg *device_cfg);
 static int pre_apply_config(void);
+static void post_apply_config(void);
 
 struct sccp_general_cfg_internal {
 	int guest;
@@ -37,6 +56,176 @@ struct sccp_line_cfg_internal {
 	int associated;
 };
 
+/*
+ * Interned strings are ao2 objects, so that a config object keeps the strings it
+ * references alive after the config it belongs to has been destroyed. The pool is
+ * shared between successive configs, and is modified while loading a config but also
+ * by the realtime lookups of the session threads.
+ */
+#define INTERN_POOL_BUCKETS 257
+
+static struct ao2_container *intern_pool;
+
+static int intern_pool_hash(const void *obj, int flags)
+{
+	return ast_str_hash(obj);
+}
+
+static int intern_pool_cmp(void *obj, void *arg, int flags)
+{
+	return strcmp(obj, arg) ? 0 : (CMP_MATCH | CMP_STOP);
+}
+
+/*
+ * The returned string has its reference count incremented by one.
+ */
+static const char *intern_str(const char *str)
+{
+	char *interned;
+	size_t len;
+
+	/* the lookup and the insertion must be atomic, or a string could be interned twice */
+	ao2_lock(intern_pool);
+	interned = ao2_find(intern_pool, str, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (interned) {
+		goto end;
+	}
+
+	len = strlen(str) + 1;
+	interned = ao2_alloc_options(len, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!interned) {
+		goto end;
+	}
+
+	memcpy(interned, str, len);
+	ao2_link_flags(intern_pool, interned, OBJ_NOLOCK);
+
+end:
+	ao2_unlock(intern_pool);
+
+	return interned;
+}
+
+static int set_interned_str(const char **field, const char *str)
+{
+	const char *interned;
+
+	interned = intern_str(str);
+	if (!interned) {
+		return -1;
+	}
+
+	ao2_cleanup((void *) *field);
+	*field = interned;
+
+	return 0;
+}
+
+static int cb_intern_pool_prune(void *obj, void *arg, int flags)
+{
+	/* only referenced by the pool */
+	return ao2_ref(obj, 0) == 1 ? CMP_MATCH : 0;
+}
+
+static void intern_pool_prune(void)
+{
+	ao2_callback(intern_pool, OBJ_NODATA | OBJ_MULTIPLE | OBJ_UNLINK, cb_intern_pool_prune, NULL);
+}
+
+/*
+ * Lines with the same formats share the same format capabilities object. The pool is
+ * only used while building a config.
+ */
+struct shared_caps {
+	struct ast_format_cap *caps;
+	char key[0];
+};
+
+static void shared_caps_destructor(void *obj)
+{
+	struct shared_caps *shared = obj;
+
+	ao2_ref(shared->caps, -1);
+}
+
+static int shared_caps_hash(const void *obj, int flags)
+{
+	const char *key;
+
+	if (flags & OBJ_SEARCH_KEY) {
+		key = obj;
+	} else {
+		key = ((const struct shared_caps *) obj)->key;
+	}
+
+	return ast_str_hash(key);
+}
+
+static int shared_caps_cmp(void *obj, void *arg, int flags)
+{
+	struct shared_caps *shared = obj;
+	const char *key;
+
+	if (flags & OBJ_SEARCH_KEY) {
+		key = arg;
+	} else {
+		key = ((const struct shared_caps *) arg)->key;
+	}
+
+	return strcmp(shared->key, key) ? 0 : (CMP_MATCH | CMP_STOP);
+}
+
+static struct ao2_container *caps_pool_alloc(void)
+{
+	return ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, 31, shared_caps_hash, shared_caps_cmp);
+}
+
+/*
+ * Replace *caps by an identical format capabilities object from the pool, or add it
+ * to the pool.
+ */
+static void share_caps(struct ao2_container *pool, struct ast_format_cap **caps)
+{
+	struct ast_str *key = ast_str_alloca(256);
+	struct shared_caps *shared;
+	struct ast_format *format;
+	size_t len;
+	size_t i;
+	size_t n;
+
+	if (!pool) {
+		return;
+	}
+
+	n = ast_format_cap_count(*caps);
+	for (i = 0; i < n; i++) {
+		format = ast_format_cap_get_format(*caps, i);
+		ast_str_append(&key, 0, "%s:%u,", ast_format_get_name(format), ast_format_cap_get_format_framing(*caps, format));
+		ao2_ref(format, -1);
+	}
+
+	shared = ao2_find(pool, ast_str_buffer(key), OBJ_SEARCH_KEY);
+	if (shared) {
+		ao2_ref(*caps, -1);
+		*caps = shared->caps;
+		ao2_ref(*caps, +1);
+		ao2_ref(shared, -1);
+		return;
+	}
+
+	len = ast_str_strlen(key) + 1;
+	shared = ao2_alloc_options(sizeof(*shared) + len, shared_caps_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!shared) {
+		return;
+	}
+
+	memcpy(shared->key, ast_str_buffer(key), len);
+	shared->caps = *caps;
+	ao2_ref(*caps, +1);
+	ao2_link(pool, shared);
+	ao2_ref(shared, -1);
+}
+
 static void *sccp_speeddial_cfg_alloc(const char *category)
 {
 	struct sccp_speeddial_cfg *speeddial_cfg;
@@ -92,6 +281,9 @@ static void sccp_line_cfg_destructor(void *obj)
 	ast_unref_namedgroups(line_cfg->named_callgroups);
 	ast_unref_namedgroups(line_cfg->named_pickupgroups);
 	ao2_ref(line_cfg->caps, -1);
+	ao2_cleanup((void *) line_cfg->language);
+	ao2_cleanup((void *) line_cfg->context);
+	ao2_cleanup((void *) line_cfg->accountcode);
 }
 
 static void *sccp_line_cfg_alloc(const char *category)
@@ -127,6 +319,13 @@ static void *sccp_line_cfg_alloc(const char *category)
 	line_cfg->named_pickupgroups = NULL;
 	line_cfg->internal = internal;
 	line_cfg->internal->associated = 0;
+	line_cfg->language = intern_str("");
+	line_cfg->context = intern_str("");
+	line_cfg->accountcode = intern_str("");
+	if (!line_cfg->language || !line_cfg->context || !line_cfg->accountcode) {
+		ao2_ref(line_cfg, -1);
+		return NULL;
+	}
 
 	return line_cfg;
 }
@@ -180,6 +379,8 @@ static void sccp_device_cfg_destructor(void *obj)
 	sccp_device_cfg_free_internal(device_cfg);
 	sccp_device_cfg_free_speeddials(device_cfg);
 	ao2_cleanup(device_cfg->line_cfg);
+	ao2_cleanup((void *) device_cfg->vmexten);
+	ao2_cleanup((void *) device_cfg->timezone);
 }
 
 static void *sccp_device_cfg_alloc(const char *category)
@@ -206,6 +407,12 @@ static void *sccp_device_cfg_alloc(const char *category)
 	device_cfg->internal = internal;
 	device_cfg->internal->line_name[0] = '\0';
 	AST_LIST_HEAD_INIT_NOLOCK(&device_cfg->internal->speeddials);
+	device_cfg->vmexten = intern_str("");
+	device_cfg->timezone = intern_str("");
+	if (!device_cfg->vmexten || !device_cfg->timezone) {
+		ao2_ref(device_cfg, -1);
+		return NULL;
+	}
 
 	return device_cfg;
 }
@@ -264,11 +471,127 @@ static int sccp_device_cfg_add_speeddial_name(struct sccp_device_cfg *device_cfg
 	return 0;
 }
 
+/*
+ * Sorted arrays of the lines and speeddials of a config being built. The config
+ * containers are not locked, so the pre-apply workers look the lines and speeddials up
+ * in the index instead, which is built before the workers start and then only read.
+ *
+ * The index doesn't hold references; the containers must not be modified meanwhile.
+ */
+struct cfg_index {
+	struct sccp_line_cfg **lines;
+	size_t line_count;
+	struct sccp_speeddial_cfg **speeddials;
+	size_t speeddial_count;
+};
+
+static int cmp_line_cfg(const void *a, const void *b)
+{
+	return strcmp((*(struct sccp_line_cfg * const *) a)->name, (*(struct sccp_line_cfg * const *) b)->name);
+}
+
+static int cmp_line_cfg_name(const void *key, const void *elem)
+{
+	return strcmp(key, (*(struct sccp_line_cfg * const *) elem)->name);
+}
+
+static int cmp_speeddial_cfg(const void *a, const void *b)
+{
+	return strcmp((*(struct sccp_speeddial_cfg * const *) a)->name, (*(struct sccp_speeddial_cfg * const *) b)->name);
+}
+
+static int cmp_speeddial_cfg_name(const void *key, const void *elem)
+{
+	return strcmp(key, (*(struct sccp_speeddial_cfg * const *) elem)->name);
+}
+
+/*
+ * Fill objs with the objects of the container, without taking references, and return
+ * the number of objects.
+ */
+static size_t container_to_array(struct ao2_container *container, void **objs, size_t n)
+{
+	struct ao2_iterator iter;
+	void *obj;
+	size_t i = 0;
+
+	iter = ao2_iterator_init(container, 0);
+	while (i < n && (obj = ao2_iterator_next(&iter))) {
+		objs[i++] = obj;
+		ao2_ref(obj, -1);
+	}
+	ao2_iterator_destroy(&iter);
+
+	return i;
+}
+
+static int cfg_index_init(struct cfg_index *index, struct sccp_cfg *cfg)
+{
+	size_t n_lines = ao2_container_count(cfg->lines_cfg);
+	size_t n_speeddials = ao2_container_count(cfg->speeddials_cfg);
+
+	index->lines = ast_malloc((n_lines ? n_lines : 1) * sizeof(*index->lines));
+	index->speeddials = ast_malloc((n_speeddials ? n_speeddials : 1) * sizeof(*index->speeddials));
+	if (!index->lines || !index->speeddials) {
+		ast_free(index->lines);
+		ast_free(index->speeddials);
+		return -1;
+	}
+
+	index->line_count = container_to_array(cfg->lines_cfg, (void **) index->lines, n_lines);
+	qsort(index->lines, index->line_count, sizeof(*index->lines), cmp_line_cfg);
+
+	index->speeddial_count = container_to_array(cfg->speeddials_cfg, (void **) index->speeddials, n_speeddials);
+	qsort(index->speeddials, index->speeddial_count, sizeof(*index->speeddials), cmp_speeddial_cfg);
+
+	return 0;
+}
+
+static void cfg_index_deinit(struct cfg_index *index)
+{
+	ast_free(index->lines);
+	ast_free(index->speeddials);
+}
+
+/*
+ * The returned object has its reference count incremented by one.
+ */
+static struct sccp_line_cfg *cfg_index_find_line(const struct cfg_index *index, const char *name)
+{
+	struct sccp_line_cfg **line_cfg;
+
+	line_cfg = bsearch(name, index->lines, index->line_count, sizeof(*index->lines), cmp_line_cfg_name);
+	if (!line_cfg) {
+		return NULL;
+	}
+
+	ao2_ref(*line_cfg, +1);
+
+	return *line_cfg;
+}
+
+/*
+ * The returned object has its reference count incremented by one.
+ */
+static struct sccp_speeddial_cfg *cfg_index_find_speeddial(const struct cfg_index *index, const char *name)
+{
+	struct sccp_speeddial_cfg **speeddial_cfg;
+
+	speeddial_cfg = bsearch(name, index->speeddials, index->speeddial_count, sizeof(*index->speeddials), cmp_speeddial_cfg_name);
+	if (!speeddial_cfg) {
+		return NULL;
+	}
+
+	ao2_ref(*speeddial_cfg, +1);
+
+	return *speeddial_cfg;
+}
+
 /*
  * The "internal" member must not have been freed.
  * The function must not have been called successfully for this device config
  */
-static int sccp_device_cfg_build_line(struct sccp_device_cfg *device_cfg, struct sccp_cfg *cfg)
+static int sccp_device_cfg_build_line(struct sccp_device_cfg *device_cfg, const struct cfg_index *index)
 {
 	struct sccp_line_cfg *line_cfg;
 
@@ -277,20 +600,20 @@ static int sccp_device_cfg_build_line(struct sccp_device_cfg *device_cfg, struct
 		return -1;
 	}
 
-	line_cfg = sccp_cfg_find_line(cfg, device_cfg->internal->line_name);
+	line_cfg = cfg_index_find_line(index, device_cfg->internal->line_name);
 	if (!line_cfg) {
 		ast_log(LOG_ERROR, "invalid device %s: unknown line %s\n", device_cfg->name, device_cfg->internal->line_name);
 		return -1;
 	}
 
-	if (line_cfg->internal->associated) {
+	/* device configs are built concurrently, see pre_apply_devices_cfg */
+	if (__atomic_exchange_n(&line_cfg->internal->associated, 1, __ATOMIC_RELAXED)) {
 		ast_log(LOG_ERROR, "invalid device %s: line %s is already associated\n", device_cfg->name, line_cfg->name);
 		ao2_ref(line_cfg, -1);
 		return -1;
 	}
 
 	device_cfg->line_cfg = line_cfg;
-	line_cfg->internal->associated = 1;
 
 	return 0;
 }
@@ -298,15 +621,22 @@ static int sccp_device_cfg_build_line(struct sccp_device_cfg *device_cfg, struct
 /*
  * The "internal" member must not have been freed.
  * The function must not have been called successfully for this device config
+ *
+ * If index is NULL, the speeddials are looked up in cfg.
  */
-static int sccp_device_cfg_build_speeddials(struct sccp_device_cfg *device_cfg, struct sccp_cfg *cfg)
+static int sccp_device_cfg_build_speeddials(struct sccp_device_cfg *device_cfg, struct sccp_cfg *cfg, const struct cfg_index *index)
 {
 	struct device_cfg_speeddial *device_sd;
 	size_t i;
 	size_t count = 0;
 
 	AST_LIST_TRAVERSE(&device_cfg->internal->speeddials, device_sd, list) {
-		device_sd->speeddial_cfg = sccp_cfg_find_speeddial(cfg, device_sd->name);
+		if (index) {
+			device_sd->speeddial_cfg = cfg_index_find_speeddial(index, device_sd->name);
+		} else {
+			device_sd->speeddial_cfg = sccp_cfg_find_speeddial(cfg, device_sd->name);
+		}
+
 		if (!device_sd->speeddial_cfg) {
 			ast_log(LOG_WARNING, "invalid device %s: unknown speeddial %s\n", device_cfg->name, device_sd->name);
 			continue;
@@ -436,12 +766,76 @@ static void sccp_cfg_destructor(void *obj)
 {
 	struct sccp_cfg *cfg = obj;
 
+	ast_free(cfg->changes.device_names);
 	ao2_cleanup(cfg->general_cfg);
 	ao2_cleanup(cfg->devices_cfg);
 	ao2_cleanup(cfg->lines_cfg);
 	ao2_cleanup(cfg->speeddials_cfg);
 }
 
+/*
+ * Expected number of items of each kind in the next config, used to size the containers.
+ * On the first load, it's the number of sections in the configuration file; on reload,
+ * it's the number of items of the current config.
+ */
+struct cfg_size_hint {
+	size_t devices;
+	size_t lines;
+	size_t speeddials;
+};
+
+static struct cfg_size_hint size_hint;
+
+static const size_t cfg_buckets_primes[] = { SCCP_BUCKETS, 1129, 2269, 4547, 9103, 18211, 36433, 72869 };
+
+/*
+ * Return a number of buckets for about one item per bucket.
+ */
+static int cfg_buckets(size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_LEN(cfg_buckets_primes) - 1; i++) {
+		if (cfg_buckets_primes[i] >= count) {
+			break;
+		}
+	}
+
+	return cfg_buckets_primes[i];
+}
+
+/*
+ * Count the sections of the configuration file, without parsing it. Included files
+ * are ignored, since this is only a hint.
+ */
+static size_t count_cfg_sections(const char *filename)
+{
+	char path[PATH_MAX];
+	char buf[256];
+	FILE *fp;
+	size_t count = 0;
+	int line_start = 1;
+
+	snprintf(path, sizeof(path), "%s/%s", ast_config_AST_CONFIG_DIR, filename);
+	fp = fopen(path, "r");
+	if (!fp) {
+		return 0;
+	}
+
+	while (fgets(buf, sizeof(buf), fp)) {
+		if (line_start && buf[0] == '[') {
+			count++;
+		}
+
+		/* only look at the start of lines, even if longer than the buffer */
+		line_start = strchr(buf, '\n') != NULL;
+	}
+
+	fclose(fp);
+
+	return count;
+}
+
 static void *sccp_cfg_alloc(void)
 {
 	struct sccp_cfg *cfg;
@@ -455,17 +849,17 @@ static void *sccp_cfg_alloc(void)
 		goto error;
 	}
 
-	devices_cfg = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, SCCP_BUCKETS, sccp_device_cfg_hash, sccp_device_cfg_cmp);
+	devices_cfg = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, cfg_buckets(size_hint.devices), sccp_device_cfg_hash, sccp_device_cfg_cmp);
 	if (!devices_cfg) {
 		goto error;
 	}
 
-	lines_cfg = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, SCCP_BUCKETS, sccp_line_cfg_hash, sccp_line_cfg_cmp);
+	lines_cfg = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, cfg_buckets(size_hint.lines), sccp_line_cfg_hash, sccp_line_cfg_cmp);
 	if (!lines_cfg) {
 		goto error;
 	}
 
-	speeddials_cfg = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, SCCP_BUCKETS, sccp_speeddial_cfg_hash, sccp_speeddial_cfg_cmp);
+	speeddials_cfg = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, cfg_buckets(size_hint.speeddials), sccp_speeddial_cfg_hash, sccp_speeddial_cfg_cmp);
 	if (!speeddials_cfg) {
 		goto error;
 	}
@@ -479,6 +873,10 @@ static void *sccp_cfg_alloc(void)
 	cfg->devices_cfg = devices_cfg;
 	cfg->lines_cfg = lines_cfg;
 	cfg->speeddials_cfg = speeddials_cfg;
+	cfg->pre_apply_time = 0;
+	cfg->pre_apply_workers = 0;
+	memset(&cfg->sharing, 0, sizeof(cfg->sharing));
+	memset(&cfg->changes, 0, sizeof(cfg->changes));
 
 	return cfg;
 
@@ -558,42 +956,182 @@ static AO2_GLOBAL_OBJ_STATIC(global_cfg);
 CONFIG_INFO_STANDARD(cfg_info, global_cfg, sccp_cfg_alloc,
 	.files = ACO_FILES(&sccp_conf),
 	.pre_apply_config = pre_apply_config,
+	.post_apply_config = post_apply_config,
 	.hidden = 1,
 );
 
-static int cb_pre_apply_device_cfg(void *obj, void *arg, int flags)
-{
-	struct sccp_device_cfg *device_cfg = obj;
-	struct sccp_cfg *cfg = arg;
+/*
+ * The current config is also published in one of two slots, so that it can be read
+ * without taking the global_cfg lock.
+ *
+ * A reader increments the reader count of the current slot, then checks that the slot
+ * is still the current one before using its config. A writer fills the other slot,
+ * after waiting for the readers of the config it replaces to leave, and then makes it
+ * the current slot. Writers are serialized by the config framework.
+ */
+struct cfg_slot {
+	struct sccp_cfg *cfg;
+	int readers;
+};
 
-	if (sccp_device_cfg_build_line(device_cfg, cfg)) {
-		return CMP_MATCH;
+static struct cfg_slot cfg_slots[2];
+static unsigned int cfg_slot_current;
+
+/*
+ * Realtime device configs are cached independently of the config they have been
+ * loaded with; the cache is emptied each time a new config is applied.
+ */
+static struct sccp_lru_cache *realtime_cache;
+static struct sccp_config_realtime_stats realtime_stats;
+AST_MUTEX_DEFINE_STATIC(realtime_stats_lock);
+
+static int pre_apply_device_cfg(struct sccp_device_cfg *device_cfg, struct sccp_cfg *cfg, const struct cfg_index *index)
+{
+	if (sccp_device_cfg_build_line(device_cfg, index)) {
+		return -1;
 	}
 
-	if (sccp_device_cfg_build_speeddials(device_cfg, cfg)) {
-		return CMP_MATCH;
+	if (sccp_device_cfg_build_speeddials(device_cfg, cfg, index)) {
+		return -1;
 	}
 
 	sccp_device_cfg_norm_voicemail(device_cfg);
 	sccp_device_cfg_free_internal(device_cfg);
+	device_cfg->hash = hash_device_cfg(device_cfg);
 
 	return 0;
 }
 
+struct pre_apply_work {
+	struct sccp_cfg *cfg;
+	const struct cfg_index *index;
+	struct sccp_device_cfg **devices_cfg;
+	/* invalid[i] is set to 1 if devices_cfg[i] is invalid */
+	unsigned char *invalid;
+	size_t start;
+	size_t end;
+};
+
+static void *pre_apply_worker_run(void *data)
+{
+	struct pre_apply_work *work = data;
+	size_t i;
+
+	for (i = work->start; i < work->end; i++) {
+		if (pre_apply_device_cfg(work->devices_cfg[i], work->cfg, work->index)) {
+			work->invalid[i] = 1;
+		}
+	}
+
+	return NULL;
+}
+
+static unsigned int pre_apply_workers_count(size_t n)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t workers = n / PRE_APPLY_MIN_DEVICES_PER_WORKER;
+
+	if (cpus > 0 && workers > (size_t) cpus) {
+		workers = cpus;
+	}
+
+	if (workers > PRE_APPLY_MAX_WORKERS) {
+		workers = PRE_APPLY_MAX_WORKERS;
+	}
+
+	return workers ? workers : 1;
+}
+
+/*
+ * The device configs are partitioned between worker threads. The containers are not
+ * accessed while the workers run: the lines and speeddials are looked up in an index
+ * built beforehand, and the invalid device configs are unlinked once all the workers
+ * are done.
+ */
 static void pre_apply_devices_cfg(struct sccp_cfg *cfg)
 {
-	ao2_callback(cfg->devices_cfg, OBJ_NODATA | OBJ_MULTIPLE | OBJ_UNLINK, cb_pre_apply_device_cfg, cfg);
+	struct pre_apply_work works[PRE_APPLY_MAX_WORKERS];
+	pthread_t threads[PRE_APPLY_MAX_WORKERS];
+	int started[PRE_APPLY_MAX_WORKERS];
+	struct sccp_device_cfg **devices_cfg;
+	struct sccp_device_cfg *device_cfg;
+	struct ao2_iterator iter;
+	struct cfg_index index;
+	unsigned char *invalid;
+	unsigned int workers;
+	unsigned int w;
+	size_t n;
+	size_t i;
+
+	n = ao2_container_count(cfg->devices_cfg);
+	if (!n) {
+		return;
+	}
+
+	devices_cfg = ast_malloc(n * sizeof(*devices_cfg));
+	invalid = ast_calloc(n, sizeof(*invalid));
+	if (!devices_cfg || !invalid || cfg_index_init(&index, cfg)) {
+		ast_free(devices_cfg);
+		ast_free(invalid);
+		/* can't do better than rejecting every device */
+		ao2_callback(cfg->devices_cfg, OBJ_NODATA | OBJ_MULTIPLE | OBJ_UNLINK, NULL, NULL);
+		return;
+	}
+
+	i = 0;
+	iter = ao2_iterator_init(cfg->devices_cfg, 0);
+	while (i < n && (device_cfg = ao2_iterator_next(&iter))) {
+		devices_cfg[i++] = device_cfg;
+	}
+	ao2_iterator_destroy(&iter);
+	n = i;
+
+	workers = pre_apply_workers_count(n);
+	for (w = 0; w < workers; w++) {
+		works[w].cfg = cfg;
+		works[w].index = &index;
+		works[w].devices_cfg = devices_cfg;
+		works[w].invalid = invalid;
+		works[w].start = n * w / workers;
+		works[w].end = n * (w + 1) / workers;
+		/* the first partition is handled by the calling thread */
+		started[w] = w && !ast_pthread_create(&threads[w], NULL, pre_apply_worker_run, &works[w]);
+	}
+
+	for (w = 0; w < workers; w++) {
+		if (started[w]) {
+			pthread_join(threads[w], NULL);
+		} else {
+			pre_apply_worker_run(&works[w]);
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		if (invalid[i]) {
+			ao2_unlink(cfg->devices_cfg, devices_cfg[i]);
+		}
+
+		ao2_ref(devices_cfg[i], -1);
+	}
+
+	cfg->pre_apply_workers = workers;
+
+	cfg_index_deinit(&index);
+	ast_free(invalid);
+	ast_free(devices_cfg);
 }
 
 static int cb_pre_apply_line_cfg(void *obj, void *arg, int flags)
 {
 	struct sccp_line_cfg *line_cfg = obj;
+	struct ao2_container *caps_pool = arg;
 
 	if (!line_cfg->internal->associated) {
 		ast_log(LOG_ERROR, "invalid line %s: not associated to any device\n", line_cfg->name);
 		return CMP_MATCH;
 	}
 
+	share_caps(caps_pool, &line_cfg->caps);
 	sccp_line_cfg_free_internal(line_cfg);
 
 	return 0;
@@ -601,26 +1139,225 @@ static int cb_pre_apply_line_cfg(void *obj, void *arg, int flags)
 
 static void pre_apply_lines_cfg(struct sccp_cfg *cfg)
 {
-	ao2_callback(cfg->lines_cfg, OBJ_NODATA | OBJ_MULTIPLE | OBJ_UNLINK, cb_pre_apply_line_cfg, NULL);
+	struct ao2_container *caps_pool = caps_pool_alloc();
+
+	ao2_callback(cfg->lines_cfg, OBJ_NODATA | OBJ_MULTIPLE | OBJ_UNLINK, cb_pre_apply_line_cfg, caps_pool);
+	ao2_cleanup(caps_pool);
 }
 
-static void pre_apply_general_cfg(struct sccp_cfg *cfg)
+static int speeddial_content_hash(const void *obj, int flags)
 {
-	struct sccp_general_cfg *general_cfg = cfg->general_cfg;
-	struct sccp_device_cfg *device_cfg;
+	const struct sccp_speeddial_cfg *speeddial_cfg = obj;
 
-	device_cfg = sccp_cfg_find_device(cfg, DEVICE_CFG_NAME_GUEST);
-	if (device_cfg) {
-		/* unlink the guest device and its line */
-		ao2_unlink(cfg->devices_cfg, device_cfg);
-		ao2_unlink(cfg->lines_cfg, device_cfg->line_cfg);
+	return ast_str_hash(speeddial_cfg->label) ^ ast_str_hash(speeddial_cfg->extension);
+}
 
-		if (general_cfg->internal->guest) {
-			general_cfg->guest_device_cfg = device_cfg;
-			device_cfg->guest = 1;
-		} else {
-			ao2_ref(device_cfg, -1);
-		}
+static int speeddial_content_cmp(void *obj, void *arg, int flags)
+{
+	struct sccp_speeddial_cfg *speeddial_cfg = obj;
+	struct sccp_speeddial_cfg *other = arg;
+
+	if (speeddial_cfg->blf != other->blf || strcmp(speeddial_cfg->label, other->label) || strcmp(speeddial_cfg->extension, other->extension)) {
+		return 0;
+	}
+
+	return CMP_MATCH | CMP_STOP;
+}
+
+static void device_cfg_merge_speeddials(struct sccp_device_cfg *device_cfg, struct ao2_container *merged)
+{
+	struct sccp_speeddial_cfg *speeddial_cfg;
+	size_t i;
+
+	for (i = 0; i < device_cfg->speeddial_count; i++) {
+		speeddial_cfg = ao2_find(merged, device_cfg->speeddials_cfg[i], OBJ_SEARCH_OBJECT);
+		if (!speeddial_cfg) {
+			continue;
+		}
+
+		/* swap the references */
+		ao2_ref(device_cfg->speeddials_cfg[i], -1);
+		device_cfg->speeddials_cfg[i] = speeddial_cfg;
+	}
+}
+
+static int cb_is_merged_speeddial(void *obj, void *arg, int flags)
+{
+	struct sccp_speeddial_cfg *speeddial_cfg;
+	int ret;
+
+	speeddial_cfg = ao2_find(arg, obj, OBJ_SEARCH_OBJECT);
+	ret = speeddial_cfg != obj ? CMP_MATCH : 0;
+	ao2_cleanup(speeddial_cfg);
+
+	return ret;
+}
+
+/*
+ * Merge the speeddial sections with the same content, so that the devices share the
+ * same speeddial configs. Must be called after the devices have been built.
+ */
+static void pre_apply_speeddials_cfg(struct sccp_cfg *cfg)
+{
+	struct ao2_container *merged;
+	struct sccp_speeddial_cfg *speeddial_cfg;
+	struct sccp_speeddial_cfg *other;
+	struct sccp_device_cfg *device_cfg;
+	struct ao2_iterator iter;
+	int n;
+
+	merged = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, cfg_buckets(ao2_container_count(cfg->speeddials_cfg)), speeddial_content_hash, speeddial_content_cmp);
+	if (!merged) {
+		return;
+	}
+
+	iter = ao2_iterator_init(cfg->speeddials_cfg, 0);
+	while ((speeddial_cfg = ao2_iterator_next(&iter))) {
+		other = ao2_find(merged, speeddial_cfg, OBJ_SEARCH_OBJECT);
+		if (!other) {
+			ao2_link(merged, speeddial_cfg);
+		}
+
+		ao2_cleanup(other);
+		ao2_ref(speeddial_cfg, -1);
+	}
+	ao2_iterator_destroy(&iter);
+
+	n = ao2_container_count(cfg->speeddials_cfg) - ao2_container_count(merged);
+	if (n) {
+		iter = ao2_iterator_init(cfg->devices_cfg, 0);
+		while ((device_cfg = ao2_iterator_next(&iter))) {
+			device_cfg_merge_speeddials(device_cfg, merged);
+			ao2_ref(device_cfg, -1);
+		}
+		ao2_iterator_destroy(&iter);
+
+		if (cfg->general_cfg->guest_device_cfg) {
+			device_cfg_merge_speeddials(cfg->general_cfg->guest_device_cfg, merged);
+		}
+
+		ao2_callback(cfg->speeddials_cfg, OBJ_NODATA | OBJ_MULTIPLE | OBJ_UNLINK, cb_is_merged_speeddial, merged);
+	}
+
+	cfg->sharing.speeddials_merged = n;
+
+	ao2_ref(merged, -1);
+}
+
+static int cmp_ptr(const void *a, const void *b)
+{
+	const void *ptr_a = *(const void * const *) a;
+	const void *ptr_b = *(const void * const *) b;
+
+	return ptr_a < ptr_b ? -1 : ptr_a > ptr_b;
+}
+
+/*
+ * Sort the pointers, and return the number of distinct ones, which are moved to the
+ * front of the array.
+ */
+static size_t distinct_ptrs(const void **ptrs, size_t n)
+{
+	size_t i;
+	size_t distinct = 0;
+
+	qsort(ptrs, n, sizeof(*ptrs), cmp_ptr);
+	for (i = 0; i < n; i++) {
+		if (!distinct || ptrs[distinct - 1] != ptrs[i]) {
+			ptrs[distinct++] = ptrs[i];
+		}
+	}
+
+	return distinct;
+}
+
+/* size of the fixed arrays the interned strings would need otherwise */
+#define LINE_INTERNED_SIZE (MAX_LANGUAGE + AST_MAX_CONTEXT + AST_MAX_ACCOUNT_CODE)
+#define DEVICE_INTERNED_SIZE (AST_MAX_EXTENSION + 40)
+#define LINE_INTERNED_COUNT 3
+#define DEVICE_INTERNED_COUNT 2
+
+static void sharing_add_device(struct sccp_device_cfg *device_cfg, const void **strings, const void **caps, size_t *n)
+{
+	struct sccp_line_cfg *line_cfg = device_cfg->line_cfg;
+
+	strings[*n * 5] = device_cfg->vmexten;
+	strings[*n * 5 + 1] = device_cfg->timezone;
+	strings[*n * 5 + 2] = line_cfg->language;
+	strings[*n * 5 + 3] = line_cfg->context;
+	strings[*n * 5 + 4] = line_cfg->accountcode;
+	caps[*n] = line_cfg->caps;
+	(*n)++;
+}
+
+static void compute_sharing(struct sccp_cfg *cfg)
+{
+	struct sccp_cfg_sharing *sharing = &cfg->sharing;
+	struct sccp_device_cfg *device_cfg;
+	struct ao2_iterator iter;
+	const void **strings;
+	const void **caps;
+	size_t strings_size = 0;
+	size_t count;
+	size_t n = 0;
+	size_t i;
+
+	count = ao2_container_count(cfg->devices_cfg) + 1;
+	strings = ast_malloc(count * (DEVICE_INTERNED_COUNT + LINE_INTERNED_COUNT) * sizeof(*strings));
+	caps = ast_malloc(count * sizeof(*caps));
+	if (!strings || !caps) {
+		goto end;
+	}
+
+	iter = ao2_iterator_init(cfg->devices_cfg, 0);
+	while (n < count - 1 && (device_cfg = ao2_iterator_next(&iter))) {
+		sharing_add_device(device_cfg, strings, caps, &n);
+		ao2_ref(device_cfg, -1);
+	}
+	ao2_iterator_destroy(&iter);
+
+	if (cfg->general_cfg->guest_device_cfg) {
+		sharing_add_device(cfg->general_cfg->guest_device_cfg, strings, caps, &n);
+	}
+
+	sharing->string_refs = n * (DEVICE_INTERNED_COUNT + LINE_INTERNED_COUNT);
+	sharing->strings = distinct_ptrs(strings, sharing->string_refs);
+	for (i = 0; i < sharing->strings; i++) {
+		strings_size += strlen(strings[i]) + 1 + sizeof(char *);
+	}
+
+	sharing->caps_refs = n;
+	sharing->caps = distinct_ptrs(caps, n);
+
+	/* the size of a format capabilities object is not known, so only the interned
+	 * strings and the merged speeddials are accounted for
+	 */
+	sharing->saved = n * (LINE_INTERNED_SIZE + DEVICE_INTERNED_SIZE);
+	sharing->saved -= MIN(sharing->saved, strings_size);
+	sharing->saved += sharing->speeddials_merged * sizeof(struct sccp_speeddial_cfg);
+
+end:
+	ast_free(strings);
+	ast_free(caps);
+}
+
+static void pre_apply_general_cfg(struct sccp_cfg *cfg)
+{
+	struct sccp_general_cfg *general_cfg = cfg->general_cfg;
+	struct sccp_device_cfg *device_cfg;
+
+	device_cfg = sccp_cfg_find_device(cfg, DEVICE_CFG_NAME_GUEST);
+	if (device_cfg) {
+		/* unlink the guest device and its line */
+		ao2_unlink(cfg->devices_cfg, device_cfg);
+		ao2_unlink(cfg->lines_cfg, device_cfg->line_cfg);
+
+		if (general_cfg->internal->guest) {
+			general_cfg->guest_device_cfg = device_cfg;
+			device_cfg->guest = 1;
+		} else {
+			ao2_ref(device_cfg, -1);
+		}
 	} else {
 		if (general_cfg->internal->guest) {
 			ast_log(LOG_WARNING, "invalid config: guest is enabled but no device \"%s\" is defined\n", DEVICE_CFG_NAME_GUEST);
@@ -630,17 +1367,289 @@ static void pre_apply_general_cfg(struct sccp_cfg *cfg)
 	sccp_general_cfg_free_internal(general_cfg);
 }
 
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/* the null byte is hashed too, so that ("ab", "c") and ("a", "bc") differ */
+static uint64_t hash_str(uint64_t hash, const char *str)
+{
+	return hash_bytes(hash, str, strlen(str) + 1);
+}
+
+static uint64_t hash_int(uint64_t hash, int64_t val)
+{
+	return hash_bytes(hash, &val, sizeof(val));
+}
+
+static uint64_t hash_caps(uint64_t hash, struct ast_format_cap *caps)
+{
+	struct ast_format *format;
+	size_t i;
+	size_t n;
+
+	n = ast_format_cap_count(caps);
+	for (i = 0; i < n; i++) {
+		format = ast_format_cap_get_format(caps, i);
+		hash = hash_str(hash, ast_format_get_name(format));
+		hash = hash_int(hash, ast_format_cap_get_format_framing(caps, format));
+		ao2_ref(format, -1);
+	}
+
+	return hash;
+}
+
+static uint64_t hash_namedgroups(uint64_t hash, struct ast_namedgroups *groups)
+{
+	struct ast_str *buf;
+
+	if (!groups) {
+		return hash_int(hash, 0);
+	}
+
+	buf = ast_str_alloca(1024);
+
+	return hash_str(hash, ast_print_namedgroups(&buf, groups));
+}
+
+static uint64_t hash_line_cfg(uint64_t hash, struct sccp_line_cfg *line_cfg)
+{
+	struct ast_variable *var;
+
+	hash = hash_str(hash, line_cfg->name);
+	hash = hash_str(hash, line_cfg->cid_num);
+	hash = hash_str(hash, line_cfg->cid_name);
+	hash = hash_str(hash, line_cfg->language);
+	hash = hash_str(hash, line_cfg->context);
+	hash = hash_str(hash, line_cfg->accountcode);
+	hash = hash_int(hash, line_cfg->directmedia);
+	hash = hash_int(hash, line_cfg->tos_audio);
+	hash = hash_int(hash, line_cfg->callgroups);
+	hash = hash_int(hash, line_cfg->pickupgroups);
+	hash = hash_namedgroups(hash, line_cfg->named_callgroups);
+	hash = hash_namedgroups(hash, line_cfg->named_pickupgroups);
+	hash = hash_caps(hash, line_cfg->caps);
+
+	for (var = line_cfg->chanvars; var; var = var->next) {
+		hash = hash_str(hash, var->name);
+		hash = hash_str(hash, var->value);
+	}
+
+	return hash;
+}
+
+static uint64_t hash_speeddial_cfg(uint64_t hash, struct sccp_speeddial_cfg *speeddial_cfg)
+{
+	/* the name is not hashed, since identical speeddials are merged */
+	hash = hash_str(hash, speeddial_cfg->label);
+	hash = hash_str(hash, speeddial_cfg->extension);
+	hash = hash_int(hash, speeddial_cfg->blf);
+
+	return hash;
+}
+
+static uint64_t hash_device_cfg(struct sccp_device_cfg *device_cfg)
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+	size_t i;
+
+	hash = hash_str(hash, device_cfg->name);
+	hash = hash_str(hash, device_cfg->dateformat);
+	hash = hash_str(hash, device_cfg->voicemail);
+	hash = hash_str(hash, device_cfg->vmexten);
+	hash = hash_str(hash, device_cfg->timezone);
+	hash = hash_int(hash, device_cfg->keepalive);
+	hash = hash_int(hash, device_cfg->dialtimeout);
+	hash = hash_int(hash, device_cfg->guest);
+	hash = hash_line_cfg(hash, device_cfg->line_cfg);
+
+	hash = hash_int(hash, device_cfg->speeddial_count);
+	for (i = 0; i < device_cfg->speeddial_count; i++) {
+		hash = hash_speeddial_cfg(hash, device_cfg->speeddials_cfg[i]);
+	}
+
+	return hash;
+}
+
+static uint64_t hash_general_cfg(struct sccp_general_cfg *general_cfg)
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	hash = hash_int(hash, general_cfg->authtimeout);
+	hash = hash_int(hash, general_cfg->max_guests);
+	hash = hash_int(hash, general_cfg->tos);
+	hash = hash_int(hash, general_cfg->realtime);
+	hash = hash_int(hash, general_cfg->realtime_cache_size);
+	hash = hash_int(hash, general_cfg->realtime_cache_ttl);
+	hash = hash_int(hash, general_cfg->rtp_pool_size);
+	if (general_cfg->guest_device_cfg) {
+		general_cfg->guest_device_cfg->hash = hash_device_cfg(general_cfg->guest_device_cfg);
+		hash = hash_int(hash, general_cfg->guest_device_cfg->hash);
+	} else {
+		hash = hash_int(hash, 0);
+	}
+
+	return hash;
+}
+
+static void changes_add_device_name(struct sccp_cfg_changes *changes, const char *name)
+{
+	ast_copy_string(changes->device_names[changes->count++], name, sizeof(changes->device_names[0]));
+}
+
+/*
+ * Compute the content hashes of the new config, and compare them to the old config
+ * ones to find the devices that need to be reloaded.
+ */
+static void compute_changes(struct sccp_cfg *cfg, struct sccp_cfg *old_cfg)
+{
+	struct sccp_cfg_changes *changes = &cfg->changes;
+	struct sccp_device_cfg *device_cfg;
+	struct sccp_device_cfg *other_device_cfg;
+	struct ao2_iterator iter;
+	struct timeval start = ast_tvnow();
+	size_t n;
+
+	/* the device config hashes have been computed in pre_apply_device_cfg */
+	cfg->general_cfg->hash = hash_general_cfg(cfg->general_cfg);
+
+	n = ao2_container_count(cfg->devices_cfg);
+	if (old_cfg) {
+		n += ao2_container_count(old_cfg->devices_cfg);
+	}
+
+	changes->device_names = n ? ast_calloc(n, sizeof(*changes->device_names)) : NULL;
+	if (!old_cfg || (n && !changes->device_names)) {
+		changes->all = 1;
+		changes->devices_added = ao2_container_count(cfg->devices_cfg);
+		goto end;
+	}
+
+	changes->all = cfg->general_cfg->hash != old_cfg->general_cfg->hash;
+
+	iter = ao2_iterator_init(cfg->devices_cfg, 0);
+	while ((device_cfg = ao2_iterator_next(&iter))) {
+		other_device_cfg = sccp_cfg_find_device(old_cfg, device_cfg->name);
+		if (!other_device_cfg) {
+			changes->devices_added++;
+			changes_add_device_name(changes, device_cfg->name);
+		} else if (other_device_cfg->hash != device_cfg->hash) {
+			changes->devices_modified++;
+			changes_add_device_name(changes, device_cfg->name);
+		} else {
+			changes->devices_unchanged++;
+		}
+
+		ao2_cleanup(other_device_cfg);
+		ao2_ref(device_cfg, -1);
+	}
+	ao2_iterator_destroy(&iter);
+
+	iter = ao2_iterator_init(old_cfg->devices_cfg, 0);
+	while ((device_cfg = ao2_iterator_next(&iter))) {
+		other_device_cfg = sccp_cfg_find_device(cfg, device_cfg->name);
+		if (!other_device_cfg) {
+			changes->devices_removed++;
+			changes_add_device_name(changes, device_cfg->name);
+		}
+
+		ao2_cleanup(other_device_cfg);
+		ao2_ref(device_cfg, -1);
+	}
+	ao2_iterator_destroy(&iter);
+
+end:
+	changes->diff_time = ast_tvdiff_us(ast_tvnow(), start);
+}
+
 static int pre_apply_config(void)
 {
 	struct sccp_cfg *cfg = aco_pending_config(&cfg_info);
+	struct sccp_cfg *old_cfg = ao2_global_obj_ref(global_cfg);
+	struct timeval start = ast_tvnow();
 
 	pre_apply_devices_cfg(cfg);
 	pre_apply_lines_cfg(cfg);
 	pre_apply_general_cfg(cfg);
+	pre_apply_speeddials_cfg(cfg);
+	cfg->pre_apply_time = ast_tvdiff_us(ast_tvnow(), start);
+	compute_changes(cfg, old_cfg);
+	compute_sharing(cfg);
+
+	size_hint.devices = ao2_container_count(cfg->devices_cfg);
+	size_hint.lines = ao2_container_count(cfg->lines_cfg);
+	size_hint.speeddials = ao2_container_count(cfg->speeddials_cfg);
+
+	ao2_cleanup(old_cfg);
 
 	return 0;
 }
 
+static void publish_cfg(struct sccp_cfg *cfg)
+{
+	struct cfg_slot *slot;
+	struct sccp_cfg *old_cfg;
+	unsigned int next;
+
+	next = !__atomic_load_n(&cfg_slot_current, __ATOMIC_RELAXED);
+	slot = &cfg_slots[next];
+
+	while (__atomic_load_n(&slot->readers, __ATOMIC_ACQUIRE)) {
+		sched_yield();
+	}
+
+	old_cfg = slot->cfg;
+	if (cfg) {
+		ao2_ref(cfg, +1);
+	}
+
+	__atomic_store_n(&slot->cfg, cfg, __ATOMIC_RELEASE);
+	__atomic_store_n(&cfg_slot_current, next, __ATOMIC_SEQ_CST);
+
+	ao2_cleanup(old_cfg);
+}
+
+static void apply_realtime_cfg(struct sccp_cfg *cfg)
+{
+	sccp_lru_cache_invalidate(realtime_cache, NULL);
+	sccp_lru_cache_set_limits(realtime_cache, cfg->general_cfg->realtime_cache_size, cfg->general_cfg->realtime_cache_ttl);
+
+	if (cfg->general_cfg->realtime && !ast_check_realtime(REALTIME_DEVICES_FAMILY)) {
+		ast_log(LOG_WARNING, "realtime is enabled but no realtime engine is configured for %s\n", REALTIME_DEVICES_FAMILY);
+	}
+}
+
+static void post_apply_config(void)
+{
+	struct sccp_cfg *cfg = ao2_global_obj_ref(global_cfg);
+
+	apply_realtime_cfg(cfg);
+	publish_cfg(cfg);
+	ao2_cleanup(cfg);
+}
+
+/*
+ * The flags of the option are the offset of the interned string field in the object.
+ */
+static int interned_str_handler(const struct aco_option *opt, struct ast_variable *var, void *obj)
+{
+	const char **field = (const char **) ((char *) obj + aco_option_get_flags(opt));
+
+	return set_interned_str(field, var->value);
+}
+
 static int general_cfg_guest_handler(const struct aco_option *opt, struct ast_variable *var, void *obj)
 {
 	struct sccp_general_cfg *general_cfg = obj;
@@ -740,24 +1749,38 @@ static int line_cfg_tos_audio_handler(const struct aco_option *opt, struct ast_v
 
 int sccp_config_init(void)
 {
-	if (aco_info_init(&cfg_info)) {
+	intern_pool = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_MUTEX, INTERN_POOL_BUCKETS, intern_pool_hash, intern_pool_cmp);
+	if (!intern_pool) {
 		return -1;
 	}
 
+	realtime_cache = sccp_lru_cache_create(0, 0);
+	if (!realtime_cache) {
+		goto fail;
+	}
+
+	if (aco_info_init(&cfg_info)) {
+		goto fail;
+	}
+
 	/* general options */
 	aco_option_register(&cfg_info, "authtimeout", ACO_EXACT, general_types, "5", OPT_INT_T, PARSE_IN_RANGE, FLDSET(struct sccp_general_cfg, authtimeout), 1, 60);
 	aco_option_register_custom(&cfg_info, "guest", ACO_EXACT, general_types, "no", general_cfg_guest_handler, 0);
 	aco_option_register(&cfg_info, "max_guests", ACO_EXACT, general_types, "100", OPT_UINT_T, 0, FLDSET(struct sccp_general_cfg, max_guests));
+	aco_option_register(&cfg_info, "realtime", ACO_EXACT, general_types, "no", OPT_BOOL_T, 1, FLDSET(struct sccp_general_cfg, realtime));
+	aco_option_register(&cfg_info, "realtime_cache_size", ACO_EXACT, general_types, "1000", OPT_UINT_T, 0, FLDSET(struct sccp_general_cfg, realtime_cache_size));
+	aco_option_register(&cfg_info, "realtime_cache_ttl", ACO_EXACT, general_types, "300", OPT_INT_T, PARSE_IN_RANGE, FLDSET(struct sccp_general_cfg, realtime_cache_ttl), 1, 86400);
+	aco_option_register(&cfg_info, "rtp_pool_size", ACO_EXACT, general_types, "4", OPT_UINT_T, PARSE_IN_RANGE, FLDSET(struct sccp_general_cfg, rtp_pool_size), 0, 256);
 	aco_option_register_custom(&cfg_info, "tos", ACO_EXACT, general_types, "AF31", general_cfg_tos_handler, 0);
 
 	/* device options */
 	aco_option_register(&cfg_info, "type", ACO_EXACT, device_types, NULL, OPT_NOOP_T, 0, 0);
 	aco_option_register(&cfg_info, "dateformat", ACO_EXACT, device_types, "D/M/Y", OPT_CHAR_ARRAY_T, 0, CHARFLDSET(struct sccp_device_cfg, dateformat));
 	aco_option_register(&cfg_info, "voicemail", ACO_EXACT, device_types, NULL, OPT_CHAR_ARRAY_T, 0, CHARFLDSET(struct sccp_device_cfg, voicemail));
-	aco_option_register(&cfg_info, "vmexten", ACO_EXACT, device_types, "*98", OPT_CHAR_ARRAY_T, 0, CHARFLDSET(struct sccp_device_cfg, vmexten));
+	aco_option_register_custom(&cfg_info, "vmexten", ACO_EXACT, device_types, "*98", interned_str_handler, offsetof(struct sccp_device_cfg, vmexten));
 	aco_option_register(&cfg_info, "keepalive", ACO_EXACT, device_types, "10", OPT_INT_T, PARSE_IN_RANGE, FLDSET(struct sccp_device_cfg, keepalive), 1, 600);
 	aco_option_register(&cfg_info, "dialtimeout", ACO_EXACT, device_types, "2", OPT_INT_T, PARSE_IN_RANGE, FLDSET(struct sccp_device_cfg, dialtimeout), 1, 60);
-	aco_option_register(&cfg_info, "timezone", ACO_EXACT, device_types, NULL, OPT_CHAR_ARRAY_T, 0, CHARFLDSET(struct sccp_device_cfg, timezone));
+	aco_option_register_custom(&cfg_info, "timezone", ACO_EXACT, device_types, NULL, interned_str_handler, offsetof(struct sccp_device_cfg, timezone));
 	aco_option_register_custom(&cfg_info, "line", ACO_EXACT, device_types, NULL, device_cfg_line_handler, 0);
 	aco_option_register_custom(&cfg_info, "speeddial", ACO_EXACT, device_types, NULL, device_cfg_speeddial_handler, 0);
 
@@ -766,9 +1789,9 @@ int sccp_config_init(void)
 	aco_option_register(&cfg_info, "cid_name", ACO_EXACT, line_types, NULL, OPT_CHAR_ARRAY_T, 0, CHARFLDSET(struct sccp_line_cfg, cid_name));
 	aco_option_register(&cfg_info, "cid_num", ACO_EXACT, line_types, NULL, OPT_CHAR_ARRAY_T, 0, CHARFLDSET(struct sccp_line_cfg, cid_num));
 	aco_option_register_custom(&cfg_info, "setvar", ACO_EXACT, line_types, NULL, line_cfg_setvar_handler, 0);
-	aco_option_register(&cfg_info, "context", ACO_EXACT, line_types, "default", OPT_CHAR_ARRAY_T, 0, CHARFLDSET(struct sccp_line_cfg, context));
-	aco_option_register(&cfg_info, "language", ACO_EXACT, line_types, "en_US", OPT_CHAR_ARRAY_T, 0, CHARFLDSET(struct sccp_line_cfg, language));
-	aco_option_register(&cfg_info, "accountcode", ACO_EXACT, line_types, NULL, OPT_CHAR_ARRAY_T, 0, CHARFLDSET(struct sccp_line_cfg, accountcode));
+	aco_option_register_custom(&cfg_info, "context", ACO_EXACT, line_types, "default", interned_str_handler, offsetof(struct sccp_line_cfg, context));
+	aco_option_register_custom(&cfg_info, "language", ACO_EXACT, line_types, "en_US", interned_str_handler, offsetof(struct sccp_line_cfg, language));
+	aco_option_register_custom(&cfg_info, "accountcode", ACO_EXACT, line_types, NULL, interned_str_handler, offsetof(struct sccp_line_cfg, accountcode));
 	aco_option_register(&cfg_info, "directmedia", ACO_EXACT, line_types, "no", OPT_BOOL_T, 1, FLDSET(struct sccp_line_cfg, directmedia));
 	aco_option_register_custom(&cfg_info, "tos_audio", ACO_EXACT, line_types, "EF", line_cfg_tos_audio_handler, 0);
 	aco_option_register(&cfg_info, "disallow", ACO_EXACT, line_types, NULL, OPT_CODEC_T, 0, FLDSET(struct sccp_line_cfg, caps));
@@ -785,59 +1808,1113 @@ int sccp_config_init(void)
 	aco_option_register(&cfg_info, "blf", ACO_EXACT, speeddial_types, "no", OPT_BOOL_T, 1, FLDSET(struct sccp_speeddial_cfg, blf));
 
 	return 0;
-}
 
-static int sccp_config_load_internal(int reload)
-{
-	if (aco_process_config(&cfg_info, reload) == ACO_PROCESS_ERROR) {
-		return -1;
+fail:
+	if (realtime_cache) {
+		sccp_lru_cache_destroy(realtime_cache);
+		realtime_cache = NULL;
 	}
 
-	return 0;
-}
+	ao2_ref(intern_pool, -1);
+	intern_pool = NULL;
 
-int sccp_config_load(void)
-{
-	return sccp_config_load_internal(0);
+	return -1;
 }
 
-int sccp_config_reload(void)
-{
-	return sccp_config_load_internal(1);
-}
+/*
+ * Config cache image payload.
+ *
+ * All the offsets are relative to the start of the payload, which starts with the
+ * image_root. Lines are stored with the device they are associated to, and a device
+ * references its speeddials by name.
+ */
+#define IMAGE_ALIGN 8
+
+struct image_general {
+	int32_t authtimeout;
+	uint32_t max_guests;
+	uint32_t tos;
+	int32_t realtime;
+	uint32_t realtime_cache_size;
+	int32_t realtime_cache_ttl;
+	uint32_t rtp_pool_size;
+	uint32_t padding;
+};
 
-void sccp_config_destroy(void)
-{
-	aco_info_destroy(&cfg_info);
-	ao2_global_obj_release(global_cfg);
-}
+struct image_format {
+	uint32_t name;
+	uint32_t framing;
+};
 
-struct sccp_cfg *sccp_config_get(void)
-{
-	return ao2_global_obj_ref(global_cfg);
-}
+struct image_chanvar {
+	uint32_t name;
+	uint32_t value;
+};
 
-struct sccp_device_cfg *sccp_cfg_find_device(struct sccp_cfg *cfg, const char *name)
-{
-	return ao2_find(cfg->devices_cfg, name, OBJ_SEARCH_KEY);
-}
+struct image_line {
+	uint32_t name;
+	uint32_t cid_num;
+	uint32_t cid_name;
+	uint32_t language;
+	uint32_t context;
+	uint32_t accountcode;
+	int32_t directmedia;
+	uint32_t tos_audio;
+	uint64_t callgroups;
+	uint64_t pickupgroups;
+	/* 0 if there is no named groups */
+	uint32_t named_callgroups;
+	uint32_t named_pickupgroups;
+	uint32_t formats;
+	uint32_t format_count;
+	uint32_t chanvars;
+	uint32_t chanvar_count;
+};
 
-struct sccp_device_cfg *sccp_cfg_find_device_or_guest(struct sccp_cfg *cfg, const char *name)
+struct image_device {
+	uint32_t name;
+	uint32_t dateformat;
+	uint32_t voicemail;
+	uint32_t vmexten;
+	uint32_t timezone;
+	int32_t keepalive;
+	int32_t dialtimeout;
+	int32_t guest;
+	uint32_t speeddials;
+	uint32_t speeddial_count;
+	struct image_line line;
+};
+
+struct image_speeddial {
+	uint32_t name;
+	uint32_t label;
+	uint32_t extension;
+	int32_t blf;
+};
+
+struct image_root {
+	struct image_general general;
+	uint32_t devices;
+	uint32_t device_count;
+	uint32_t speeddials;
+	uint32_t speeddial_count;
+};
+
+struct image_buf {
+	char *data;
+	size_t len;
+	size_t cap;
+	int error;
+};
+
+/*
+ * Reserve len zeroed bytes at the end of the buffer and return their offset.
+ *
+ * On failure, the error flag of the buffer is set and 0 is returned, so that the
+ * callers only need to check the flag once the image is built.
+ */
+static uint32_t image_buf_reserve(struct image_buf *buf, size_t len)
 {
-	struct sccp_device_cfg *device_cfg;
+	size_t offset = (buf->len + IMAGE_ALIGN - 1) & ~((size_t) IMAGE_ALIGN - 1);
+	size_t cap;
+	char *data;
 
-	device_cfg = sccp_cfg_find_device(cfg, name);
-	if (device_cfg) {
-		return device_cfg;
+	if (buf->error) {
+		return 0;
 	}
 
-	device_cfg = cfg->general_cfg->guest_device_cfg;
-	if (device_cfg) {
-		ao2_ref(device_cfg, +1);
-		return device_cfg;
+	if (offset + len > UINT32_MAX) {
+		buf->error = 1;
+		return 0;
 	}
 
-	return NULL;
+	if (offset + len > buf->cap) {
+		cap = MAX(buf->cap * 2, offset + len);
+		data = ast_realloc(buf->data, cap);
+		if (!data) {
+			buf->error = 1;
+			return 0;
+		}
+
+		buf->data = data;
+		buf->cap = cap;
+	}
+
+	memset(buf->data + buf->len, 0, offset + len - buf->len);
+	buf->len = offset + len;
+
+	return offset;
+}
+
+static uint32_t image_buf_add_str(struct image_buf *buf, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	uint32_t offset;
+
+	offset = image_buf_reserve(buf, len);
+	if (!buf->error) {
+		memcpy(buf->data + offset, str, len);
+	}
+
+	return offset;
+}
+
+static void image_buf_set(struct image_buf *buf, uint32_t offset, const void *data, size_t len)
+{
+	if (!buf->error) {
+		memcpy(buf->data + offset, data, len);
+	}
+}
+
+static uint32_t image_add_namedgroups(struct image_buf *buf, struct ast_namedgroups *groups)
+{
+	struct ast_str *str;
+
+	if (!groups) {
+		return 0;
+	}
+
+	str = ast_str_alloca(1024);
+
+	return image_buf_add_str(buf, ast_print_namedgroups(&str, groups));
+}
+
+static void image_add_line(struct image_buf *buf, struct sccp_line_cfg *line_cfg, struct image_line *img_line)
+{
+	struct image_format img_format;
+	struct image_chanvar img_chanvar;
+	struct ast_format *format;
+	struct ast_variable *var;
+	size_t i;
+
+	img_line->name = image_buf_add_str(buf, line_cfg->name);
+	img_line->cid_num = image_buf_add_str(buf, line_cfg->cid_num);
+	img_line->cid_name = image_buf_add_str(buf, line_cfg->cid_name);
+	img_line->language = image_buf_add_str(buf, line_cfg->language);
+	img_line->context = image_buf_add_str(buf, line_cfg->context);
+	img_line->accountcode = image_buf_add_str(buf, line_cfg->accountcode);
+	img_line->directmedia = line_cfg->directmedia;
+	img_line->tos_audio = line_cfg->tos_audio;
+	img_line->callgroups = line_cfg->callgroups;
+	img_line->pickupgroups = line_cfg->pickupgroups;
+	img_line->named_callgroups = image_add_namedgroups(buf, line_cfg->named_callgroups);
+	img_line->named_pickupgroups = image_add_namedgroups(buf, line_cfg->named_pickupgroups);
+
+	img_line->format_count = ast_format_cap_count(line_cfg->caps);
+	img_line->formats = image_buf_reserve(buf, img_line->format_count * sizeof(img_format));
+	for (i = 0; i < img_line->format_count; i++) {
+		format = ast_format_cap_get_format(line_cfg->caps, i);
+		img_format.name = image_buf_add_str(buf, ast_format_get_name(format));
+		img_format.framing = ast_format_cap_get_format_framing(line_cfg->caps, format);
+		image_buf_set(buf, img_line->formats + i * sizeof(img_format), &img_format, sizeof(img_format));
+		ao2_ref(format, -1);
+	}
+
+	img_line->chanvar_count = 0;
+	for (var = line_cfg->chanvars; var; var = var->next) {
+		img_line->chanvar_count++;
+	}
+
+	img_line->chanvars = image_buf_reserve(buf, img_line->chanvar_count * sizeof(img_chanvar));
+	for (i = 0, var = line_cfg->chanvars; var; i++, var = var->next) {
+		img_chanvar.name = image_buf_add_str(buf, var->name);
+		img_chanvar.value = image_buf_add_str(buf, var->value);
+		image_buf_set(buf, img_line->chanvars + i * sizeof(img_chanvar), &img_chanvar, sizeof(img_chanvar));
+	}
+}
+
+static void image_add_device(struct image_buf *buf, uint32_t offset, struct sccp_device_cfg *device_cfg)
+{
+	struct image_device img_device;
+	uint32_t name;
+	size_t i;
+
+	memset(&img_device, 0, sizeof(img_device));
+	img_device.name = image_buf_add_str(buf, device_cfg->name);
+	img_device.dateformat = image_buf_add_str(buf, device_cfg->dateformat);
+	img_device.voicemail = image_buf_add_str(buf, device_cfg->voicemail);
+	img_device.vmexten = image_buf_add_str(buf, device_cfg->vmexten);
+	img_device.timezone = image_buf_add_str(buf, device_cfg->timezone);
+	img_device.keepalive = device_cfg->keepalive;
+	img_device.dialtimeout = device_cfg->dialtimeout;
+	img_device.guest = device_cfg->guest;
+	img_device.speeddial_count = device_cfg->speeddial_count;
+	img_device.speeddials = image_buf_reserve(buf, device_cfg->speeddial_count * sizeof(name));
+	for (i = 0; i < device_cfg->speeddial_count; i++) {
+		name = image_buf_add_str(buf, device_cfg->speeddials_cfg[i]->name);
+		image_buf_set(buf, img_device.speeddials + i * sizeof(name), &name, sizeof(name));
+	}
+
+	image_add_line(buf, device_cfg->line_cfg, &img_device.line);
+
+	image_buf_set(buf, offset, &img_device, sizeof(img_device));
+}
+
+/*
+ * Serialize a validated config. The returned buffer must be freed with ast_free.
+ */
+static char *image_build(struct sccp_cfg *cfg, size_t *len)
+{
+	struct image_buf buf = { NULL, 0, 0, 0 };
+	struct image_root root;
+	struct image_speeddial img_speeddial;
+	struct sccp_device_cfg *device_cfg;
+	struct sccp_speeddial_cfg *speeddial_cfg;
+	struct ao2_iterator iter;
+	size_t i;
+
+	memset(&root, 0, sizeof(root));
+	image_buf_reserve(&buf, sizeof(root));
+
+	root.general.authtimeout = cfg->general_cfg->authtimeout;
+	root.general.max_guests = cfg->general_cfg->max_guests;
+	root.general.tos = cfg->general_cfg->tos;
+	root.general.realtime = cfg->general_cfg->realtime;
+	root.general.realtime_cache_size = cfg->general_cfg->realtime_cache_size;
+	root.general.realtime_cache_ttl = cfg->general_cfg->realtime_cache_ttl;
+	root.general.rtp_pool_size = cfg->general_cfg->rtp_pool_size;
+
+	root.device_count = ao2_container_count(cfg->devices_cfg) + (cfg->general_cfg->guest_device_cfg ? 1 : 0);
+	root.devices = image_buf_reserve(&buf, root.device_count * sizeof(struct image_device));
+	i = 0;
+	iter = ao2_iterator_init(cfg->devices_cfg, 0);
+	while ((device_cfg = ao2_iterator_next(&iter))) {
+		if (i < root.device_count) {
+			image_add_device(&buf, root.devices + i++ * sizeof(struct image_device), device_cfg);
+		}
+
+		ao2_ref(device_cfg, -1);
+	}
+	ao2_iterator_destroy(&iter);
+
+	if (cfg->general_cfg->guest_device_cfg && i < root.device_count) {
+		image_add_device(&buf, root.devices + i++ * sizeof(struct image_device), cfg->general_cfg->guest_device_cfg);
+	}
+
+	root.device_count = i;
+
+	root.speeddial_count = ao2_container_count(cfg->speeddials_cfg);
+	root.speeddials = image_buf_reserve(&buf, root.speeddial_count * sizeof(img_speeddial));
+	i = 0;
+	iter = ao2_iterator_init(cfg->speeddials_cfg, 0);
+	while ((speeddial_cfg = ao2_iterator_next(&iter))) {
+		if (i < root.speeddial_count) {
+			img_speeddial.name = image_buf_add_str(&buf, speeddial_cfg->name);
+			img_speeddial.label = image_buf_add_str(&buf, speeddial_cfg->label);
+			img_speeddial.extension = image_buf_add_str(&buf, speeddial_cfg->extension);
+			img_speeddial.blf = speeddial_cfg->blf;
+			image_buf_set(&buf, root.speeddials + i++ * sizeof(img_speeddial), &img_speeddial, sizeof(img_speeddial));
+		}
+
+		ao2_ref(speeddial_cfg, -1);
+	}
+	ao2_iterator_destroy(&iter);
+
+	root.speeddial_count = i;
+
+	image_buf_set(&buf, 0, &root, sizeof(root));
+
+	if (buf.error) {
+		ast_free(buf.data);
+		return NULL;
+	}
+
+	*len = buf.len;
+
+	return buf.data;
+}
+
+static int image_copy_str(const struct sccp_cfg_cache_image *image, uint32_t offset, char *dst, size_t size)
+{
+	const char *str = sccp_cfg_cache_str(image, offset);
+
+	if (!str) {
+		return -1;
+	}
+
+	ast_copy_string(dst, str, size);
+
+	return 0;
+}
+
+static int image_intern_str(const struct sccp_cfg_cache_image *image, uint32_t offset, const char **field)
+{
+	const char *str = sccp_cfg_cache_str(image, offset);
+
+	if (!str) {
+		return -1;
+	}
+
+	return set_interned_str(field, str);
+}
+
+static int image_read_namedgroups(const struct sccp_cfg_cache_image *image, uint32_t offset, struct ast_namedgroups **groups)
+{
+	const char *str;
+
+	if (!offset) {
+		return 0;
+	}
+
+	str = sccp_cfg_cache_str(image, offset);
+	if (!str) {
+		return -1;
+	}
+
+	*groups = ast_get_namedgroups(str);
+
+	return 0;
+}
+
+static struct sccp_line_cfg *image_read_line(const struct sccp_cfg_cache_image *image, const struct image_line *img_line)
+{
+	const struct image_format *img_formats;
+	const struct image_chanvar *img_chanvars;
+	struct sccp_line_cfg *line_cfg;
+	struct ast_variable *var;
+	struct ast_variable **tail;
+	struct ast_format *format;
+	const char *name;
+	const char *value;
+	uint32_t i;
+
+	name = sccp_cfg_cache_str(image, img_line->name);
+	if (!name) {
+		return NULL;
+	}
+
+	line_cfg = sccp_line_cfg_alloc(name);
+	if (!line_cfg) {
+		return NULL;
+	}
+
+	sccp_line_cfg_free_internal(line_cfg);
+
+	if (image_copy_str(image, img_line->cid_num, line_cfg->cid_num, sizeof(line_cfg->cid_num)) ||
+			image_copy_str(image, img_line->cid_name, line_cfg->cid_name, sizeof(line_cfg->cid_name)) ||
+			image_intern_str(image, img_line->language, &line_cfg->language) ||
+			image_intern_str(image, img_line->context, &line_cfg->context) ||
+			image_intern_str(image, img_line->accountcode, &line_cfg->accountcode) ||
+			image_read_namedgroups(image, img_line->named_callgroups, &line_cfg->named_callgroups) ||
+			image_read_namedgroups(image, img_line->named_pickupgroups, &line_cfg->named_pickupgroups)) {
+		goto fail;
+	}
+
+	line_cfg->directmedia = img_line->directmedia;
+	line_cfg->tos_audio = img_line->tos_audio;
+	line_cfg->callgroups = img_line->callgroups;
+	line_cfg->pickupgroups = img_line->pickupgroups;
+
+	img_formats = sccp_cfg_cache_array(image, img_line->formats, img_line->format_count, sizeof(*img_formats));
+	if (!img_formats) {
+		goto fail;
+	}
+
+	for (i = 0; i < img_line->format_count; i++) {
+		name = sccp_cfg_cache_str(image, img_formats[i].name);
+		format = name ? ast_format_cache_get(name) : NULL;
+		if (!format) {
+			goto fail;
+		}
+
+		ast_format_cap_append(line_cfg->caps, format, img_formats[i].framing);
+		ao2_ref(format, -1);
+	}
+
+	img_chanvars = sccp_cfg_cache_array(image, img_line->chanvars, img_line->chanvar_count, sizeof(*img_chanvars));
+	if (!img_chanvars) {
+		goto fail;
+	}
+
+	/* keep the order of the variables, so that the content hash is the same */
+	tail = &line_cfg->chanvars;
+	for (i = 0; i < img_line->chanvar_count; i++) {
+		name = sccp_cfg_cache_str(image, img_chanvars[i].name);
+		value = sccp_cfg_cache_str(image, img_chanvars[i].value);
+		if (!name || !value) {
+			goto fail;
+		}
+
+		var = ast_variable_new(name, value, "");
+		if (!var) {
+			goto fail;
+		}
+
+		*tail = var;
+		tail = &var->next;
+	}
+
+	return line_cfg;
+
+fail:
+	ao2_ref(line_cfg, -1);
+
+	return NULL;
+}
+
+static struct sccp_device_cfg *image_read_device(const struct sccp_cfg_cache_image *image, const struct image_device *img_device, struct sccp_cfg *cfg)
+{
+	struct sccp_device_cfg *device_cfg;
+	const uint32_t *speeddials;
+	const char *name;
+	uint32_t i;
+
+	name = sccp_cfg_cache_str(image, img_device->name);
+	if (!name) {
+		return NULL;
+	}
+
+	device_cfg = sccp_device_cfg_alloc(name);
+	if (!device_cfg) {
+		return NULL;
+	}
+
+	sccp_device_cfg_free_internal(device_cfg);
+
+	if (image_copy_str(image, img_device->dateformat, device_cfg->dateformat, sizeof(device_cfg->dateformat)) ||
+			image_copy_str(image, img_device->voicemail, device_cfg->voicemail, sizeof(device_cfg->voicemail)) ||
+			image_intern_str(image, img_device->vmexten, &device_cfg->vmexten) ||
+			image_intern_str(image, img_device->timezone, &device_cfg->timezone)) {
+		goto fail;
+	}
+
+	device_cfg->keepalive = img_device->keepalive;
+	device_cfg->dialtimeout = img_device->dialtimeout;
+	device_cfg->guest = img_device->guest;
+
+	device_cfg->line_cfg = image_read_line(image, &img_device->line);
+	if (!device_cfg->line_cfg) {
+		goto fail;
+	}
+
+	speeddials = sccp_cfg_cache_array(image, img_device->speeddials, img_device->speeddial_count, sizeof(*speeddials));
+	if (!speeddials) {
+		goto fail;
+	}
+
+	if (img_device->speeddial_count) {
+		device_cfg->speeddials_cfg = ast_calloc(img_device->speeddial_count, sizeof(*device_cfg->speeddials_cfg));
+		if (!device_cfg->speeddials_cfg) {
+			goto fail;
+		}
+
+		for (i = 0; i < img_device->speeddial_count; i++) {
+			name = sccp_cfg_cache_str(image, speeddials[i]);
+			device_cfg->speeddials_cfg[i] = name ? sccp_cfg_find_speeddial(cfg, name) : NULL;
+			if (!device_cfg->speeddials_cfg[i]) {
+				goto fail;
+			}
+
+			device_cfg->speeddial_count++;
+		}
+	}
+
+	device_cfg->hash = hash_device_cfg(device_cfg);
+
+	return device_cfg;
+
+fail:
+	ao2_ref(device_cfg, -1);
+
+	return NULL;
+}
+
+static int image_read_speeddials(const struct sccp_cfg_cache_image *image, const struct image_root *root, struct sccp_cfg *cfg)
+{
+	const struct image_speeddial *img_speeddials;
+	struct sccp_speeddial_cfg *speeddial_cfg;
+	const char *name;
+	uint32_t i;
+
+	img_speeddials = sccp_cfg_cache_array(image, root->speeddials, root->speeddial_count, sizeof(*img_speeddials));
+	if (!img_speeddials) {
+		return -1;
+	}
+
+	for (i = 0; i < root->speeddial_count; i++) {
+		name = sccp_cfg_cache_str(image, img_speeddials[i].name);
+		speeddial_cfg = name ? sccp_speeddial_cfg_alloc(name) : NULL;
+		if (!speeddial_cfg) {
+			return -1;
+		}
+
+		if (image_copy_str(image, img_speeddials[i].label, speeddial_cfg->label, sizeof(speeddial_cfg->label)) ||
+				image_copy_str(image, img_speeddials[i].extension, speeddial_cfg->extension, sizeof(speeddial_cfg->extension))) {
+			ao2_ref(speeddial_cfg, -1);
+			return -1;
+		}
+
+		speeddial_cfg->blf = img_speeddials[i].blf;
+		ao2_link(cfg->speeddials_cfg, speeddial_cfg);
+		ao2_ref(speeddial_cfg, -1);
+	}
+
+	return 0;
+}
+
+static int image_read_devices(const struct sccp_cfg_cache_image *image, const struct image_root *root, struct sccp_cfg *cfg)
+{
+	const struct image_device *img_devices;
+	struct sccp_device_cfg *device_cfg;
+	struct ao2_container *caps_pool;
+	uint32_t i;
+
+	img_devices = sccp_cfg_cache_array(image, root->devices, root->device_count, sizeof(*img_devices));
+	if (!img_devices) {
+		return -1;
+	}
+
+	caps_pool = caps_pool_alloc();
+	for (i = 0; i < root->device_count; i++) {
+		device_cfg = image_read_device(image, &img_devices[i], cfg);
+		if (!device_cfg) {
+			ao2_cleanup(caps_pool);
+			return -1;
+		}
+
+		share_caps(caps_pool, &device_cfg->line_cfg->caps);
+		if (device_cfg->guest) {
+			ao2_cleanup(cfg->general_cfg->guest_device_cfg);
+			cfg->general_cfg->guest_device_cfg = device_cfg;
+		} else {
+			ao2_link(cfg->devices_cfg, device_cfg);
+			ao2_link(cfg->lines_cfg, device_cfg->line_cfg);
+			ao2_ref(device_cfg, -1);
+		}
+	}
+
+	ao2_cleanup(caps_pool);
+
+	return 0;
+}
+
+/*
+ * Build a config from an image. The image has been written from a validated config,
+ * so the config doesn't need to be validated again.
+ */
+static struct sccp_cfg *image_read(const struct sccp_cfg_cache_image *image)
+{
+	const struct image_root *root;
+	struct sccp_cfg *cfg;
+
+	root = sccp_cfg_cache_array(image, 0, 1, sizeof(*root));
+	if (!root) {
+		return NULL;
+	}
+
+	size_hint.devices = root->device_count;
+	size_hint.lines = root->device_count;
+	size_hint.speeddials = root->speeddial_count;
+
+	cfg = sccp_cfg_alloc();
+	if (!cfg) {
+		return NULL;
+	}
+
+	cfg->general_cfg->authtimeout = root->general.authtimeout;
+	cfg->general_cfg->max_guests = root->general.max_guests;
+	cfg->general_cfg->tos = root->general.tos;
+	cfg->general_cfg->realtime = root->general.realtime;
+	cfg->general_cfg->realtime_cache_size = root->general.realtime_cache_size;
+	cfg->general_cfg->realtime_cache_ttl = root->general.realtime_cache_ttl;
+	cfg->general_cfg->rtp_pool_size = root->general.rtp_pool_size;
+	sccp_general_cfg_free_internal(cfg->general_cfg);
+
+	if (image_read_speeddials(image, root, cfg) || image_read_devices(image, root, cfg)) {
+		ao2_ref(cfg, -1);
+		return NULL;
+	}
+
+	compute_changes(cfg, NULL);
+	compute_sharing(cfg);
+
+	return cfg;
+}
+
+struct cfg_cache_state {
+	int loaded;
+	int load_time;
+	int write_time;
+	unsigned int writes;
+	unsigned int write_failures;
+};
+
+static struct cfg_cache_state cache_state;
+
+static void cfg_source_path(char *buf, size_t size)
+{
+	snprintf(buf, size, "%s/%s", ast_config_AST_CONFIG_DIR, sccp_conf.filename);
+}
+
+static void cfg_cache_path(char *buf, size_t size)
+{
+	snprintf(buf, size, "%s/%s.cache", ast_config_AST_CACHE_DIR, sccp_conf.filename);
+}
+
+static void cfg_cache_write(const struct sccp_cfg_cache_fingerprint *fingerprint)
+{
+	char path[PATH_MAX];
+	struct sccp_cfg *cfg;
+	struct timeval start = ast_tvnow();
+	char *payload;
+	size_t len;
+
+	cfg = ao2_global_obj_ref(global_cfg);
+	if (!cfg) {
+		return;
+	}
+
+	payload = image_build(cfg, &len);
+	ao2_ref(cfg, -1);
+
+	cfg_cache_path(path, sizeof(path));
+	if (!payload || sccp_cfg_cache_write(path, fingerprint, payload, len)) {
+		cache_state.write_failures++;
+	} else {
+		cache_state.writes++;
+	}
+
+	ast_free(payload);
+	cache_state.write_time = ast_tvdiff_us(ast_tvnow(), start);
+}
+
+/*
+ * Load the config from the cache, without going through the config framework.
+ */
+static int cfg_cache_load(const struct sccp_cfg_cache_fingerprint *fingerprint)
+{
+	struct sccp_cfg_cache_image image;
+	char path[PATH_MAX];
+	struct sccp_cfg *cfg;
+
+	cfg_cache_path(path, sizeof(path));
+	if (sccp_cfg_cache_open(path, fingerprint, &image)) {
+		return -1;
+	}
+
+	cfg = image_read(&image);
+	sccp_cfg_cache_close(&image);
+	if (!cfg) {
+		ast_log(LOG_WARNING, "could not load the config from cache %s, loading %s\n", path, sccp_conf.filename);
+		return -1;
+	}
+
+	ao2_global_obj_replace_unref(global_cfg, cfg);
+	apply_realtime_cfg(cfg);
+	publish_cfg(cfg);
+	ao2_ref(cfg, -1);
+
+	return 0;
+}
+
+static int sccp_config_load_internal(int reload)
+{
+	struct sccp_cfg_cache_fingerprint fingerprint;
+	char path[PATH_MAX];
+	int cacheable;
+	int ret;
+
+	/* take the fingerprint before parsing, so that a concurrent change of the file
+	 * leaves a stale cache instead of a cache not matching the file content
+	 */
+	cfg_source_path(path, sizeof(path));
+	cacheable = !sccp_cfg_cache_fingerprint(path, &fingerprint);
+
+	ret = aco_process_config(&cfg_info, reload);
+
+	/* release the interned strings that are not referenced anymore */
+	intern_pool_prune();
+
+	switch (ret) {
+	case ACO_PROCESS_ERROR:
+		return -1;
+	case ACO_PROCESS_UNCHANGED:
+		return SCCP_CONFIG_UNCHANGED;
+	default:
+		break;
+	}
+
+	if (cacheable) {
+		cfg_cache_write(&fingerprint);
+	}
+
+	return 0;
+}
+
+int sccp_config_load(void)
+{
+	struct sccp_cfg_cache_fingerprint fingerprint;
+	char path[PATH_MAX];
+	struct timeval start = ast_tvnow();
+	size_t sections;
+	int ret;
+
+	cfg_source_path(path, sizeof(path));
+	if (!sccp_cfg_cache_fingerprint(path, &fingerprint) && !cfg_cache_load(&fingerprint)) {
+		cache_state.loaded = 1;
+		cache_state.load_time = ast_tvdiff_us(ast_tvnow(), start);
+		ast_verb(2, "SCCP config loaded from cache in %d ms\n", cache_state.load_time / 1000);
+		return 0;
+	}
+
+	sections = count_cfg_sections(sccp_conf.filename);
+	size_hint.devices = sections;
+	size_hint.lines = sections;
+	size_hint.speeddials = sections;
+
+	ret = sccp_config_load_internal(0);
+	cache_state.loaded = 0;
+	cache_state.load_time = ast_tvdiff_us(ast_tvnow(), start);
+
+	return ret;
+}
+
+void sccp_config_cache_get_status(struct sccp_config_cache_status *status)
+{
+	struct sccp_cfg_cache_fingerprint fingerprint;
+	struct sccp_cfg_cache_image image;
+	char path[PATH_MAX];
+	struct stat st;
+
+	cfg_cache_path(status->path, sizeof(status->path));
+	status->loaded = cache_state.loaded;
+	status->load_time = cache_state.load_time;
+	status->write_time = cache_state.write_time;
+	status->writes = cache_state.writes;
+	status->write_failures = cache_state.write_failures;
+	status->size = stat(status->path, &st) ? 0 : st.st_size;
+
+	cfg_source_path(path, sizeof(path));
+	status->cacheable = !sccp_cfg_cache_fingerprint(path, &fingerprint);
+	status->valid = status->cacheable && !sccp_cfg_cache_open(status->path, &fingerprint, &image);
+	if (status->valid) {
+		sccp_cfg_cache_close(&image);
+	}
+}
+
+int sccp_config_reload(void)
+{
+	return sccp_config_load_internal(1);
+}
+
+void sccp_config_destroy(void)
+{
+	aco_info_destroy(&cfg_info);
+	ao2_global_obj_release(global_cfg);
+
+	/* publishing twice empties both slots */
+	publish_cfg(NULL);
+	publish_cfg(NULL);
+
+	sccp_lru_cache_destroy(realtime_cache);
+	realtime_cache = NULL;
+
+	ao2_cleanup(intern_pool);
+	intern_pool = NULL;
+}
+
+struct sccp_cfg *sccp_config_get(void)
+{
+	struct sccp_config_reader reader;
+	struct sccp_cfg *cfg;
+
+	cfg = sccp_config_read_begin(&reader);
+	if (cfg) {
+		ao2_ref(cfg, +1);
+	}
+	sccp_config_read_end(&reader);
+
+	return cfg;
+}
+
+struct sccp_cfg *sccp_config_read_begin(struct sccp_config_reader *reader)
+{
+	struct cfg_slot *slot;
+	unsigned int current;
+
+	for (;;) {
+		current = __atomic_load_n(&cfg_slot_current, __ATOMIC_SEQ_CST);
+		slot = &cfg_slots[current];
+		__atomic_add_fetch(&slot->readers, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&cfg_slot_current, __ATOMIC_SEQ_CST) == current) {
+			break;
+		}
+
+		/* a new config has been published in the meantime */
+		__atomic_sub_fetch(&slot->readers, 1, __ATOMIC_RELEASE);
+	}
+
+	reader->slot = current;
+
+	return __atomic_load_n(&slot->cfg, __ATOMIC_ACQUIRE);
+}
+
+void sccp_config_read_end(struct sccp_config_reader *reader)
+{
+	__atomic_sub_fetch(&cfg_slots[reader->slot].readers, 1, __ATOMIC_RELEASE);
+}
+
+struct sccp_device_cfg *sccp_cfg_find_device(struct sccp_cfg *cfg, const char *name)
+{
+	return ao2_find(cfg->devices_cfg, name, OBJ_SEARCH_KEY);
+}
+
+/*
+ * Realtime columns that can hold many values, separated by ';'.
+ */
+static const char * const realtime_multi_columns[] = { "speeddial", "setvar", NULL };
+
+static int is_realtime_multi_column(const char *name)
+{
+	size_t i;
+
+	for (i = 0; realtime_multi_columns[i]; i++) {
+		if (!strcasecmp(name, realtime_multi_columns[i])) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int apply_realtime_var(struct aco_type *type, const char *category, struct ast_variable *var, void *obj)
+{
+	struct ast_variable tmp_var = *var;
+	char *values;
+	char *value;
+
+	if (!is_realtime_multi_column(var->name)) {
+		return aco_process_var(type, category, var, obj);
+	}
+
+	values = ast_strdupa(var->value);
+	while ((value = strsep(&values, ";"))) {
+		value = ast_strip(value);
+		if (ast_strlen_zero(value)) {
+			continue;
+		}
+
+		tmp_var.value = value;
+		tmp_var.next = NULL;
+		if (aco_process_var(type, category, &tmp_var, obj)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int apply_realtime_vars(struct aco_type *type, const char *category, struct ast_variable *vars, void *obj)
+{
+	struct ast_variable *var;
+
+	if (aco_set_defaults(type, category, obj)) {
+		return -1;
+	}
+
+	for (var = vars; var; var = var->next) {
+		/* skip the key column and the empty columns */
+		if (!strcasecmp(var->name, "name") || ast_strlen_zero(var->value)) {
+			continue;
+		}
+
+		if (apply_realtime_var(type, category, var, obj)) {
+			ast_log(LOG_ERROR, "invalid realtime %s %s: invalid value for %s\n", type->name, category, var->name);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static struct sccp_line_cfg *realtime_load_line_cfg(struct sccp_cfg *cfg, const char *name)
+{
+	struct sccp_line_cfg *line_cfg;
+	struct ast_variable *vars;
+
+	/* a line of the configuration file is associated to a device of the file */
+	line_cfg = sccp_cfg_find_line(cfg, name);
+	if (line_cfg) {
+		ast_log(LOG_ERROR, "invalid realtime line %s: already defined in %s\n", name, sccp_conf.filename);
+		ao2_ref(line_cfg, -1);
+		return NULL;
+	}
+
+	vars = ast_load_realtime(REALTIME_LINES_FAMILY, "name", name, SENTINEL);
+	if (!vars) {
+		ast_log(LOG_ERROR, "invalid realtime device: unknown line %s\n", name);
+		return NULL;
+	}
+
+	line_cfg = sccp_line_cfg_alloc(name);
+	if (line_cfg && apply_realtime_vars(&line_type, name, vars, line_cfg)) {
+		ao2_ref(line_cfg, -1);
+		line_cfg = NULL;
+	}
+
+	ast_variables_destroy(vars);
+
+	if (line_cfg) {
+		sccp_line_cfg_free_internal(line_cfg);
+	}
+
+	return line_cfg;
+}
+
+static struct sccp_device_cfg *realtime_load_device_cfg(struct sccp_cfg *cfg, const char *name)
+{
+	struct sccp_device_cfg *device_cfg;
+	struct ast_variable *vars;
+
+	vars = ast_load_realtime(REALTIME_DEVICES_FAMILY, "name", name, SENTINEL);
+	if (!vars) {
+		return NULL;
+	}
+
+	device_cfg = sccp_device_cfg_alloc(name);
+	if (!device_cfg) {
+		ast_variables_destroy(vars);
+		return NULL;
+	}
+
+	if (apply_realtime_vars(&device_type, name, vars, device_cfg)) {
+		goto fail;
+	}
+
+	if (ast_strlen_zero(device_cfg->internal->line_name)) {
+		ast_log(LOG_ERROR, "invalid realtime device %s: no line associated\n", name);
+		goto fail;
+	}
+
+	device_cfg->line_cfg = realtime_load_line_cfg(cfg, device_cfg->internal->line_name);
+	if (!device_cfg->line_cfg) {
+		goto fail;
+	}
+
+	/* speeddials are taken from the configuration file */
+	if (sccp_device_cfg_build_speeddials(device_cfg, cfg, NULL)) {
+		goto fail;
+	}
+
+	sccp_device_cfg_norm_voicemail(device_cfg);
+	sccp_device_cfg_free_internal(device_cfg);
+	device_cfg->hash = hash_device_cfg(device_cfg);
+
+	ast_variables_destroy(vars);
+
+	return device_cfg;
+
+fail:
+	ast_variables_destroy(vars);
+	ao2_ref(device_cfg, -1);
+
+	return NULL;
+}
+
+static void realtime_stats_add_lookup(int found, int lookup_time)
+{
+	ast_mutex_lock(&realtime_stats_lock);
+	realtime_stats.lookups++;
+	if (found) {
+		realtime_stats.lookups_found++;
+	}
+
+	realtime_stats.lookup_time_total += lookup_time;
+	if (lookup_time > realtime_stats.lookup_time_max) {
+		realtime_stats.lookup_time_max = lookup_time;
+	}
+	ast_mutex_unlock(&realtime_stats_lock);
+}
+
+static struct sccp_device_cfg *realtime_lookup_device_cfg(struct sccp_cfg *cfg, const char *name)
+{
+	struct sccp_device_cfg *device_cfg;
+	struct timeval start;
+
+	/* concurrent lookups of the same device are not merged; the last one is cached */
+	start = ast_tvnow();
+	device_cfg = realtime_load_device_cfg(cfg, name);
+	realtime_stats_add_lookup(device_cfg != NULL, ast_tvdiff_us(ast_tvnow(), start));
+
+	if (device_cfg) {
+		sccp_lru_cache_put(realtime_cache, name, device_cfg);
+	}
+
+	return device_cfg;
+}
+
+void sccp_config_realtime_take_stats(struct sccp_config_realtime_stats *stats)
+{
+	sccp_lru_cache_take_stats(realtime_cache, &stats->cache);
+
+	ast_mutex_lock(&realtime_stats_lock);
+	stats->lookups = realtime_stats.lookups;
+	stats->lookups_found = realtime_stats.lookups_found;
+	stats->lookup_time_total = realtime_stats.lookup_time_total;
+	stats->lookup_time_max = realtime_stats.lookup_time_max;
+	ast_mutex_unlock(&realtime_stats_lock);
+}
+
+void sccp_config_realtime_invalidate(const char *name)
+{
+	sccp_lru_cache_invalidate(realtime_cache, name);
+}
+
+static struct sccp_device_cfg *find_guest_device_cfg(struct sccp_cfg *cfg)
+{
+	struct sccp_device_cfg *device_cfg = cfg->general_cfg->guest_device_cfg;
+
+	if (device_cfg) {
+		ao2_ref(device_cfg, +1);
+	}
+
+	return device_cfg;
+}
+
+int sccp_cfg_try_find_device_or_guest(struct sccp_cfg *cfg, const char *name, struct sccp_device_cfg **device_cfg)
+{
+	*device_cfg = sccp_cfg_find_device(cfg, name);
+	if (*device_cfg) {
+		return 0;
+	}
+
+	if (cfg->general_cfg->realtime) {
+		*device_cfg = sccp_lru_cache_get(realtime_cache, name);
+		if (*device_cfg) {
+			return 0;
+		}
+
+		return SCCP_CFG_REALTIME_LOOKUP;
+	}
+
+	*device_cfg = find_guest_device_cfg(cfg);
+
+	return 0;
+}
+
+struct sccp_device_cfg *sccp_cfg_lookup_device_or_guest(struct sccp_cfg *cfg, const char *name)
+{
+	struct sccp_device_cfg *device_cfg;
+
+	if (cfg->general_cfg->realtime) {
+		device_cfg = realtime_lookup_device_cfg(cfg, name);
+		if (device_cfg) {
+			return device_cfg;
+		}
+	}
+
+	return find_guest_device_cfg(cfg);
+}
+
+struct sccp_device_cfg *sccp_cfg_find_device_or_guest(struct sccp_cfg *cfg, const char *name)
+{
+	struct sccp_device_cfg *device_cfg;
+
+	if (sccp_cfg_try_find_device_or_guest(cfg, name, &device_cfg) == SCCP_CFG_REALTIME_LOOKUP) {
+		return sccp_cfg_lookup_device_or_guest(cfg, name);
+	}
+
+	return device_cfg;
 }
 
 struct sccp_line_cfg *sccp_cfg_find_line(struct sccp_cfg *cfg, const char *name)
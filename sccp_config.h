@@ -3,23 +3,77 @@
 
 #include <asterisk/app.h>
 #include <asterisk/channel.h>
+#include <limits.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "sccp.h"
+#include "sccp_lru_cache.h"
 
 struct ao2_container;
 
+#define SCCP_CONFIG_UNCHANGED 1
+
+/*!
+ * \brief What changed compared to the previous config.
+ */
+struct sccp_cfg_changes {
+	/* non-zero if every session must reload, i.e. on first load or if the general section changed */
+	int all;
+	unsigned int devices_added;
+	unsigned int devices_modified;
+	unsigned int devices_removed;
+	unsigned int devices_unchanged;
+	/* names of the added, modified and removed devices */
+	size_t count;
+	char (*device_names)[SCCP_DEVICE_NAME_MAX];
+	/* time spent computing the changes, in microseconds */
+	int diff_time;
+};
+
+/*!
+ * \brief How much the config objects are shared.
+ */
+struct sccp_cfg_sharing {
+	/* references to interned strings, and number of distinct strings */
+	unsigned int string_refs;
+	unsigned int strings;
+	/* lines, and number of distinct format capabilities they reference */
+	unsigned int caps_refs;
+	unsigned int caps;
+	/* speeddial sections that were merged with an identical one */
+	unsigned int speeddials_merged;
+	/* estimated memory saved, in bytes */
+	size_t saved;
+};
+
 struct sccp_cfg {
 	struct sccp_general_cfg *general_cfg;
 	struct ao2_container *devices_cfg;
 	struct ao2_container *lines_cfg;
 	struct ao2_container *speeddials_cfg;
+
+	/* time spent validating and linking the config items, in microseconds */
+	int pre_apply_time;
+	/* number of threads the device configs were built with */
+	unsigned int pre_apply_workers;
+
+	struct sccp_cfg_sharing sharing;
+
+	struct sccp_cfg_changes changes;
 };
 
 struct sccp_general_cfg {
 	int authtimeout;
 	unsigned int max_guests;
 	unsigned int tos;
+	int realtime;
+	unsigned int realtime_cache_size;
+	int realtime_cache_ttl;
+	unsigned int rtp_pool_size;
+
+	/* content hash, including the guest device */
+	uint64_t hash;
 
 	struct sccp_device_cfg *guest_device_cfg;
 
@@ -30,12 +84,16 @@ struct sccp_device_cfg {
 	char name[SCCP_DEVICE_NAME_MAX];
 	char dateformat[6];
 	char voicemail[AST_MAX_MAILBOX_UNIQUEID];
-	char vmexten[AST_MAX_EXTENSION];
-	char timezone[40];
+	/* interned */
+	const char *vmexten;
+	/* interned */
+	const char *timezone;
 	int keepalive;
 	int dialtimeout;
 
 	int guest;
+	/* content hash, including the line and the speeddials */
+	uint64_t hash;
 	size_t speeddial_count;
 	struct sccp_line_cfg *line_cfg;
 	struct sccp_speeddial_cfg **speeddials_cfg;
@@ -47,9 +105,12 @@ struct sccp_line_cfg {
 	char name[SCCP_LINE_NAME_MAX];
 	char cid_num[40];
 	char cid_name[40];
-	char language[MAX_LANGUAGE];
-	char context[AST_MAX_CONTEXT];
-	char accountcode[AST_MAX_ACCOUNT_CODE];
+	/* interned */
+	const char *language;
+	/* interned */
+	const char *context;
+	/* interned */
+	const char *accountcode;
 	int directmedia;
 	unsigned int tos_audio;
 
@@ -59,6 +120,7 @@ struct sccp_line_cfg {
 	struct ast_namedgroups *named_callgroups;
 	struct ast_namedgroups *named_pickupgroups;
 
+	/* shared between the lines with the same formats, must not be modified */
 	struct ast_format_cap *caps;
 
 	struct ast_variable *chanvars;
@@ -103,10 +165,42 @@ int sccp_config_load(void);
  * \brief Reload the config from the configuration file.
  *
  * \retval 0 on success
- * \retval non-zero on faiure
+ * \retval SCCP_CONFIG_UNCHANGED if the configuration file has not changed
+ * \retval -1 on faiure
  */
 int sccp_config_reload(void);
 
+/*!
+ * \brief Status of the config cache.
+ */
+struct sccp_config_cache_status {
+	/* non-zero if the current config has been loaded from the cache at startup */
+	int loaded;
+	/* non-zero if the configuration file can be cached, i.e. has no #include */
+	int cacheable;
+	/* non-zero if the cache matches the current configuration file */
+	int valid;
+	char path[PATH_MAX];
+	size_t size;
+	/* time spent loading the config at startup, in microseconds */
+	int load_time;
+	/* time spent writing the cache the last time, in microseconds */
+	int write_time;
+	unsigned int writes;
+	unsigned int write_failures;
+};
+
+/*!
+ * \brief Get the status of the config cache.
+ *
+ * On successful load or reload, a binary image of the config is written to the cache
+ * directory, and the config is loaded from this image at the next startup if the
+ * configuration file has not changed since.
+ *
+ * \note This reads the whole configuration file to check the cache validity.
+ */
+void sccp_config_cache_get_status(struct sccp_config_cache_status *status);
+
 /*!
  * \brief Get the current config.
  *
@@ -114,6 +208,33 @@ int sccp_config_reload(void);
  */
 struct sccp_cfg *sccp_config_get(void);
 
+/*!
+ * \brief Config read-side section, see sccp_config_read_begin.
+ */
+struct sccp_config_reader {
+	unsigned int slot;
+};
+
+/*!
+ * \brief Enter a config read-side section and return the current config.
+ *
+ * This is lock-free, and cheaper than sccp_config_get for short lookups: the returned
+ * config stays valid until the matching sccp_config_read_end, without its reference
+ * count being incremented. A config reload waits for the sections still using the
+ * config it replaces, so the section must be short and must not block.
+ *
+ * \note Objects found in the config (i.e. with sccp_cfg_find_line) are still returned
+ *       with their reference count incremented, and can be used after the section.
+ *
+ * \retval the current config, or NULL if no config has been loaded
+ */
+struct sccp_cfg *sccp_config_read_begin(struct sccp_config_reader *reader);
+
+/*!
+ * \brief Leave a config read-side section.
+ */
+void sccp_config_read_end(struct sccp_config_reader *reader);
+
 /*!
  * \brief Find the device config with the given name.
  *
@@ -127,13 +248,74 @@ struct sccp_device_cfg *sccp_cfg_find_device(struct sccp_cfg *cfg, const char *n
 /*!
  * \brief Find the device config with the given name, or the guest device config.
  *
+ * If realtime is enabled, a device which is not in the configuration file is looked
+ * up in the realtime "sccpdevices" family, and its line in the "sccplines" family.
+ * Realtime device configs are kept in a cache, bounded in size and age.
+ *
  * \note The returned object has its reference count incremented by one
+ * \note This blocks while the device is looked up in realtime, see
+ *       sccp_cfg_try_find_device_or_guest.
  *
  * \retval non-NULL on success
  * \retval NULL on failure
  */
 struct sccp_device_cfg *sccp_cfg_find_device_or_guest(struct sccp_cfg *cfg, const char *name);
 
+#define SCCP_CFG_REALTIME_LOOKUP 1
+
+/*!
+ * \brief Find the device config with the given name, or the guest device config,
+ *        without blocking.
+ *
+ * Same as sccp_cfg_find_device_or_guest, except that a device which is neither in the
+ * configuration file nor in the realtime cache is not looked up in realtime. The
+ * caller is then expected to call sccp_cfg_lookup_device_or_guest from a thread that
+ * can block.
+ *
+ * \note On success, *device_cfg has its reference count incremented by one, or is
+ *       NULL if the device is not configured.
+ *
+ * \retval 0 on success
+ * \retval SCCP_CFG_REALTIME_LOOKUP if the device must be looked up in realtime
+ */
+int sccp_cfg_try_find_device_or_guest(struct sccp_cfg *cfg, const char *name, struct sccp_device_cfg **device_cfg);
+
+/*!
+ * \brief Look the device up in realtime, or return the guest device config.
+ *
+ * The device config found is added to the realtime cache.
+ *
+ * \note This blocks for the duration of the realtime queries.
+ * \note The returned object has its reference count incremented by one
+ *
+ * \retval non-NULL on success
+ * \retval NULL on failure
+ */
+struct sccp_device_cfg *sccp_cfg_lookup_device_or_guest(struct sccp_cfg *cfg, const char *name);
+
+struct sccp_config_realtime_stats {
+	struct sccp_lru_cache_stats cache;
+	/* realtime lookups, i.e. cache misses */
+	unsigned int lookups;
+	unsigned int lookups_found;
+	/* in microseconds */
+	unsigned long long lookup_time_total;
+	int lookup_time_max;
+};
+
+/*!
+ * \brief Take a snapshot of the realtime stats.
+ */
+void sccp_config_realtime_take_stats(struct sccp_config_realtime_stats *stats);
+
+/*!
+ * \brief Remove a device config, or every device config if name is NULL, from the
+ *        realtime cache.
+ *
+ * \note Registered devices keep their config until they register again.
+ */
+void sccp_config_realtime_invalidate(const char *name);
+
 /*!
  * \brief Find the line config with the given name.
  *
@@ -0,0 +1,308 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/strings.h>
+#include <asterisk/utils.h>
+
+#include "sccp_config_cache.h"
+
+#define CACHE_MAGIC "SCCPCFG\0"
+/* bump when the layout of the header or of the payload changes */
+#define CACHE_VERSION 3
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+struct cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	struct sccp_cfg_cache_fingerprint source;
+	uint64_t payload_size;
+	uint64_t payload_hash;
+};
+
+static uint64_t hash_update(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/*
+ * Directives are only recognized at the start of a line, like in the config parser.
+ */
+static int has_directive(const char *buf, size_t len)
+{
+	const char *p = buf;
+	const char *end = buf + len;
+
+	while (p < end) {
+		while (p < end && (*p == ' ' || *p == '\t')) {
+			p++;
+		}
+
+		if (p < end && *p == '#') {
+			if (end - p >= 8 && !strncasecmp(p, "#include", 8)) {
+				return 1;
+			}
+
+			if (end - p >= 5 && !strncasecmp(p, "#exec", 5)) {
+				return 1;
+			}
+		}
+
+		p = memchr(p, '\n', end - p);
+		if (!p) {
+			break;
+		}
+
+		p++;
+	}
+
+	return 0;
+}
+
+int sccp_cfg_cache_fingerprint(const char *path, struct sccp_cfg_cache_fingerprint *fingerprint)
+{
+	struct stat st;
+	void *addr;
+	int ret = 0;
+	int fd;
+
+	if (!path) {
+		ast_log(LOG_ERROR, "sccp cfg cache fingerprint failed: path is null\n");
+		return -1;
+	}
+
+	if (!fingerprint) {
+		ast_log(LOG_ERROR, "sccp cfg cache fingerprint failed: fingerprint is null\n");
+		return -1;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return -1;
+	}
+
+	if (fstat(fd, &st) == -1 || !st.st_size) {
+		close(fd);
+		return -1;
+	}
+
+	addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		return -1;
+	}
+
+	if (has_directive(addr, st.st_size)) {
+		ast_debug(1, "config file %s has directives, not caching it\n", path);
+		ret = -1;
+	} else {
+		fingerprint->mtime = st.st_mtime;
+		fingerprint->size = st.st_size;
+		fingerprint->hash = hash_update(FNV_OFFSET_BASIS, addr, st.st_size);
+	}
+
+	munmap(addr, st.st_size);
+
+	return ret;
+}
+
+static int write_all(int fd, const void *data, size_t len)
+{
+	const char *p = data;
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, p, len);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return -1;
+		}
+
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+int sccp_cfg_cache_write(const char *path, const struct sccp_cfg_cache_fingerprint *fingerprint, const void *payload, size_t payload_size)
+{
+	struct cache_header header;
+	char *tmp_path;
+	int fd;
+
+	if (!path) {
+		ast_log(LOG_ERROR, "sccp cfg cache write failed: path is null\n");
+		return -1;
+	}
+
+	if (!fingerprint) {
+		ast_log(LOG_ERROR, "sccp cfg cache write failed: fingerprint is null\n");
+		return -1;
+	}
+
+	if (ast_asprintf(&tmp_path, "%s.%d", path, (int) getpid()) == -1) {
+		return -1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+	header.version = CACHE_VERSION;
+	header.header_size = sizeof(header);
+	header.source = *fingerprint;
+	header.payload_size = payload_size;
+	header.payload_hash = hash_update(FNV_OFFSET_BASIS, payload, payload_size);
+
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0640);
+	if (fd == -1) {
+		ast_log(LOG_WARNING, "sccp cfg cache write failed: open %s: %s\n", tmp_path, strerror(errno));
+		ast_free(tmp_path);
+		return -1;
+	}
+
+	if (write_all(fd, &header, sizeof(header)) || write_all(fd, payload, payload_size)) {
+		ast_log(LOG_WARNING, "sccp cfg cache write failed: write %s: %s\n", tmp_path, strerror(errno));
+		goto fail;
+	}
+
+	if (close(fd) == -1) {
+		fd = -1;
+		goto fail;
+	}
+
+	if (rename(tmp_path, path) == -1) {
+		ast_log(LOG_WARNING, "sccp cfg cache write failed: rename %s: %s\n", path, strerror(errno));
+		fd = -1;
+		goto fail;
+	}
+
+	ast_free(tmp_path);
+
+	return 0;
+
+fail:
+	if (fd != -1) {
+		close(fd);
+	}
+
+	unlink(tmp_path);
+	ast_free(tmp_path);
+
+	return -1;
+}
+
+int sccp_cfg_cache_open(const char *path, const struct sccp_cfg_cache_fingerprint *fingerprint, struct sccp_cfg_cache_image *image)
+{
+	const struct cache_header *header;
+	struct stat st;
+	void *addr;
+	int fd;
+
+	if (!path) {
+		ast_log(LOG_ERROR, "sccp cfg cache open failed: path is null\n");
+		return -1;
+	}
+
+	if (!fingerprint) {
+		ast_log(LOG_ERROR, "sccp cfg cache open failed: fingerprint is null\n");
+		return -1;
+	}
+
+	if (!image) {
+		ast_log(LOG_ERROR, "sccp cfg cache open failed: image is null\n");
+		return -1;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return -1;
+	}
+
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t) sizeof(*header)) {
+		close(fd);
+		return -1;
+	}
+
+	addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		return -1;
+	}
+
+	header = addr;
+	if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) ||
+			header->version != CACHE_VERSION ||
+			header->header_size != sizeof(*header) ||
+			header->payload_size != (uint64_t) st.st_size - sizeof(*header) ||
+			memcmp(&header->source, fingerprint, sizeof(*fingerprint))) {
+		goto fail;
+	}
+
+	image->addr = addr;
+	image->map_size = st.st_size;
+	image->payload = (const char *) addr + sizeof(*header);
+	image->payload_size = header->payload_size;
+
+	if (header->payload_hash != hash_update(FNV_OFFSET_BASIS, image->payload, image->payload_size)) {
+		ast_log(LOG_WARNING, "config cache %s is corrupted\n", path);
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	munmap(addr, st.st_size);
+	image->addr = NULL;
+
+	return -1;
+}
+
+void sccp_cfg_cache_close(struct sccp_cfg_cache_image *image)
+{
+	if (!image->addr) {
+		return;
+	}
+
+	munmap(image->addr, image->map_size);
+	image->addr = NULL;
+}
+
+const char *sccp_cfg_cache_str(const struct sccp_cfg_cache_image *image, uint32_t offset)
+{
+	if (offset >= image->payload_size) {
+		return NULL;
+	}
+
+	if (!memchr(image->payload + offset, '\0', image->payload_size - offset)) {
+		return NULL;
+	}
+
+	return image->payload + offset;
+}
+
+const void *sccp_cfg_cache_array(const struct sccp_cfg_cache_image *image, uint32_t offset, uint32_t count, size_t elem_size)
+{
+	if (offset > image->payload_size || (image->payload_size - offset) / elem_size < count) {
+		return NULL;
+	}
+
+	return image->payload + offset;
+}
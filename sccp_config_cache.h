@@ -0,0 +1,81 @@
+#ifndef SCCP_CONFIG_CACHE_H_
+#define SCCP_CONFIG_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ * \brief Identify the content of a configuration file.
+ */
+struct sccp_cfg_cache_fingerprint {
+	int64_t mtime;
+	int64_t size;
+	uint64_t hash;
+};
+
+/*!
+ * \brief A cache image mapped in memory.
+ */
+struct sccp_cfg_cache_image {
+	void *addr;
+	size_t map_size;
+	/* the payload, as given to sccp_cfg_cache_write */
+	const char *payload;
+	size_t payload_size;
+};
+
+/*!
+ * \brief Compute the fingerprint of a configuration file.
+ *
+ * \note A configuration file with #include or #exec directives can't be fingerprinted,
+ *       since the content of the other files would not be taken into account.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int sccp_cfg_cache_fingerprint(const char *path, struct sccp_cfg_cache_fingerprint *fingerprint);
+
+/*!
+ * \brief Write a cache image.
+ *
+ * The image is written to a temporary file which is then renamed, so that a concurrent
+ * or interrupted write never leaves a partial image.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int sccp_cfg_cache_write(const char *path, const struct sccp_cfg_cache_fingerprint *fingerprint, const void *payload, size_t payload_size);
+
+/*!
+ * \brief Map a cache image in memory.
+ *
+ * The image is only mapped if it is well formed and if it has been written for a
+ * configuration file with the given fingerprint.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure, i.e. if the image doesn't exist or is stale
+ */
+int sccp_cfg_cache_open(const char *path, const struct sccp_cfg_cache_fingerprint *fingerprint, struct sccp_cfg_cache_image *image);
+
+/*!
+ * \brief Unmap a cache image.
+ */
+void sccp_cfg_cache_close(struct sccp_cfg_cache_image *image);
+
+/*!
+ * \brief Return the string at the given offset of the payload.
+ *
+ * \retval the string on success
+ * \retval NULL if the offset is out of bounds or the string is not null terminated
+ */
+const char *sccp_cfg_cache_str(const struct sccp_cfg_cache_image *image, uint32_t offset);
+
+/*!
+ * \brief Return the array at the given offset of the payload.
+ *
+ * \retval the array on success
+ * \retval NULL if the array is not entirely in the payload
+ */
+const void *sccp_cfg_cache_array(const struct sccp_cfg_cache_image *image, uint32_t offset, uint32_t count, size_t elem_size);
+
+#endif /* SCCP_CONFIG_CACHE_H_ */
@@ -1,4 +1,8 @@
 #include <asterisk.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/cli.h>
+#include <asterisk/lock.h>
+#include <asterisk/network.h>
 #include <asterisk/strings.h>
 
 #include "sccp.h"
@@ -6,42 +10,399 @@
 #include "sccp_msg.h"
 #include "sccp_utils.h"
 
-static int sccp_debug;
-static char sccp_debug_device_name[SCCP_DEVICE_NAME_MAX];
-static char sccp_debug_ip[INET_ADDRSTRLEN];
+#define DEBUG_DEVICES_BUCKETS 17
+#define DEBUG_PREFIX_LEN_MAX 32
+
+struct debug_prefix {
+	/* in host byte order, masked */
+	uint32_t addr;
+	unsigned int len;
+};
+
+/*
+ * Published filters are never modified; a change publishes a modified copy.
+ */
+struct debug_filters {
+	int all;
+	struct ao2_container *devices;
+	/* sorted by length, then address */
+	struct debug_prefix *prefixes;
+	size_t prefix_count;
+	/* the prefixes of length n are in [len_start[n], len_start[n + 1]) */
+	size_t len_start[DEBUG_PREFIX_LEN_MAX + 2];
+	unsigned char msgs[SCCP_MSG_COUNT];
+	size_t msg_count;
+};
+
+static AO2_GLOBAL_OBJ_STATIC(global_filters);
+AST_MUTEX_DEFINE_STATIC(filters_lock);
+static unsigned int filters_generation;
 
 static void dump_message(const struct sccp_msg *msg, const char *head1, const char *head2, const char *ipaddr, int port);
 
-void sccp_debug_enable(void)
+static uint32_t prefix_mask(unsigned int len)
+{
+	return len ? 0xffffffff << (32 - len) : 0;
+}
+
+static int debug_prefix_cmp(const void *a, const void *b)
+{
+	const struct debug_prefix *prefix_a = a;
+	const struct debug_prefix *prefix_b = b;
+
+	if (prefix_a->len != prefix_b->len) {
+		return prefix_a->len < prefix_b->len ? -1 : 1;
+	}
+
+	if (prefix_a->addr != prefix_b->addr) {
+		return prefix_a->addr < prefix_b->addr ? -1 : 1;
+	}
+
+	return 0;
+}
+
+static void debug_filters_destructor(void *data)
+{
+	struct debug_filters *filters = data;
+
+	ao2_cleanup(filters->devices);
+	ast_free(filters->prefixes);
+}
+
+/*
+ * Copy the filters, with room for one more prefix.
+ */
+static struct debug_filters *debug_filters_copy(const struct debug_filters *orig)
+{
+	struct debug_filters *filters;
+
+	filters = ao2_alloc_options(sizeof(*filters), debug_filters_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!filters) {
+		return NULL;
+	}
+
+	if (orig) {
+		*filters = *orig;
+		filters->devices = ao2_container_clone(orig->devices, 0);
+	} else {
+		memset(filters, 0, sizeof(*filters));
+		filters->devices = ast_str_container_alloc(DEBUG_DEVICES_BUCKETS);
+	}
+
+	filters->prefixes = ast_malloc((filters->prefix_count + 1) * sizeof(*filters->prefixes));
+	if (!filters->devices || !filters->prefixes) {
+		ao2_ref(filters, -1);
+		return NULL;
+	}
+
+	if (orig && orig->prefix_count) {
+		memcpy(filters->prefixes, orig->prefixes, orig->prefix_count * sizeof(*filters->prefixes));
+	}
+
+	return filters;
+}
+
+static void debug_filters_index_prefixes(struct debug_filters *filters)
+{
+	unsigned int len;
+	size_t i = 0;
+
+	qsort(filters->prefixes, filters->prefix_count, sizeof(*filters->prefixes), debug_prefix_cmp);
+
+	for (len = 0; len <= DEBUG_PREFIX_LEN_MAX + 1; len++) {
+		while (i < filters->prefix_count && filters->prefixes[i].len < len) {
+			i++;
+		}
+
+		filters->len_start[len] = i;
+	}
+}
+
+static int debug_filters_find_prefix(const struct debug_filters *filters, const struct debug_prefix *prefix)
 {
-	sccp_debug_disable();
-	sccp_debug = 1;
+	return bsearch(prefix, &filters->prefixes[filters->len_start[prefix->len]],
+			filters->len_start[prefix->len + 1] - filters->len_start[prefix->len],
+			sizeof(*filters->prefixes), debug_prefix_cmp) != NULL;
 }
 
-void sccp_debug_enable_device_name(const char *name)
+static int debug_filters_match_ip(const struct debug_filters *filters, const struct in_addr *addr)
 {
-	sccp_debug_disable();
-	ast_copy_string(sccp_debug_device_name, name, sizeof(sccp_debug_device_name));
+	struct debug_prefix prefix;
+	uint32_t ip = ntohl(addr->s_addr);
+
+	for (prefix.len = 0; prefix.len <= DEBUG_PREFIX_LEN_MAX; prefix.len++) {
+		if (filters->len_start[prefix.len] == filters->len_start[prefix.len + 1]) {
+			continue;
+		}
+
+		prefix.addr = ip & prefix_mask(prefix.len);
+		if (debug_filters_find_prefix(filters, &prefix)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Publish the filters, stealing the reference. Must be called with filters_lock held.
+ */
+static void debug_filters_publish(struct debug_filters *filters)
+{
+	ao2_global_obj_replace_unref(global_filters, filters);
+	ao2_ref(filters, -1);
+
+	/* the sessions will reevaluate their debug flag */
+	__atomic_add_fetch(&filters_generation, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Copy the current filters, for modification. Must be called with filters_lock held.
+ */
+static struct debug_filters *debug_filters_edit(void)
+{
+	struct debug_filters *orig = ao2_global_obj_ref(global_filters);
+	struct debug_filters *filters;
+
+	filters = debug_filters_copy(orig);
+	ao2_cleanup(orig);
+
+	return filters;
 }
 
-void sccp_debug_enable_ip(const char *ip)
+void sccp_debug_enable(void)
 {
-	sccp_debug_disable();
-	ast_copy_string(sccp_debug_ip, ip, sizeof(sccp_debug_ip));
+	struct debug_filters *filters;
+
+	ast_mutex_lock(&filters_lock);
+	filters = debug_filters_edit();
+	if (filters) {
+		filters->all = 1;
+		debug_filters_publish(filters);
+	}
+	ast_mutex_unlock(&filters_lock);
 }
 
 void sccp_debug_disable(void)
 {
-	sccp_debug = 0;
-	*sccp_debug_device_name = '\0';
-	*sccp_debug_ip = '\0';
+	struct debug_filters *filters;
+
+	ast_mutex_lock(&filters_lock);
+	filters = debug_filters_copy(NULL);
+	if (filters) {
+		debug_filters_publish(filters);
+	}
+	ast_mutex_unlock(&filters_lock);
 }
 
-int sccp_debug_enabled(const char *device_name, const char *ip)
+void sccp_debug_set_device_name(const char *name, int remove)
 {
-	return sccp_debug ||
-		(device_name && !strcmp(device_name, sccp_debug_device_name)) ||
-		(ip && !strcmp(ip, sccp_debug_ip));
+	struct debug_filters *filters;
+
+	ast_mutex_lock(&filters_lock);
+	filters = debug_filters_edit();
+	if (filters) {
+		/* the container accepts duplicates */
+		ast_str_container_remove(filters->devices, name);
+		if (!remove) {
+			ast_str_container_add(filters->devices, name);
+		}
+
+		debug_filters_publish(filters);
+	}
+	ast_mutex_unlock(&filters_lock);
+}
+
+static int parse_prefix(const char *str, struct debug_prefix *prefix)
+{
+	struct in_addr addr;
+	char *copy = ast_strdupa(str);
+	char *len;
+
+	prefix->len = DEBUG_PREFIX_LEN_MAX;
+
+	len = strchr(copy, '/');
+	if (len) {
+		*len++ = '\0';
+		if (sscanf(len, "%u", &prefix->len) != 1 || prefix->len > DEBUG_PREFIX_LEN_MAX) {
+			return -1;
+		}
+	}
+
+	if (!inet_aton(copy, &addr)) {
+		return -1;
+	}
+
+	prefix->addr = ntohl(addr.s_addr) & prefix_mask(prefix->len);
+
+	return 0;
+}
+
+int sccp_debug_set_ip(const char *str, int remove)
+{
+	struct debug_filters *filters;
+	struct debug_prefix prefix;
+	struct debug_prefix *found;
+	int ret = -1;
+
+	if (parse_prefix(str, &prefix)) {
+		return -1;
+	}
+
+	ast_mutex_lock(&filters_lock);
+	filters = debug_filters_edit();
+	if (!filters) {
+		goto end;
+	}
+
+	found = bsearch(&prefix, filters->prefixes, filters->prefix_count, sizeof(*filters->prefixes), debug_prefix_cmp);
+	if (remove && found) {
+		*found = filters->prefixes[--filters->prefix_count];
+	} else if (!remove && !found) {
+		/* there's room for one more */
+		filters->prefixes[filters->prefix_count++] = prefix;
+	}
+
+	debug_filters_index_prefixes(filters);
+	debug_filters_publish(filters);
+	ret = 0;
+
+end:
+	ast_mutex_unlock(&filters_lock);
+
+	return ret;
+}
+
+static const struct sccp_msg_desc *find_msg_desc(const char *str)
+{
+	const struct sccp_msg_desc *desc;
+	unsigned long msg_id;
+	char *end;
+
+	msg_id = strtoul(str, &end, 0);
+	if (*str && !*end) {
+		return msg_id < SCCP_MSG_ID_LIMIT ? sccp_msg_desc_get(msg_id) : NULL;
+	}
+
+	for (msg_id = 0; msg_id < SCCP_MSG_ID_LIMIT; msg_id++) {
+		desc = sccp_msg_desc_get(msg_id);
+		if (desc && !strcasecmp(desc->name, str)) {
+			return desc;
+		}
+	}
+
+	return NULL;
+}
+
+int sccp_debug_set_msg(const char *str, int remove)
+{
+	const struct sccp_msg_desc *desc;
+	struct debug_filters *filters;
+
+	desc = find_msg_desc(str);
+	if (!desc) {
+		return -1;
+	}
+
+	ast_mutex_lock(&filters_lock);
+	filters = debug_filters_edit();
+	if (filters) {
+		if (remove && filters->msgs[desc->index]) {
+			filters->msgs[desc->index] = 0;
+			filters->msg_count--;
+		} else if (!remove && !filters->msgs[desc->index]) {
+			filters->msgs[desc->index] = 1;
+			filters->msg_count++;
+		}
+
+		debug_filters_publish(filters);
+	}
+	ast_mutex_unlock(&filters_lock);
+
+	return 0;
+}
+
+unsigned int sccp_debug_generation(void)
+{
+	return __atomic_load_n(&filters_generation, __ATOMIC_ACQUIRE);
+}
+
+int sccp_debug_enabled(const char *device_name, const struct in_addr *addr)
+{
+	struct debug_filters *filters = ao2_global_obj_ref(global_filters);
+	void *found;
+	int enabled = 0;
+
+	if (!filters) {
+		return 0;
+	}
+
+	if (filters->all) {
+		enabled = 1;
+	} else if (device_name && (found = ao2_find(filters->devices, device_name, OBJ_SEARCH_KEY))) {
+		ao2_ref(found, -1);
+		enabled = 1;
+	} else if (addr && filters->prefix_count) {
+		enabled = debug_filters_match_ip(filters, addr);
+	}
+
+	ao2_ref(filters, -1);
+
+	return enabled;
+}
+
+void sccp_debug_show(int fd)
+{
+	struct debug_filters *filters = ao2_global_obj_ref(global_filters);
+	const struct sccp_msg_desc *desc;
+	struct ao2_iterator iter;
+	struct in_addr addr;
+	char *name;
+	uint32_t msg_id;
+	size_t i;
+
+	if (!filters) {
+		ast_cli(fd, "SCCP debugging disabled\n");
+		return;
+	}
+
+	ast_cli(fd, "All devices: %s\n", AST_CLI_YESNO(filters->all));
+
+	ast_cli(fd, "Devices:");
+	iter = ao2_iterator_init(filters->devices, 0);
+	while ((name = ao2_iterator_next(&iter))) {
+		ast_cli(fd, " %s", name);
+		ao2_ref(name, -1);
+	}
+	ao2_iterator_destroy(&iter);
+	ast_cli(fd, "\n");
+
+	ast_cli(fd, "IP prefixes:");
+	for (i = 0; i < filters->prefix_count; i++) {
+		addr.s_addr = htonl(filters->prefixes[i].addr);
+		ast_cli(fd, " %s/%u", ast_inet_ntoa(addr), filters->prefixes[i].len);
+	}
+	ast_cli(fd, "\n");
+
+	ast_cli(fd, "Messages:");
+	if (!filters->msg_count) {
+		ast_cli(fd, " all but keep alives");
+	} else {
+		for (msg_id = 0; msg_id < SCCP_MSG_ID_LIMIT; msg_id++) {
+			desc = sccp_msg_desc_get(msg_id);
+			if (desc && filters->msgs[desc->index]) {
+				ast_cli(fd, " %s", desc->name);
+			}
+		}
+	}
+	ast_cli(fd, "\n");
+
+	ao2_ref(filters, -1);
+}
+
+void sccp_debug_destroy(void)
+{
+	ao2_global_obj_release(global_filters);
 }
 
 void sccp_dump_message_received(const struct sccp_msg *msg, const char *ipaddr, int port)
@@ -54,6 +415,25 @@ void sccp_dump_message_transmitting(const struct sccp_msg *msg, const char *ipad
 	dump_message(msg, "Transmitting message", "to", ipaddr, port);
 }
 
+static int is_msg_dumped(uint32_t msg_id)
+{
+	struct debug_filters *filters = ao2_global_obj_ref(global_filters);
+	const struct sccp_msg_desc *desc;
+	int dumped;
+
+	if (!filters || !filters->msg_count) {
+		/* don't dump these messages by default */
+		dumped = msg_id != KEEP_ALIVE_MESSAGE && msg_id != KEEP_ALIVE_ACK_MESSAGE;
+	} else {
+		desc = sccp_msg_desc_get(msg_id);
+		dumped = desc && filters->msgs[desc->index];
+	}
+
+	ao2_cleanup(filters);
+
+	return dumped;
+}
+
 static void dump_message(const struct sccp_msg *msg, const char *head1, const char *head2, const char *ipaddr, int port)
 {
 	char body[256];
@@ -66,8 +446,7 @@ static void dump_message(const struct sccp_msg *msg, const char *head1, const ch
 
 	msg_id = letohl(msg->id);
 
-	/* don't dump these messages */
-	if (msg_id == KEEP_ALIVE_MESSAGE || msg_id == KEEP_ALIVE_ACK_MESSAGE) {
+	if (!is_msg_dumped(msg_id)) {
 		return;
 	}
 
@@ -1,17 +1,59 @@
 #ifndef SCCP_DEBUG_H_
 #define SCCP_DEBUG_H_
 
+struct in_addr;
 struct sccp_msg;
 
-void sccp_debug_enable(void);
-
-void sccp_debug_enable_device_name(const char *name);
+/*
+ * The debug filters tell which sessions have their messages dumped: every session,
+ * or those of a set of device names and of a set of IP prefixes. A set of message
+ * types can further restrict the messages dumped.
+ *
+ * Every change bumps a generation counter, which the sessions check before dumping a
+ * message, so that they don't need to be notified.
+ */
 
-void sccp_debug_enable_ip(const char *ip);
+void sccp_debug_enable(void);
 
 void sccp_debug_disable(void);
 
-int sccp_debug_enabled(const char *device_name, const char *ip);
+/*!
+ * \brief Add (or remove, if remove is non-zero) a device name to the debugged devices.
+ */
+void sccp_debug_set_device_name(const char *name, int remove);
+
+/*!
+ * \brief Add (or remove) an IP prefix, i.e. "10.0.0.0/8", or an IP address.
+ *
+ * \retval 0 on success
+ * \retval non-zero if the prefix is invalid
+ */
+int sccp_debug_set_ip(const char *prefix, int remove);
+
+/*!
+ * \brief Add (or remove) a message type, given by name or ID, to the dumped messages.
+ *
+ * \retval 0 on success
+ * \retval non-zero if the message type is unknown
+ */
+int sccp_debug_set_msg(const char *msg, int remove);
+
+/*!
+ * \brief Return the generation of the debug filters, which changes with them.
+ */
+unsigned int sccp_debug_generation(void);
+
+int sccp_debug_enabled(const char *device_name, const struct in_addr *addr);
+
+/*!
+ * \brief Show the debug filters on the CLI.
+ */
+void sccp_debug_show(int fd);
+
+/*!
+ * \brief Release the debug filters.
+ */
+void sccp_debug_destroy(void);
 
 void sccp_dump_message_received(const struct sccp_msg *msg, const char *ipaddr, int port);
 
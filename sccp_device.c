@@ -1,3 +1,5 @@
+#include <unistd.h>
+
 #include <asterisk.h>
 #include <asterisk/astdb.h>
 #include <asterisk/astobj2.h>
@@ -20,6 +22,8 @@
 #include <asterisk/strings.h>
 #include <asterisk/stasis_channels.h>
 #include <asterisk/rtp_engine.h>
+#include <asterisk/taskprocessor.h>
+#include <asterisk/threadpool.h>
 #include <asterisk/utils.h>
 
 #include "device/sccp_channel_tech.h"
@@ -27,14 +31,23 @@
 #include "sccp.h"
 #include "sccp_config.h"
 #include "sccp_device.h"
+#include "sccp_devstate_cache.h"
+#include "sccp_lock_profile.h"
 #include "sccp_session.h"
 #include "sccp_msg.h"
 #include "sccp_queue.h"
+#include "sccp_rtp_pool.h"
+#include "sccp_sched.h"
 #include "sccp_utils.h"
 
 #define LINE_INSTANCE_START 1
 #define SPEEDDIAL_INDEX_START 1
 
+#define TASK_POOL_INITIAL_SIZE 2
+#define TASK_POOL_MAX_SIZE 16
+#define TASK_POOL_IDLE_TIMEOUT 60
+/* in milliseconds */
+
 struct sccp_speeddial {
 	/* const */
 	struct sccp_device *device;
@@ -66,17 +79,47 @@ enum {
 	SUBCHANNEL_TRANSFERRING = (1 << 3),
 };
 
+struct retired_rtp {
+	struct ast_rtp_instance *rtp;
+	unsigned int shard;
+	AST_LIST_ENTRY(retired_rtp) list;
+};
+
+/*
+ * An RTP instance published to the media path.
+ *
+ * The readers are the channel tech read and write callbacks, which only load the
+ * pointer: no reference is taken and nothing is written, since they are called for
+ * every frame. An instance must thus be fully set up before it's published.
+ *
+ * The media ref owns the published instance and its scheduler shard. A writer
+ * exchanges the pointer and retires the previous instance, which is only stopped and
+ * destroyed by media_ref_release, once no reader can use it anymore (RCU-style
+ * deferred release).
+ */
+struct media_ref {
+	struct ast_rtp_instance *rtp;
+	/* scheduler shard of rtp */
+	unsigned int shard;
+	AST_LIST_HEAD_NOLOCK(, retired_rtp) retired;
+};
+
 struct sccp_subchannel {
 	/* (dynamic) */
 	struct ast_sockaddr direct_media_addr;
 
+	/* (dynamic, written with the device locked, read lock-free) same as rtp */
+	struct media_ref media;
+	/* (dynamic, written with the device locked, read lock-free) subchan == device->active_subchan */
+	int media_active;
+
 	/* (static) */
 	struct sccp_line *line;
 	/* (dynamic) */
 	struct ast_channel *channel;
 	/* (dynamic) */
 	struct ast_format *fmt;
-	/* (dynamic) */
+	/* (dynamic) same instance as media.rtp, owned by media */
 	struct ast_rtp_instance *rtp;
 	/* (dynamic) */
 	struct sccp_subchannel *related;
@@ -102,6 +145,8 @@ struct sccp_line {
 	struct sccp_device *device;
 	/* updated in session thread only */
 	struct sccp_line_cfg *cfg;
+	/* (dynamic) formats of cfg also supported by the device, NULL if not computed yet */
+	struct ast_format_cap *compatible_cap;
 
 	/* const */
 	uint32_t instance;
@@ -145,6 +190,17 @@ enum {
 	DEVICE_FAULT = (1 << 1),
 };
 
+struct device_stats {
+	time_t registration_time;
+	time_t last_keepalive;
+	unsigned int keepalive_interval;
+	unsigned int keepalive_jitter;
+	unsigned int calls_placed;
+	unsigned int calls_received;
+	/* only read by the session thread */
+	struct timeval keepalive_at;
+};
+
 struct sccp_device {
 	/* (static) */
 	ast_mutex_t lock;
@@ -158,6 +214,16 @@ struct sccp_device {
 	struct sccp_msg_builder msg_builder;
 	/* (dynamic) */
 	struct sccp_queue nolock_tasks;
+	/* (dynamic) created on the first offloaded batch of nolock tasks */
+	struct ast_taskprocessor *serializer;
+	/* (dynamic) number of offloaded batches not yet executed, updated atomically */
+	int offloaded;
+	/* (dynamic) non-zero if nolock_tasks contains a task that might block */
+	int nolock_heavy;
+	/* (dynamic) when the device lock has been taken */
+	struct timeval locked_at;
+	/* (dynamic) where the device lock has been taken, if the lock profiler is enabled */
+	const char *locked_site;
 	/* (dynamic) */
 	struct sockaddr_in remote;
 
@@ -171,6 +237,8 @@ struct sccp_device {
 	struct stasis_subscription *mwi_event_sub;
 	/* (dynamic) */
 	struct sccp_subchannel *active_subchan;
+	/* (dynamic, written with the device locked, read lock-free) state == STATE_DESTROYED */
+	int destroyed;
 
 	uint32_t serial_callid;
 	uint32_t callfwd_id;
@@ -189,6 +257,12 @@ struct sccp_device {
 	char exten[AST_MAX_EXTENSION];
 	char last_exten[AST_MAX_EXTENSION];
 	char callfwd_exten[AST_MAX_EXTENSION];
+
+	/* (dynamic, written in session thread only, read lock-free) */
+	struct sccp_seqlock summary_lock;
+	struct sccp_device_snapshot summary;
+	/* (dynamic, written with the device locked, read lock-free) */
+	struct device_stats stats;
 };
 
 struct nolock_task_ast_bridge_transfer_attended {
@@ -240,21 +314,40 @@ union nolock_task_data {
 struct nolock_task {
 	union nolock_task_data data;
 	void (*exec)(union nolock_task_data *data);
+	enum sccp_device_task_type type;
 };
 
+/*
+ * A batch of nolock tasks executed by the device serializer.
+ */
+struct nolock_batch {
+	struct sccp_device *device;
+	struct sccp_queue tasks;
+	struct timeval queued;
+};
+
+static struct ast_threadpool *task_pool;
+static struct sccp_device_task_stats task_stats;
+static struct sccp_device_lock_stats lock_stats;
+static int task_pool_pending;
+/* signaled when the last pending batch is done */
+AST_MUTEX_DEFINE_STATIC(task_pool_lock);
+static ast_cond_t task_pool_cond;
+
 enum option_flags {
 	OPT_SPEAKER_ON = (1 << 0),
 };
 
 static int add_ast_queue_hangup_task(struct sccp_device *device, struct ast_channel *channel);
+static int task_type_is_heavy(enum sccp_device_task_type type);
 static void sccp_line_update_devstate(struct sccp_line *line, enum ast_device_state state);
 static struct sccp_line *sccp_lines_get_default(struct sccp_lines *lines);
-static void sccp_device_lock(struct sccp_device *device);
+static void sccp_device_lock_at(struct sccp_device *device, const char *site);
 static void sccp_device_unlock(struct sccp_device *device);
 static void sccp_device_panic(struct sccp_device *device);
 static void subscribe_mwi(struct sccp_device *device);
 static void unsubscribe_mwi(struct sccp_device *device);
-static void handle_msg_state_common(struct sccp_device *device, struct sccp_msg *msg, uint32_t msg_id);
+static void handle_msg_state_common(struct sccp_device *device, struct sccp_msg *msg, const struct sccp_msg_desc *desc);
 static void transmit_feature_status(struct sccp_device *device, struct sccp_speeddial *sd);
 static void transmit_reset(struct sccp_device *device, enum sccp_reset_type type);
 static void transmit_subchan_start_media_transmission(struct sccp_device *device, struct sccp_subchannel *subchan, struct sockaddr_in *endpoint);
@@ -263,6 +356,9 @@ static void remove_dialtimeout_task(struct sccp_device *device, struct sccp_subc
 static int add_fwdtimeout_task(struct sccp_device *device);
 static void remove_fwdtimeout_task(struct sccp_device *device);
 
+/* the acquisition site is recorded by the lock profiler */
+#define sccp_device_lock(device) sccp_device_lock_at(device, __func__)
+
 static unsigned int chan_idx = 0;
 
 static void sccp_speeddial_destructor(void *data)
@@ -533,6 +629,64 @@ static void sccp_speeddials_apply_config(struct sccp_speeddials *speeddials, str
 	}
 }
 
+/*
+ * The returned instance stays valid as long as the caller holds the channel lock, or
+ * runs from a channel tech callback, but its reference count is NOT incremented.
+ */
+static struct ast_rtp_instance *media_ref_get(struct media_ref *ref)
+{
+	return __atomic_load_n(&ref->rtp, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Publish rtp, taking the ownership of it and of its scheduler shard, and retire the
+ * previous instance.
+ *
+ * Writers must be serialized, i.e. the device MUST be locked.
+ */
+static void media_ref_set(struct media_ref *ref, struct ast_rtp_instance *rtp, unsigned int shard)
+{
+	struct ast_rtp_instance *old_rtp;
+	unsigned int old_shard = ref->shard;
+	struct retired_rtp *retired;
+
+	ref->shard = shard;
+	old_rtp = __atomic_exchange_n(&ref->rtp, rtp, __ATOMIC_ACQ_REL);
+	if (!old_rtp) {
+		return;
+	}
+
+	/* a reader might still be using it */
+	retired = ast_malloc(sizeof(*retired));
+	if (!retired) {
+		/* leaking the instance is the only safe option left */
+		ast_log(LOG_ERROR, "media ref set failed: could not retire RTP instance\n");
+		return;
+	}
+
+	retired->rtp = old_rtp;
+	retired->shard = old_shard;
+	AST_LIST_INSERT_TAIL(&ref->retired, retired, list);
+}
+
+/*
+ * Stop and destroy the retired instances, and release their scheduler shard.
+ *
+ * Must be called when no reader can be running, i.e. with the channel locked or when
+ * there is no channel anymore, and with the device locked.
+ */
+static void media_ref_release(struct media_ref *ref)
+{
+	struct retired_rtp *retired;
+
+	while ((retired = AST_LIST_REMOVE_HEAD(&ref->retired, list))) {
+		ast_rtp_instance_stop(retired->rtp);
+		ast_rtp_instance_destroy(retired->rtp);
+		sccp_sched_release(retired->shard);
+		ast_free(retired);
+	}
+}
+
 static void sccp_subchannel_destructor(void *data)
 {
 	struct sccp_subchannel *subchan = data;
@@ -546,6 +700,43 @@ static void sccp_subchannel_destructor(void *data)
 
 	ao2_ref(subchan->line, -1);
 	ao2_cleanup(subchan->fmt);
+	media_ref_set(&subchan->media, NULL, 0);
+	media_ref_release(&subchan->media);
+}
+
+/*
+ * the device MUST be locked
+ */
+static void subchan_set_rtp(struct sccp_subchannel *subchan, struct ast_rtp_instance *rtp, unsigned int shard)
+{
+	subchan->rtp = rtp;
+	media_ref_set(&subchan->media, rtp, shard);
+}
+
+/*
+ * the device MUST be locked, and the channel too if there's one, since the media path
+ * might otherwise be using the instance
+ */
+static void subchan_destroy_rtp(struct sccp_subchannel *subchan)
+{
+	subchan_set_rtp(subchan, NULL, 0);
+	media_ref_release(&subchan->media);
+}
+
+/*
+ * the device MUST be locked
+ */
+static void set_active_subchan(struct sccp_device *device, struct sccp_subchannel *subchan)
+{
+	if (device->active_subchan) {
+		__atomic_store_n(&device->active_subchan->media_active, 0, __ATOMIC_RELEASE);
+	}
+
+	device->active_subchan = subchan;
+
+	if (subchan) {
+		__atomic_store_n(&subchan->media_active, 1, __ATOMIC_RELEASE);
+	}
 }
 
 static struct sccp_subchannel *sccp_subchannel_alloc(struct sccp_line *line, uint32_t id, enum sccp_direction direction)
@@ -562,6 +753,10 @@ static struct sccp_subchannel *sccp_subchannel_alloc(struct sccp_line *line, uin
 	subchan->channel = NULL;
 	subchan->fmt = NULL;
 	subchan->rtp = NULL;
+	subchan->media.rtp = NULL;
+	subchan->media.shard = 0;
+	AST_LIST_HEAD_INIT_NOLOCK(&subchan->media.retired);
+	subchan->media_active = 0;
 	subchan->related = NULL;
 	subchan->id = id;
 	subchan->framing = 0;
@@ -578,9 +773,7 @@ static void sccp_subchannel_destroy(struct sccp_subchannel *subchan)
 		add_ast_queue_hangup_task(subchan->line->device, subchan->channel);
 	} else {
 		if (subchan->rtp) {
-			ast_rtp_instance_stop(subchan->rtp);
-			ast_rtp_instance_destroy(subchan->rtp);
-			subchan->rtp = NULL;
+			subchan_destroy_rtp(subchan);
 		}
 	}
 }
@@ -595,19 +788,172 @@ static int add_nolock_task(struct sccp_device *device, struct nolock_task *task)
 		return -1;
 	}
 
+	if (task_type_is_heavy(task->type)) {
+		device->nolock_heavy = 1;
+	}
+
 	return 0;
 }
 
+static void update_max(unsigned int *max, unsigned int value)
+{
+	unsigned int cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+	while (value > cur && !__atomic_compare_exchange_n(max, &cur, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		/* cur has been reloaded */
+	}
+}
+
+static void task_stats_add(enum sccp_device_task_type type, int offloaded, unsigned int exec_time)
+{
+	struct sccp_device_task_stat *stat = &task_stats.types[type];
+
+	__atomic_add_fetch(&stat->count, 1, __ATOMIC_RELAXED);
+	if (offloaded) {
+		__atomic_add_fetch(&stat->offloaded, 1, __ATOMIC_RELAXED);
+	}
+
+	__atomic_add_fetch(&stat->time_total, exec_time, __ATOMIC_RELAXED);
+	update_max(&stat->time_max, exec_time);
+}
+
 /*
  * the device MUST NOT be locked
  */
-static void exec_nolock_tasks(struct sccp_queue *tasks)
+static void exec_nolock_tasks(struct sccp_queue *tasks, int offloaded)
 {
 	struct nolock_task task;
+	struct timeval start;
 
 	while (!sccp_queue_get(tasks, &task)) {
+		start = ast_tvnow();
 		task.exec(&task.data);
+		task_stats_add(task.type, offloaded, ast_tvdiff_us(ast_tvnow(), start));
+	}
+}
+
+static void task_pool_pending_dec(void)
+{
+	if (!__atomic_sub_fetch(&task_pool_pending, 1, __ATOMIC_ACQ_REL)) {
+		ast_mutex_lock(&task_pool_lock);
+		ast_cond_broadcast(&task_pool_cond);
+		ast_mutex_unlock(&task_pool_lock);
+	}
+}
+
+struct pool_task {
+	int (*exec)(void *data);
+	void *data;
+};
+
+static int exec_pool_task(void *data)
+{
+	struct pool_task *task = data;
+
+	task->exec(task->data);
+	ast_free(task);
+
+	task_pool_pending_dec();
+
+	return 0;
+}
+
+int sccp_device_task_pool_push(int (*exec)(void *data), void *data)
+{
+	struct pool_task *task;
+
+	if (!task_pool) {
+		return -1;
 	}
+
+	task = ast_malloc(sizeof(*task));
+	if (!task) {
+		return -1;
+	}
+
+	task->exec = exec;
+	task->data = data;
+
+	__atomic_add_fetch(&task_pool_pending, 1, __ATOMIC_RELAXED);
+
+	if (ast_threadpool_push(task_pool, exec_pool_task, task)) {
+		ast_free(task);
+		task_pool_pending_dec();
+		return -1;
+	}
+
+	return 0;
+}
+
+static int exec_nolock_batch(void *data)
+{
+	struct nolock_batch *batch = data;
+	unsigned int wait_time = ast_tvdiff_us(ast_tvnow(), batch->queued);
+
+	__atomic_add_fetch(&task_stats.batches_wait_total, wait_time, __ATOMIC_RELAXED);
+	update_max(&task_stats.batches_wait_max, wait_time);
+
+	exec_nolock_tasks(&batch->tasks, 1);
+	sccp_queue_destroy(&batch->tasks);
+
+	__atomic_sub_fetch(&batch->device->offloaded, 1, __ATOMIC_RELEASE);
+	ao2_ref(batch->device, -1);
+	ast_free(batch);
+
+	/* last, since the module might be unloaded as soon as no batch is pending */
+	task_pool_pending_dec();
+
+	return 0;
+}
+
+/*
+ * Queue the tasks on the device serializer, so that they are executed in order after
+ * the previously offloaded tasks of the device, but without blocking the caller.
+ *
+ * The device MUST be locked. On failure, the tasks are left in the given queue.
+ */
+static int offload_nolock_tasks(struct sccp_device *device, struct sccp_queue *tasks)
+{
+	char name[AST_TASKPROCESSOR_MAX_NAME + 1];
+	struct nolock_batch *batch;
+
+	if (!task_pool) {
+		return -1;
+	}
+
+	if (!device->serializer) {
+		ast_taskprocessor_build_name(name, sizeof(name), "sccp/device/%s", device->name);
+		device->serializer = ast_threadpool_serializer(name, task_pool);
+		if (!device->serializer) {
+			return -1;
+		}
+	}
+
+	batch = ast_malloc(sizeof(*batch));
+	if (!batch) {
+		return -1;
+	}
+
+	batch->device = device;
+	ao2_ref(device, +1);
+	batch->queued = ast_tvnow();
+	sccp_queue_move(&batch->tasks, tasks);
+
+	__atomic_add_fetch(&device->offloaded, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&task_pool_pending, 1, __ATOMIC_RELAXED);
+
+	if (ast_taskprocessor_push(device->serializer, exec_nolock_batch, batch)) {
+		__atomic_sub_fetch(&device->offloaded, 1, __ATOMIC_RELAXED);
+		sccp_queue_move(tasks, &batch->tasks);
+		ao2_ref(device, -1);
+		ast_free(batch);
+		task_pool_pending_dec();
+		return -1;
+	}
+
+	__atomic_add_fetch(&task_stats.batches_offloaded, 1, __ATOMIC_RELAXED);
+
+	return 0;
 }
 
 static void exec_ast_bridge_transfer_attended(union nolock_task_data *data)
@@ -644,6 +990,7 @@ static int add_ast_bridge_transfer_attended_task(struct sccp_device *device, str
 	struct nolock_task task;
 
 	task.exec = exec_ast_bridge_transfer_attended;
+	task.type = SCCP_DEVICE_TASK_TRANSFER_ATTENDED;
 	task.data.transfer_attended.to_transferee = to_transferee;
 	task.data.transfer_attended.to_transfer_target = to_transfer_target;
 
@@ -672,6 +1019,7 @@ static int add_ast_queue_control_task(struct sccp_device *device, struct ast_cha
 	struct nolock_task task;
 
 	task.exec = exec_ast_queue_control;
+	task.type = SCCP_DEVICE_TASK_QUEUE_CONTROL;
 	task.data.queue_control.channel = channel;
 	task.data.queue_control.control = control;
 
@@ -706,6 +1054,7 @@ static int add_ast_queue_frame_dtmf_task(struct sccp_device *device, struct ast_
 	struct nolock_task task;
 
 	task.exec = exec_ast_queue_frame_dtmf;
+	task.type = SCCP_DEVICE_TASK_QUEUE_FRAME_DTMF;
 	task.data.queue_frame_dtmf.channel = channel;
 	task.data.queue_frame_dtmf.digit = digit;
 
@@ -732,6 +1081,7 @@ static int add_ast_queue_hangup_task(struct sccp_device *device, struct ast_chan
 	struct nolock_task task;
 
 	task.exec = exec_ast_queue_hangup;
+	task.type = SCCP_DEVICE_TASK_QUEUE_HANGUP;
 	task.data.queue_hangup.channel = channel;
 
 	if (add_nolock_task(device, &task)) {
@@ -757,6 +1107,7 @@ static int add_ast_queue_hold_task(struct sccp_device *device, struct ast_channe
 	struct nolock_task task;
 
 	task.exec = exec_ast_queue_hold;
+	task.type = SCCP_DEVICE_TASK_QUEUE_HOLD;
 	task.data.queue_hold.channel = channel;
 
 	if (add_nolock_task(device, &task)) {
@@ -782,6 +1133,7 @@ static int add_ast_queue_unhold_task(struct sccp_device *device, struct ast_chan
 	struct nolock_task task;
 
 	task.exec = exec_ast_queue_unhold;
+	task.type = SCCP_DEVICE_TASK_QUEUE_UNHOLD;
 	task.data.queue_unhold.channel = channel;
 
 	if (add_nolock_task(device, &task)) {
@@ -812,6 +1164,7 @@ static int add_pickup_channel_task(struct sccp_device *device, struct ast_channe
 	struct nolock_task task;
 
 	task.exec = exec_pickup_channel;
+	task.type = SCCP_DEVICE_TASK_PICKUP_CHANNEL;
 	task.data.pickup_channel.channel = channel;
 
 	if (add_nolock_task(device, &task)) {
@@ -837,6 +1190,7 @@ static int add_start_channel_task(struct sccp_device *device, struct ast_channel
 	struct nolock_task task;
 
 	task.exec = exec_start_channel;
+	task.type = SCCP_DEVICE_TASK_START_CHANNEL;
 	task.data.start_channel.channel = channel;
 
 	if (add_nolock_task(device, &task)) {
@@ -889,62 +1243,87 @@ static struct ast_channel *alloc_channel(struct sccp_line_cfg *line_cfg, const c
 	return channel;
 }
 
-static struct ast_format_cap *sccp_line_build_native_format_cap(struct sccp_line *line, struct ast_format_cap *cap)
+/*
+ * Return the formats supported by both the line and the device, computed once per
+ * line config and device capabilities.
+ *
+ * the device MUST be locked
+ */
+static struct ast_format_cap *sccp_line_compatible_cap(struct sccp_line *line)
 {
 	struct sccp_device *device = line->device;
-	struct ast_format_cap *allowed_cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
-	struct ast_format_cap *selected_cap = NULL;
-	struct ast_format_cap *native_cap = NULL;
+	struct ast_format_cap *compatible_cap;
+
+	if (!line->compatible_cap) {
+		compatible_cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+		if (!compatible_cap) {
+			return NULL;
+		}
+
+		ast_format_cap_get_compatible(line->cfg->caps, device->caps, compatible_cap);
+		line->compatible_cap = compatible_cap;
+	}
+
+	if (ast_format_cap_empty(line->compatible_cap)) {
+		return NULL;
+	}
+
+	ao2_ref(line->compatible_cap, +1);
+
+	return line->compatible_cap;
+}
+
+/*
+ * the device MUST be locked
+ */
+static void sccp_line_invalidate_compatible_cap(struct sccp_line *line)
+{
+	ao2_cleanup(line->compatible_cap);
+	line->compatible_cap = NULL;
+}
+
+/*
+ * The native format is the first format of the line which is supported by the
+ * device and, if given, by cap.
+ *
+ * the device MUST be locked
+ */
+static struct ast_format_cap *sccp_line_build_native_format_cap(struct sccp_line *line, struct ast_format_cap *cap)
+{
+	struct ast_format_cap *allowed_cap;
+	struct ast_format_cap *native_cap;
 	struct ast_format *fmt = NULL;
+	struct ast_format *tmp_fmt;
 	unsigned int framing;
+	size_t i;
 
+	allowed_cap = sccp_line_compatible_cap(line);
 	if (!allowed_cap) {
-		goto end;
-	}
-
-	ast_format_cap_get_compatible(line->cfg->caps, device->caps, allowed_cap);
-	if (ast_format_cap_empty(allowed_cap)) {
 		ast_log(LOG_WARNING, "no compatible codecs\n");
-		goto end;
+		return NULL;
 	}
 
-	if (cap && ast_format_cap_iscompatible(allowed_cap, cap)) {
-		selected_cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
-		if (!selected_cap) {
-			goto end;
-		}
+	if (cap) {
+		for (i = 0; i < ast_format_cap_count(allowed_cap); i++) {
+			tmp_fmt = ast_format_cap_get_format(allowed_cap, i);
+			if (ast_format_cap_iscompatible_format(cap, tmp_fmt) != AST_FORMAT_CMP_NOT_EQUAL) {
+				fmt = tmp_fmt;
+				break;
+			}
 
-		if (ast_format_cap_get_compatible(allowed_cap, cap, selected_cap)) {
-			goto end;
+			ao2_ref(tmp_fmt, -1);
 		}
-	} else {
-		selected_cap = allowed_cap;
-		ao2_ref(selected_cap, +1);
 	}
 
-	if (ast_format_cap_count(selected_cap) == 1) {
-		native_cap = selected_cap;
-		ao2_ref(native_cap, +1);
-	} else {
-		native_cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
-		if (!native_cap) {
-			goto end;
-		}
-
-		fmt = ast_format_cap_get_format(selected_cap, 0);
-		framing = ast_format_cap_get_format_framing(selected_cap, fmt);
-
-		if (ast_format_cap_append(native_cap, fmt, framing)) {
-			ao2_ref(native_cap, -1);
-			native_cap = NULL;
-			goto end;
-		}
+	if (!fmt) {
+		fmt = ast_format_cap_get_format(allowed_cap, 0);
 	}
 
-end:
-	ao2_cleanup(allowed_cap);
-	ao2_cleanup(selected_cap);
-	ao2_cleanup(fmt);
+	framing = ast_format_cap_get_format_framing(allowed_cap, fmt);
+	native_cap = sccp_format_cap_single(fmt, framing);
+
+	ao2_ref(fmt, -1);
+	ao2_ref(allowed_cap, -1);
 
 	return native_cap;
 }
@@ -1021,6 +1400,7 @@ static void sccp_line_destructor(void *data)
 
 	ao2_ref(line->device, -1);
 	ao2_ref(line->cfg, -1);
+	ao2_cleanup(line->compatible_cap);
 }
 
 static struct sccp_line *sccp_line_alloc(struct sccp_line_cfg *cfg, struct sccp_device *device, uint32_t instance)
@@ -1037,6 +1417,7 @@ static struct sccp_line *sccp_line_alloc(struct sccp_line_cfg *cfg, struct sccp_
 	ao2_ref(device, +1);
 	line->cfg = cfg;
 	ao2_ref(cfg, +1);
+	line->compatible_cap = NULL;
 	line->instance = instance;
 	ast_copy_string(line->name, cfg->name, sizeof(line->name));
 
@@ -1056,6 +1437,7 @@ static void sccp_line_destroy(struct sccp_line *line)
 	AST_LIST_TRAVERSE_SAFE_END;
 
 	/* update the line devstate */
+	sccp_devstate_cache_unset(line->name);
 	sccp_line_update_devstate(line, AST_DEVICE_UNAVAILABLE);
 }
 
@@ -1078,6 +1460,7 @@ static struct sccp_subchannel *sccp_line_new_subchannel(struct sccp_line *line,
 
 	/* add subchannel to line */
 	AST_LIST_INSERT_TAIL(&line->subchans, subchan, list);
+	sccp_devstate_cache_set(line->name, AST_DEVICE_INUSE);
 
 	return subchan;
 }
@@ -1115,6 +1498,7 @@ static void sccp_lines_destroy(struct sccp_lines *lines)
  */
 static void sccp_lines_on_registration_success(struct sccp_lines *lines)
 {
+	sccp_devstate_cache_set(lines->line->name, AST_DEVICE_NOT_INUSE);
 	sccp_line_update_devstate(lines->line, AST_DEVICE_NOT_INUSE);
 }
 
@@ -1224,6 +1608,12 @@ static void sccp_lines_apply_config(struct sccp_lines *lines, struct sccp_device
 	ao2_ref(line->cfg, -1);
 	line->cfg = new_device_cfg->line_cfg;
 	ao2_ref(line->cfg, +1);
+	sccp_line_invalidate_compatible_cap(line);
+}
+
+static void sccp_lines_invalidate_compatible_cap(struct sccp_lines *lines)
+{
+	sccp_line_invalidate_compatible_cap(lines->line);
 }
 
 static void sccp_device_destructor(void *data)
@@ -1237,6 +1627,9 @@ static void sccp_device_destructor(void *data)
 	 */
 
 	sccp_queue_destroy(&device->nolock_tasks);
+	if (device->serializer) {
+		ast_taskprocessor_unreference(device->serializer);
+	}
 	ast_mutex_destroy(&device->lock);
 	ao2_ref(device->caps, -1);
 	ao2_ref(device->session, -1);
@@ -1282,6 +1675,27 @@ static int device_type_is_supported(enum sccp_device_type device_type)
 	return supported;
 }
 
+/*
+ * Publish the summary returned by sccp_device_take_snapshot.
+ *
+ * thread: session
+ */
+static void update_summary(struct sccp_device *device)
+{
+	struct ast_str *buf = ast_str_alloca(sizeof(device->summary.capabilities));
+
+	ast_format_cap_get_names(device->caps, &buf);
+
+	sccp_seqlock_write_begin(&device->summary_lock);
+	device->summary.type = device->type;
+	device->summary.guest = device->cfg->guest;
+	device->summary.proto_version = device->proto_version;
+	ast_copy_string(device->summary.name, device->name, sizeof(device->summary.name));
+	ast_copy_string(device->summary.ipaddr, sccp_session_remote_addr_ch(device->session), sizeof(device->summary.ipaddr));
+	ast_copy_string(device->summary.capabilities, ast_str_buffer(buf), sizeof(device->summary.capabilities));
+	sccp_seqlock_write_end(&device->summary_lock);
+}
+
 static struct sccp_device *sccp_device_alloc(struct sccp_device_cfg *cfg, struct sccp_session *session, struct sccp_device_info *info)
 {
 	struct ast_format_cap *caps;
@@ -1301,6 +1715,9 @@ static struct sccp_device *sccp_device_alloc(struct sccp_device_cfg *cfg, struct
 	ast_mutex_init(&device->lock);
 	sccp_msg_builder_init(&device->msg_builder, info->proto_version);
 	sccp_queue_init(&device->nolock_tasks, sizeof(struct nolock_task));
+	device->serializer = NULL;
+	device->offloaded = 0;
+	device->nolock_heavy = 0;
 	device->session = session;
 	ao2_ref(session, +1);
 	device->cfg = cfg;
@@ -1309,6 +1726,7 @@ static struct sccp_device *sccp_device_alloc(struct sccp_device_cfg *cfg, struct
 	device->caps = caps;
 	device->mwi_event_sub = NULL;
 	device->active_subchan = NULL;
+	device->destroyed = 0;
 	/* The callid is not initialized to 1 since the 7940 needs a power cycle
 	   to track calls with a callid lower than the last callid in it's outgoing
 	   call history. ie after an asterisk restart
@@ -1325,6 +1743,8 @@ static struct sccp_device *sccp_device_alloc(struct sccp_device_cfg *cfg, struct
 	device->exten[0] = '\0';
 	device->last_exten[0] = '\0';
 	device->callfwd_exten[0] = '\0';
+	device->summary_lock.seq = 0;
+	update_summary(device);
 
 	return device;
 }
@@ -1388,29 +1808,74 @@ void sccp_device_destroy(struct sccp_device *device)
 	}
 
 	device->state = STATE_DESTROYED;
+	__atomic_store_n(&device->destroyed, 1, __ATOMIC_RELEASE);
 
 	sccp_device_unlock(device);
 }
 
-static void sccp_device_lock(struct sccp_device *device)
+static void sccp_device_lock_at(struct sccp_device *device, const char *site)
 {
+	struct timeval start;
+
+	if (!sccp_lock_profile_enabled()) {
+		ast_mutex_lock(&device->lock);
+		device->locked_at = ast_tvnow();
+		device->locked_site = NULL;
+		return;
+	}
+
+	start = ast_tvnow();
 	ast_mutex_lock(&device->lock);
+	device->locked_at = ast_tvnow();
+	device->locked_site = site;
+
+	sccp_lock_profile_on_wait(SCCP_LOCK_DEVICE, site, ast_tvdiff_us(device->locked_at, start));
 }
 
+static void lock_stats_add(unsigned int hold_time)
+{
+	__atomic_add_fetch(&lock_stats.count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&lock_stats.time_total, hold_time, __ATOMIC_RELAXED);
+	update_max(&lock_stats.time_max, hold_time);
+}
+
+/*
+ * The messages staged while the device was locked are written after the unlock, and
+ * before the nolock tasks are executed.
+ */
 static void sccp_device_unlock(struct sccp_device *device)
 {
 	struct sccp_queue tasks;
+	unsigned int hold_time;
+	int has_tasks;
+	int offload;
+
+	has_tasks = !sccp_queue_empty(&device->nolock_tasks);
+	if (has_tasks) {
+		/* once a batch has been offloaded, the next ones must follow it until it's done */
+		offload = device->nolock_heavy || __atomic_load_n(&device->offloaded, __ATOMIC_ACQUIRE);
+		device->nolock_heavy = 0;
+
+		sccp_queue_move(&tasks, &device->nolock_tasks);
+		if (offload && !offload_nolock_tasks(device, &tasks)) {
+			has_tasks = 0;
+		}
+	}
 
-	if (sccp_queue_empty(&device->nolock_tasks)) {
-		ast_mutex_unlock(&device->lock);
-		return;
+	hold_time = ast_tvdiff_us(ast_tvnow(), device->locked_at);
+	lock_stats_add(hold_time);
+	if (device->locked_site) {
+		sccp_lock_profile_on_hold(SCCP_LOCK_DEVICE, device->locked_site, hold_time);
 	}
 
-	sccp_queue_move(&tasks, &device->nolock_tasks);
 	ast_mutex_unlock(&device->lock);
 
-	exec_nolock_tasks(&tasks);
-	sccp_queue_destroy(&tasks);
+	sccp_session_flush_msgs(device->session);
+
+	if (has_tasks) {
+		exec_nolock_tasks(&tasks, 0);
+		sccp_queue_destroy(&tasks);
+	}
 }
 
 static int sccp_device_is_idle(struct sccp_device *device)
@@ -1483,7 +1948,7 @@ static void transmit_button_template_res(struct sccp_device *device)
 	}
 
 	sccp_msg_button_template_res(&msg, definition, n);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_callinfo(struct sccp_device *device, const char *from_name, const char *from_num, const char *to_name, const char *to_num, uint32_t line_instance, uint32_t callid, enum sccp_direction direction)
@@ -1491,15 +1956,27 @@ static void transmit_callinfo(struct sccp_device *device, const char *from_name,
 	struct sccp_msg msg;
 
 	sccp_msg_builder_callinfo(&device->msg_builder, &msg, from_name, from_num, to_name, to_num, line_instance, callid, direction);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
+}
+
+struct callstate_args {
+	enum sccp_state state;
+	uint32_t line_instance;
+	uint32_t callid;
+};
+
+static void encode_callstate(void *buf, const void *data)
+{
+	const struct callstate_args *args = data;
+
+	sccp_msg_encode_callstate(buf, args->state, args->line_instance, args->callid);
 }
 
 static void transmit_callstate(struct sccp_device *device, enum sccp_state state, uint32_t line_instance, uint32_t callid)
 {
-	struct sccp_msg msg;
+	struct callstate_args args = { state, line_instance, callid };
 
-	sccp_msg_callstate(&msg, state, line_instance, callid);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_encoded(device->session, SCCP_MSG_CALLSTATE_LEN, encode_callstate, &args);
 }
 
 static void transmit_capabilities_req(struct sccp_device *device)
@@ -1507,7 +1984,7 @@ static void transmit_capabilities_req(struct sccp_device *device)
 	struct sccp_msg msg;
 
 	sccp_msg_capabilities_req(&msg);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_close_receive_channel(struct sccp_device *device, uint32_t callid)
@@ -1517,7 +1994,7 @@ static void transmit_close_receive_channel(struct sccp_device *device, uint32_t
 	device->recv_chan_status = SCCP_RECV_CHAN_CLOSED;
 
 	sccp_msg_close_receive_channel(&msg, callid);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_config_status_res(struct sccp_device *device)
@@ -1525,7 +2002,7 @@ static void transmit_config_status_res(struct sccp_device *device)
 	struct sccp_msg msg;
 
 	sccp_msg_config_status_res(&msg, device->name, device->lines.count, device->speeddials.count);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_clear_message(struct sccp_device *device)
@@ -1533,7 +2010,7 @@ static void transmit_clear_message(struct sccp_device *device)
 	struct sccp_msg msg;
 
 	sccp_msg_clear_message(&msg);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_dialed_number(struct sccp_device *device, const char *extension, uint32_t line_instance, uint32_t callid)
@@ -1541,7 +2018,7 @@ static void transmit_dialed_number(struct sccp_device *device, const char *exten
 	struct sccp_msg msg;
 
 	sccp_msg_dialed_number(&msg, extension, line_instance, callid);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_display_message(struct sccp_device *device, const char *text)
@@ -1549,15 +2026,28 @@ static void transmit_display_message(struct sccp_device *device, const char *tex
 	struct sccp_msg msg;
 
 	sccp_msg_display_message(&msg, text);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
+}
+
+struct feature_status_args {
+	uint32_t instance;
+	enum sccp_blf_status status;
+	const char *label;
+};
+
+static void encode_feature_status(void *buf, const void *data)
+{
+	const struct feature_status_args *args = data;
+
+	sccp_msg_encode_feature_status(buf, args->instance, BT_FEATUREBUTTON, args->status, args->label);
 }
 
 static void transmit_feature_status(struct sccp_device *device, struct sccp_speeddial *sd)
 {
-	struct sccp_msg msg;
+	/* not computed while the staged messages are locked */
+	struct feature_status_args args = { sd->instance, sccp_speeddial_status(device, sd), sd->cfg->label };
 
-	sccp_msg_feature_status(&msg, sd->instance, BT_FEATUREBUTTON, sccp_speeddial_status(device, sd), sd->cfg->label);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_encoded(device->session, SCCP_MSG_FEATURE_STATUS_LEN, encode_feature_status, &args);
 }
 
 static void transmit_forward_status_res(struct sccp_device *device, uint32_t line_instance, const char *extension, uint32_t status)
@@ -1565,23 +2055,37 @@ static void transmit_forward_status_res(struct sccp_device *device, uint32_t lin
 	struct sccp_msg msg;
 
 	sccp_msg_forward_status_res(&msg, line_instance, extension, status);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
+}
+
+static void encode_keep_alive_ack(void *buf, const void *data)
+{
+	sccp_msg_encode_keep_alive_ack(buf);
 }
 
 static void transmit_keep_alive_ack(struct sccp_device *device)
 {
-	struct sccp_msg msg;
+	sccp_session_stage_encoded(device->session, SCCP_MSG_KEEP_ALIVE_ACK_LEN, encode_keep_alive_ack, NULL);
+}
+
+struct lamp_state_args {
+	enum sccp_stimulus_type stimulus;
+	uint32_t instance;
+	enum sccp_lamp_state indication;
+};
 
-	sccp_msg_keep_alive_ack(&msg);
-	sccp_session_transmit_msg(device->session, &msg);
+static void encode_lamp_state(void *buf, const void *data)
+{
+	const struct lamp_state_args *args = data;
+
+	sccp_msg_encode_lamp_state(buf, args->stimulus, args->instance, args->indication);
 }
 
 static void transmit_lamp_state(struct sccp_device *device, enum sccp_stimulus_type stimulus, uint32_t instance, enum sccp_lamp_state indication)
 {
-	struct sccp_msg msg;
+	struct lamp_state_args args = { stimulus, instance, indication };
 
-	sccp_msg_lamp_state(&msg, stimulus, instance, indication);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_encoded(device->session, SCCP_MSG_LAMP_STATE_LEN, encode_lamp_state, &args);
 }
 
 static void transmit_line_status_res(struct sccp_device *device, struct sccp_line *line)
@@ -1590,7 +2094,7 @@ static void transmit_line_status_res(struct sccp_device *device, struct sccp_lin
 	struct sccp_line_cfg *line_cfg = line->cfg;
 
 	sccp_msg_builder_line_status_res(&device->msg_builder, &msg, line_cfg->cid_name, line_cfg->cid_num, line->instance);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_register_ack(struct sccp_device *device)
@@ -1599,7 +2103,7 @@ static void transmit_register_ack(struct sccp_device *device)
 	struct sccp_device_cfg *device_cfg = device->cfg;
 
 	sccp_msg_builder_register_ack(&device->msg_builder, &msg, device_cfg->dateformat, device_cfg->keepalive);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_reset(struct sccp_device *device, enum sccp_reset_type type)
@@ -1607,7 +2111,7 @@ static void transmit_reset(struct sccp_device *device, enum sccp_reset_type type
 	struct sccp_msg msg;
 
 	sccp_msg_reset(&msg, type);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_ringer_mode(struct sccp_device *device, enum sccp_ringer_mode mode)
@@ -1615,15 +2119,27 @@ static void transmit_ringer_mode(struct sccp_device *device, enum sccp_ringer_mo
 	struct sccp_msg msg;
 
 	sccp_msg_ringer_mode(&msg, mode);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
+}
+
+struct selectsoftkeys_args {
+	uint32_t line_instance;
+	uint32_t callid;
+	enum sccp_softkey_status softkey;
+};
+
+static void encode_selectsoftkeys(void *buf, const void *data)
+{
+	const struct selectsoftkeys_args *args = data;
+
+	sccp_msg_encode_select_softkeys(buf, args->line_instance, args->callid, args->softkey);
 }
 
 static void transmit_selectsoftkeys(struct sccp_device *device, uint32_t line_instance, uint32_t callid, enum sccp_softkey_status softkey)
 {
-	struct sccp_msg msg;
+	struct selectsoftkeys_args args = { line_instance, callid, softkey };
 
-	sccp_msg_select_softkeys(&msg, line_instance, callid, softkey);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_encoded(device->session, SCCP_MSG_SELECT_SOFTKEYS_LEN, encode_selectsoftkeys, &args);
 }
 
 static void transmit_speeddial_stat_res(struct sccp_device *device, struct sccp_speeddial *sd)
@@ -1631,7 +2147,7 @@ static void transmit_speeddial_stat_res(struct sccp_device *device, struct sccp_
 	struct sccp_msg msg;
 
 	sccp_msg_speeddial_stat_res(&msg, sd->index, sd->cfg->extension, sd->cfg->label);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_softkey_set_res(struct sccp_device *device)
@@ -1639,7 +2155,7 @@ static void transmit_softkey_set_res(struct sccp_device *device)
 	struct sccp_msg msg;
 
 	sccp_msg_softkey_set_res(&msg);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_softkey_template_res(struct sccp_device *device)
@@ -1647,7 +2163,7 @@ static void transmit_softkey_template_res(struct sccp_device *device)
 	struct sccp_msg msg;
 
 	sccp_msg_softkey_template_res(&msg);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_speaker_mode(struct sccp_device *device, enum sccp_speaker_mode mode)
@@ -1655,7 +2171,7 @@ static void transmit_speaker_mode(struct sccp_device *device, enum sccp_speaker_
 	struct sccp_msg msg;
 
 	sccp_msg_speaker_mode(&msg, mode);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_stop_media_transmission(struct sccp_device *device, uint32_t callid)
@@ -1663,15 +2179,26 @@ static void transmit_stop_media_transmission(struct sccp_device *device, uint32_
 	struct sccp_msg msg;
 
 	sccp_msg_stop_media_transmission(&msg, callid);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
+}
+
+struct stop_tone_args {
+	uint32_t line_instance;
+	uint32_t callid;
+};
+
+static void encode_stop_tone(void *buf, const void *data)
+{
+	const struct stop_tone_args *args = data;
+
+	sccp_msg_encode_stop_tone(buf, args->line_instance, args->callid);
 }
 
 static void transmit_stop_tone(struct sccp_device *device, uint32_t line_instance, uint32_t callid)
 {
-	struct sccp_msg msg;
+	struct stop_tone_args args = { line_instance, callid };
 
-	sccp_msg_stop_tone(&msg, line_instance, callid);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_encoded(device->session, SCCP_MSG_STOP_TONE_LEN, encode_stop_tone, &args);
 }
 
 static void transmit_time_date_res(struct sccp_device *device)
@@ -1679,15 +2206,27 @@ static void transmit_time_date_res(struct sccp_device *device)
 	struct sccp_msg msg;
 
 	sccp_msg_time_date_res(&msg, device->cfg->timezone);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
+}
+
+struct tone_args {
+	enum sccp_tone tone;
+	uint32_t line_instance;
+	uint32_t callid;
+};
+
+static void encode_tone(void *buf, const void *data)
+{
+	const struct tone_args *args = data;
+
+	sccp_msg_encode_tone(buf, args->tone, args->line_instance, args->callid);
 }
 
 static void transmit_tone(struct sccp_device *device, enum sccp_tone tone, uint32_t line_instance, uint32_t callid)
 {
-	struct sccp_msg msg;
+	struct tone_args args = { tone, line_instance, callid };
 
-	sccp_msg_tone(&msg, tone, line_instance, callid);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_encoded(device->session, SCCP_MSG_TONE_LEN, encode_tone, &args);
 }
 
 static void transmit_version_res(struct sccp_device *device)
@@ -1696,7 +2235,7 @@ static void transmit_version_res(struct sccp_device *device)
 
 	/* hardcoded firmware version value taken from chan_skinny */
 	sccp_msg_version_res(&msg, "P002F202");
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_line_forward_status_res(struct sccp_device *device, struct sccp_line *line)
@@ -1732,7 +2271,7 @@ static void transmit_subchan_open_receive_channel(struct sccp_device *device, st
 	device->recv_chan_status = SCCP_RECV_CHAN_OPENING;
 
 	sccp_msg_open_receive_channel(&msg, subchan->id, subchan->framing, codec_ast2sccp(subchan->fmt));
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_subchan_selectsoftkeys(struct sccp_device *device, struct sccp_subchannel *subchan, enum sccp_softkey_status softkey)
@@ -1746,7 +2285,7 @@ static void transmit_subchan_start_media_transmission(struct sccp_device *device
 
 	ast_debug(2, "Sending start media transmission to %s: %s %d\n", sccp_session_remote_addr_ch(device->session), ast_inet_ntoa(endpoint->sin_addr), ntohs(endpoint->sin_port));
 	sccp_msg_start_media_transmission(&msg, subchan->id, subchan->framing, codec_ast2sccp(subchan->fmt), subchan->line->cfg->tos_audio, endpoint);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_subchan_stop_tone(struct sccp_device *device, struct sccp_subchannel *subchan)
@@ -1771,7 +2310,7 @@ static void transmit_subscription_status_res(struct sccp_device *device, uint32_
 	struct sccp_msg msg;
 
 	sccp_msg_subscription_status_res(&msg, transactionId, featureId, timer, cause);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
 static void transmit_notification(struct sccp_device *device, uint32_t transactionId, uint32_t featureId, enum sccp_blf_status status, const char *text)
@@ -1779,10 +2318,10 @@ static void transmit_notification(struct sccp_device *device, uint32_t transacti
 	struct sccp_msg msg;
 
 	sccp_msg_notification(&msg, transactionId, featureId, status, text);
-	sccp_session_transmit_msg(device->session, &msg);
+	sccp_session_stage_msg(device->session, &msg);
 }
 
-static void handle_msg_button_template_req(struct sccp_device *device)
+static void handle_msg_button_template_req(struct sccp_device *device, struct sccp_msg *msg)
 {
 	transmit_button_template_res(device);
 }
@@ -1791,6 +2330,7 @@ static void sccp_device_panic(struct sccp_device *device)
 {
 	ast_log(LOG_WARNING, "panic for device %s\n", device->name);
 	sccp_stat_on_device_panic();
+	sccp_session_dump_flight_recorder(device->session, -1, "panic");
 
 	sccp_session_stop(device->session);
 	if (device->state == STATE_WORKING) {
@@ -1804,6 +2344,7 @@ static void sccp_device_set_fault(struct sccp_device *device, const char *reason
 	ast_log(LOG_WARNING, "fault detected on device %s: %s\n", device->name, reason);
 	ast_set_flag(device, DEVICE_FAULT);
 	sccp_stat_on_device_fault();
+	sccp_session_dump_flight_recorder(device->session, -1, reason);
 }
 
 static void sccp_device_on_idle(struct sccp_device *device)
@@ -1970,7 +2511,7 @@ static int do_hold(struct sccp_device *device)
 	transmit_close_receive_channel(device, subchan->id);
 	transmit_stop_media_transmission(device, subchan->id);
 
-	device->active_subchan = NULL;
+	set_active_subchan(device, NULL);
 
 	return 0;
 }
@@ -1993,7 +2534,7 @@ static int do_resume(struct sccp_device *device, struct sccp_subchannel *subchan
 		transmit_subchan_open_receive_channel(device, subchan);
 	}
 
-	device->active_subchan = subchan;
+	set_active_subchan(device, subchan);
 
 	return 0;
 }
@@ -2026,7 +2567,7 @@ static struct sccp_subchannel *do_newcall_options(struct sccp_device *device, en
 		return NULL;
 	}
 
-	device->active_subchan = subchan;
+	set_active_subchan(device, subchan);
 
 	transmit_line_lamp_state(device, subchan->line, SCCP_LAMP_ON);
 	transmit_subchan_callstate(device, subchan, SCCP_OFFHOOK);
@@ -2058,9 +2599,7 @@ static void do_clear_subchannel(struct sccp_device *device, struct sccp_subchann
 			transmit_stop_media_transmission(device, subchan->id);
 		}
 
-		ast_rtp_instance_stop(subchan->rtp);
-		ast_rtp_instance_destroy(subchan->rtp);
-		subchan->rtp = NULL;
+		subchan_destroy_rtp(subchan);
 	} else if (subchan == device->active_subchan && device->recv_chan_status != SCCP_RECV_CHAN_CLOSED) {
 		transmit_close_receive_channel(device, subchan->id);
 	}
@@ -2080,11 +2619,12 @@ static void do_clear_subchannel(struct sccp_device *device, struct sccp_subchann
 	AST_LIST_REMOVE(&line->subchans, subchan, list);
 	if (AST_LIST_EMPTY(&line->subchans)) {
 		transmit_speaker_mode(device, SCCP_SPEAKEROFF);
+		sccp_devstate_cache_set(line->name, AST_DEVICE_NOT_INUSE);
 		sccp_line_update_devstate(line, AST_DEVICE_NOT_INUSE);
 	}
 
 	if (subchan == device->active_subchan) {
-		device->active_subchan = NULL;
+		set_active_subchan(device, NULL);
 	}
 
 	if (sccp_device_is_idle(device)) {
@@ -2143,7 +2683,7 @@ static int do_answer_options(struct sccp_device *device, struct sccp_subchannel
 		}
 	}
 
-	device->active_subchan = subchan;
+	set_active_subchan(device, subchan);
 
 	if (options & OPT_SPEAKER_ON) {
 		transmit_speaker_mode(device, SCCP_SPEAKERON);
@@ -2235,6 +2775,7 @@ static int start_the_call(struct sccp_device *device, struct sccp_subchannel *su
 	ast_channel_unlock(channel);
 
 	subchan->state = SCCP_RINGOUT;
+	SCCP_STAT_INC(device->stats.calls_placed, 1);
 	if (ast_test_flag(subchan, SUBCHANNEL_TRANSFERRING)) {
 		transmit_subchan_selectsoftkeys(device, subchan, KEYDEF_CONNINTRANSFER);
 	} else {
@@ -2281,6 +2822,7 @@ static void handle_msg_capabilities_res(struct sccp_device *device, struct sccp_
 {
 	struct ast_format *format;
 	uint32_t count = letohl(msg->data.caps.count);
+	uint32_t body_count;
 	uint32_t sccpcodec;
 	uint32_t i;
 
@@ -2289,7 +2831,14 @@ static void handle_msg_capabilities_res(struct sccp_device *device, struct sccp_
 		ast_log(LOG_WARNING, "Received more capabilities (%d) than we can handle (%d)\n", count, SCCP_MAX_CAPABILITIES);
 	}
 
+	/* only the capabilities that are in the body */
+	body_count = (letohl(msg->length) - 4 - SCCP_MSG_BODY_LEN_UPTO(capabilities_res_message, count)) / sizeof(struct station_capabilities);
+	if (count > body_count) {
+		count = body_count;
+	}
+
 	ast_format_cap_remove_by_type(device->caps, AST_MEDIA_TYPE_UNKNOWN);
+	sccp_lines_invalidate_compatible_cap(&device->lines);
 
 	for (i = 0; i < count; i++) {
 		sccpcodec = letohl(msg->data.caps.caps[i].codec);
@@ -2298,9 +2847,11 @@ static void handle_msg_capabilities_res(struct sccp_device *device, struct sccp_
 			ast_format_cap_append(device->caps, format, 0);
 		}
 	}
+
+	update_summary(device);
 }
 
-static void handle_msg_config_status_req(struct sccp_device *device)
+static void handle_msg_config_status_req(struct sccp_device *device, struct sccp_msg *msg)
 {
 	transmit_config_status_res(device);
 }
@@ -2339,8 +2890,27 @@ static void handle_msg_feature_status_req(struct sccp_device *device, struct scc
 	transmit_feature_status(device, sd);
 }
 
-static void handle_msg_keep_alive(struct sccp_device *device)
+static void update_keepalive_stats(struct sccp_device *device)
 {
+	struct device_stats *stats = &device->stats;
+	struct timeval now = ast_tvnow();
+	unsigned int interval = ast_tvdiff_ms(now, stats->keepalive_at);
+	int delta;
+
+	if (stats->last_keepalive) {
+		delta = abs((int) interval - (int) stats->keepalive_interval);
+		/* smoothed like the interarrival jitter of RFC 3550 */
+		SCCP_STAT_SET(stats->keepalive_jitter, stats->keepalive_jitter + (delta - (int) stats->keepalive_jitter) / 16);
+	}
+
+	SCCP_STAT_SET(stats->keepalive_interval, interval);
+	SCCP_STAT_SET(stats->last_keepalive, now.tv_sec);
+	stats->keepalive_at = now;
+}
+
+static void handle_msg_keep_alive(struct sccp_device *device, struct sccp_msg *msg)
+{
+	update_keepalive_stats(device);
 	transmit_keep_alive_ack(device);
 }
 
@@ -2477,45 +3047,48 @@ static void handle_msg_offhook(struct sccp_device *device, struct sccp_msg *msg)
 	}
 }
 
-static void subchan_init_rtp_instance(struct sccp_subchannel *subchan)
+/*
+ * The properties common to every instance are set by the RTP pool.
+ */
+static void subchan_init_rtp_instance(struct sccp_subchannel *subchan, struct ast_rtp_instance *rtp)
 {
-	ast_rtp_instance_set_prop(subchan->rtp, AST_RTP_PROPERTY_RTCP, 1);
+	struct ast_sockaddr remote_tmp;
 
 	if (subchan->channel) {
-		ast_rtp_instance_set_channel_id(subchan->rtp, ast_channel_uniqueid(subchan->channel));
-		ast_channel_set_fd(subchan->channel, 0, ast_rtp_instance_fd(subchan->rtp, 0));
-		ast_channel_set_fd(subchan->channel, 1, ast_rtp_instance_fd(subchan->rtp, 1));
+		ast_rtp_instance_set_channel_id(rtp, ast_channel_uniqueid(subchan->channel));
+		ast_channel_set_fd(subchan->channel, 0, ast_rtp_instance_fd(rtp, 0));
+		ast_channel_set_fd(subchan->channel, 1, ast_rtp_instance_fd(rtp, 1));
 	}
 
-	ast_rtp_instance_set_qos(subchan->rtp, subchan->line->cfg->tos_audio, 0, "sccp rtp");
-	ast_rtp_instance_set_prop(subchan->rtp, AST_RTP_PROPERTY_NAT, 0);
+	ast_rtp_instance_set_qos(rtp, subchan->line->cfg->tos_audio, 0, "sccp rtp");
 
-	/*
-	 *  hack that add the 0 payload type (i.e. the G.711 mu-law payload type) to the list
-	 *  of payload that the rtp_instance knows about. It works because currently, we are
-	 *  always using G.711 mu-law, alaw or g729 (0, 8, 18)
-	 */
-	ast_rtp_codecs_payloads_set_m_type(ast_rtp_instance_get_codecs(subchan->rtp), subchan->rtp, 0);
-	ast_rtp_codecs_payloads_set_m_type(ast_rtp_instance_get_codecs(subchan->rtp), subchan->rtp, 8);
-	ast_rtp_codecs_payloads_set_m_type(ast_rtp_instance_get_codecs(subchan->rtp), subchan->rtp, 18);
+	ast_rtp_codecs_set_framing(ast_rtp_instance_get_codecs(rtp), subchan->framing);
 
-	ast_rtp_codecs_set_framing(ast_rtp_instance_get_codecs(subchan->rtp), subchan->framing);
+	ast_sockaddr_from_sin(&remote_tmp, &subchan->line->device->remote);
+	ast_rtp_instance_set_remote_address(rtp, &remote_tmp);
 }
 
 static int start_rtp(struct sccp_subchannel *subchan)
 {
-	struct ast_sockaddr bindaddr_tmp;
+	struct ast_rtp_instance *rtp;
+	struct sockaddr_in local;
+	unsigned int shard;
 
-	ast_sockaddr_from_sin(&bindaddr_tmp, sccp_session_local_addr(subchan->line->device->session));
-	subchan->rtp = ast_rtp_instance_new("asterisk", sccp_sched, &bindaddr_tmp, NULL);
-	if (!subchan->rtp) {
+	rtp = sccp_rtp_pool_get(sccp_session_local_addr(subchan->line->device->session), &shard);
+	if (!rtp) {
 		ast_log(LOG_ERROR, "RTP instance creation failed\n");
 		return -1;
 	}
 
-	subchan_init_rtp_instance(subchan);
+	/*
+	 * The write fast path may use the instance as soon as it's published, and might
+	 * still be using the previous one, which is retired until the channel is locked.
+	 */
+	subchan_init_rtp_instance(subchan, rtp);
+	subchan_set_rtp(subchan, rtp, shard);
 
-	sccp_subchannel_start_media_transmission(subchan);
+	sccp_subchannel_get_rtp_local_address(subchan, &local);
+	transmit_subchan_start_media_transmission(subchan->line->device, subchan, &local);
 
 	return 0;
 }
@@ -2733,7 +3306,7 @@ static void handle_softkey_transfer(struct sccp_device *device, uint32_t line_in
 		xfer_subchan->related = subchan;
 		subchan->related = xfer_subchan;
 
-		device->active_subchan = subchan;
+		set_active_subchan(device, subchan);
 
 		transmit_subchan_callstate(device, subchan, SCCP_OFFHOOK);
 		transmit_subchan_selectsoftkeys(device, subchan, KEYDEF_DIALINTRANSFER);
@@ -2811,13 +3384,13 @@ static void handle_msg_softkey_event(struct sccp_device *device, struct sccp_msg
 	}
 }
 
-static void handle_msg_softkey_set_req(struct sccp_device *device)
+static void handle_msg_softkey_set_req(struct sccp_device *device, struct sccp_msg *msg)
 {
 	transmit_softkey_set_res(device);
 	transmit_selectsoftkeys(device, 0, 0, KEYDEF_ONHOOK);
 }
 
-static void handle_msg_softkey_template_req(struct sccp_device *device)
+static void handle_msg_softkey_template_req(struct sccp_device *device, struct sccp_msg *msg)
 {
 	transmit_softkey_template_res(device);
 }
@@ -2896,17 +3469,17 @@ static void handle_msg_stimulus(struct sccp_device *device, struct sccp_msg *msg
 	}
 }
 
-static void handle_msg_time_date_req(struct sccp_device *device)
+static void handle_msg_time_date_req(struct sccp_device *device, struct sccp_msg *msg)
 {
 	transmit_time_date_res(device);
 }
 
-static void handle_msg_unregister(struct sccp_device *device)
+static void handle_msg_unregister(struct sccp_device *device, struct sccp_msg *msg)
 {
 	sccp_session_stop(device->session);
 }
 
-static void handle_msg_version_req(struct sccp_device *device)
+static void handle_msg_version_req(struct sccp_device *device, struct sccp_msg *msg)
 {
 	transmit_version_res(device);
 }
@@ -2917,6 +3490,8 @@ static void handle_msg_subscription_status_req(struct sccp_device *device, struc
 	uint32_t featureId = letohl(msg->data.subscription.featureId);
 	uint32_t timer = letohl(msg->data.subscription.timer);
 
+	msg->data.subscription.subscriptionId[sizeof(msg->data.subscription.subscriptionId) - 1] = '\0';
+
 	// We should perform a real lookup on the dialplan to return a valid cause
 	transmit_subscription_status_res(device, transactionId, featureId, timer, OK);
 
@@ -2926,117 +3501,52 @@ static void handle_msg_subscription_status_req(struct sccp_device *device, struc
 	transmit_notification(device, transactionId, featureId, status, NULL);
 }
 
-static void handle_msg_state_common(struct sccp_device *device, struct sccp_msg *msg, uint32_t msg_id)
+static void handle_msg_alarm(struct sccp_device *device, struct sccp_msg *msg)
 {
-	switch (msg_id) {
-	case KEEP_ALIVE_MESSAGE:
-		handle_msg_keep_alive(device);
-		break;
-
-	case ALARM_MESSAGE:
-		ast_debug(1, "Alarm message: %s\n", msg->data.alarm.displayMessage);
-		break;
-
-	case ENBLOC_CALL_MESSAGE:
-		handle_msg_enbloc_call(device, msg);
-		break;
-
-	case STIMULUS_MESSAGE:
-		handle_msg_stimulus(device, msg);
-		break;
-
-	case KEYPAD_BUTTON_MESSAGE:
-		handle_msg_keypad_button(device, msg);
-		break;
-
-	case OFFHOOK_MESSAGE:
-		handle_msg_offhook(device, msg);
-		break;
-
-	case ONHOOK_MESSAGE:
-		handle_msg_onhook(device, msg);
-		break;
-
-	case FORWARD_STATUS_REQ_MESSAGE:
-		/* do nothing here, not all phone query the forward status */
-		break;
-
-	case CAPABILITIES_RES_MESSAGE:
-		handle_msg_capabilities_res(device, msg);
-		break;
-
-	case SPEEDDIAL_STAT_REQ_MESSAGE:
-		handle_msg_speeddial_status_req(device, msg);
-		break;
-
-	case FEATURE_STATUS_REQ_MESSAGE:
-		handle_msg_feature_status_req(device, msg);
-		break;
-
-	case LINE_STATUS_REQ_MESSAGE:
-		handle_msg_line_status_req(device, msg);
-		break;
-
-	case CONFIG_STATUS_REQ_MESSAGE:
-		handle_msg_config_status_req(device);
-		break;
-
-	case TIME_DATE_REQ_MESSAGE:
-		handle_msg_time_date_req(device);
-		break;
-
-	case BUTTON_TEMPLATE_REQ_MESSAGE:
-		handle_msg_button_template_req(device);
-		break;
-
-	case UNREGISTER_MESSAGE:
-		handle_msg_unregister(device);
-		break;
+	ast_debug(1, "Alarm message: %s\n", msg->data.alarm.displayMessage);
+}
 
-	case SOFTKEY_TEMPLATE_REQ_MESSAGE:
-		handle_msg_softkey_template_req(device);
-		break;
+static void handle_msg_forward_status_req(struct sccp_device *device, struct sccp_msg *msg)
+{
+	/* do nothing here, not all phone query the forward status */
+}
 
-	case SOFTKEY_EVENT_MESSAGE:
-		handle_msg_softkey_event(device, msg);
-		break;
+typedef void (*sccp_msg_handler)(struct sccp_device *device, struct sccp_msg *msg);
 
-	case OPEN_RECEIVE_CHANNEL_ACK_MESSAGE:
-		handle_msg_open_receive_channel_ack(device, msg);
-		break;
+#define SCCP_MSG_AS_HANDLER(name, id, str, min_len, max_len, dump, handler) handler,
 
-	case SOFTKEY_SET_REQ_MESSAGE:
-		handle_msg_softkey_set_req(device);
-		break;
+static const sccp_msg_handler msg_handlers[SCCP_MSG_COUNT] = {
+	SCCP_MSG_LIST(SCCP_MSG_AS_HANDLER)
+};
 
-	case VERSION_REQ_MESSAGE:
-		handle_msg_version_req(device);
-		break;
+static void handle_msg_state_common(struct sccp_device *device, struct sccp_msg *msg, const struct sccp_msg_desc *desc)
+{
+	sccp_msg_handler handler = msg_handlers[desc->index];
 
-	case SUBSCRIPTION_STATUS_REQ_MESSAGE:
-		handle_msg_subscription_status_req(device, msg);
-		break;
-	default:
-		ast_debug(1, "ignoring message with ID 0x%04X\n", msg_id);
-		break;
+	if (!handler) {
+		ast_debug(1, "ignoring %s message\n", desc->name);
+		return;
 	}
+
+	handler(device, msg);
 }
 
-int sccp_device_handle_msg(struct sccp_device *device, struct sccp_msg *msg)
+int sccp_device_handle_msg(struct sccp_device *device, struct sccp_msg *msg, const struct sccp_msg_desc *desc)
 {
-	uint32_t msg_id;
-
 	if (!msg) {
 		ast_log(LOG_ERROR, "sccp device handle msg failed: msg is null\n");
 		return -1;
 	}
 
-	msg_id = letohl(msg->id);
+	if (!desc) {
+		ast_log(LOG_ERROR, "sccp device handle msg failed: desc is null\n");
+		return -1;
+	}
 
 	sccp_device_lock(device);
 
 	if (device->state == STATE_WORKING) {
-		handle_msg_state_common(device, msg, msg_id);
+		handle_msg_state_common(device, msg, desc);
 	}
 
 	sccp_device_unlock(device);
@@ -3128,6 +3638,7 @@ static void on_keepalive_timeout(struct sccp_device *device, void __attribute__(
 {
 	ast_log(LOG_NOTICE, "Device %s has timed out\n", device->name);
 
+	sccp_session_dump_flight_recorder(device->session, -1, "keepalive timeout");
 	sccp_session_stop(device->session);
 }
 
@@ -3267,6 +3778,9 @@ void sccp_device_on_registration_success(struct sccp_device *device)
 
 	add_keepalive_task(device);
 
+	device->stats.keepalive_at = ast_tvnow();
+	SCCP_STAT_SET(device->stats.registration_time, device->stats.keepalive_at.tv_sec);
+
 	device->state = STATE_WORKING;
 
 	sccp_lines_on_registration_success(&device->lines);
@@ -3291,18 +3805,20 @@ int sccp_device_reset(struct sccp_device *device, enum sccp_reset_type type)
 
 void sccp_device_take_snapshot(struct sccp_device *device, struct sccp_device_snapshot *snapshot)
 {
-	struct ast_str *buf = ast_str_alloca(sizeof(snapshot->capabilities));
+	unsigned int seq;
 
-	sccp_device_lock(device);
-	snapshot->type = device->type;
-	snapshot->guest = device->cfg->guest;
-	snapshot->proto_version = device->proto_version;
-	ast_copy_string(snapshot->name, device->name, sizeof(snapshot->name));
-	ast_copy_string(snapshot->ipaddr, sccp_session_remote_addr_ch(device->session), sizeof(snapshot->ipaddr));
-	ast_format_cap_get_names(device->caps, &buf);
-	sccp_device_unlock(device);
+	do {
+		seq = sccp_seqlock_read_begin(&device->summary_lock);
+		memcpy(snapshot, &device->summary, sizeof(*snapshot));
+	} while (sccp_seqlock_read_retry(&device->summary_lock, seq));
 
-	ast_copy_string(snapshot->capabilities, ast_str_buffer(buf), sizeof(snapshot->capabilities));
+	sccp_session_take_stats(device->session, &snapshot->stats.session);
+	snapshot->stats.registration_time = SCCP_STAT_LOAD(device->stats.registration_time);
+	snapshot->stats.last_keepalive = SCCP_STAT_LOAD(device->stats.last_keepalive);
+	snapshot->stats.keepalive_interval = SCCP_STAT_LOAD(device->stats.keepalive_interval);
+	snapshot->stats.keepalive_jitter = SCCP_STAT_LOAD(device->stats.keepalive_jitter);
+	snapshot->stats.calls_placed = SCCP_STAT_LOAD(device->stats.calls_placed);
+	snapshot->stats.calls_received = SCCP_STAT_LOAD(device->stats.calls_received);
 }
 
 unsigned int sccp_device_line_count(const struct sccp_device *device)
@@ -3335,11 +3851,36 @@ int sccp_device_is_guest(struct sccp_device *device)
 	return guest;
 }
 
+enum sccp_device_type sccp_device_type(const struct sccp_device *device)
+{
+	return device->type;
+}
+
+uint8_t sccp_device_proto_version(const struct sccp_device *device)
+{
+	return device->proto_version;
+}
+
+const struct sockaddr_in *sccp_device_remote_addr(const struct sccp_device *device)
+{
+	return sccp_session_remote_addr(device->session);
+}
+
+struct sccp_session *sccp_device_session(const struct sccp_device *device)
+{
+	return device->session;
+}
+
 const char *sccp_line_name(const struct sccp_line *line)
 {
 	return line->name;
 }
 
+struct sccp_device *sccp_line_device(const struct sccp_line *line)
+{
+	return line->device;
+}
+
 static int channel_tech_requester_locked(struct sccp_device *device, struct sccp_line *line, struct ast_channel *channel, const char *options, struct ast_format_cap *cap, int *cause)
 {
 	struct sccp_subchannel *subchan;
@@ -3494,6 +4035,7 @@ int sccp_channel_tech_call(struct ast_channel *channel, const char *dest, int ti
 	}
 
 	subchan->state = SCCP_RINGIN;
+	SCCP_STAT_INC(device->stats.calls_received, 1);
 
 	if (!device->active_subchan) {
 		transmit_ringer_mode(device, SCCP_RING_INSIDE);
@@ -3529,9 +4071,7 @@ int sccp_channel_tech_hangup(struct ast_channel *channel)
 
 	if (device->state == STATE_DESTROYED) {
 		if (subchan->rtp) {
-			ast_rtp_instance_stop(subchan->rtp);
-			ast_rtp_instance_destroy(subchan->rtp);
-			subchan->rtp = NULL;
+			subchan_destroy_rtp(subchan);
 		}
 
 		subchan->channel = NULL;
@@ -3602,23 +4142,16 @@ struct ast_frame *sccp_channel_tech_read(struct ast_channel *channel)
 	struct sccp_line *line = subchan->line;
 	struct sccp_device *device = line->device;
 	struct ast_frame *frame;
-	struct ast_rtp_instance *rtp = NULL;
+	struct ast_rtp_instance *rtp;
 	struct ast_format_cap *caps;
 
-	sccp_device_lock(device);
-
-	if (device->state == STATE_DESTROYED) {
-		goto unlock;
-	}
-
-	if (subchan->rtp) {
-		rtp = subchan->rtp;
-		ao2_ref(rtp, +1);
+	/* lock-free, since it's called for every frame */
+	if (__atomic_load_n(&device->destroyed, __ATOMIC_ACQUIRE)) {
+		return &ast_null_frame;
 	}
 
-unlock:
-	sccp_device_unlock(device);
-
+	/* no reference is taken: the instance is released only after the channel hangup */
+	rtp = media_ref_get(&subchan->media);
 	if (!rtp) {
 		return &ast_null_frame;
 	}
@@ -3638,9 +4171,8 @@ unlock:
 
 	if (frame && frame->frametype == AST_FRAME_VOICE) {
 		if (ast_format_cap_iscompatible_format(ast_channel_nativeformats(channel), frame->subclass.format) == AST_FORMAT_CMP_NOT_EQUAL) {
-			caps = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+			caps = sccp_format_cap_single(frame->subclass.format, 0);
 			if (caps) {
-				ast_format_cap_append(caps, frame->subclass.format, 0);
 				ast_channel_nativeformats_set(channel, caps);
 				ao2_ref(caps, -1);
 			}
@@ -3650,8 +4182,6 @@ unlock:
 		}
 	}
 
-	ao2_ref(rtp, -1);
-
 	return frame;
 }
 
@@ -3660,8 +4190,17 @@ int sccp_channel_tech_write(struct ast_channel *channel, struct ast_frame *frame
 	struct sccp_subchannel *subchan = ast_channel_tech_pvt(channel);
 	struct sccp_line *line = subchan->line;
 	struct sccp_device *device = line->device;
+	struct ast_rtp_instance *rtp;
 	int res = 0;
 
+	/* lock-free fast path, when the media is established */
+	if (__atomic_load_n(&subchan->media_active, __ATOMIC_ACQUIRE) && !__atomic_load_n(&device->destroyed, __ATOMIC_ACQUIRE)) {
+		rtp = media_ref_get(&subchan->media);
+		if (rtp) {
+			return ast_rtp_instance_write(rtp, frame);
+		}
+	}
+
 	sccp_device_lock(device);
 
 	if (device->state == STATE_DESTROYED) {
@@ -3935,3 +4474,114 @@ void sccp_rtp_glue_get_codec(struct ast_channel *channel, struct ast_format_cap
 
 	ast_format_cap_append(result, subchan->fmt, subchan->framing);
 }
+
+static int task_type_is_heavy(enum sccp_device_task_type type)
+{
+	switch (type) {
+	case SCCP_DEVICE_TASK_TRANSFER_ATTENDED:
+	case SCCP_DEVICE_TASK_PICKUP_CHANNEL:
+	case SCCP_DEVICE_TASK_START_CHANNEL:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+const char *sccp_device_task_type_str(enum sccp_device_task_type type)
+{
+	switch (type) {
+	case SCCP_DEVICE_TASK_TRANSFER_ATTENDED:
+		return "transfer_attended";
+	case SCCP_DEVICE_TASK_QUEUE_CONTROL:
+		return "queue_control";
+	case SCCP_DEVICE_TASK_QUEUE_FRAME_DTMF:
+		return "queue_frame_dtmf";
+	case SCCP_DEVICE_TASK_QUEUE_HANGUP:
+		return "queue_hangup";
+	case SCCP_DEVICE_TASK_QUEUE_HOLD:
+		return "queue_hold";
+	case SCCP_DEVICE_TASK_QUEUE_UNHOLD:
+		return "queue_unhold";
+	case SCCP_DEVICE_TASK_PICKUP_CHANNEL:
+		return "pickup_channel";
+	case SCCP_DEVICE_TASK_START_CHANNEL:
+		return "start_channel";
+	default:
+		return "unknown";
+	}
+}
+
+int sccp_device_task_pool_init(void)
+{
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = TASK_POOL_IDLE_TIMEOUT,
+		.auto_increment = 1,
+		.initial_size = TASK_POOL_INITIAL_SIZE,
+		.max_size = TASK_POOL_MAX_SIZE,
+	};
+
+	ast_cond_init(&task_pool_cond, NULL);
+
+	task_pool = ast_threadpool_create("sccp/device", NULL, &options);
+	if (!task_pool) {
+		ast_log(LOG_ERROR, "sccp device task pool init failed: could not create threadpool\n");
+		ast_cond_destroy(&task_pool_cond);
+		return -1;
+	}
+
+	return 0;
+}
+
+void sccp_device_task_pool_destroy(void)
+{
+	int pending;
+
+	if (!task_pool) {
+		return;
+	}
+
+	/*
+	 * The offloaded tasks hold channel and device references and run module code, so
+	 * every batch must be done before the module is unloaded, however long it takes.
+	 * No batch is added anymore, since every device has been destroyed.
+	 */
+	pending = __atomic_load_n(&task_pool_pending, __ATOMIC_ACQUIRE);
+	if (pending) {
+		ast_verb(2, "Waiting for %d pending SCCP device task batches\n", pending);
+	}
+
+	ast_mutex_lock(&task_pool_lock);
+	while (__atomic_load_n(&task_pool_pending, __ATOMIC_ACQUIRE)) {
+		ast_cond_wait(&task_pool_cond, &task_pool_lock);
+	}
+	ast_mutex_unlock(&task_pool_lock);
+
+	/* the worker threads are joined */
+	ast_threadpool_shutdown(task_pool);
+	task_pool = NULL;
+	ast_cond_destroy(&task_pool_cond);
+}
+
+void sccp_device_take_task_stats(struct sccp_device_task_stats *stats)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_LEN(stats->types); i++) {
+		stats->types[i].count = __atomic_load_n(&task_stats.types[i].count, __ATOMIC_RELAXED);
+		stats->types[i].offloaded = __atomic_load_n(&task_stats.types[i].offloaded, __ATOMIC_RELAXED);
+		stats->types[i].time_total = __atomic_load_n(&task_stats.types[i].time_total, __ATOMIC_RELAXED);
+		stats->types[i].time_max = __atomic_load_n(&task_stats.types[i].time_max, __ATOMIC_RELAXED);
+	}
+
+	stats->batches_offloaded = __atomic_load_n(&task_stats.batches_offloaded, __ATOMIC_RELAXED);
+	stats->batches_wait_total = __atomic_load_n(&task_stats.batches_wait_total, __ATOMIC_RELAXED);
+	stats->batches_wait_max = __atomic_load_n(&task_stats.batches_wait_max, __ATOMIC_RELAXED);
+}
+
+void sccp_device_take_lock_stats(struct sccp_device_lock_stats *stats)
+{
+	stats->count = __atomic_load_n(&lock_stats.count, __ATOMIC_RELAXED);
+	stats->time_total = __atomic_load_n(&lock_stats.time_total, __ATOMIC_RELAXED);
+	stats->time_max = __atomic_load_n(&lock_stats.time_max, __ATOMIC_RELAXED);
+}
@@ -1,8 +1,11 @@
 #ifndef SCCP_DEVICE_H_
 #define SCCP_DEVICE_H_
 
+#include <time.h>
+
 #include "sccp.h"
 #include "sccp_msg.h"
+#include "sccp_session.h"
 
 struct ast_channel;
 struct ast_format_cap;
@@ -11,8 +14,10 @@ struct sccp_device;
 struct sccp_device_cfg;
 struct sccp_line;
 struct sccp_msg;
+struct sccp_msg_desc;
 struct sccp_session;
 struct sccp_subchannel;
+struct sockaddr_in;
 
 struct sccp_device_info {
 	const char *name;
@@ -20,6 +25,58 @@ struct sccp_device_info {
 	uint8_t proto_version;
 };
 
+/*!
+ * \brief Asterisk calls made by a device outside of its lock.
+ */
+enum sccp_device_task_type {
+	SCCP_DEVICE_TASK_TRANSFER_ATTENDED,
+	SCCP_DEVICE_TASK_QUEUE_CONTROL,
+	SCCP_DEVICE_TASK_QUEUE_FRAME_DTMF,
+	SCCP_DEVICE_TASK_QUEUE_HANGUP,
+	SCCP_DEVICE_TASK_QUEUE_HOLD,
+	SCCP_DEVICE_TASK_QUEUE_UNHOLD,
+	SCCP_DEVICE_TASK_PICKUP_CHANNEL,
+	SCCP_DEVICE_TASK_START_CHANNEL,
+	SCCP_DEVICE_TASK_TYPE_COUNT,
+};
+
+struct sccp_device_task_stat {
+	unsigned int count;
+	/* tasks executed by the task pool instead of the calling thread */
+	unsigned int offloaded;
+	/* execution time, in microseconds */
+	unsigned long long time_total;
+	unsigned int time_max;
+};
+
+struct sccp_device_task_stats {
+	struct sccp_device_task_stat types[SCCP_DEVICE_TASK_TYPE_COUNT];
+	unsigned int batches_offloaded;
+	/* time spent in the task pool queue, in microseconds */
+	unsigned long long batches_wait_total;
+	unsigned int batches_wait_max;
+};
+
+struct sccp_device_lock_stats {
+	unsigned int count;
+	/* time the device locks have been held, in microseconds */
+	unsigned long long time_total;
+	unsigned int time_max;
+};
+
+struct sccp_device_stats {
+	/* traffic of the device session */
+	struct sccp_session_stats session;
+	time_t registration_time;
+	/* 0 if no keepalive has been received yet */
+	time_t last_keepalive;
+	/* interval between the last two keepalives, and its smoothed variation, in milliseconds */
+	unsigned int keepalive_interval;
+	unsigned int keepalive_jitter;
+	unsigned int calls_placed;
+	unsigned int calls_received;
+};
+
 struct sccp_device_snapshot {
 	enum sccp_device_type type;
 	int guest;
@@ -27,6 +84,7 @@ struct sccp_device_snapshot {
 	char name[SCCP_DEVICE_NAME_MAX];
 	char ipaddr[16];
 	char capabilities[32];
+	struct sccp_device_stats stats;
 };
 
 /*!
@@ -47,10 +105,14 @@ struct sccp_device *sccp_device_create(struct sccp_device_cfg *device_cfg, struc
 void sccp_device_destroy(struct sccp_device *device);
 
 /*!
+ * \brief Handle a received message.
+ *
+ * \param desc the descriptor of the message, as returned by sccp_msg_validate
+ *
  * \note Must be called only from the session thread.
  * \note It is an undefined behaviour to call this function on a destroyed device.
  */
-int sccp_device_handle_msg(struct sccp_device *device, struct sccp_msg *msg);
+int sccp_device_handle_msg(struct sccp_device *device, struct sccp_msg *msg, const struct sccp_msg_desc *desc);
 
 /*!
  * \note Must be called only from the session thread.
@@ -93,6 +155,10 @@ int sccp_device_reset(struct sccp_device *device, enum sccp_reset_type type);
 /*!
  * \brief Take a snapshot of information from the device.
  *
+ * The snapshot is copied from a seqlock protected summary of the device, i.e. this
+ * function does not acquire the device lock. The stats are read lock-free too, one
+ * counter at a time.
+ *
  * \param snapshot memory where the snapshot will be saved
  */
 void sccp_device_take_snapshot(struct sccp_device *device, struct sccp_device_snapshot *snapshot);
@@ -127,6 +193,35 @@ const char *sccp_device_name(const struct sccp_device *device);
  */
 int sccp_device_is_guest(struct sccp_device *device);
 
+/*!
+ * \brief Return the type of the device.
+ *
+ * \note The type of a device is a constant attribute.
+ */
+enum sccp_device_type sccp_device_type(const struct sccp_device *device);
+
+/*!
+ * \brief Return the protocol version of the device.
+ *
+ * \note The protocol version of a device is a constant attribute.
+ */
+uint8_t sccp_device_proto_version(const struct sccp_device *device);
+
+/*!
+ * \brief Return the remote IPv4 address of the device, i.e. the address of its session.
+ *
+ * \note The remote address of a device is a constant attribute.
+ */
+const struct sockaddr_in *sccp_device_remote_addr(const struct sccp_device *device);
+
+/*!
+ * \brief Return the session of the device.
+ *
+ * \note The session of a device is a constant attribute. The returned object does NOT
+ *       have its reference count incremented; it stays valid as long as the device.
+ */
+struct sccp_session *sccp_device_session(const struct sccp_device *device);
+
 /*!
  * \brief Return the name of the line.
  *
@@ -134,4 +229,62 @@ int sccp_device_is_guest(struct sccp_device *device);
  */
 const char *sccp_line_name(const struct sccp_line *line);
 
+/*!
+ * \brief Return the device of the line.
+ *
+ * \note The device of a line is a constant attribute.
+ * \note The reference count is NOT incremented
+ */
+struct sccp_device *sccp_line_device(const struct sccp_line *line);
+
+/*!
+ * \brief Create the pool executing the device tasks that might block.
+ *
+ * Tasks that might block, like starting the PBX on a channel, are executed by a
+ * serializer of the pool instead of the session thread. Once a device has offloaded
+ * tasks, its following tasks are offloaded too until the pool has caught up, so that
+ * the tasks of a device are always executed in order.
+ *
+ * \note If the pool is not created, every task is executed by the calling thread.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int sccp_device_task_pool_init(void);
+
+/*!
+ * \brief Execute a task that might block on the task pool, in no particular order.
+ *
+ * The task is always executed once this function has returned successfully, and the
+ * pool waits for it when destroyed.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure, e.g. if the pool has not been created
+ */
+int sccp_device_task_pool_push(int (*exec)(void *data), void *data);
+
+/*!
+ * \brief Destroy the task pool, after waiting for the pending tasks.
+ *
+ * There's no timeout: once this function returns, no offloaded task is running.
+ *
+ * \note Must be called after every device has been destroyed.
+ */
+void sccp_device_task_pool_destroy(void);
+
+/*!
+ * \brief Return the name of the task type.
+ */
+const char *sccp_device_task_type_str(enum sccp_device_task_type type);
+
+/*!
+ * \brief Take a snapshot of the task stats.
+ */
+void sccp_device_take_task_stats(struct sccp_device_task_stats *stats);
+
+/*!
+ * \brief Take a snapshot of the device lock stats.
+ */
+void sccp_device_take_lock_stats(struct sccp_device_lock_stats *stats);
+
 #endif /* SCCP_DEVICE_H_ */
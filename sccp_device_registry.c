@@ -1,19 +1,80 @@
 #include <asterisk.h>
 #include <asterisk/astobj2.h>
 #include <asterisk/lock.h>
+#include <asterisk/network.h>
 #include <asterisk/strings.h>
 
 #include "sccp.h"
 #include "sccp_config.h"
 #include "sccp_device.h"
 #include "sccp_device_registry.h"
+#include "sccp_lock_profile.h"
+#include "sccp_utils.h"
+
+#define INDEX_MIN_CAPACITY 64
+
+struct ip_index_entry {
+	/* host byte order */
+	uint32_t addr;
+	struct sccp_device *device;
+};
+
+/*
+ * Devices sorted by remote address, so that all the devices inside a prefix
+ * are found in a contiguous range of entries.
+ */
+struct ip_index {
+	struct ip_index_entry *entries;
+	size_t count;
+	size_t capacity;
+};
+
+/*
+ * Devices sorted by name, to walk the registry by pages in a stable order.
+ */
+struct name_index {
+	struct sccp_device **devices;
+	size_t count;
+	size_t capacity;
+};
 
 struct sccp_device_registry {
 	ast_mutex_t lock;
+	/* when and where the lock has been taken, for the lock profiler */
+	struct timeval locked_at;
+	const char *locked_site;
 	unsigned int max_guests;
 	unsigned int cur_guests;
 	struct ao2_container *devices;
 	struct ao2_container *lines;
+	struct ao2_container *devices_by_type;
+	struct ao2_container *devices_by_proto;
+	struct ip_index ip_index;
+	struct name_index name_index;
+
+	/* (written with the lock held, read lock-free) */
+	struct sccp_seqlock stats_lock;
+	struct sccp_device_registry_stats stats;
+};
+
+/* the acquisition site is recorded by the lock profiler */
+#define registry_lock(registry) registry_lock_at(registry, __func__)
+
+static void registry_lock_at(struct sccp_device_registry *registry, const char *site)
+{
+	registry->locked_at = sccp_lock_profile_lock(&registry->lock, SCCP_LOCK_REGISTRY, site);
+	registry->locked_site = site;
+}
+
+static void registry_unlock(struct sccp_device_registry *registry)
+{
+	sccp_lock_profile_unlock(&registry->lock, SCCP_LOCK_REGISTRY, registry->locked_site, registry->locked_at);
+}
+
+struct device_list {
+	struct sccp_device **devices;
+	size_t count;
+	size_t capacity;
 };
 
 static int sccp_device_hash(const void *obj, int flags)
@@ -70,6 +131,187 @@ static int sccp_line_cmp(void *obj, void *arg, int flags)
 	return strcmp(sccp_line_name(line), name) ? 0 : (CMP_MATCH | CMP_STOP);
 }
 
+static int sccp_device_type_hash(const void *obj, int flags)
+{
+	if (flags & OBJ_SEARCH_KEY) {
+		return *((const int *) obj);
+	}
+
+	return sccp_device_type((const struct sccp_device *) obj);
+}
+
+static int sccp_device_type_cmp(void *obj, void *arg, int flags)
+{
+	int type;
+
+	if (flags & OBJ_SEARCH_KEY) {
+		type = *((const int *) arg);
+	} else {
+		type = sccp_device_type((const struct sccp_device *) arg);
+	}
+
+	return (int) sccp_device_type(obj) == type ? CMP_MATCH : 0;
+}
+
+static int sccp_device_proto_hash(const void *obj, int flags)
+{
+	if (flags & OBJ_SEARCH_KEY) {
+		return *((const int *) obj);
+	}
+
+	return sccp_device_proto_version((const struct sccp_device *) obj);
+}
+
+static int sccp_device_proto_cmp(void *obj, void *arg, int flags)
+{
+	int proto_version;
+
+	if (flags & OBJ_SEARCH_KEY) {
+		proto_version = *((const int *) arg);
+	} else {
+		proto_version = sccp_device_proto_version((const struct sccp_device *) arg);
+	}
+
+	return sccp_device_proto_version(obj) == proto_version ? CMP_MATCH : 0;
+}
+
+static uint32_t device_addr(const struct sccp_device *device)
+{
+	return ntohl(sccp_device_remote_addr(device)->sin_addr.s_addr);
+}
+
+/*
+ * Return the index of the first entry with an address greater or equal to addr.
+ */
+static size_t ip_index_lower_bound(const struct ip_index *index, uint32_t addr)
+{
+	size_t lo = 0;
+	size_t hi = index->count;
+	size_t mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->entries[mid].addr < addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static int ip_index_add(struct ip_index *index, struct sccp_device *device)
+{
+	struct ip_index_entry *entries;
+	size_t capacity;
+	size_t i;
+	uint32_t addr = device_addr(device);
+
+	if (index->count == index->capacity) {
+		capacity = index->capacity ? index->capacity * 2 : INDEX_MIN_CAPACITY;
+		entries = ast_realloc(index->entries, capacity * sizeof(*entries));
+		if (!entries) {
+			return -1;
+		}
+
+		index->entries = entries;
+		index->capacity = capacity;
+	}
+
+	i = ip_index_lower_bound(index, addr);
+	memmove(&index->entries[i + 1], &index->entries[i], (index->count - i) * sizeof(*index->entries));
+	index->entries[i].addr = addr;
+	index->entries[i].device = device;
+	index->count++;
+
+	return 0;
+}
+
+static void ip_index_remove(struct ip_index *index, struct sccp_device *device)
+{
+	size_t i;
+	uint32_t addr = device_addr(device);
+
+	for (i = ip_index_lower_bound(index, addr); i < index->count && index->entries[i].addr == addr; i++) {
+		if (index->entries[i].device == device) {
+			index->count--;
+			memmove(&index->entries[i], &index->entries[i + 1], (index->count - i) * sizeof(*index->entries));
+			return;
+		}
+	}
+}
+
+static void ip_index_deinit(struct ip_index *index)
+{
+	ast_free(index->entries);
+}
+
+/*
+ * Return the index of the first device with a name greater than name, or greater
+ * or equal if inclusive is non-zero.
+ */
+static size_t name_index_bound(const struct name_index *index, const char *name, int inclusive)
+{
+	size_t lo = 0;
+	size_t hi = index->count;
+	size_t mid;
+	int cmp;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = strcmp(sccp_device_name(index->devices[mid]), name);
+		if (cmp < 0 || (cmp == 0 && !inclusive)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static int name_index_add(struct name_index *index, struct sccp_device *device)
+{
+	struct sccp_device **devices;
+	size_t capacity;
+	size_t i;
+
+	if (index->count == index->capacity) {
+		capacity = index->capacity ? index->capacity * 2 : INDEX_MIN_CAPACITY;
+		devices = ast_realloc(index->devices, capacity * sizeof(*devices));
+		if (!devices) {
+			return -1;
+		}
+
+		index->devices = devices;
+		index->capacity = capacity;
+	}
+
+	i = name_index_bound(index, sccp_device_name(device), 1);
+	memmove(&index->devices[i + 1], &index->devices[i], (index->count - i) * sizeof(*index->devices));
+	index->devices[i] = device;
+	index->count++;
+
+	return 0;
+}
+
+static void name_index_remove(struct name_index *index, struct sccp_device *device)
+{
+	size_t i;
+
+	i = name_index_bound(index, sccp_device_name(device), 1);
+	if (i < index->count && index->devices[i] == device) {
+		index->count--;
+		memmove(&index->devices[i], &index->devices[i + 1], (index->count - i) * sizeof(*index->devices));
+	}
+}
+
+static void name_index_deinit(struct name_index *index)
+{
+	ast_free(index->devices);
+}
+
 struct sccp_device_registry *sccp_device_registry_create(struct sccp_cfg *cfg)
 {
 	struct sccp_device_registry *registry;
@@ -97,6 +339,23 @@ struct sccp_device_registry *sccp_device_registry_create(struct sccp_cfg *cfg)
 		return NULL;
 	}
 
+	registry->devices_by_type = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, SCCP_BUCKETS, sccp_device_type_hash, sccp_device_type_cmp);
+	if (!registry->devices_by_type) {
+		ao2_ref(registry->lines, -1);
+		ao2_ref(registry->devices, -1);
+		ast_free(registry);
+		return NULL;
+	}
+
+	registry->devices_by_proto = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, SCCP_BUCKETS, sccp_device_proto_hash, sccp_device_proto_cmp);
+	if (!registry->devices_by_proto) {
+		ao2_ref(registry->devices_by_type, -1);
+		ao2_ref(registry->lines, -1);
+		ao2_ref(registry->devices, -1);
+		ast_free(registry);
+		return NULL;
+	}
+
 	ast_mutex_init(&registry->lock);
 	registry->max_guests = cfg->general_cfg->max_guests;
 	registry->cur_guests = 0;
@@ -108,20 +367,102 @@ void sccp_device_registry_destroy(struct sccp_device_registry *registry)
 {
 	ao2_ref(registry->devices, -1);
 	ao2_ref(registry->lines, -1);
+	ao2_ref(registry->devices_by_type, -1);
+	ao2_ref(registry->devices_by_proto, -1);
+	ip_index_deinit(&registry->ip_index);
+	name_index_deinit(&registry->name_index);
 	ast_mutex_destroy(&registry->lock);
 	ast_free(registry);
 }
 
 static int add_device(struct sccp_device_registry *registry, struct sccp_device *device)
 {
-	return !ao2_link(registry->devices, device);
+	if (!ao2_link(registry->devices, device)) {
+		goto fail1;
+	}
+
+	if (!ao2_link(registry->devices_by_type, device)) {
+		goto fail2;
+	}
+
+	if (!ao2_link(registry->devices_by_proto, device)) {
+		goto fail3;
+	}
+
+	if (ip_index_add(&registry->ip_index, device)) {
+		goto fail4;
+	}
+
+	if (name_index_add(&registry->name_index, device)) {
+		goto fail5;
+	}
+
+	return 0;
+
+fail5:
+	ip_index_remove(&registry->ip_index, device);
+fail4:
+	ao2_unlink(registry->devices_by_proto, device);
+fail3:
+	ao2_unlink(registry->devices_by_type, device);
+fail2:
+	ao2_unlink(registry->devices, device);
+fail1:
+	return -1;
 }
 
 static void remove_device(struct sccp_device_registry *registry, struct sccp_device *device)
 {
+	name_index_remove(&registry->name_index, device);
+	ip_index_remove(&registry->ip_index, device);
+	ao2_unlink(registry->devices_by_proto, device);
+	ao2_unlink(registry->devices_by_type, device);
 	ao2_unlink(registry->devices, device);
 }
 
+static unsigned int *stats_type_devices(struct sccp_device_registry_stats *stats, enum sccp_device_type type)
+{
+	size_t i;
+
+	for (i = 0; i < stats->type_count; i++) {
+		if (stats->types[i].type == type) {
+			return &stats->types[i].devices;
+		}
+	}
+
+	if (stats->type_count == ARRAY_LEN(stats->types)) {
+		return &stats->other_devices;
+	}
+
+	/* types are never removed, so that the order stays stable */
+	stats->types[stats->type_count].type = type;
+	stats->types[stats->type_count].devices = 0;
+
+	return &stats->types[stats->type_count++].devices;
+}
+
+/*
+ * Must be called with the registry lock held.
+ */
+static void update_stats(struct sccp_device_registry *registry, struct sccp_device *device, int delta)
+{
+	struct sccp_device_registry_stats *stats = &registry->stats;
+	unsigned int *type_devices;
+
+	sccp_seqlock_write_begin(&registry->stats_lock);
+	type_devices = stats_type_devices(stats, sccp_device_type(device));
+	if (delta > 0 || *type_devices) {
+		*type_devices += delta;
+	}
+
+	if (delta > 0 || stats->devices) {
+		stats->devices += delta;
+	}
+
+	stats->guests = registry->cur_guests;
+	sccp_seqlock_write_end(&registry->stats_lock);
+}
+
 static int add_lines(struct sccp_device_registry *registry, struct sccp_device *device)
 {
 	unsigned int i;
@@ -167,7 +508,7 @@ int sccp_device_registry_add(struct sccp_device_registry *registry, struct sccp_
 	}
 
 	is_guest = sccp_device_is_guest(device);
-	ast_mutex_lock(&registry->lock);
+	registry_lock(registry);
 
 	if (is_guest && registry->cur_guests >= registry->max_guests) {
 		ret = SCCP_DEVICE_REGISTRY_MAXGUESTS;
@@ -196,8 +537,10 @@ int sccp_device_registry_add(struct sccp_device_registry *registry, struct sccp_
 		registry->cur_guests++;
 	}
 
+	update_stats(registry, device, 1);
+
 unlock:
-	ast_mutex_unlock(&registry->lock);
+	registry_unlock(registry);
 
 	return ret;
 }
@@ -212,7 +555,7 @@ void sccp_device_registry_remove(struct sccp_device_registry *registry, struct s
 	}
 
 	is_guest = sccp_device_is_guest(device);
-	ast_mutex_lock(&registry->lock);
+	registry_lock(registry);
 	remove_lines(registry, device);
 	remove_device(registry, device);
 
@@ -220,7 +563,8 @@ void sccp_device_registry_remove(struct sccp_device_registry *registry, struct s
 		registry->cur_guests--;
 	}
 
-	ast_mutex_unlock(&registry->lock);
+	update_stats(registry, device, -1);
+	registry_unlock(registry);
 }
 
 struct sccp_device *sccp_device_registry_find(struct sccp_device_registry *registry, const char *name)
@@ -232,9 +576,9 @@ struct sccp_device *sccp_device_registry_find(struct sccp_device_registry *regis
 		return NULL;
 	}
 
-	ast_mutex_lock(&registry->lock);
+	registry_lock(registry);
 	device = ao2_find(registry->devices, name, OBJ_SEARCH_KEY);
-	ast_mutex_unlock(&registry->lock);
+	registry_unlock(registry);
 
 	return device;
 }
@@ -248,9 +592,9 @@ struct sccp_line *sccp_device_registry_find_line(struct sccp_device_registry *re
 		return NULL;
 	}
 
-	ast_mutex_lock(&registry->lock);
+	registry_lock(registry);
 	line = ao2_find(registry->lines, name, OBJ_SEARCH_KEY);
-	ast_mutex_unlock(&registry->lock);
+	registry_unlock(registry);
 
 	return line;
 }
@@ -260,7 +604,7 @@ void sccp_device_registry_do(struct sccp_device_registry *registry, sccp_device_
 	struct ao2_iterator iter;
 	struct sccp_device *device;
 
-	ast_mutex_lock(&registry->lock);
+	registry_lock(registry);
 
 	iter = ao2_iterator_init(registry->devices, 0);
 	while ((device = ao2_iterator_next(&iter))) {
@@ -269,7 +613,7 @@ void sccp_device_registry_do(struct sccp_device_registry *registry, sccp_device_
 	}
 	ao2_iterator_destroy(&iter);
 
-	ast_mutex_unlock(&registry->lock);
+	registry_unlock(registry);
 }
 
 char *sccp_device_registry_complete(struct sccp_device_registry *registry, const char *word, int state)
@@ -287,7 +631,7 @@ char *sccp_device_registry_complete(struct sccp_device_registry *registry, const
 
 	len = strlen(word);
 
-	ast_mutex_lock(&registry->lock);
+	registry_lock(registry);
 
 	iter = ao2_iterator_init(registry->devices, 0);
 	while ((device = ao2_iterator_next(&iter))) {
@@ -301,7 +645,7 @@ char *sccp_device_registry_complete(struct sccp_device_registry *registry, const
 	}
 	ao2_iterator_destroy(&iter);
 
-	ast_mutex_unlock(&registry->lock);
+	registry_unlock(registry);
 
 	return result;
 }
@@ -323,7 +667,7 @@ int sccp_device_registry_take_snapshots(struct sccp_device_registry *registry, s
 		return -1;
 	}
 
-	ast_mutex_lock(&registry->lock);
+	registry_lock(registry);
 
 	*n = ao2_container_count(registry->devices);
 	if (!*n) {
@@ -346,11 +690,217 @@ int sccp_device_registry_take_snapshots(struct sccp_device_registry *registry, s
 	ao2_iterator_destroy(&iter);
 
 unlock:
-	ast_mutex_unlock(&registry->lock);
+	registry_unlock(registry);
 
 	return ret;
 }
 
+int sccp_device_registry_take_snapshots_page(struct sccp_device_registry *registry, const char *after, struct sccp_device_snapshot *snapshots, size_t limit, size_t *n)
+{
+	struct name_index *index = &registry->name_index;
+	size_t i;
+
+	if (!snapshots) {
+		ast_log(LOG_ERROR, "registry take snapshots page failed: snapshots is null\n");
+		return -1;
+	}
+
+	if (!n) {
+		ast_log(LOG_ERROR, "registry take snapshots page failed: n is null\n");
+		return -1;
+	}
+
+	*n = 0;
+
+	registry_lock(registry);
+
+	i = ast_strlen_zero(after) ? 0 : name_index_bound(index, after, 0);
+	for (; i < index->count && *n < limit; i++) {
+		sccp_device_take_snapshot(index->devices[i], &snapshots[(*n)++]);
+	}
+
+	registry_unlock(registry);
+
+	return 0;
+}
+
+static int device_list_append(struct device_list *list, struct sccp_device *device)
+{
+	struct sccp_device **devices;
+	size_t capacity;
+
+	if (list->count == list->capacity) {
+		capacity = list->capacity ? list->capacity * 2 : 16;
+		devices = ast_realloc(list->devices, capacity * sizeof(*devices));
+		if (!devices) {
+			return -1;
+		}
+
+		list->devices = devices;
+		list->capacity = capacity;
+	}
+
+	ao2_ref(device, +1);
+	list->devices[list->count++] = device;
+
+	return 0;
+}
+
+static void device_list_deinit(struct device_list *list)
+{
+	size_t i;
+
+	for (i = 0; i < list->count; i++) {
+		ao2_ref(list->devices[i], -1);
+	}
+
+	ast_free(list->devices);
+}
+
+static int collect_by_ip(struct sccp_device_registry *registry, const struct sccp_device_filter *filter, struct device_list *list)
+{
+	uint32_t mask;
+	uint32_t first;
+	uint32_t last;
+	size_t i;
+
+	if (filter->u.ip.prefix_len > 32) {
+		return -1;
+	}
+
+	mask = filter->u.ip.prefix_len ? 0xFFFFFFFFu << (32 - filter->u.ip.prefix_len) : 0;
+	first = ntohl(filter->u.ip.addr.s_addr) & mask;
+	last = first | ~mask;
+
+	for (i = ip_index_lower_bound(&registry->ip_index, first); i < registry->ip_index.count; i++) {
+		if (registry->ip_index.entries[i].addr > last) {
+			break;
+		}
+
+		if (device_list_append(list, registry->ip_index.entries[i].device)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int collect_by_key(struct ao2_container *container, int key, struct device_list *list)
+{
+	struct ao2_iterator *iter;
+	struct sccp_device *device;
+	int ret = 0;
+
+	iter = ao2_find(container, &key, OBJ_SEARCH_KEY | OBJ_MULTIPLE);
+	if (!iter) {
+		return 0;
+	}
+
+	while ((device = ao2_iterator_next(iter))) {
+		if (!ret && device_list_append(list, device)) {
+			ret = -1;
+		}
+
+		ao2_ref(device, -1);
+	}
+	ao2_iterator_destroy(iter);
+
+	return ret;
+}
+
+static int collect_by_line(struct sccp_device_registry *registry, const char *name, struct device_list *list)
+{
+	struct sccp_line *line;
+	int ret;
+
+	line = ao2_find(registry->lines, name, OBJ_SEARCH_KEY);
+	if (!line) {
+		return 0;
+	}
+
+	ret = device_list_append(list, sccp_line_device(line));
+	ao2_ref(line, -1);
+
+	return ret;
+}
+
+static int collect_devices(struct sccp_device_registry *registry, const struct sccp_device_filter *filter, struct device_list *list)
+{
+	switch (filter->type) {
+	case SCCP_DEVICE_FILTER_IP:
+		return collect_by_ip(registry, filter, list);
+	case SCCP_DEVICE_FILTER_TYPE:
+		return collect_by_key(registry->devices_by_type, filter->u.device_type, list);
+	case SCCP_DEVICE_FILTER_PROTO:
+		return collect_by_key(registry->devices_by_proto, filter->u.proto_version, list);
+	case SCCP_DEVICE_FILTER_LINE:
+		return collect_by_line(registry, filter->u.line_name, list);
+	}
+
+	return -1;
+}
+
+int sccp_device_registry_take_filtered_snapshots(struct sccp_device_registry *registry, const struct sccp_device_filter *filter, struct sccp_device_snapshot **snapshots, size_t *n)
+{
+	struct device_list list = { NULL, 0, 0 };
+	size_t i;
+	int ret;
+
+	if (!filter) {
+		ast_log(LOG_ERROR, "registry take filtered snapshots failed: filter is null\n");
+		return -1;
+	}
+
+	if (!snapshots) {
+		ast_log(LOG_ERROR, "registry take filtered snapshots failed: snapshots is null\n");
+		return -1;
+	}
+
+	if (!n) {
+		ast_log(LOG_ERROR, "registry take filtered snapshots failed: n is null\n");
+		return -1;
+	}
+
+	registry_lock(registry);
+	ret = collect_devices(registry, filter, &list);
+	registry_unlock(registry);
+
+	if (ret) {
+		goto end;
+	}
+
+	*n = list.count;
+	if (!*n) {
+		*snapshots = NULL;
+		goto end;
+	}
+
+	*snapshots = ast_calloc(*n, sizeof(**snapshots));
+	if (!*snapshots) {
+		ret = -1;
+		goto end;
+	}
+
+	for (i = 0; i < list.count; i++) {
+		sccp_device_take_snapshot(list.devices[i], &(*snapshots)[i]);
+	}
+
+end:
+	device_list_deinit(&list);
+
+	return ret;
+}
+
+void sccp_device_registry_take_stats(struct sccp_device_registry *registry, struct sccp_device_registry_stats *stats)
+{
+	unsigned int seq;
+
+	do {
+		seq = sccp_seqlock_read_begin(&registry->stats_lock);
+		memcpy(stats, &registry->stats, sizeof(*stats));
+	} while (sccp_seqlock_read_retry(&registry->stats_lock, seq));
+}
+
 int sccp_device_registry_reload_config(struct sccp_device_registry *registry, struct sccp_cfg *cfg)
 {
 	if (!cfg) {
@@ -358,9 +908,9 @@ int sccp_device_registry_reload_config(struct sccp_device_registry *registry, st
 		return -1;
 	}
 
-	ast_mutex_lock(&registry->lock);
+	registry_lock(registry);
 	registry->max_guests = cfg->general_cfg->max_guests;
-	ast_mutex_unlock(&registry->lock);
+	registry_unlock(registry);
 
 	return 0;
 }
@@ -1,6 +1,10 @@
 #ifndef SCCP_DEVICE_REGISTRY_H_
 #define SCCP_DEVICE_REGISTRY_H_
 
+#include <netinet/in.h>
+
+#include "sccp_msg.h"
+
 struct sccp_cfg;
 struct sccp_device;
 struct sccp_device_registry;
@@ -9,6 +13,48 @@ struct sccp_device_snapshot;
 #define SCCP_DEVICE_REGISTRY_ALREADY 1
 #define SCCP_DEVICE_REGISTRY_MAXGUESTS 2
 
+#define SCCP_DEVICE_REGISTRY_STATS_TYPES 32
+
+enum sccp_device_filter_type {
+	SCCP_DEVICE_FILTER_IP,
+	SCCP_DEVICE_FILTER_TYPE,
+	SCCP_DEVICE_FILTER_PROTO,
+	SCCP_DEVICE_FILTER_LINE,
+};
+
+/*!
+ * \brief Select the devices matching one of the registry secondary indexes.
+ */
+struct sccp_device_filter {
+	enum sccp_device_filter_type type;
+	union {
+		/* devices whose remote address is inside addr/prefix_len */
+		struct {
+			struct in_addr addr;
+			unsigned int prefix_len;
+		} ip;
+		enum sccp_device_type device_type;
+		uint8_t proto_version;
+		/* the device owning the line */
+		const char *line_name;
+	} u;
+};
+
+struct sccp_device_registry_type_stat {
+	enum sccp_device_type type;
+	unsigned int devices;
+};
+
+struct sccp_device_registry_stats {
+	unsigned int devices;
+	unsigned int guests;
+	/* registered devices per type, in order of first registration of the type */
+	size_t type_count;
+	struct sccp_device_registry_type_stat types[SCCP_DEVICE_REGISTRY_STATS_TYPES];
+	/* registered devices whose type didn't fit in the types array */
+	unsigned int other_devices;
+};
+
 /*!
  * \brief Create a new device registry.
  *
@@ -98,6 +144,42 @@ char *sccp_device_registry_complete(struct sccp_device_registry *registry, const
  */
 int sccp_device_registry_take_snapshots(struct sccp_device_registry *registry, struct sccp_device_snapshot **snapshots, size_t *n);
 
+/*!
+ * \brief Take a snapshot of a page of devices, in device name order.
+ *
+ * \param after name of the last device of the previous page, or NULL/empty to start from the first device
+ * \param snapshots caller provided array of at least limit elements
+ * \param[out] n number of snapshots stored into the array
+ *
+ * The next page starts after snapshots[*n - 1].name; the last page has been reached
+ * once *n is less than limit. Since the device summaries are read without locking the
+ * devices, the registry lock is held only for the duration of one page.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int sccp_device_registry_take_snapshots_page(struct sccp_device_registry *registry, const char *after, struct sccp_device_snapshot *snapshots, size_t limit, size_t *n);
+
+/*!
+ * \brief Take a snapshot of the devices matching a filter.
+ *
+ * Only the devices found through the secondary index of the filter are visited, and
+ * they are snapshotted after the registry lock has been released.
+ *
+ * The returned snapshots array has the same semantic as with sccp_device_registry_take_snapshots.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int sccp_device_registry_take_filtered_snapshots(struct sccp_device_registry *registry, const struct sccp_device_filter *filter, struct sccp_device_snapshot **snapshots, size_t *n);
+
+/*!
+ * \brief Take a snapshot of the registry stats.
+ *
+ * The stats are protected by a seqlock, i.e. this function does not acquire the registry lock.
+ */
+void sccp_device_registry_take_stats(struct sccp_device_registry *registry, struct sccp_device_registry_stats *stats);
+
 /*!
  * \brief Reload the device registry configuration.
  *
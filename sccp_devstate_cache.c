@@ -0,0 +1,221 @@
+#include <asterisk.h>
+#include <asterisk/devicestate.h>
+#include <asterisk/lock.h>
+#include <asterisk/utils.h>
+
+#include "sccp_devstate_cache.h"
+#include "sccp_utils.h"
+
+#define DEVSTATE_CACHE_BUCKETS 8191
+
+/*
+ * Entries are never removed before the cache is destroyed; the state of a line which
+ * is not registered anymore is either UNAVAILABLE or unknown (i.e. a miss). The number
+ * of entries is then bounded by the number of line names that have been configured.
+ */
+struct devstate_entry {
+	struct devstate_entry *next;
+	int state;
+	size_t len;
+	char name[0];
+};
+
+/* per CPU, so that lookups don't share a cache line */
+struct devstate_counters {
+	unsigned long hits;
+	unsigned long misses;
+} __attribute__((aligned(SCCP_CACHE_LINE_SIZE)));
+
+static struct devstate_entry **buckets;
+static struct devstate_counters counters[SCCP_CPU_SHARDS];
+static int entries;
+/* incremented on each invalidation */
+static unsigned int generation;
+
+static unsigned int hash_name(const char *name, size_t len)
+{
+	unsigned int hash = 5381;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash = hash * 33 ^ (unsigned char) name[i];
+	}
+
+	return hash % DEVSTATE_CACHE_BUCKETS;
+}
+
+static struct devstate_entry *find_entry(struct devstate_entry *entry, const char *name, size_t len)
+{
+	for (; entry; entry = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE)) {
+		if (entry->len == len && !memcmp(entry->name, name, len)) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Insert the entry if it doesn't exist yet, and return it.
+ */
+static struct devstate_entry *find_or_add_entry(const char *name, size_t len)
+{
+	struct devstate_entry **bucket = &buckets[hash_name(name, len)];
+	struct devstate_entry *head;
+	struct devstate_entry *entry;
+	struct devstate_entry *new_entry = NULL;
+
+	head = __atomic_load_n(bucket, __ATOMIC_ACQUIRE);
+	for (;;) {
+		entry = find_entry(head, name, len);
+		if (entry) {
+			ast_free(new_entry);
+			return entry;
+		}
+
+		if (!new_entry) {
+			new_entry = ast_malloc(sizeof(*new_entry) + len + 1);
+			if (!new_entry) {
+				return NULL;
+			}
+
+			new_entry->state = SCCP_DEVSTATE_CACHE_MISS;
+			new_entry->len = len;
+			memcpy(new_entry->name, name, len);
+			new_entry->name[len] = '\0';
+		}
+
+		new_entry->next = head;
+		/* on failure, head is updated and only the new entries need to be checked again */
+		if (__atomic_compare_exchange_n(bucket, &head, new_entry, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+			ast_atomic_fetchadd_int(&entries, 1);
+			return new_entry;
+		}
+	}
+}
+
+int sccp_devstate_cache_init(void)
+{
+	buckets = ast_calloc(DEVSTATE_CACHE_BUCKETS, sizeof(*buckets));
+	if (!buckets) {
+		return -1;
+	}
+
+	memset(counters, 0, sizeof(counters));
+	entries = 0;
+
+	return 0;
+}
+
+void sccp_devstate_cache_destroy(void)
+{
+	struct devstate_entry *entry;
+	struct devstate_entry *next;
+	size_t i;
+
+	for (i = 0; i < DEVSTATE_CACHE_BUCKETS; i++) {
+		for (entry = buckets[i]; entry; entry = next) {
+			next = entry->next;
+			ast_free(entry);
+		}
+	}
+
+	ast_free(buckets);
+	buckets = NULL;
+}
+
+int sccp_devstate_cache_get(const char *name, size_t len)
+{
+	struct devstate_entry *entry;
+	int state = SCCP_DEVSTATE_CACHE_MISS;
+
+	entry = find_entry(__atomic_load_n(&buckets[hash_name(name, len)], __ATOMIC_ACQUIRE), name, len);
+	if (entry) {
+		state = __atomic_load_n(&entry->state, __ATOMIC_RELAXED);
+	}
+
+	if (state == SCCP_DEVSTATE_CACHE_MISS) {
+		__atomic_fetch_add(&counters[sccp_cpu_shard()].misses, 1, __ATOMIC_RELAXED);
+	} else {
+		__atomic_fetch_add(&counters[sccp_cpu_shard()].hits, 1, __ATOMIC_RELAXED);
+	}
+
+	return state;
+}
+
+void sccp_devstate_cache_set(const char *name, int state)
+{
+	struct devstate_entry *entry;
+
+	entry = find_or_add_entry(name, strlen(name));
+	if (entry) {
+		__atomic_store_n(&entry->state, state, __ATOMIC_RELAXED);
+	}
+}
+
+void sccp_devstate_cache_unset(const char *name)
+{
+	struct devstate_entry *entry;
+	size_t len = strlen(name);
+
+	entry = find_entry(__atomic_load_n(&buckets[hash_name(name, len)], __ATOMIC_ACQUIRE), name, len);
+	if (entry) {
+		__atomic_store_n(&entry->state, SCCP_DEVSTATE_CACHE_MISS, __ATOMIC_RELAXED);
+	}
+}
+
+unsigned int sccp_devstate_cache_generation(void)
+{
+	return __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+}
+
+void sccp_devstate_cache_set_if_unknown(const char *name, size_t len, int state, unsigned int gen)
+{
+	struct devstate_entry *entry;
+	int expected = SCCP_DEVSTATE_CACHE_MISS;
+
+	if (sccp_devstate_cache_generation() != gen) {
+		return;
+	}
+
+	entry = find_or_add_entry(name, len);
+	if (!entry || !__atomic_compare_exchange_n(&entry->state, &expected, state, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	/* the state might have been computed from the config before the invalidation */
+	if (sccp_devstate_cache_generation() != gen) {
+		expected = state;
+		__atomic_compare_exchange_n(&entry->state, &expected, SCCP_DEVSTATE_CACHE_MISS, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	}
+}
+
+void sccp_devstate_cache_invalidate(void)
+{
+	struct devstate_entry *entry;
+	size_t i;
+	int expected;
+
+	__atomic_add_fetch(&generation, 1, __ATOMIC_SEQ_CST);
+
+	for (i = 0; i < DEVSTATE_CACHE_BUCKETS; i++) {
+		for (entry = __atomic_load_n(&buckets[i], __ATOMIC_ACQUIRE); entry; entry = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE)) {
+			expected = AST_DEVICE_UNAVAILABLE;
+			__atomic_compare_exchange_n(&entry->state, &expected, SCCP_DEVSTATE_CACHE_MISS, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+void sccp_devstate_cache_take_stats(struct sccp_devstate_cache_stats *stats)
+{
+	size_t i;
+
+	stats->hits = 0;
+	stats->misses = 0;
+	for (i = 0; i < SCCP_CPU_SHARDS; i++) {
+		stats->hits += __atomic_load_n(&counters[i].hits, __ATOMIC_RELAXED);
+		stats->misses += __atomic_load_n(&counters[i].misses, __ATOMIC_RELAXED);
+	}
+
+	stats->entries = __atomic_load_n(&entries, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,90 @@
+#ifndef SCCP_DEVSTATE_CACHE_H_
+#define SCCP_DEVSTATE_CACHE_H_
+
+#include <stddef.h>
+
+#define SCCP_DEVSTATE_CACHE_MISS -1
+
+struct sccp_devstate_cache_stats {
+	unsigned long hits;
+	unsigned long misses;
+	int entries;
+};
+
+/*!
+ * \brief Initialize the devstate cache.
+ *
+ * The devstate cache maps line names to the state returned to the channel tech
+ * devicestate callback. Lookups are lock-free and never touch a device.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int sccp_devstate_cache_init(void);
+
+/*!
+ * \brief Free the devstate cache.
+ *
+ * \note There must be no concurrent user of the cache.
+ */
+void sccp_devstate_cache_destroy(void);
+
+/*!
+ * \brief Lookup the state of a line.
+ *
+ * \param name the line name, not necessarily null terminated
+ * \param len the length of the line name
+ *
+ * \retval the device state (enum ast_device_state) on hit
+ * \retval SCCP_DEVSTATE_CACHE_MISS if the state of the line is not known
+ */
+int sccp_devstate_cache_get(const char *name, size_t len);
+
+/*!
+ * \brief Set the state of a registered line.
+ *
+ * \note Must be called by the device owning the line, with the device locked.
+ */
+void sccp_devstate_cache_set(const char *name, int state);
+
+/*!
+ * \brief Forget the state of a line that is being unregistered.
+ *
+ * The state of an unregistered line depends on the config at the time of the lookup,
+ * so it is left to the slow path of the next lookup.
+ *
+ * \note Must be called by the device owning the line, with the device locked.
+ */
+void sccp_devstate_cache_unset(const char *name);
+
+/*!
+ * \brief Return the current generation of the cache, incremented on each invalidation.
+ */
+unsigned int sccp_devstate_cache_generation(void);
+
+/*!
+ * \brief Set the state of a line, unless it is already known.
+ *
+ * This is used to cache the result of the slow path of a lookup, without overwriting
+ * a state set concurrently by a device.
+ *
+ * \param gen the generation read before the slow path; nothing is cached if the cache
+ *            has been invalidated since, since the state might come from the old config
+ */
+void sccp_devstate_cache_set_if_unknown(const char *name, size_t len, int state, unsigned int gen);
+
+/*!
+ * \brief Forget the state of the lines that are not registered.
+ *
+ * Must be called once a reloaded config has been published, since the state of
+ * unregistered lines depends on the config. The lines of the devices torn down by the
+ * reload forget their own state, whenever the teardown happens.
+ */
+void sccp_devstate_cache_invalidate(void);
+
+/*!
+ * \brief Take a snapshot of the devstate cache stats.
+ */
+void sccp_devstate_cache_take_stats(struct sccp_devstate_cache_stats *stats);
+
+#endif /* SCCP_DEVSTATE_CACHE_H_ */
@@ -0,0 +1,210 @@
+#include <asterisk.h>
+#include <asterisk/cli.h>
+#include <asterisk/localtime.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+
+#include "sccp_flight_recorder.h"
+#include "sccp_msg.h"
+#include "sccp_utils.h"
+
+/* number of bytes dumped per line */
+#define DUMP_BYTES_PER_LINE 32
+
+_Static_assert(SCCP_MSG_HEADER_LEN + sizeof(struct register_message) <= SCCP_FLIGHT_RECORDER_FULL_DATA_LEN, "register message doesn't fit in a full entry");
+
+void sccp_flight_recorder_init(struct sccp_flight_recorder *fr)
+{
+	memset(fr, 0, sizeof(*fr));
+}
+
+static uint32_t msg_id_from_data(const uint8_t *data, size_t len)
+{
+	uint32_t msg_id;
+
+	if (len < SCCP_MSG_HEADER_LEN) {
+		return 0;
+	}
+
+	memcpy(&msg_id, &data[8], sizeof(msg_id));
+
+	return letohl(msg_id);
+}
+
+static int is_kept_in_full(uint32_t msg_id)
+{
+	return msg_id == REGISTER_MESSAGE || msg_id == CALL_INFO_MESSAGE;
+}
+
+/*
+ * Return the index plus one of the full entry.
+ */
+static unsigned int record_full(struct sccp_flight_recorder *fr, const void *msg, size_t len)
+{
+	struct flight_full_entry *entry = &fr->full_entries[fr->full_head % SCCP_FLIGHT_RECORDER_FULL_SIZE];
+	unsigned int seq = entry->seq;
+	unsigned int index = fr->full_head;
+
+	__atomic_store_n(&entry->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy(entry->data, msg, MIN(len, sizeof(entry->data)));
+
+	__atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&fr->full_head, index + 1, __ATOMIC_RELEASE);
+
+	return index + 1;
+}
+
+void sccp_flight_recorder_record(struct sccp_flight_recorder *fr, enum sccp_flight_dir dir, const void *msg, size_t len)
+{
+	struct flight_entry *entry = &fr->entries[fr->head % SCCP_FLIGHT_RECORDER_SIZE];
+	unsigned int seq = entry->seq;
+	unsigned int full_index = 0;
+
+	if (is_kept_in_full(msg_id_from_data(msg, len))) {
+		full_index = record_full(fr, msg, len);
+	}
+
+	/* per entry seqlock, the writer being the only one to modify seq */
+	__atomic_store_n(&entry->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	entry->tv = ast_tvnow();
+	entry->len = len;
+	entry->dir = dir;
+	memcpy(entry->data, msg, MIN(len, sizeof(entry->data)));
+	entry->full_index = full_index;
+
+	__atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&fr->head, fr->head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Copy the entry of the given message index. The k-th write of an entry leaves its
+ * seq at 2 * (k + 1), which tells if the entry has been overwritten since.
+ *
+ * Return non-zero if the entry no longer holds that message.
+ */
+static int flight_entry_copy(struct sccp_flight_recorder *fr, unsigned int index, struct flight_entry *copy)
+{
+	struct flight_entry *entry = &fr->entries[index % SCCP_FLIGHT_RECORDER_SIZE];
+	unsigned int seq = 2 * (index / SCCP_FLIGHT_RECORDER_SIZE + 1);
+
+	if (__atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) != seq) {
+		return -1;
+	}
+
+	memcpy(copy, entry, sizeof(*copy));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq;
+}
+
+/*
+ * Same as flight_entry_copy, for the full entries.
+ */
+static int flight_full_entry_copy(struct sccp_flight_recorder *fr, unsigned int index, struct flight_full_entry *copy)
+{
+	struct flight_full_entry *entry = &fr->full_entries[index % SCCP_FLIGHT_RECORDER_FULL_SIZE];
+	unsigned int seq = 2 * (index / SCCP_FLIGHT_RECORDER_FULL_SIZE + 1);
+
+	if (__atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) != seq) {
+		return -1;
+	}
+
+	memcpy(copy, entry, sizeof(*copy));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq;
+}
+
+static void dump_line(int fd, const char *line)
+{
+	if (fd < 0) {
+		ast_log(LOG_NOTICE, "%s\n", line);
+	} else {
+		ast_cli(fd, "%s\n", line);
+	}
+}
+
+static void dump_bytes(int fd, const uint8_t *data, size_t len)
+{
+	char line[8 + 3 * DUMP_BYTES_PER_LINE + 1];
+	size_t i;
+	int n = 0;
+
+	for (i = 0; i < len; i++) {
+		if (i % DUMP_BYTES_PER_LINE == 0) {
+			n = snprintf(line, sizeof(line), "  %04zx:", i);
+		}
+
+		n += snprintf(&line[n], sizeof(line) - n, " %02x", data[i]);
+
+		if (i % DUMP_BYTES_PER_LINE == DUMP_BYTES_PER_LINE - 1 || i == len - 1) {
+			dump_line(fd, line);
+		}
+	}
+}
+
+static void dump_entry(struct sccp_flight_recorder *fr, int fd, const struct flight_entry *entry)
+{
+	char line[256];
+	char timestr[16];
+	struct ast_tm tm;
+	struct flight_full_entry full_copy;
+	uint32_t msg_id;
+	size_t data_len = MIN(entry->len, sizeof(entry->data));
+	size_t i;
+	int n;
+
+	msg_id = msg_id_from_data(entry->data, data_len);
+
+	ast_localtime(&entry->tv, &tm, NULL);
+	ast_strftime(timestr, sizeof(timestr), "%T", &tm);
+
+	n = snprintf(line, sizeof(line), "%s.%03ld %s %-24s %4u:", timestr, (long) entry->tv.tv_usec / 1000,
+			entry->dir == SCCP_FLIGHT_IN ? "<-" : "->", sccp_msg_id_str(msg_id), entry->len);
+
+	if (entry->full_index && !flight_full_entry_copy(fr, entry->full_index - 1, &full_copy)) {
+		dump_line(fd, line);
+		dump_bytes(fd, full_copy.data, MIN(entry->len, sizeof(full_copy.data)));
+		return;
+	}
+
+	for (i = 0; i < data_len && n > 0 && (size_t) n < sizeof(line); i++) {
+		n += snprintf(&line[n], sizeof(line) - n, " %02x", entry->data[i]);
+	}
+
+	dump_line(fd, line);
+}
+
+void sccp_flight_recorder_dump(struct sccp_flight_recorder *fr, int fd, const char *title)
+{
+	struct flight_entry copy;
+	unsigned int head = __atomic_load_n(&fr->head, __ATOMIC_ACQUIRE);
+	unsigned int start;
+	unsigned int skipped = 0;
+	unsigned int i;
+
+	start = head > SCCP_FLIGHT_RECORDER_SIZE ? head - SCCP_FLIGHT_RECORDER_SIZE : 0;
+
+	dump_line(fd, title);
+
+	for (i = start; i != head; i++) {
+		if (flight_entry_copy(fr, i, &copy)) {
+			skipped++;
+			continue;
+		}
+
+		dump_entry(fr, fd, &copy);
+	}
+
+	if (skipped) {
+		if (fd < 0) {
+			ast_log(LOG_NOTICE, "%u entries overwritten during the dump\n", skipped);
+		} else {
+			ast_cli(fd, "%u entries overwritten during the dump\n", skipped);
+		}
+	}
+}
@@ -0,0 +1,82 @@
+#ifndef SCCP_FLIGHT_RECORDER_H_
+#define SCCP_FLIGHT_RECORDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "sccp_msg.h"
+
+/* number of messages kept */
+#define SCCP_FLIGHT_RECORDER_SIZE 64
+/* number of bytes kept of each message, header included */
+#define SCCP_FLIGHT_RECORDER_DATA_LEN 48
+/* number of messages kept in full, among the register and call info messages */
+#define SCCP_FLIGHT_RECORDER_FULL_SIZE 8
+/* number of bytes kept of these messages, the call info message being the largest */
+#define SCCP_FLIGHT_RECORDER_FULL_DATA_LEN (SCCP_MSG_HEADER_LEN + sizeof(struct call_info_message))
+
+enum sccp_flight_dir {
+	SCCP_FLIGHT_IN,
+	SCCP_FLIGHT_OUT,
+};
+
+/* not to be used directly */
+struct flight_entry {
+	/* odd while the entry is being written */
+	unsigned int seq;
+	struct timeval tv;
+	uint32_t len;
+	uint8_t dir;
+	uint8_t data[SCCP_FLIGHT_RECORDER_DATA_LEN];
+	/* index plus one of the full copy of the message, or 0 if none */
+	unsigned int full_index;
+};
+
+/* not to be used directly */
+struct flight_full_entry {
+	/* odd while the entry is being written */
+	unsigned int seq;
+	uint8_t data[SCCP_FLIGHT_RECORDER_FULL_DATA_LEN];
+};
+
+/* not to be used directly */
+struct sccp_flight_recorder {
+	unsigned int head;
+	unsigned int full_head;
+	struct flight_entry entries[SCCP_FLIGHT_RECORDER_SIZE];
+	struct flight_full_entry full_entries[SCCP_FLIGHT_RECORDER_FULL_SIZE];
+};
+
+/*!
+ * \brief Initialize the flight recorder.
+ *
+ * The flight recorder keeps the start of the last messages received and transmitted
+ * on a session, with their timestamp, so that they can be dumped after the fact. The
+ * last register and call info messages, whose content matters past their start, are
+ * also kept in full.
+ */
+void sccp_flight_recorder_init(struct sccp_flight_recorder *fr);
+
+/*!
+ * \brief Record a message in its wire format.
+ *
+ * \param len the total length of the message
+ *
+ * \note Must only be called by a single thread, i.e. the session thread. It never
+ *       blocks and doesn't allocate.
+ */
+void sccp_flight_recorder_record(struct sccp_flight_recorder *fr, enum sccp_flight_dir dir, const void *msg, size_t len);
+
+/*!
+ * \brief Dump the recorded messages, from the oldest to the newest.
+ *
+ * \param fd the CLI file descriptor to write to, or -1 to write to the log
+ * \param title the first line of the dump
+ *
+ * \note Can be called from any thread, concurrently with sccp_flight_recorder_record.
+ *       Entries overwritten while being dumped are skipped.
+ */
+void sccp_flight_recorder_dump(struct sccp_flight_recorder *fr, int fd, const char *title);
+
+#endif /* SCCP_FLIGHT_RECORDER_H_ */
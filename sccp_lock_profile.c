@@ -0,0 +1,360 @@
+#include <sched.h>
+
+#include <asterisk.h>
+#include <asterisk/lock.h>
+#include <asterisk/time.h>
+#include <asterisk/utils.h>
+
+#include "sccp_lock_profile.h"
+#include "sccp_utils.h"
+
+/* per shard, must be a power of 2 */
+#define SHARD_SITES 256
+
+struct site_stats_array {
+	struct sccp_lock_site_stats *stats;
+	size_t count;
+	size_t capacity;
+};
+
+/*
+ * The sites recorded by a thread, in an open addressing table. The thread is the only
+ * writer: a site is published with a release store, and its histograms are updated with
+ * relaxed stores, so that readers can merge it concurrently.
+ */
+struct lock_profile_shard {
+	struct sccp_lock_site_stats *sites[SHARD_SITES];
+	/* non-zero while the thread is recording into the profiler */
+	int inside;
+};
+
+static int profile_enabled;
+
+static struct sccp_thread_shards shards = SCCP_THREAD_SHARDS_INIT(sizeof(struct lock_profile_shard));
+
+/* the baseline is protected by baseline_lock */
+AST_MUTEX_DEFINE_STATIC(baseline_lock);
+static struct site_stats_array baseline;
+
+static struct sccp_lock_site_stats *site_stats_array_find(struct site_stats_array *array, enum sccp_lock_class class, const char *site)
+{
+	size_t i;
+
+	for (i = 0; i < array->count; i++) {
+		if (array->stats[i].site == site && array->stats[i].class == class) {
+			return &array->stats[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int site_stats_array_merge(struct site_stats_array *array, const struct sccp_lock_site_stats *src)
+{
+	struct sccp_lock_site_stats *stats;
+	size_t capacity;
+
+	stats = site_stats_array_find(array, src->class, src->site);
+	if (!stats) {
+		if (array->count == array->capacity) {
+			capacity = array->capacity ? array->capacity * 2 : 64;
+			stats = ast_realloc(array->stats, capacity * sizeof(*stats));
+			if (!stats) {
+				return -1;
+			}
+
+			array->stats = stats;
+			array->capacity = capacity;
+		}
+
+		stats = &array->stats[array->count++];
+		memset(stats, 0, sizeof(*stats));
+		stats->class = src->class;
+		stats->site = src->site;
+	}
+
+	sccp_histogram_merge(&stats->wait, &src->wait);
+	sccp_histogram_merge(&stats->hold, &src->hold);
+
+	return 0;
+}
+
+static void site_stats_array_free(struct site_stats_array *array)
+{
+	ast_free(array->stats);
+	array->stats = NULL;
+	array->count = 0;
+	array->capacity = 0;
+}
+
+struct merge_args {
+	struct site_stats_array *array;
+	int ret;
+};
+
+static void shard_merge(void *data, void *arg)
+{
+	const struct lock_profile_shard *shard = data;
+	struct merge_args *args = arg;
+	const struct sccp_lock_site_stats *stats;
+	size_t i;
+
+	if (args->ret) {
+		return;
+	}
+
+	for (i = 0; i < SHARD_SITES; i++) {
+		stats = __atomic_load_n(&shard->sites[i], __ATOMIC_ACQUIRE);
+		if (stats && site_stats_array_merge(args->array, stats)) {
+			args->ret = -1;
+			return;
+		}
+	}
+}
+
+/*
+ * Return the shard the calling thread entered, or NULL if the profiler is disabled. A
+ * shard entered must be left with profile_leave.
+ *
+ * A thread marks itself inside before checking that the profiler is still enabled, so
+ * that once sccp_lock_profile_disable has seen no thread inside, none can enter. This
+ * store-load ordering is the only fence left on the path; the histograms are updated
+ * with plain stores.
+ */
+static struct lock_profile_shard *profile_enter(void)
+{
+	struct lock_profile_shard *shard;
+
+	if (!__atomic_load_n(&profile_enabled, __ATOMIC_RELAXED)) {
+		return NULL;
+	}
+
+	shard = sccp_thread_shards_get(&shards);
+	if (!shard) {
+		return NULL;
+	}
+
+	__atomic_store_n(&shard->inside, 1, __ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&profile_enabled, __ATOMIC_SEQ_CST)) {
+		__atomic_store_n(&shard->inside, 0, __ATOMIC_RELEASE);
+		return NULL;
+	}
+
+	return shard;
+}
+
+static void profile_leave(struct lock_profile_shard *shard)
+{
+	__atomic_store_n(&shard->inside, 0, __ATOMIC_RELEASE);
+}
+
+static size_t site_hash(enum sccp_lock_class class, const char *site)
+{
+	return ((uintptr_t) site >> 3) * 31 + class;
+}
+
+static struct sccp_lock_site_stats *get_shard_site(struct lock_profile_shard *shard, enum sccp_lock_class class, const char *site)
+{
+	struct sccp_lock_site_stats *stats;
+	size_t i;
+	size_t probes;
+
+	i = site_hash(class, site) & (SHARD_SITES - 1);
+	for (probes = 0; probes < SHARD_SITES; probes++) {
+		stats = shard->sites[i];
+		if (!stats) {
+			stats = ast_calloc(1, sizeof(*stats));
+			if (!stats) {
+				return NULL;
+			}
+
+			stats->class = class;
+			stats->site = site;
+
+			/* published for the readers */
+			__atomic_store_n(&shard->sites[i], stats, __ATOMIC_RELEASE);
+
+			return stats;
+		}
+
+		if (stats->site == site && stats->class == class) {
+			return stats;
+		}
+
+		i = (i + 1) & (SHARD_SITES - 1);
+	}
+
+	/* the table is full, which would take more sites than there are */
+	return NULL;
+}
+
+static void profile_record(enum sccp_lock_class class, const char *site, unsigned int time, int hold)
+{
+	struct lock_profile_shard *shard;
+	struct sccp_lock_site_stats *stats;
+
+	shard = profile_enter();
+	if (!shard) {
+		return;
+	}
+
+	stats = get_shard_site(shard, class, site);
+	if (stats) {
+		sccp_histogram_add(hold ? &stats->hold : &stats->wait, time);
+	}
+
+	profile_leave(shard);
+}
+
+static void shard_free(void *data)
+{
+	struct lock_profile_shard *shard = data;
+	size_t i;
+
+	for (i = 0; i < SHARD_SITES; i++) {
+		ast_free(shard->sites[i]);
+	}
+}
+
+void sccp_lock_profile_destroy(void)
+{
+	/* waits for the threads recording */
+	sccp_lock_profile_disable();
+
+	sccp_thread_shards_destroy(&shards, shard_free);
+
+	ast_mutex_lock(&baseline_lock);
+	site_stats_array_free(&baseline);
+	ast_mutex_unlock(&baseline_lock);
+}
+
+void sccp_lock_profile_enable(void)
+{
+	__atomic_store_n(&profile_enabled, 1, __ATOMIC_SEQ_CST);
+}
+
+static void shard_wait_outside(void *data, void *arg)
+{
+	struct lock_profile_shard *shard = data;
+
+	while (__atomic_load_n(&shard->inside, __ATOMIC_SEQ_CST)) {
+		sched_yield();
+	}
+}
+
+void sccp_lock_profile_disable(void)
+{
+	__atomic_store_n(&profile_enabled, 0, __ATOMIC_SEQ_CST);
+
+	sccp_thread_shards_foreach(&shards, shard_wait_outside, NULL);
+}
+
+int sccp_lock_profile_enabled(void)
+{
+	return __atomic_load_n(&profile_enabled, __ATOMIC_RELAXED);
+}
+
+void sccp_lock_profile_on_wait(enum sccp_lock_class class, const char *site, unsigned int time)
+{
+	profile_record(class, site, time, 0);
+}
+
+void sccp_lock_profile_on_hold(enum sccp_lock_class class, const char *site, unsigned int time)
+{
+	profile_record(class, site, time, 1);
+}
+
+struct timeval sccp_lock_profile_lock(ast_mutex_t *mutex, enum sccp_lock_class class, const char *site)
+{
+	struct timeval start;
+	struct timeval locked_at;
+
+	if (!sccp_lock_profile_enabled()) {
+		ast_mutex_lock(mutex);
+		return ast_tv(0, 0);
+	}
+
+	start = ast_tvnow();
+	ast_mutex_lock(mutex);
+	locked_at = ast_tvnow();
+
+	sccp_lock_profile_on_wait(class, site, ast_tvdiff_us(locked_at, start));
+
+	return locked_at;
+}
+
+void sccp_lock_profile_unlock(ast_mutex_t *mutex, enum sccp_lock_class class, const char *site, struct timeval locked_at)
+{
+	if (!ast_tvzero(locked_at)) {
+		sccp_lock_profile_on_hold(class, site, ast_tvdiff_us(ast_tvnow(), locked_at));
+	}
+
+	ast_mutex_unlock(mutex);
+}
+
+static int merge_all(struct site_stats_array *array)
+{
+	struct merge_args args = { array, 0 };
+
+	sccp_thread_shards_foreach(&shards, shard_merge, &args);
+
+	return args.ret;
+}
+
+int sccp_lock_profile_take_stats(struct sccp_lock_site_stats **stats, size_t *n)
+{
+	struct site_stats_array merged = { NULL, 0, 0 };
+	struct sccp_lock_site_stats *site_stats;
+	size_t i;
+
+	if (merge_all(&merged)) {
+		site_stats_array_free(&merged);
+		return -1;
+	}
+
+	ast_mutex_lock(&baseline_lock);
+	for (i = 0; i < baseline.count; i++) {
+		site_stats = site_stats_array_find(&merged, baseline.stats[i].class, baseline.stats[i].site);
+		if (site_stats) {
+			sccp_histogram_subtract(&site_stats->wait, &baseline.stats[i].wait);
+			sccp_histogram_subtract(&site_stats->hold, &baseline.stats[i].hold);
+		}
+	}
+	ast_mutex_unlock(&baseline_lock);
+
+	*stats = merged.stats;
+	*n = merged.count;
+
+	return 0;
+}
+
+void sccp_lock_profile_reset(void)
+{
+	struct site_stats_array merged = { NULL, 0, 0 };
+
+	if (merge_all(&merged)) {
+		site_stats_array_free(&merged);
+		return;
+	}
+
+	ast_mutex_lock(&baseline_lock);
+	site_stats_array_free(&baseline);
+	baseline = merged;
+	ast_mutex_unlock(&baseline_lock);
+}
+
+const char *sccp_lock_class_str(enum sccp_lock_class class)
+{
+	switch (class) {
+	case SCCP_LOCK_DEVICE:
+		return "device";
+	case SCCP_LOCK_REGISTRY:
+		return "registry";
+	case SCCP_LOCK_SYNC_QUEUE:
+		return "sync queue";
+	case SCCP_LOCK_CLASS_COUNT:
+		break;
+	}
+
+	return "unknown";
+}
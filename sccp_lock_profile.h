@@ -0,0 +1,97 @@
+#ifndef SCCP_LOCK_PROFILE_H_
+#define SCCP_LOCK_PROFILE_H_
+
+#include <stddef.h>
+#include <sys/time.h>
+
+#include <asterisk/lock.h>
+
+#include "sccp_msg_stats.h"
+
+/*
+ * The lock profiler records, when enabled, the time spent waiting for and holding the
+ * profiled locks, per lock class and acquisition site (i.e. the name of the function
+ * that took the lock).
+ *
+ * Like the message stats, the histograms are sharded per thread, so that profiling doesn't
+ * add contention on the locks it measures; the shards are merged when the stats are taken.
+ */
+
+enum sccp_lock_class {
+	SCCP_LOCK_DEVICE,
+	SCCP_LOCK_REGISTRY,
+	SCCP_LOCK_SYNC_QUEUE,
+	SCCP_LOCK_CLASS_COUNT,
+};
+
+struct sccp_lock_site_stats {
+	enum sccp_lock_class class;
+	const char *site;
+	/* in microseconds */
+	struct sccp_histogram wait;
+	struct sccp_histogram hold;
+};
+
+/*!
+ * \brief Destroy the lock profiler.
+ *
+ * The profiler is disabled first, so a thread still taking a profiled lock doesn't record
+ * into it, but it should be called once the threads taking profiled locks have stopped.
+ */
+void sccp_lock_profile_destroy(void);
+
+void sccp_lock_profile_enable(void);
+
+/*!
+ * \brief Disable the lock profiler.
+ *
+ * \note Once this function returns, no thread is recording into the profiler anymore.
+ */
+void sccp_lock_profile_disable(void);
+
+int sccp_lock_profile_enabled(void);
+
+/*!
+ * \brief Record the time spent waiting for a lock, in microseconds.
+ */
+void sccp_lock_profile_on_wait(enum sccp_lock_class class, const char *site, unsigned int time);
+
+/*!
+ * \brief Record the time a lock has been held, in microseconds.
+ */
+void sccp_lock_profile_on_hold(enum sccp_lock_class class, const char *site, unsigned int time);
+
+/*!
+ * \brief Lock the mutex, recording the time spent waiting for it if the profiler is enabled.
+ *
+ * \return the time the mutex has been locked at, to pass to sccp_lock_profile_unlock, or a
+ *         zero time if the profiler is disabled
+ */
+struct timeval sccp_lock_profile_lock(ast_mutex_t *mutex, enum sccp_lock_class class, const char *site);
+
+/*!
+ * \brief Unlock the mutex, recording the time it has been held if it was profiled.
+ */
+void sccp_lock_profile_unlock(ast_mutex_t *mutex, enum sccp_lock_class class, const char *site, struct timeval locked_at);
+
+/*!
+ * \brief Take a snapshot of the stats since the last reset, merging every shard.
+ *
+ * \param[out] stats address where to store the dynamically allocated stats array
+ * \param[out] n length of the stats array
+ *
+ * It is the caller responsibility to call ast_free on *stats.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int sccp_lock_profile_take_stats(struct sccp_lock_site_stats **stats, size_t *n);
+
+/*!
+ * \brief Reset the stats.
+ */
+void sccp_lock_profile_reset(void);
+
+const char *sccp_lock_class_str(enum sccp_lock_class class);
+
+#endif /* SCCP_LOCK_PROFILE_H_ */
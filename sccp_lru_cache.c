@@ -0,0 +1,241 @@
+#include <asterisk.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/dlinkedlists.h>
+#include <asterisk/lock.h>
+#include <asterisk/strings.h>
+#include <asterisk/time.h>
+#include <asterisk/utils.h>
+
+#include "sccp.h"
+#include "sccp_lru_cache.h"
+
+struct lru_entry {
+	void *obj;
+	time_t expire;
+	AST_DLLIST_ENTRY(lru_entry) list;
+	char name[0];
+};
+
+/*
+ * The entries are indexed by name in a container, and ordered from the most recently
+ * used to the least recently used in a list. Both are protected by the cache lock.
+ */
+struct sccp_lru_cache {
+	ast_mutex_t lock;
+	struct ao2_container *entries;
+	AST_DLLIST_HEAD_NOLOCK(, lru_entry) lru;
+	size_t capacity;
+	int ttl;
+
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int expirations;
+	unsigned int evictions;
+};
+
+static void lru_entry_destructor(void *obj)
+{
+	struct lru_entry *entry = obj;
+
+	ao2_cleanup(entry->obj);
+}
+
+static int lru_entry_hash(const void *obj, int flags)
+{
+	const char *name;
+
+	if (flags & OBJ_SEARCH_KEY) {
+		name = obj;
+	} else {
+		name = ((const struct lru_entry *) obj)->name;
+	}
+
+	return ast_str_hash(name);
+}
+
+static int lru_entry_cmp(void *obj, void *arg, int flags)
+{
+	struct lru_entry *entry = obj;
+	const char *name;
+
+	if (flags & OBJ_SEARCH_KEY) {
+		name = arg;
+	} else {
+		name = ((const struct lru_entry *) arg)->name;
+	}
+
+	return strcmp(entry->name, name) ? 0 : (CMP_MATCH | CMP_STOP);
+}
+
+struct sccp_lru_cache *sccp_lru_cache_create(size_t capacity, int ttl)
+{
+	struct sccp_lru_cache *cache;
+
+	cache = ast_calloc(1, sizeof(*cache));
+	if (!cache) {
+		return NULL;
+	}
+
+	cache->entries = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, SCCP_BUCKETS, lru_entry_hash, lru_entry_cmp);
+	if (!cache->entries) {
+		ast_free(cache);
+		return NULL;
+	}
+
+	ast_mutex_init(&cache->lock);
+	AST_DLLIST_HEAD_INIT_NOLOCK(&cache->lru);
+	cache->capacity = capacity;
+	cache->ttl = ttl;
+
+	return cache;
+}
+
+void sccp_lru_cache_destroy(struct sccp_lru_cache *cache)
+{
+	sccp_lru_cache_invalidate(cache, NULL);
+	ao2_ref(cache->entries, -1);
+	ast_mutex_destroy(&cache->lock);
+	ast_free(cache);
+}
+
+/*
+ * Must be called with the cache locked.
+ */
+static void lru_remove_entry(struct sccp_lru_cache *cache, struct lru_entry *entry)
+{
+	AST_DLLIST_REMOVE(&cache->lru, entry, list);
+	ao2_unlink(cache->entries, entry);
+}
+
+/*
+ * Must be called with the cache locked.
+ */
+static void lru_evict(struct sccp_lru_cache *cache, size_t capacity)
+{
+	struct lru_entry *entry;
+
+	while ((size_t) ao2_container_count(cache->entries) > capacity) {
+		entry = AST_DLLIST_LAST(&cache->lru);
+		lru_remove_entry(cache, entry);
+		cache->evictions++;
+	}
+}
+
+void sccp_lru_cache_set_limits(struct sccp_lru_cache *cache, size_t capacity, int ttl)
+{
+	ast_mutex_lock(&cache->lock);
+	cache->capacity = capacity;
+	cache->ttl = ttl;
+	lru_evict(cache, capacity);
+	ast_mutex_unlock(&cache->lock);
+}
+
+void *sccp_lru_cache_get(struct sccp_lru_cache *cache, const char *name)
+{
+	struct lru_entry *entry;
+	void *obj = NULL;
+
+	ast_mutex_lock(&cache->lock);
+
+	entry = ao2_find(cache->entries, name, OBJ_SEARCH_KEY);
+	if (entry) {
+		if (entry->expire <= time(NULL)) {
+			lru_remove_entry(cache, entry);
+			cache->expirations++;
+		} else {
+			AST_DLLIST_REMOVE(&cache->lru, entry, list);
+			AST_DLLIST_INSERT_HEAD(&cache->lru, entry, list);
+			obj = entry->obj;
+			ao2_ref(obj, +1);
+		}
+
+		ao2_ref(entry, -1);
+	}
+
+	if (obj) {
+		cache->hits++;
+	} else {
+		cache->misses++;
+	}
+
+	ast_mutex_unlock(&cache->lock);
+
+	return obj;
+}
+
+int sccp_lru_cache_put(struct sccp_lru_cache *cache, const char *name, void *obj)
+{
+	struct lru_entry *entry;
+	struct lru_entry *old_entry;
+	size_t len = strlen(name) + 1;
+
+	entry = ao2_alloc_options(sizeof(*entry) + len, lru_entry_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!entry) {
+		return -1;
+	}
+
+	memcpy(entry->name, name, len);
+	entry->obj = obj;
+	ao2_ref(obj, +1);
+
+	ast_mutex_lock(&cache->lock);
+
+	if (!cache->capacity) {
+		ast_mutex_unlock(&cache->lock);
+		ao2_ref(entry, -1);
+		return 0;
+	}
+
+	entry->expire = time(NULL) + cache->ttl;
+
+	old_entry = ao2_find(cache->entries, name, OBJ_SEARCH_KEY);
+	if (old_entry) {
+		lru_remove_entry(cache, old_entry);
+		ao2_ref(old_entry, -1);
+	}
+
+	/* the list borrows the container reference */
+	ao2_link(cache->entries, entry);
+	AST_DLLIST_INSERT_HEAD(&cache->lru, entry, list);
+	lru_evict(cache, cache->capacity);
+
+	ast_mutex_unlock(&cache->lock);
+
+	ao2_ref(entry, -1);
+
+	return 0;
+}
+
+void sccp_lru_cache_invalidate(struct sccp_lru_cache *cache, const char *name)
+{
+	struct lru_entry *entry;
+
+	ast_mutex_lock(&cache->lock);
+
+	if (name) {
+		entry = ao2_find(cache->entries, name, OBJ_SEARCH_KEY);
+		if (entry) {
+			lru_remove_entry(cache, entry);
+			ao2_ref(entry, -1);
+		}
+	} else {
+		while ((entry = AST_DLLIST_FIRST(&cache->lru))) {
+			lru_remove_entry(cache, entry);
+		}
+	}
+
+	ast_mutex_unlock(&cache->lock);
+}
+
+void sccp_lru_cache_take_stats(struct sccp_lru_cache *cache, struct sccp_lru_cache_stats *stats)
+{
+	ast_mutex_lock(&cache->lock);
+	stats->hits = cache->hits;
+	stats->misses = cache->misses;
+	stats->expirations = cache->expirations;
+	stats->evictions = cache->evictions;
+	stats->entries = ao2_container_count(cache->entries);
+	stats->capacity = cache->capacity;
+	stats->ttl = cache->ttl;
+	ast_mutex_unlock(&cache->lock);
+}
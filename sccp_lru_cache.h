@@ -0,0 +1,75 @@
+#ifndef SCCP_LRU_CACHE_H_
+#define SCCP_LRU_CACHE_H_
+
+#include <stddef.h>
+
+struct sccp_lru_cache;
+
+struct sccp_lru_cache_stats {
+	unsigned int hits;
+	unsigned int misses;
+	/* entries removed because they were too old */
+	unsigned int expirations;
+	/* entries removed because the cache was full */
+	unsigned int evictions;
+	size_t entries;
+	size_t capacity;
+	int ttl;
+};
+
+/*!
+ * \brief Create a new LRU cache of ao2 objects indexed by name.
+ *
+ * The cache holds at most capacity entries, and an entry older than ttl seconds is
+ * never returned. When the cache is full, the least recently used entry is removed.
+ *
+ * \note The cache can be used from any thread.
+ *
+ * \retval non-NULL on success
+ * \retval NULL on failure
+ */
+struct sccp_lru_cache *sccp_lru_cache_create(size_t capacity, int ttl);
+
+/*!
+ * \brief Destroy the cache.
+ */
+void sccp_lru_cache_destroy(struct sccp_lru_cache *cache);
+
+/*!
+ * \brief Change the capacity and the TTL of the cache.
+ *
+ * \note The new TTL only applies to the entries added after this call.
+ */
+void sccp_lru_cache_set_limits(struct sccp_lru_cache *cache, size_t capacity, int ttl);
+
+/*!
+ * \brief Get the object with the given name.
+ *
+ * \note The returned object has its reference count incremented by one.
+ *
+ * \retval non-NULL on hit
+ * \retval NULL on miss
+ */
+void *sccp_lru_cache_get(struct sccp_lru_cache *cache, const char *name);
+
+/*!
+ * \brief Add an object to the cache, replacing the object with the same name if any.
+ *
+ * \note The cache holds a reference on the object.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int sccp_lru_cache_put(struct sccp_lru_cache *cache, const char *name, void *obj);
+
+/*!
+ * \brief Remove the object with the given name, or every object if name is NULL.
+ */
+void sccp_lru_cache_invalidate(struct sccp_lru_cache *cache, const char *name);
+
+/*!
+ * \brief Take a snapshot of the cache stats.
+ */
+void sccp_lru_cache_take_stats(struct sccp_lru_cache *cache, struct sccp_lru_cache_stats *stats);
+
+#endif /* SCCP_LRU_CACHE_H_ */
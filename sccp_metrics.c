@@ -0,0 +1,227 @@
+#include <asterisk.h>
+#include <asterisk/http.h>
+#include <asterisk/strings.h>
+#include <asterisk/utils.h>
+
+#include "sccp_device_registry.h"
+#include "sccp_metrics.h"
+#include "sccp_msg.h"
+#include "sccp_msg_stats.h"
+#include "sccp_utils.h"
+
+#define CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+static struct sccp_device_registry *metrics_registry;
+
+static void render_family(struct ast_str **out, const char *name, const char *type, const char *help)
+{
+	ast_str_append(out, 0, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+static void render_device_stats(struct ast_str **out)
+{
+	struct sccp_device_registry_stats stats;
+	const struct sccp_device_registry_type_stat *type_stat;
+	const char *type_str;
+	size_t i;
+
+	sccp_device_registry_take_stats(metrics_registry, &stats);
+
+	render_family(out, "sccp_devices", "gauge", "Registered devices, by device type.");
+	for (i = 0; i < stats.type_count; i++) {
+		type_stat = &stats.types[i];
+		type_str = sccp_device_type_str(type_stat->type);
+		if (!strcmp(type_str, "unknown")) {
+			ast_str_append(out, 0, "sccp_devices{type=\"%d\"} %u\n", type_stat->type, type_stat->devices);
+		} else {
+			ast_str_append(out, 0, "sccp_devices{type=\"%s\"} %u\n", type_str, type_stat->devices);
+		}
+	}
+
+	if (stats.other_devices) {
+		ast_str_append(out, 0, "sccp_devices{type=\"other\"} %u\n", stats.other_devices);
+	}
+
+	render_family(out, "sccp_guest_devices", "gauge", "Registered guest devices.");
+	ast_str_append(out, 0, "sccp_guest_devices %u\n", stats.guests);
+}
+
+static void render_stat(struct ast_str **out)
+{
+	struct sccp_stat stat;
+
+	sccp_stat_take_snapshot(&stat);
+
+	render_family(out, "sccp_sessions", "gauge", "Open sessions, registered or not.");
+	ast_str_append(out, 0, "sccp_sessions %d\n", stat.session_count);
+
+	render_family(out, "sccp_connections", "counter", "Accepted connections.");
+	ast_str_append(out, 0, "sccp_connections_total %d\n", stat.connection_count);
+
+	render_family(out, "sccp_registrations", "counter", "Registrations, by result.");
+	ast_str_append(out, 0, "sccp_registrations_total{result=\"accepted\"} %d\n", stat.registration_count);
+	ast_str_append(out, 0, "sccp_registrations_total{result=\"rejected\"} %d\n", stat.registration_reject_count);
+
+	render_family(out, "sccp_device_faults", "counter", "Device faults.");
+	ast_str_append(out, 0, "sccp_device_faults_total %d\n", stat.device_fault_count);
+
+	render_family(out, "sccp_device_panics", "counter", "Device panics.");
+	ast_str_append(out, 0, "sccp_device_panics_total %d\n", stat.device_panic_count);
+
+	render_family(out, "sccp_reload_duration_seconds", "summary", "Time spent reloading the config.");
+	ast_str_append(out, 0, "sccp_reload_duration_seconds_count %d\n", stat.reload_count);
+	ast_str_append(out, 0, "sccp_reload_duration_seconds_sum %.6f\n", stat.reload_time_total / 1000000.0);
+
+	render_family(out, "sccp_reload_last_duration_seconds", "gauge", "Time spent in the last config reload.");
+	ast_str_append(out, 0, "sccp_reload_last_duration_seconds %.6f\n", stat.reload_time_last / 1000000.0);
+
+	render_family(out, "sccp_reload_max_duration_seconds", "gauge", "Longest time spent in a config reload.");
+	ast_str_append(out, 0, "sccp_reload_max_duration_seconds %.6f\n", stat.reload_time_max / 1000000.0);
+}
+
+static void render_histogram(struct ast_str **out, const char *name, const char *labels, const struct sccp_histogram *hist)
+{
+	unsigned int count = 0;
+	int last;
+	int i;
+
+	/* the last bucket also counts every value above its bound, so only +Inf covers it */
+	for (last = SCCP_HISTOGRAM_BUCKETS - 2; last >= 0 && !hist->buckets[last]; last--) {
+	}
+
+	for (i = 0; i <= last; i++) {
+		count += hist->buckets[i];
+		ast_str_append(out, 0, "%s_bucket{%s%sle=\"%.6f\"} %u\n", name, labels, *labels ? "," : "",
+				sccp_histogram_bucket_max(i) / 1000000.0, count);
+	}
+
+	count = sccp_histogram_count(hist);
+	ast_str_append(out, 0, "%s_bucket{%s%sle=\"+Inf\"} %u\n", name, labels, *labels ? "," : "", count);
+	if (*labels) {
+		ast_str_append(out, 0, "%s_count{%s} %u\n%s_sum{%s} %.6f\n", name, labels, count, name, labels, hist->total / 1000000.0);
+	} else {
+		ast_str_append(out, 0, "%s_count %u\n%s_sum %.6f\n", name, count, name, hist->total / 1000000.0);
+	}
+}
+
+static void render_msg_stats(struct ast_str **out)
+{
+	struct sccp_msg_stats *stats;
+	const struct sccp_msg_desc *descs[SCCP_MSG_COUNT] = { NULL };
+	const struct sccp_msg_desc *desc;
+	char labels[64];
+	uint32_t msg_id;
+	int i;
+
+	stats = ast_malloc(sizeof(*stats));
+	if (!stats) {
+		return;
+	}
+
+	sccp_msg_stats_take(stats);
+
+	for (msg_id = 0; msg_id < SCCP_MSG_ID_LIMIT; msg_id++) {
+		desc = sccp_msg_desc_get(msg_id);
+		if (desc) {
+			descs[desc->index] = desc;
+		}
+	}
+
+#define RENDER_COUNTER(field, metric, help) \
+	do { \
+		render_family(out, metric, "counter", help); \
+		for (i = 0; i < SCCP_MSG_COUNT; i++) { \
+			if (descs[i] && stats->field[i]) { \
+				ast_str_append(out, 0, metric "_total{type=\"%s\"} %llu\n", descs[i]->name, (unsigned long long) stats->field[i]); \
+			} \
+		} \
+		if (stats->field[SCCP_MSG_STATS_UNKNOWN]) { \
+			ast_str_append(out, 0, metric "_total{type=\"unknown\"} %llu\n", (unsigned long long) stats->field[SCCP_MSG_STATS_UNKNOWN]); \
+		} \
+	} while (0)
+
+	RENDER_COUNTER(msgs_in, "sccp_messages_received", "Messages received, by message type.");
+	RENDER_COUNTER(bytes_in, "sccp_received_bytes", "Bytes received, by message type.");
+	RENDER_COUNTER(msgs_out, "sccp_messages_transmitted", "Messages transmitted, by message type.");
+	RENDER_COUNTER(bytes_out, "sccp_transmitted_bytes", "Bytes transmitted, by message type.");
+
+#undef RENDER_COUNTER
+
+	render_family(out, "sccp_message_handle_seconds", "histogram", "Time spent handling a message by the device, by message type.");
+	for (i = 0; i < SCCP_MSG_COUNT; i++) {
+		if (descs[i] && sccp_histogram_count(&stats->handle[i])) {
+			snprintf(labels, sizeof(labels), "type=\"%s\"", descs[i]->name);
+			render_histogram(out, "sccp_message_handle_seconds", labels, &stats->handle[i]);
+		}
+	}
+
+	render_family(out, "sccp_transmit_seconds", "histogram", "Time spent writing messages to the socket.");
+	render_histogram(out, "sccp_transmit_seconds", "", &stats->transmit);
+
+	ast_free(stats);
+}
+
+static int metrics_callback(struct ast_tcptls_session_instance *ser, const struct ast_http_uri *urih, const char *uri, enum ast_http_method method,
+		struct ast_variable *get_params, struct ast_variable *headers)
+{
+	struct ast_str *http_header;
+	struct ast_str *out;
+
+	if (method != AST_HTTP_GET && method != AST_HTTP_HEAD) {
+		ast_http_error(ser, 501, "Not Implemented", "Attempt to use unimplemented / unsupported method");
+		return 0;
+	}
+
+	http_header = ast_str_create(128);
+	out = ast_str_create(8192);
+	if (!http_header || !out) {
+		ast_free(http_header);
+		ast_free(out);
+		ast_http_error(ser, 500, "Server Error", "Internal Server Error");
+		return 0;
+	}
+
+	ast_str_set(&http_header, 0, "Content-Type: " CONTENT_TYPE "\r\n");
+
+	render_device_stats(&out);
+	render_stat(&out);
+	render_msg_stats(&out);
+	ast_str_append(&out, 0, "# EOF\n");
+
+	/* http_header and out are freed by ast_http_send */
+	ast_http_send(ser, method, 200, NULL, http_header, out, 0, 0);
+
+	return 0;
+}
+
+static struct ast_http_uri metrics_uri = {
+	.description = "SCCP metrics",
+	.uri = "sccp/metrics",
+	.callback = metrics_callback,
+	.has_subtree = 0,
+	.data = NULL,
+	.key = __FILE__,
+};
+
+int sccp_metrics_register(struct sccp_device_registry *registry)
+{
+	if (!registry) {
+		ast_log(LOG_ERROR, "sccp metrics register failed: registry is null\n");
+		return -1;
+	}
+
+	metrics_registry = registry;
+
+	if (ast_http_uri_link(&metrics_uri)) {
+		ast_log(LOG_ERROR, "sccp metrics register failed: ast_http_uri_link failed\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+void sccp_metrics_unregister(void)
+{
+	/* the URI list lock is held while a request is served, so this waits for it */
+	ast_http_uri_unlink(&metrics_uri);
+}
@@ -0,0 +1,31 @@
+#ifndef SCCP_METRICS_H_
+#define SCCP_METRICS_H_
+
+struct sccp_device_registry;
+
+/*
+ * The metrics are served by the Asterisk HTTP server at <prefix>/sccp/metrics, in the
+ * OpenMetrics text format, so that they can be scraped by Prometheus.
+ *
+ * Rendering the metrics only takes snapshots of stats that are read lock-free (or with
+ * locks the session threads don't take when handling messages).
+ */
+
+/*!
+ * \brief Register the metrics HTTP URI.
+ *
+ * \note The registry must outlive the registration.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int sccp_metrics_register(struct sccp_device_registry *registry);
+
+/*!
+ * \brief Unregister the metrics HTTP URI.
+ *
+ * \note Once this function returns, no request is being served anymore.
+ */
+void sccp_metrics_unregister(void);
+
+#endif /* SCCP_METRICS_H_ */
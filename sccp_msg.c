@@ -99,31 +99,31 @@ static struct softkey_template_definition softkey_template_default[] = {
 	{"\200\77", SOFTKEY_DND},
 };
 
-static void dump_call_info(char *str, size_t size, const struct call_info_message *m);
-static void dump_call_state(char *str, size_t size, const struct call_state_message *m);
-static void dump_close_receive_channel(char *str, size_t size, const struct close_receive_channel_message *m);
-static void dump_dialed_number(char *str, size_t size, const struct dialed_number_message *m);
-static void dump_feature_stat(char *str, size_t size, const struct feature_stat_message *m);
-static void dump_forward_status_res(char *str, size_t size, const struct forward_status_res_message *m);
-static void dump_keypad_button(char *str, size_t size, const struct keypad_button_message *m);
-static void dump_notification(char *str, size_t size, const struct notification_message *m);
-static void dump_offhook(char *str, size_t size, const struct offhook_message *m);
-static void dump_onhook(char *str, size_t size, const struct onhook_message *m);
-static void dump_open_receive_channel(char *str, size_t size, const struct open_receive_channel_message *m);
-static void dump_open_receive_channel_ack(char *str, size_t size, const struct open_receive_channel_ack_message *m);
-static void dump_reset(char *str, size_t size, const struct reset_message *m);
-static void dump_select_soft_keys(char *str, size_t size, const struct select_soft_keys_message *m);
-static void dump_set_lamp(char *str, size_t size, const struct set_lamp_message *m);
-static void dump_set_ringer(char *str, size_t size, const struct set_ringer_message *m);
-static void dump_set_speaker(char *str, size_t size, const struct set_speaker_message *m);
-static void dump_softkey_event(char *str, size_t size, const struct softkey_event_message *m);
-static void dump_start_media_transmission(char *str, size_t size, const struct start_media_transmission_message *m);
-static void dump_start_tone(char *str, size_t size, const struct start_tone_message *m);
-static void dump_stimulus(char *str, size_t size, const struct stimulus_message *m);
-static void dump_stop_media_transmission(char *str, size_t size, const struct stop_media_transmission_message *m);
-static void dump_stop_tone(char *str, size_t size, const struct stop_tone_message *m);
-static void dump_subscription_status_req(char *str, size_t size, const struct subscription_status_req_message *m);
-static void dump_subscription_status_res(char *str, size_t size, const struct subscription_status_res_message *m);
+static void dump_call_info(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_call_state(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_close_receive_channel(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_dialed_number(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_feature_stat(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_forward_status_res(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_keypad_button(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_notification(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_offhook(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_onhook(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_open_receive_channel(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_open_receive_channel_ack(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_reset(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_select_soft_keys(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_set_lamp(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_set_ringer(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_set_speaker(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_softkey_event(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_start_media_transmission(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_start_tone(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_stimulus(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_stop_media_transmission(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_stop_tone(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_subscription_status_req(char *str, size_t size, const struct sccp_msg *msg);
+static void dump_subscription_status_res(char *str, size_t size, const struct sccp_msg *msg);
 
 static const char *sccp_codecs_str(enum sccp_codecs v);
 static const char *sccp_lamp_state_str(enum sccp_lamp_state state);
@@ -497,6 +497,107 @@ void sccp_msg_version_res(struct sccp_msg *msg, const char *version)
 	ast_copy_string(msg->data.version.version, version, sizeof(msg->data.version.version));
 }
 
+/* the encoded messages must match the wire format */
+_Static_assert(offsetof(struct sccp_msg, data) == SCCP_MSG_HEADER_LEN, "sccp_msg header size mismatch");
+_Static_assert(sizeof(struct call_state_message) == 24, "call_state_message size mismatch");
+_Static_assert(sizeof(struct feature_stat_message) == 52, "feature_stat_message size mismatch");
+_Static_assert(sizeof(struct select_soft_keys_message) == 16, "select_soft_keys_message size mismatch");
+_Static_assert(sizeof(struct set_lamp_message) == 12, "set_lamp_message size mismatch");
+_Static_assert(sizeof(struct start_tone_message) == 16, "start_tone_message size mismatch");
+_Static_assert(sizeof(struct stop_tone_message) == 8, "stop_tone_message size mismatch");
+
+/*
+ * Write the header and the body of a message. Only the bytes of the message are
+ * touched, and buf doesn't need to be aligned.
+ */
+static void encode_msg(void *buf, uint32_t msg_id, const void *body, size_t body_len)
+{
+	uint32_t header[3];
+
+	header[0] = htolel(SCCP_MSG_LEN_FROM_DATA_LEN(body_len));
+	header[1] = 0;
+	header[2] = htolel(msg_id);
+
+	memcpy(buf, header, sizeof(header));
+	if (body_len) {
+		memcpy((char *) buf + sizeof(header), body, body_len);
+	}
+}
+
+void sccp_msg_encode_callstate(void *buf, enum sccp_state state, uint32_t line_instance, uint32_t callid)
+{
+	struct call_state_message body = {
+		.callState = htolel(state),
+		.lineInstance = htolel(line_instance),
+		.callReference = htolel(callid),
+		.priority = htolel(4),
+	};
+
+	encode_msg(buf, CALL_STATE_MESSAGE, &body, sizeof(body));
+}
+
+void sccp_msg_encode_feature_status(void *buf, uint32_t instance, enum sccp_button_type type, enum sccp_blf_status status, const char *label)
+{
+	struct feature_stat_message body = {
+		.bt_instance = htolel(instance),
+		.type = htolel(type),
+		.status = htolel(status),
+	};
+
+	ast_copy_string(body.label, label, sizeof(body.label));
+
+	encode_msg(buf, FEATURE_STAT_MESSAGE, &body, sizeof(body));
+}
+
+void sccp_msg_encode_keep_alive_ack(void *buf)
+{
+	encode_msg(buf, KEEP_ALIVE_ACK_MESSAGE, NULL, 0);
+}
+
+void sccp_msg_encode_lamp_state(void *buf, enum sccp_stimulus_type stimulus, uint32_t instance, enum sccp_lamp_state indication)
+{
+	struct set_lamp_message body = {
+		.stimulus = htolel(stimulus),
+		.lineInstance = htolel(instance),
+		.state = htolel(indication),
+	};
+
+	encode_msg(buf, SET_LAMP_MESSAGE, &body, sizeof(body));
+}
+
+void sccp_msg_encode_select_softkeys(void *buf, uint32_t line_instance, uint32_t callid, enum sccp_softkey_status softkey)
+{
+	struct select_soft_keys_message body = {
+		.lineInstance = htolel(line_instance),
+		.callInstance = htolel(callid),
+		.softKeySetIndex = htolel(softkey),
+		.validKeyMask = htolel(0xFFFFFFFF),
+	};
+
+	encode_msg(buf, SELECT_SOFT_KEYS_MESSAGE, &body, sizeof(body));
+}
+
+void sccp_msg_encode_stop_tone(void *buf, uint32_t line_instance, uint32_t callid)
+{
+	struct stop_tone_message body = {
+		.lineInstance = htolel(line_instance),
+		.callInstance = htolel(callid),
+	};
+
+	encode_msg(buf, STOP_TONE_MESSAGE, &body, sizeof(body));
+}
+
+void sccp_msg_encode_tone(void *buf, enum sccp_tone tone, uint32_t line_instance, uint32_t callid)
+{
+	struct start_tone_message body = {
+		.tone = htolel(tone),
+		.lineInstance = htolel(line_instance),
+		.callInstance = htolel(callid),
+	};
+
+	encode_msg(buf, START_TONE_MESSAGE, &body, sizeof(body));
+}
+
 static int utf8_to_iso88591(char *out, const char *in, size_t n)
 {
 	iconv_t cd;
@@ -617,6 +718,8 @@ void sccp_msg_builder_register_ack(struct sccp_msg_builder *builder, struct sccp
 
 void sccp_deserializer_init(struct sccp_deserializer *deserializer, int fd)
 {
+	memset(&deserializer->msg, 0, sizeof(deserializer->msg));
+	deserializer->msg_len = 0;
 	deserializer->start = 0;
 	deserializer->end = 0;
 	deserializer->fd = fd;
@@ -678,6 +781,16 @@ int sccp_deserializer_pop(struct sccp_deserializer *deserializer, struct sccp_ms
 	}
 
 	memcpy(&deserializer->msg, &deserializer->buf[deserializer->start], copy_length);
+	/* only the bytes of the previous message can be stale */
+	if (deserializer->msg_len > copy_length) {
+		memset((char *) &deserializer->msg + copy_length, 0, deserializer->msg_len - copy_length);
+	}
+	deserializer->msg_len = copy_length;
+
+	if (copy_length != total_length) {
+		deserializer->msg.length = htolel(copy_length - 8);
+	}
+
 	*msg = &deserializer->msg;
 
 	new_start = deserializer->start + total_length;
@@ -691,94 +804,67 @@ int sccp_deserializer_pop(struct sccp_deserializer *deserializer, struct sccp_ms
 	return 0;
 }
 
+#define SCCP_MSG_AS_DESC(name, id, str, min_len, max_len, dump, handler) \
+	{ name, SCCP_MSG_INDEX_ ## name, str, min_len, max_len, dump },
+#define SCCP_MSG_AS_DESC_INDEX(name, id, str, min_len, max_len, dump, handler) \
+	[name] = SCCP_MSG_INDEX_ ## name + 1,
+
+static const struct sccp_msg_desc msg_descs[SCCP_MSG_COUNT] = {
+	SCCP_MSG_LIST(SCCP_MSG_AS_DESC)
+};
+
+/* message ID -> index in msg_descs plus one, or 0 if the ID is unknown */
+static const uint16_t msg_desc_index[SCCP_MSG_ID_LIMIT] = {
+	SCCP_MSG_LIST(SCCP_MSG_AS_DESC_INDEX)
+};
+
+const struct sccp_msg_desc *sccp_msg_desc_get(uint32_t msg_id)
+{
+	if (msg_id >= SCCP_MSG_ID_LIMIT || !msg_desc_index[msg_id]) {
+		return NULL;
+	}
+
+	return &msg_descs[msg_desc_index[msg_id] - 1];
+}
+
+int sccp_msg_validate(const struct sccp_msg *msg, const struct sccp_msg_desc **desc)
+{
+	/* A: the message length is at least the length of the ID */
+	uint32_t body_len = letohl(msg->length) - 4;
+
+	*desc = sccp_msg_desc_get(letohl(msg->id));
+	if (!*desc) {
+		return SCCP_MSG_UNKNOWN;
+	}
+
+	if (body_len < (*desc)->min_len) {
+		return SCCP_MSG_TOO_SHORT;
+	}
+
+	if (body_len > (*desc)->max_len) {
+		return SCCP_MSG_TOO_LONG;
+	}
+
+	return SCCP_MSG_VALID;
+}
+
 int sccp_msg_dump(char *str, size_t size, const struct sccp_msg *msg)
 {
-	uint32_t msg_id = letohl(msg->id);
-
-	switch (msg_id) {
-	case CALL_INFO_MESSAGE:
-		dump_call_info(str, size, &msg->data.callinfo);
-		break;
-	case CALL_STATE_MESSAGE:
-		dump_call_state(str, size, &msg->data.callstate);
-		break;
-	case CLOSE_RECEIVE_CHANNEL_MESSAGE:
-		dump_close_receive_channel(str, size, &msg->data.closereceivechannel);
-		break;
-	case DIALED_NUMBER_MESSAGE:
-		dump_dialed_number(str, size, &msg->data.dialednumber);
-		break;
-	case FEATURE_STAT_MESSAGE:
-		dump_feature_stat(str, size, &msg->data.featurestatus);
-		break;
-	case FORWARD_STATUS_RES_MESSAGE:
-		dump_forward_status_res(str, size, &msg->data.forwardstatus);
-		break;
-	case KEYPAD_BUTTON_MESSAGE:
-		dump_keypad_button(str, size, &msg->data.keypad);
-		break;
-	case NOTIFICATION_MESSAGE:
-		dump_notification(str, size, &msg->data.notification);
-		break;
-	case OFFHOOK_MESSAGE:
-		dump_offhook(str, size, &msg->data.offhook);
-		break;
-	case ONHOOK_MESSAGE:
-		dump_onhook(str, size, &msg->data.onhook);
-		break;
-	case OPEN_RECEIVE_CHANNEL_MESSAGE:
-		dump_open_receive_channel(str, size, &msg->data.openreceivechannel);
-		break;
-	case OPEN_RECEIVE_CHANNEL_ACK_MESSAGE:
-		dump_open_receive_channel_ack(str, size, &msg->data.openreceivechannelack);
-		break;
-	case RESET_MESSAGE:
-		dump_reset(str, size, &msg->data.reset);
-		break;
-	case SELECT_SOFT_KEYS_MESSAGE:
-		dump_select_soft_keys(str, size, &msg->data.selectsoftkey);
-		break;
-	case SET_LAMP_MESSAGE:
-		dump_set_lamp(str, size, &msg->data.setlamp);
-		break;
-	case SET_RINGER_MESSAGE:
-		dump_set_ringer(str, size, &msg->data.setringer);
-		break;
-	case SET_SPEAKER_MESSAGE:
-		dump_set_speaker(str, size, &msg->data.setspeaker);
-		break;
-	case SOFTKEY_EVENT_MESSAGE:
-		dump_softkey_event(str, size, &msg->data.softkeyevent);
-		break;
-	case START_MEDIA_TRANSMISSION_MESSAGE:
-		dump_start_media_transmission(str, size, &msg->data.startmedia);
-		break;
-	case START_TONE_MESSAGE:
-		dump_start_tone(str, size, &msg->data.starttone);
-		break;
-	case STIMULUS_MESSAGE:
-		dump_stimulus(str, size, &msg->data.stimulus);
-		break;
-	case STOP_MEDIA_TRANSMISSION_MESSAGE:
-		dump_stop_media_transmission(str, size, &msg->data.stopmedia);
-		break;
-	case STOP_TONE_MESSAGE:
-		dump_stop_tone(str, size, &msg->data.stop_tone);
-	case SUBSCRIPTION_STATUS_REQ_MESSAGE:
-		dump_subscription_status_req(str, size, &msg->data.subscription);
-		break;
-	case SUBSCRIPTION_STATUS_RES_MESSAGE:
-		dump_subscription_status_res(str, size, &msg->data.subscriptionstatus);
-		break;
-	default:
+	const struct sccp_msg_desc *desc = sccp_msg_desc_get(letohl(msg->id));
+
+	if (!desc || !desc->dump) {
 		return -1;
 	}
 
+	desc->dump(str, size, msg);
+
 	return 0;
 }
 
-static void dump_call_info(char *str, size_t size, const struct call_info_message *m)
+static void dump_call_info(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct call_info_message *m = &msg->data.callinfo;
+
 	snprintf(str, size,
 			"Calling name: %s\n"
 			"Calling: %s\n"
@@ -791,8 +877,10 @@ static void dump_call_info(char *str, size_t size, const struct call_info_messag
 			letohl(m->lineInstance), letohl(m->callInstance), letohl(m->type));
 }
 
-static void dump_call_state(char *str, size_t size, const struct call_state_message *m)
+static void dump_call_state(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct call_state_message *m = &msg->data.callstate;
+
 	snprintf(str, size,
 			"State: %s\n"
 			"Line instance: %u\n"
@@ -800,15 +888,19 @@ static void dump_call_state(char *str, size_t size, const struct call_state_mess
 			sccp_state_str(letohl(m->callState)), letohl(m->lineInstance), letohl(m->callReference));
 }
 
-static void dump_close_receive_channel(char *str, size_t size, const struct close_receive_channel_message *m)
+static void dump_close_receive_channel(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct close_receive_channel_message *m = &msg->data.closereceivechannel;
+
 	snprintf(str, size,
 			"Conference ID: %u\n",
 			letohl(m->conferenceId));
 }
 
-static void dump_dialed_number(char *str, size_t size, const struct dialed_number_message *m)
+static void dump_dialed_number(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct dialed_number_message *m = &msg->data.dialednumber;
+
 	snprintf(str, size,
 			"Called: %s\n"
 			"Line instance: %u\n"
@@ -816,8 +908,10 @@ static void dump_dialed_number(char *str, size_t size, const struct dialed_numbe
 			m->calledParty, letohl(m->lineInstance), letohl(m->callInstance));
 }
 
-static void dump_feature_stat(char *str, size_t size, const struct feature_stat_message *m)
+static void dump_feature_stat(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct feature_stat_message *m = &msg->data.featurestatus;
+
 	snprintf(str, size,
 			"Instance: %u\n"
 			"Type: %u\n"
@@ -829,8 +923,10 @@ static void dump_feature_stat(char *str, size_t size, const struct feature_stat_
 			m->label);
 }
 
-static void dump_forward_status_res(char *str, size_t size, const struct forward_status_res_message *m)
+static void dump_forward_status_res(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct forward_status_res_message *m = &msg->data.forwardstatus;
+
 	snprintf(str, size,
 			"Status: %u\n"
 			"Line instance: %u\n"
@@ -842,8 +938,10 @@ static void dump_forward_status_res(char *str, size_t size, const struct forward
 			m->cfwdAllNumber);
 }
 
-static void dump_keypad_button(char *str, size_t size, const struct keypad_button_message *m)
+static void dump_keypad_button(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct keypad_button_message *m = &msg->data.keypad;
+
 	snprintf(str, size,
 			"Button: %u\n"
 			"Line instance: %u\n"
@@ -851,8 +949,10 @@ static void dump_keypad_button(char *str, size_t size, const struct keypad_butto
 			letohl(m->button), letohl(m->lineInstance), letohl(m->callInstance));
 }
 
-static void dump_notification(char *str, size_t size, const struct notification_message *m)
+static void dump_notification(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct notification_message *m = &msg->data.notification;
+
 	snprintf(str, size,
 			"Transaction ID: %u\n"
 			"Feature ID: %u\n"
@@ -861,24 +961,30 @@ static void dump_notification(char *str, size_t size, const struct notification_
 			letohl(m->transactionId), letohl(m->featureId), letohl(m->status), m->text);
 }
 
-static void dump_offhook(char *str, size_t size, const struct offhook_message *m)
+static void dump_offhook(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct offhook_message *m = &msg->data.offhook;
+
 	snprintf(str, size,
 			"Line instance: %u\n"
 			"Call ID: %u\n",
 			letohl(m->lineInstance), letohl(m->callInstance));
 }
 
-static void dump_onhook(char *str, size_t size, const struct onhook_message *m)
+static void dump_onhook(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct onhook_message *m = &msg->data.onhook;
+
 	snprintf(str, size,
 			"Line instance: %u\n"
 			"Call ID: %u\n",
 			letohl(m->lineInstance), letohl(m->callInstance));
 }
 
-static void dump_open_receive_channel(char *str, size_t size, const struct open_receive_channel_message *m)
+static void dump_open_receive_channel(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct open_receive_channel_message *m = &msg->data.openreceivechannel;
+
 	snprintf(str, size,
 			"Call ID: %u\n"
 			"Party ID: %u\n"
@@ -887,8 +993,9 @@ static void dump_open_receive_channel(char *str, size_t size, const struct open_
 			letohl(m->conferenceId), letohl(m->partyId), letohl(m->packets), sccp_codecs_str(letohl(m->capability)));
 }
 
-static void dump_open_receive_channel_ack(char *str, size_t size, const struct open_receive_channel_ack_message *m)
+static void dump_open_receive_channel_ack(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct open_receive_channel_ack_message *m = &msg->data.openreceivechannelack;
 	char buf[INET_ADDRSTRLEN];
 	struct in_addr addr;
 
@@ -906,15 +1013,19 @@ static void dump_open_receive_channel_ack(char *str, size_t size, const struct o
 			letohl(m->status), buf, letohl(m->port), letohl(m->passThruId));
 }
 
-static void dump_reset(char *str, size_t size, const struct reset_message *m)
+static void dump_reset(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct reset_message *m = &msg->data.reset;
+
 	snprintf(str, size,
 			"Type: %s\n",
 			sccp_reset_type_str(letohl(m->type)));
 }
 
-static void dump_select_soft_keys(char *str, size_t size, const struct select_soft_keys_message *m)
+static void dump_select_soft_keys(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct select_soft_keys_message *m = &msg->data.selectsoftkey;
+
 	snprintf(str, size,
 			"Softkey status: %s\n"
 			"Line instance: %u\n"
@@ -922,8 +1033,10 @@ static void dump_select_soft_keys(char *str, size_t size, const struct select_so
 			sccp_softkey_status_str(letohl(m->softKeySetIndex)), letohl(m->lineInstance), letohl(m->callInstance));
 }
 
-static void dump_set_lamp(char *str, size_t size, const struct set_lamp_message *m)
+static void dump_set_lamp(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct set_lamp_message *m = &msg->data.setlamp;
+
 	snprintf(str, size,
 			"Stimulus: %s\n"
 			"Line instance: %u\n"
@@ -931,22 +1044,28 @@ static void dump_set_lamp(char *str, size_t size, const struct set_lamp_message
 			sccp_stimulus_type_str(letohl(m->stimulus)), letohl(m->lineInstance), sccp_lamp_state_str(letohl(m->state)));
 }
 
-static void dump_set_ringer(char *str, size_t size, const struct set_ringer_message *m)
+static void dump_set_ringer(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct set_ringer_message *m = &msg->data.setringer;
+
 	snprintf(str, size,
 			"Mode: %s\n",
 			sccp_ringer_mode_str(letohl(m->ringerMode)));
 }
 
-static void dump_set_speaker(char *str, size_t size, const struct set_speaker_message *m)
+static void dump_set_speaker(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct set_speaker_message *m = &msg->data.setspeaker;
+
 	snprintf(str, size,
 			"Mode: %s\n",
 			sccp_speaker_mode_str(letohl(m->mode)));
 }
 
-static void dump_softkey_event(char *str, size_t size, const struct softkey_event_message *m)
+static void dump_softkey_event(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct softkey_event_message *m = &msg->data.softkeyevent;
+
 	snprintf(str, size,
 			"Event: %s\n"
 			"Line instance: %u\n"
@@ -954,8 +1073,9 @@ static void dump_softkey_event(char *str, size_t size, const struct softkey_even
 			sccp_softkey_str(letohl(m->softKeyEvent)), letohl(m->lineInstance), letohl(m->callInstance));
 }
 
-static void dump_start_media_transmission(char *str, size_t size, const struct start_media_transmission_message *m)
+static void dump_start_media_transmission(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct start_media_transmission_message *m = &msg->data.startmedia;
 	char buf[INET_ADDRSTRLEN];
 	struct in_addr addr;
 
@@ -973,8 +1093,10 @@ static void dump_start_media_transmission(char *str, size_t size, const struct s
 			letohl(m->conferenceId), buf, letohl(m->remotePort), letohl(m->packetSize));
 }
 
-static void dump_start_tone(char *str, size_t size, const struct start_tone_message *m)
+static void dump_start_tone(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct start_tone_message *m = &msg->data.starttone;
+
 	snprintf(str, size,
 			"Tone: %s\n"
 			"Line instance: %u\n"
@@ -982,31 +1104,39 @@ static void dump_start_tone(char *str, size_t size, const struct start_tone_mess
 			sccp_tone_str(letohl(m->tone)), letohl(m->lineInstance), letohl(m->callInstance));
 }
 
-static void dump_stimulus(char *str, size_t size, const struct stimulus_message *m)
+static void dump_stimulus(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct stimulus_message *m = &msg->data.stimulus;
+
 	snprintf(str, size,
 			"Stimulus: %s\n"
 			"Line instance: %u\n",
 			sccp_stimulus_type_str(letohl(m->stimulus)), letohl(m->lineInstance));
 }
 
-static void dump_stop_media_transmission(char *str, size_t size, const struct stop_media_transmission_message *m)
+static void dump_stop_media_transmission(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct stop_media_transmission_message *m = &msg->data.stopmedia;
+
 	snprintf(str, size,
 			"Conference ID: %u\n",
 			letohl(m->conferenceId));
 }
 
-static void dump_stop_tone(char *str, size_t size, const struct stop_tone_message *m)
+static void dump_stop_tone(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct stop_tone_message *m = &msg->data.stop_tone;
+
 	snprintf(str, size,
 			"Line instance: %u\n"
 			"Call ID: %u\n",
 			letohl(m->lineInstance), letohl(m->callInstance));
 }
 
-static void dump_subscription_status_req(char *str, size_t size, const struct subscription_status_req_message *m)
+static void dump_subscription_status_req(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct subscription_status_req_message *m = &msg->data.subscription;
+
 	snprintf(str, size,
 			"Transaction ID: %u\n"
 			"Feature ID: %u\n"
@@ -1015,8 +1145,10 @@ static void dump_subscription_status_req(char *str, size_t size, const struct su
 			letohl(m->transactionId), letohl(m->featureId), letohl(m->timer), letohl(m->subscriptionId));
 }
 
-static void dump_subscription_status_res(char *str, size_t size, const struct subscription_status_res_message *m)
+static void dump_subscription_status_res(char *str, size_t size, const struct sccp_msg *msg)
 {
+	const struct subscription_status_res_message *m = &msg->data.subscriptionstatus;
+
 	snprintf(str, size,
 			"Transaction ID: %u\n"
 			"Feature ID: %u\n"
@@ -1105,6 +1237,47 @@ const char *sccp_device_type_str(enum sccp_device_type device_type)
 	return "unknown";
 }
 
+static const enum sccp_device_type all_device_types[] = {
+	SCCP_DEVICE_7905,
+	SCCP_DEVICE_7906,
+	SCCP_DEVICE_7911,
+	SCCP_DEVICE_7912,
+	SCCP_DEVICE_7920,
+	SCCP_DEVICE_7921,
+	SCCP_DEVICE_7931,
+	SCCP_DEVICE_7937,
+	SCCP_DEVICE_7940,
+	SCCP_DEVICE_7941,
+	SCCP_DEVICE_7941GE,
+	SCCP_DEVICE_7942,
+	SCCP_DEVICE_7945,
+	SCCP_DEVICE_7960,
+	SCCP_DEVICE_7961,
+	SCCP_DEVICE_7962,
+	SCCP_DEVICE_7965,
+	SCCP_DEVICE_7970,
+	SCCP_DEVICE_7971,
+	SCCP_DEVICE_7971GE,
+	SCCP_DEVICE_7975,
+	SCCP_DEVICE_8941,
+	SCCP_DEVICE_8945,
+	SCCP_DEVICE_CIPC,
+};
+
+int sccp_device_type_from_str(const char *str, enum sccp_device_type *device_type)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_LEN(all_device_types); i++) {
+		if (!strcasecmp(str, sccp_device_type_str(all_device_types[i]))) {
+			*device_type = all_device_types[i];
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
 static const char *sccp_lamp_state_str(enum sccp_lamp_state state)
 {
 	switch (state) {
@@ -1123,131 +1296,15 @@ static const char *sccp_lamp_state_str(enum sccp_lamp_state state)
 	return "unknown";
 }
 
-const char *sccp_msg_id_str(uint32_t msg_id) {
-	switch (msg_id) {
-	case KEEP_ALIVE_MESSAGE:
-		return "keep alive";
-	case REGISTER_MESSAGE:
-		return "register";
-	case IP_PORT_MESSAGE:
-		return "ip port";
-	case ENBLOC_CALL_MESSAGE:
-		return "enbloc call";
-	case KEYPAD_BUTTON_MESSAGE:
-		return "keypad button";
-	case STIMULUS_MESSAGE:
-		return "stimulus";
-	case OFFHOOK_MESSAGE:
-		return "offhook";
-	case ONHOOK_MESSAGE:
-		return "onhook";
-	case FORWARD_STATUS_REQ_MESSAGE:
-		return "forward status req";
-	case SPEEDDIAL_STAT_REQ_MESSAGE:
-		return "speeddial status req";
-	case LINE_STATUS_REQ_MESSAGE:
-		return "line status req";
-	case CONFIG_STATUS_REQ_MESSAGE:
-		return "config status req";
-	case TIME_DATE_REQ_MESSAGE:
-		return "time date req";
-	case BUTTON_TEMPLATE_REQ_MESSAGE:
-		return "button template req";
-	case VERSION_REQ_MESSAGE:
-		return "version req";
-	case CAPABILITIES_RES_MESSAGE:
-		return "capabilities res";
-	case ALARM_MESSAGE:
-		return "alarm";
-	case OPEN_RECEIVE_CHANNEL_ACK_MESSAGE:
-		return "open receive channel ack";
-	case SOFTKEY_SET_REQ_MESSAGE:
-		return "softkey set req";
-	case SOFTKEY_EVENT_MESSAGE:
-		return "softkey event";
-	case UNREGISTER_MESSAGE:
-		return "unregister";
-	case SOFTKEY_TEMPLATE_REQ_MESSAGE:
-		return "softkey template req";
-	case REGISTER_AVAILABLE_LINES_MESSAGE:
-		return "register available lines";
-	case FEATURE_STATUS_REQ_MESSAGE:
-		return "feature status req";
-	case ACCESSORY_STATUS_MESSAGE:
-		return "accessory status";
-	case REGISTER_ACK_MESSAGE:
-		return "register ack";
-	case START_TONE_MESSAGE:
-		return "start tone";
-	case STOP_TONE_MESSAGE:
-		return "stop tone";
-	case SET_RINGER_MESSAGE:
-		return "set ringer";
-	case SET_LAMP_MESSAGE:
-		return "set lamp";
-	case SET_SPEAKER_MESSAGE:
-		return "set speaker";
-	case STOP_MEDIA_TRANSMISSION_MESSAGE:
-		return "stop media transmission";
-	case START_MEDIA_TRANSMISSION_MESSAGE:
-		return "start media transmission";
-	case CALL_INFO_MESSAGE:
-		return "call info";
-	case FORWARD_STATUS_RES_MESSAGE:
-		return "forward status res";
-	case SPEEDDIAL_STAT_RES_MESSAGE:
-		return "speeddial status res";
-	case LINE_STATUS_RES_MESSAGE:
-		return "line status res";
-	case CONFIG_STATUS_RES_MESSAGE:
-		return "config status res";
-	case TIME_DATE_RES_MESSAGE:
-		return "date time res";
-	case BUTTON_TEMPLATE_RES_MESSAGE:
-		return "button template res";
-	case VERSION_RES_MESSAGE:
-		return "version res";
-	case CAPABILITIES_REQ_MESSAGE:
-		return "capabilities req";
-	case REGISTER_REJ_MESSAGE:
-		return "register rej";
-	case RESET_MESSAGE:
-		return "reset";
-	case KEEP_ALIVE_ACK_MESSAGE:
-		return "keep alive ack";
-	case OPEN_RECEIVE_CHANNEL_MESSAGE:
-		return "open receive channel";
-	case CLOSE_RECEIVE_CHANNEL_MESSAGE:
-		return "close receive channel";
-	case SOFTKEY_TEMPLATE_RES_MESSAGE:
-		return "softkey template res";
-	case SOFTKEY_SET_RES_MESSAGE:
-		return "softkey set res";
-	case SELECT_SOFT_KEYS_MESSAGE:
-		return "select soft keys";
-	case CALL_STATE_MESSAGE:
-		return "call state";
-	case DISPLAY_NOTIFY_MESSAGE:
-		return "display notify";
-	case CLEAR_NOTIFY_MESSAGE:
-		return "clear notify";
-	case ACTIVATE_CALL_PLANE_MESSAGE:
-		return "activate call plane";
-	case DIALED_NUMBER_MESSAGE:
-		return "dialed number";
-	case FEATURE_STAT_MESSAGE:
-		return "feature status";
-	case START_MEDIA_TRANSMISSION_ACK_MESSAGE:
-		return "start media transmission ack";
-	case SUBSCRIPTION_STATUS_REQ_MESSAGE:
-		return "subscription status";
-	case SUBSCRIPTION_STATUS_RES_MESSAGE:
-		return "subscription status res";
-	case NOTIFICATION_MESSAGE:
-		return "notification";
+const char *sccp_msg_id_str(uint32_t msg_id)
+{
+	const struct sccp_msg_desc *desc = sccp_msg_desc_get(msg_id);
+
+	if (!desc) {
+		return "unknown";
 	}
 
-	return "unknown";
+	return desc->name;
 }
 
 static const char *sccp_reset_type_str(enum sccp_reset_type v)
@@ -1,6 +1,7 @@
 #ifndef SCCP_MSG_H_
 #define SCCP_MSG_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 struct sockaddr_in;
@@ -193,9 +194,6 @@ enum sccp_subscription_cause {
 	THROTTLE = 0x06
 };
 
-#define KEEP_ALIVE_MESSAGE 0x0000
-
-#define REGISTER_MESSAGE 0x0001
 struct register_message {
 	char name[16];
 	uint32_t userId;
@@ -207,62 +205,47 @@ struct register_message {
 	uint8_t protoVersion;
 };
 
-#define IP_PORT_MESSAGE 0x0002
 struct ip_port_message {
 	uint32_t stationIpPort;
 };
 
-#define ENBLOC_CALL_MESSAGE 0x0004
 struct enbloc_call_message {
 	char extension[24];
 };
 
-#define KEYPAD_BUTTON_MESSAGE 0x0003
 struct keypad_button_message {
 	uint32_t button;
 	uint32_t lineInstance;
 	uint32_t callInstance;
 };
 
-#define STIMULUS_MESSAGE 0x0005
 struct stimulus_message {
 	uint32_t stimulus;
 	uint32_t lineInstance;
 };
 
-#define OFFHOOK_MESSAGE 0x0006
 struct offhook_message {
 	uint32_t lineInstance;
 	uint32_t callInstance;
 };
 
-#define ONHOOK_MESSAGE 0x0007
 struct onhook_message {
 	uint32_t lineInstance;
 	uint32_t callInstance;
 };
 
-#define FORWARD_STATUS_REQ_MESSAGE 0x0009
 struct forward_status_req_message {
 	uint32_t lineInstance;
 };
 
-#define SPEEDDIAL_STAT_REQ_MESSAGE 0x000A
 struct speeddial_stat_req_message {
 	uint32_t instance;
 };
 
-#define LINE_STATUS_REQ_MESSAGE 0x000B
 struct line_status_req_message {
 	uint32_t lineInstance;
 };
 
-#define CONFIG_STATUS_REQ_MESSAGE 0x000C
-#define TIME_DATE_REQ_MESSAGE 0x000D
-#define BUTTON_TEMPLATE_REQ_MESSAGE 0x000E
-#define VERSION_REQ_MESSAGE 0x000F
-
-#define CAPABILITIES_RES_MESSAGE 0x0010
 struct station_capabilities {
 	uint32_t codec;
 	uint32_t frames;
@@ -278,7 +261,6 @@ struct capabilities_res_message {
 	struct station_capabilities caps[SCCP_MAX_CAPABILITIES];
 };
 
-#define ALARM_MESSAGE 0x0020
 struct alarm_message {
 	uint32_t alarmSeverity;
 	char displayMessage[80];
@@ -286,7 +268,6 @@ struct alarm_message {
 	uint32_t alarmParam2;
 };
 
-#define OPEN_RECEIVE_CHANNEL_ACK_MESSAGE 0x0022
 struct open_receive_channel_ack_message {
 	uint32_t status;
 	uint32_t ipAddr;
@@ -294,25 +275,17 @@ struct open_receive_channel_ack_message {
 	uint32_t passThruId;
 };
 
-#define SOFTKEY_SET_REQ_MESSAGE 0x0025
-#define SOFTKEY_EVENT_MESSAGE 0x0026
 struct softkey_event_message {
 	uint32_t softKeyEvent;
 	uint32_t lineInstance;
 	uint32_t callInstance;
 };
 
-#define UNREGISTER_MESSAGE 0x0027
-#define SOFTKEY_TEMPLATE_REQ_MESSAGE 0x0028
-#define REGISTER_AVAILABLE_LINES_MESSAGE 0x002D
-
-#define FEATURE_STATUS_REQ_MESSAGE 0X0034
 struct feature_status_req_message {
 	uint32_t instance;
 	uint32_t unknown;
 };
 
-#define SUBSCRIPTION_STATUS_REQ_MESSAGE 0x0048
 struct subscription_status_req_message {
 	uint32_t transactionId;
 	uint32_t featureId;
@@ -320,8 +293,6 @@ struct subscription_status_req_message {
 	char subscriptionId[256];
 };
 
-#define ACCESSORY_STATUS_MESSAGE 0x0049
-#define REGISTER_ACK_MESSAGE 0x0081
 struct register_ack_message {
 	uint32_t keepAlive;
 	char dateTemplate[6];
@@ -333,7 +304,6 @@ struct register_ack_message {
 	uint8_t unknown3;
 };
 
-#define START_TONE_MESSAGE 0x0082
 struct start_tone_message {
 	uint32_t tone;
 	uint32_t space;
@@ -341,13 +311,11 @@ struct start_tone_message {
 	uint32_t callInstance;
 };
 
-#define STOP_TONE_MESSAGE 0x0083
 struct stop_tone_message {
 	uint32_t lineInstance;
 	uint32_t callInstance;
 };
 
-#define SET_RINGER_MESSAGE 0x0085
 struct set_ringer_message {
 	uint32_t ringerMode;
 	uint32_t unknown1;
@@ -355,19 +323,16 @@ struct set_ringer_message {
 	uint32_t space[2];
 };
 
-#define SET_LAMP_MESSAGE 0x0086
 struct set_lamp_message {
 	uint32_t stimulus;
 	uint32_t lineInstance;
 	uint32_t state;
 };
 
-#define SET_SPEAKER_MESSAGE 0X0088
 struct set_speaker_message {
 	uint32_t mode;
 };
 
-#define STOP_MEDIA_TRANSMISSION_MESSAGE 0x008B
 struct stop_media_transmission_message {
 	uint32_t conferenceId;
 	uint32_t partyId;
@@ -375,7 +340,6 @@ struct stop_media_transmission_message {
 	uint32_t unknown1;
 };
 
-#define START_MEDIA_TRANSMISSION_MESSAGE 0x008A
 struct media_qualifier {
 	uint32_t precedence;
 	uint32_t vad;
@@ -399,7 +363,6 @@ struct start_media_transmission_message {
 	uint32_t mixingParty;
 };
 
-#define CALL_INFO_MESSAGE 0x008F
 struct call_info_message {
 	char callingPartyName[40];
 	char callingParty[24];
@@ -421,7 +384,6 @@ struct call_info_message {
 	uint32_t space[3];
 };
 
-#define FORWARD_STATUS_RES_MESSAGE 0x0090
 struct forward_status_res_message {
 	uint32_t status;
 	uint32_t lineInstance;
@@ -433,14 +395,12 @@ struct forward_status_res_message {
 	char cfwdNoAnswerNumber[24];
 };
 
-#define SPEEDDIAL_STAT_RES_MESSAGE 0x0091
 struct speeddial_stat_res_message {
 	uint32_t instance;
 	char extension[24];
 	char label[40];
 };
 
-#define LINE_STATUS_RES_MESSAGE 0x0092
 struct line_status_res_message {
 	uint32_t lineNumber;
 	char lineDirNumber[24];
@@ -448,7 +408,6 @@ struct line_status_res_message {
 	char lineDisplayAlias[44];
 };
 
-#define CONFIG_STATUS_RES_MESSAGE 0x0093
 struct config_status_res_message {
 	char deviceName[16];
 	uint32_t stationUserId;
@@ -459,7 +418,6 @@ struct config_status_res_message {
 	uint32_t numberSpeedDials;
 };
 
-#define TIME_DATE_RES_MESSAGE 0x0094
 struct time_date_res_message {
 	uint32_t year;
 	uint32_t month;
@@ -472,7 +430,6 @@ struct time_date_res_message {
 	uint32_t systemTime;
 };
 
-#define BUTTON_TEMPLATE_RES_MESSAGE 0x0097
 struct button_definition {
 	uint8_t lineInstance;
 	uint8_t buttonDefinition;
@@ -486,26 +443,18 @@ struct button_template_res_message {
 	struct button_definition definition[MAX_BUTTON_DEFINITION];
 };
 
-#define VERSION_RES_MESSAGE 0x0098
 struct version_res_message {
 	char version[16];
 };
 
-#define CAPABILITIES_REQ_MESSAGE 0x009B
-
-#define REGISTER_REJ_MESSAGE 0x009D
 struct register_rej_message {
 	char errMsg[33];
 };
 
-#define RESET_MESSAGE 0x009F
 struct reset_message {
 	uint32_t type;
 };
 
-#define KEEP_ALIVE_ACK_MESSAGE 0x0100
-
-#define OPEN_RECEIVE_CHANNEL_MESSAGE 0x0105
 struct open_receive_channel_message {
 	uint32_t conferenceId;
 	uint32_t partyId;
@@ -540,14 +489,12 @@ struct open_receive_channel_message {
 	uint32_t unknown17;
 };
 
-#define CLOSE_RECEIVE_CHANNEL_MESSAGE 0x0106
 struct close_receive_channel_message {
 	uint32_t conferenceId;
 	uint32_t partyId;
 	uint32_t conferenceId1;
 };
 
-#define SOFTKEY_TEMPLATE_RES_MESSAGE 0x0108
 struct softkey_template_definition {
 	char softKeyLabel[16];
 	uint32_t softKeyEvent;
@@ -560,7 +507,6 @@ struct softkey_template_res_message {
 	struct softkey_template_definition softKeyTemplateDefinition[32];
 };
 
-#define SOFTKEY_SET_RES_MESSAGE 0x0109
 struct softkey_set_definition {
 	uint8_t softKeyTemplateIndex[16];
 	uint16_t softKeyInfoIndex[16];
@@ -574,7 +520,6 @@ struct softkey_set_res_message {
 	uint32_t res;
 };
 
-#define SELECT_SOFT_KEYS_MESSAGE 0x0110
 struct select_soft_keys_message {
 	uint32_t lineInstance;
 	uint32_t callInstance;
@@ -582,7 +527,6 @@ struct select_soft_keys_message {
 	uint32_t validKeyMask;
 };
 
-#define CALL_STATE_MESSAGE 0x0111
 struct call_state_message {
 	uint32_t callState;
 	uint32_t lineInstance;
@@ -592,27 +536,21 @@ struct call_state_message {
 	uint32_t unknown;
 };
 
-#define DISPLAY_NOTIFY_MESSAGE 0x0114
 struct display_notify_message {
 	uint32_t displayTimeout;
 	char displayMessage[100];
 };
 
-#define CLEAR_NOTIFY_MESSAGE 0x0115
-
-#define ACTIVATE_CALL_PLANE_MESSAGE 0x0116
 struct activate_call_plane_message {
 	uint32_t lineInstance;
 };
 
-#define DIALED_NUMBER_MESSAGE 0x011D
 struct dialed_number_message {
 	char calledParty[24];
 	uint32_t lineInstance;
 	uint32_t callInstance;
 };
 
-#define FEATURE_STAT_MESSAGE 0x0146
 struct feature_stat_message {
 	uint32_t bt_instance;
 	uint32_t type;
@@ -620,7 +558,6 @@ struct feature_stat_message {
 	char label[40];
 };
 
-#define SUBSCRIPTION_STATUS_RES_MESSAGE 0x0152
 struct subscription_status_res_message {
 	uint32_t transactionId;
 	uint32_t featureId;
@@ -628,7 +565,6 @@ struct subscription_status_res_message {
 	uint32_t cause;
 };
 
-#define NOTIFICATION_MESSAGE 0x0153
 struct notification_message {
 	uint32_t transactionId;
 	uint32_t featureId;
@@ -636,8 +572,6 @@ struct notification_message {
 	char text[97];
 };
 
-#define START_MEDIA_TRANSMISSION_ACK_MESSAGE 0x0159
-
 union sccp_data {
 	struct activate_call_plane_message activatecallplane;
 	struct alarm_message alarm;
@@ -699,6 +633,138 @@ struct sccp_msg {
 #define SCCP_MSG_TOTAL_LEN_FROM_LEN(msg_length) ((msg_length) + 8)
 #define SCCP_MSG_LEN_FROM_DATA_LEN(data_length) ((data_length) + 4)
 
+/* body lengths, for the message schema */
+#define SCCP_MSG_BODY_LEN(type) sizeof(struct type)
+#define SCCP_MSG_BODY_LEN_UPTO(type, field) (offsetof(struct type, field) + sizeof(((struct type *) NULL)->field))
+#define SCCP_MSG_BODY_LEN_MAX sizeof(union sccp_data)
+
+/*
+ * The message schema, one X(name, id, str, min_len, max_len, dump, handler) entry
+ * per message, sorted by ID:
+ *
+ * - min_len and max_len are the bounds of the body length
+ * - dump is the function dumping the body (sccp_msg.c), or NULL
+ * - handler is the function handling the message on a registered device
+ *   (sccp_device.c), or NULL
+ *
+ * Received messages accept any body at least as long as the fields their handler
+ * requires, since newer protocol versions append fields to them. The fields past the
+ * body of a received message read as zero, which handlers take as "not sent" (e.g. the
+ * line instance of an offhook message from an older device).
+ */
+#define SCCP_MSG_LIST(X) \
+	X(KEEP_ALIVE_MESSAGE, 0x0000, "keep alive", 0, SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_keep_alive) \
+	X(REGISTER_MESSAGE, 0x0001, "register", SCCP_MSG_BODY_LEN_UPTO(register_message, type), SCCP_MSG_BODY_LEN_MAX, NULL, NULL) \
+	X(IP_PORT_MESSAGE, 0x0002, "ip port", 0, SCCP_MSG_BODY_LEN_MAX, NULL, NULL) \
+	X(KEYPAD_BUTTON_MESSAGE, 0x0003, "keypad button", SCCP_MSG_BODY_LEN_UPTO(keypad_button_message, button), SCCP_MSG_BODY_LEN_MAX, dump_keypad_button, handle_msg_keypad_button) \
+	X(ENBLOC_CALL_MESSAGE, 0x0004, "enbloc call", SCCP_MSG_BODY_LEN(enbloc_call_message), SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_enbloc_call) \
+	X(STIMULUS_MESSAGE, 0x0005, "stimulus", SCCP_MSG_BODY_LEN(stimulus_message), SCCP_MSG_BODY_LEN_MAX, dump_stimulus, handle_msg_stimulus) \
+	X(OFFHOOK_MESSAGE, 0x0006, "offhook", 0, SCCP_MSG_BODY_LEN_MAX, dump_offhook, handle_msg_offhook) \
+	X(ONHOOK_MESSAGE, 0x0007, "onhook", 0, SCCP_MSG_BODY_LEN_MAX, dump_onhook, handle_msg_onhook) \
+	X(FORWARD_STATUS_REQ_MESSAGE, 0x0009, "forward status req", 0, SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_forward_status_req) \
+	X(SPEEDDIAL_STAT_REQ_MESSAGE, 0x000A, "speeddial status req", SCCP_MSG_BODY_LEN(speeddial_stat_req_message), SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_speeddial_status_req) \
+	X(LINE_STATUS_REQ_MESSAGE, 0x000B, "line status req", SCCP_MSG_BODY_LEN(line_status_req_message), SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_line_status_req) \
+	X(CONFIG_STATUS_REQ_MESSAGE, 0x000C, "config status req", 0, SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_config_status_req) \
+	X(TIME_DATE_REQ_MESSAGE, 0x000D, "time date req", 0, SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_time_date_req) \
+	X(BUTTON_TEMPLATE_REQ_MESSAGE, 0x000E, "button template req", 0, SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_button_template_req) \
+	X(VERSION_REQ_MESSAGE, 0x000F, "version req", 0, SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_version_req) \
+	X(CAPABILITIES_RES_MESSAGE, 0x0010, "capabilities res", SCCP_MSG_BODY_LEN_UPTO(capabilities_res_message, count), SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_capabilities_res) \
+	X(ALARM_MESSAGE, 0x0020, "alarm", SCCP_MSG_BODY_LEN_UPTO(alarm_message, displayMessage), SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_alarm) \
+	X(OPEN_RECEIVE_CHANNEL_ACK_MESSAGE, 0x0022, "open receive channel ack", SCCP_MSG_BODY_LEN_UPTO(open_receive_channel_ack_message, port), SCCP_MSG_BODY_LEN_MAX, dump_open_receive_channel_ack, handle_msg_open_receive_channel_ack) \
+	X(SOFTKEY_SET_REQ_MESSAGE, 0x0025, "softkey set req", 0, SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_softkey_set_req) \
+	X(SOFTKEY_EVENT_MESSAGE, 0x0026, "softkey event", SCCP_MSG_BODY_LEN(softkey_event_message), SCCP_MSG_BODY_LEN_MAX, dump_softkey_event, handle_msg_softkey_event) \
+	X(UNREGISTER_MESSAGE, 0x0027, "unregister", 0, SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_unregister) \
+	X(SOFTKEY_TEMPLATE_REQ_MESSAGE, 0x0028, "softkey template req", 0, SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_softkey_template_req) \
+	X(REGISTER_AVAILABLE_LINES_MESSAGE, 0x002D, "register available lines", 0, SCCP_MSG_BODY_LEN_MAX, NULL, NULL) \
+	X(FEATURE_STATUS_REQ_MESSAGE, 0x0034, "feature status req", SCCP_MSG_BODY_LEN_UPTO(feature_status_req_message, instance), SCCP_MSG_BODY_LEN_MAX, NULL, handle_msg_feature_status_req) \
+	X(SUBSCRIPTION_STATUS_REQ_MESSAGE, 0x0048, "subscription status", SCCP_MSG_BODY_LEN_UPTO(subscription_status_req_message, timer), SCCP_MSG_BODY_LEN_MAX, dump_subscription_status_req, handle_msg_subscription_status_req) \
+	X(ACCESSORY_STATUS_MESSAGE, 0x0049, "accessory status", 0, SCCP_MSG_BODY_LEN_MAX, NULL, NULL) \
+	X(REGISTER_ACK_MESSAGE, 0x0081, "register ack", SCCP_MSG_BODY_LEN(register_ack_message), SCCP_MSG_BODY_LEN(register_ack_message), NULL, NULL) \
+	X(START_TONE_MESSAGE, 0x0082, "start tone", SCCP_MSG_BODY_LEN(start_tone_message), SCCP_MSG_BODY_LEN(start_tone_message), dump_start_tone, NULL) \
+	X(STOP_TONE_MESSAGE, 0x0083, "stop tone", SCCP_MSG_BODY_LEN(stop_tone_message), SCCP_MSG_BODY_LEN(stop_tone_message), dump_stop_tone, NULL) \
+	X(SET_RINGER_MESSAGE, 0x0085, "set ringer", SCCP_MSG_BODY_LEN(set_ringer_message), SCCP_MSG_BODY_LEN(set_ringer_message), dump_set_ringer, NULL) \
+	X(SET_LAMP_MESSAGE, 0x0086, "set lamp", SCCP_MSG_BODY_LEN(set_lamp_message), SCCP_MSG_BODY_LEN(set_lamp_message), dump_set_lamp, NULL) \
+	X(SET_SPEAKER_MESSAGE, 0x0088, "set speaker", SCCP_MSG_BODY_LEN(set_speaker_message), SCCP_MSG_BODY_LEN(set_speaker_message), dump_set_speaker, NULL) \
+	X(START_MEDIA_TRANSMISSION_MESSAGE, 0x008A, "start media transmission", SCCP_MSG_BODY_LEN(start_media_transmission_message), SCCP_MSG_BODY_LEN(start_media_transmission_message), dump_start_media_transmission, NULL) \
+	X(STOP_MEDIA_TRANSMISSION_MESSAGE, 0x008B, "stop media transmission", SCCP_MSG_BODY_LEN(stop_media_transmission_message), SCCP_MSG_BODY_LEN(stop_media_transmission_message), dump_stop_media_transmission, NULL) \
+	X(CALL_INFO_MESSAGE, 0x008F, "call info", SCCP_MSG_BODY_LEN(call_info_message), SCCP_MSG_BODY_LEN(call_info_message), dump_call_info, NULL) \
+	X(FORWARD_STATUS_RES_MESSAGE, 0x0090, "forward status res", SCCP_MSG_BODY_LEN(forward_status_res_message), SCCP_MSG_BODY_LEN(forward_status_res_message), dump_forward_status_res, NULL) \
+	X(SPEEDDIAL_STAT_RES_MESSAGE, 0x0091, "speeddial status res", SCCP_MSG_BODY_LEN(speeddial_stat_res_message), SCCP_MSG_BODY_LEN(speeddial_stat_res_message), NULL, NULL) \
+	X(LINE_STATUS_RES_MESSAGE, 0x0092, "line status res", SCCP_MSG_BODY_LEN(line_status_res_message), SCCP_MSG_BODY_LEN(line_status_res_message), NULL, NULL) \
+	X(CONFIG_STATUS_RES_MESSAGE, 0x0093, "config status res", SCCP_MSG_BODY_LEN(config_status_res_message), SCCP_MSG_BODY_LEN(config_status_res_message), NULL, NULL) \
+	X(TIME_DATE_RES_MESSAGE, 0x0094, "date time res", SCCP_MSG_BODY_LEN(time_date_res_message), SCCP_MSG_BODY_LEN(time_date_res_message), NULL, NULL) \
+	X(BUTTON_TEMPLATE_RES_MESSAGE, 0x0097, "button template res", SCCP_MSG_BODY_LEN(button_template_res_message), SCCP_MSG_BODY_LEN(button_template_res_message), NULL, NULL) \
+	X(VERSION_RES_MESSAGE, 0x0098, "version res", SCCP_MSG_BODY_LEN(version_res_message), SCCP_MSG_BODY_LEN(version_res_message), NULL, NULL) \
+	X(CAPABILITIES_REQ_MESSAGE, 0x009B, "capabilities req", 0, 0, NULL, NULL) \
+	X(REGISTER_REJ_MESSAGE, 0x009D, "register rej", SCCP_MSG_BODY_LEN(register_rej_message), SCCP_MSG_BODY_LEN(register_rej_message), NULL, NULL) \
+	X(RESET_MESSAGE, 0x009F, "reset", SCCP_MSG_BODY_LEN(reset_message), SCCP_MSG_BODY_LEN(reset_message), dump_reset, NULL) \
+	X(KEEP_ALIVE_ACK_MESSAGE, 0x0100, "keep alive ack", 0, 0, NULL, NULL) \
+	X(OPEN_RECEIVE_CHANNEL_MESSAGE, 0x0105, "open receive channel", SCCP_MSG_BODY_LEN(open_receive_channel_message), SCCP_MSG_BODY_LEN(open_receive_channel_message), dump_open_receive_channel, NULL) \
+	X(CLOSE_RECEIVE_CHANNEL_MESSAGE, 0x0106, "close receive channel", SCCP_MSG_BODY_LEN(close_receive_channel_message), SCCP_MSG_BODY_LEN(close_receive_channel_message), dump_close_receive_channel, NULL) \
+	X(SOFTKEY_TEMPLATE_RES_MESSAGE, 0x0108, "softkey template res", SCCP_MSG_BODY_LEN(softkey_template_res_message), SCCP_MSG_BODY_LEN(softkey_template_res_message), NULL, NULL) \
+	X(SOFTKEY_SET_RES_MESSAGE, 0x0109, "softkey set res", SCCP_MSG_BODY_LEN(softkey_set_res_message), SCCP_MSG_BODY_LEN(softkey_set_res_message), NULL, NULL) \
+	X(SELECT_SOFT_KEYS_MESSAGE, 0x0110, "select soft keys", SCCP_MSG_BODY_LEN(select_soft_keys_message), SCCP_MSG_BODY_LEN(select_soft_keys_message), dump_select_soft_keys, NULL) \
+	X(CALL_STATE_MESSAGE, 0x0111, "call state", SCCP_MSG_BODY_LEN(call_state_message), SCCP_MSG_BODY_LEN(call_state_message), dump_call_state, NULL) \
+	X(DISPLAY_NOTIFY_MESSAGE, 0x0114, "display notify", SCCP_MSG_BODY_LEN(display_notify_message), SCCP_MSG_BODY_LEN(display_notify_message), NULL, NULL) \
+	X(CLEAR_NOTIFY_MESSAGE, 0x0115, "clear notify", 0, 0, NULL, NULL) \
+	X(ACTIVATE_CALL_PLANE_MESSAGE, 0x0116, "activate call plane", SCCP_MSG_BODY_LEN(activate_call_plane_message), SCCP_MSG_BODY_LEN(activate_call_plane_message), NULL, NULL) \
+	X(DIALED_NUMBER_MESSAGE, 0x011D, "dialed number", SCCP_MSG_BODY_LEN(dialed_number_message), SCCP_MSG_BODY_LEN(dialed_number_message), dump_dialed_number, NULL) \
+	X(FEATURE_STAT_MESSAGE, 0x0146, "feature status", SCCP_MSG_BODY_LEN(feature_stat_message), SCCP_MSG_BODY_LEN(feature_stat_message), dump_feature_stat, NULL) \
+	X(SUBSCRIPTION_STATUS_RES_MESSAGE, 0x0152, "subscription status res", SCCP_MSG_BODY_LEN(subscription_status_res_message), SCCP_MSG_BODY_LEN(subscription_status_res_message), dump_subscription_status_res, NULL) \
+	X(NOTIFICATION_MESSAGE, 0x0153, "notification", SCCP_MSG_BODY_LEN(notification_message), SCCP_MSG_BODY_LEN(notification_message), dump_notification, NULL) \
+	X(START_MEDIA_TRANSMISSION_ACK_MESSAGE, 0x0159, "start media transmission ack", 0, SCCP_MSG_BODY_LEN_MAX, NULL, NULL)
+
+#define SCCP_MSG_AS_ID(name, id, str, min_len, max_len, dump, handler) name = id,
+#define SCCP_MSG_AS_INDEX(name, id, str, min_len, max_len, dump, handler) SCCP_MSG_INDEX_ ## name,
+
+enum sccp_msg_id {
+	SCCP_MSG_LIST(SCCP_MSG_AS_ID)
+};
+
+/* dense index of the messages, in schema order */
+enum sccp_msg_index {
+	SCCP_MSG_LIST(SCCP_MSG_AS_INDEX)
+	SCCP_MSG_COUNT
+};
+
+/* one more than the highest message ID */
+#define SCCP_MSG_ID_LIMIT (START_MEDIA_TRANSMISSION_ACK_MESSAGE + 1)
+
+struct sccp_msg_desc {
+	uint32_t id;
+	enum sccp_msg_index index;
+	const char *name;
+	/* bounds of the body length, i.e. of the message length minus the ID */
+	uint32_t min_len;
+	uint32_t max_len;
+	void (*dump)(char *str, size_t size, const struct sccp_msg *msg);
+};
+
+#define SCCP_MSG_VALID 0
+#define SCCP_MSG_UNKNOWN 1
+#define SCCP_MSG_TOO_SHORT 2
+#define SCCP_MSG_TOO_LONG 3
+
+/*!
+ * \brief Get the descriptor of the message with the given ID.
+ *
+ * \retval non-NULL on success
+ * \retval NULL if the message ID is unknown
+ */
+const struct sccp_msg_desc *sccp_msg_desc_get(uint32_t msg_id);
+
+/*!
+ * \brief Check that a received message is known and that its body length is within bounds.
+ *
+ * \param desc output parameter used to store the descriptor of the message, if known
+ *
+ * \retval SCCP_MSG_VALID if the message is valid
+ * \retval SCCP_MSG_UNKNOWN if the message ID is unknown
+ * \retval SCCP_MSG_TOO_SHORT if the body is shorter than the minimum length
+ * \retval SCCP_MSG_TOO_LONG if the body is longer than the maximum length
+ */
+int sccp_msg_validate(const struct sccp_msg *msg, const struct sccp_msg_desc **desc);
+
 void sccp_msg_button_template_res(struct sccp_msg *msg, struct button_definition *definition, size_t n);
 void sccp_msg_callinfo(struct sccp_msg *msg, const char *from_name, const char *from_num, const char *to_name, const char *to_num, uint32_t line_instance, uint32_t callid, enum sccp_direction direction);
 void sccp_msg_callstate(struct sccp_msg *msg, enum sccp_state state, uint32_t line_instance, uint32_t callid);
@@ -732,6 +798,32 @@ void sccp_msg_tone(struct sccp_msg *msg, enum sccp_tone tone, uint32_t line_inst
 void sccp_msg_reset(struct sccp_msg *msg, enum sccp_reset_type type);
 void sccp_msg_version_res(struct sccp_msg *msg, const char *version);
 
+/* length of the header, i.e. of the length, reserved and id fields */
+#define SCCP_MSG_HEADER_LEN 12
+/* total length of an encoded message with a body of the given type */
+#define SCCP_MSG_ENCODED_LEN(type) (SCCP_MSG_HEADER_LEN + SCCP_MSG_BODY_LEN(type))
+
+#define SCCP_MSG_CALLSTATE_LEN SCCP_MSG_ENCODED_LEN(call_state_message)
+#define SCCP_MSG_FEATURE_STATUS_LEN SCCP_MSG_ENCODED_LEN(feature_stat_message)
+#define SCCP_MSG_KEEP_ALIVE_ACK_LEN SCCP_MSG_HEADER_LEN
+#define SCCP_MSG_LAMP_STATE_LEN SCCP_MSG_ENCODED_LEN(set_lamp_message)
+#define SCCP_MSG_SELECT_SOFTKEYS_LEN SCCP_MSG_ENCODED_LEN(select_soft_keys_message)
+#define SCCP_MSG_STOP_TONE_LEN SCCP_MSG_ENCODED_LEN(stop_tone_message)
+#define SCCP_MSG_TONE_LEN SCCP_MSG_ENCODED_LEN(start_tone_message)
+
+/*
+ * Encoders writing a message in its wire format, without going through a struct
+ * sccp_msg. Each one writes exactly its SCCP_MSG_*_LEN bytes to buf, which doesn't
+ * need to be aligned.
+ */
+void sccp_msg_encode_callstate(void *buf, enum sccp_state state, uint32_t line_instance, uint32_t callid);
+void sccp_msg_encode_feature_status(void *buf, uint32_t instance, enum sccp_button_type type, enum sccp_blf_status status, const char *label);
+void sccp_msg_encode_keep_alive_ack(void *buf);
+void sccp_msg_encode_lamp_state(void *buf, enum sccp_stimulus_type stimulus, uint32_t instance, enum sccp_lamp_state indication);
+void sccp_msg_encode_select_softkeys(void *buf, uint32_t line_instance, uint32_t callid, enum sccp_softkey_status softkey);
+void sccp_msg_encode_stop_tone(void *buf, uint32_t line_instance, uint32_t callid);
+void sccp_msg_encode_tone(void *buf, enum sccp_tone tone, uint32_t line_instance, uint32_t callid);
+
 struct sccp_msg_builder {
 	uint8_t proto;
 };
@@ -748,6 +840,8 @@ void sccp_msg_builder_register_ack(struct sccp_msg_builder *builder, struct sccp
 
 struct sccp_deserializer {
 	struct sccp_msg msg;
+	/* bytes of msg that might be non-zero */
+	size_t msg_len;
 	size_t start;
 	size_t end;
 	int fd;
@@ -777,6 +871,8 @@ int sccp_deserializer_read(struct sccp_deserializer *dzer);
  * \param msg output parameter used to store the address of the parsed message
  *
  * \note The message stored in *msg is only valid between calls to this function.
+ * \note The bytes of *msg past the message are zero. A message longer than
+ *       SCCP_MSG_MAX_TOTAL_LEN is truncated, with its length set accordingly.
  *
  * \retval 0 on success
  * \retval SCCP_DESERIALIZER_NOMSG if no message are available
@@ -798,4 +894,12 @@ int sccp_msg_dump(char *str, size_t size, const struct sccp_msg *msg);
 const char *sccp_msg_id_str(uint32_t msg_id);
 const char *sccp_device_type_str(enum sccp_device_type device_type);
 
+/*!
+ * \brief Parse a device type from its string representation (i.e. "7940").
+ *
+ * \retval 0 on success
+ * \retval non-zero if the string is not a known device type
+ */
+int sccp_device_type_from_str(const char *str, enum sccp_device_type *device_type);
+
 #endif /* SCCP_MSG_H_ */
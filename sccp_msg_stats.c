@@ -0,0 +1,264 @@
+#include <asterisk.h>
+#include <asterisk/lock.h>
+#include <asterisk/utils.h>
+
+#include "sccp_msg_stats.h"
+#include "sccp_utils.h"
+
+/*
+ * Each session thread has its own shard, which it updates with relaxed stores; readers
+ * merge the shards with relaxed loads. The counters only ever grow, so a reset doesn't
+ * touch the shards but records a baseline that is subtracted from the merged stats.
+ */
+struct msg_stats_shard {
+	unsigned int msgs_in[SCCP_MSG_STATS_SLOTS];
+	uint64_t bytes_in[SCCP_MSG_STATS_SLOTS];
+	unsigned int msgs_out[SCCP_MSG_STATS_SLOTS];
+	uint64_t bytes_out[SCCP_MSG_STATS_SLOTS];
+	/* allocated on the first message of the type handled by the thread */
+	struct sccp_histogram *handle[SCCP_MSG_COUNT];
+	struct sccp_histogram transmit;
+};
+
+static struct sccp_thread_shards shards = SCCP_THREAD_SHARDS_INIT(sizeof(struct msg_stats_shard));
+
+/* the baseline is protected by baseline_lock */
+AST_MUTEX_DEFINE_STATIC(baseline_lock);
+static struct sccp_msg_stats baseline;
+
+static unsigned int msg_slot(uint32_t msg_id)
+{
+	const struct sccp_msg_desc *desc = sccp_msg_desc_get(msg_id);
+
+	return desc ? desc->index : SCCP_MSG_STATS_UNKNOWN;
+}
+
+static unsigned int histogram_bucket(unsigned int value)
+{
+	unsigned int exp;
+
+	if (value < 4) {
+		return value;
+	}
+
+	exp = 31 - __builtin_clz(value);
+	if (exp > 23) {
+		return SCCP_HISTOGRAM_BUCKETS - 1;
+	}
+
+	return 4 + (exp - 2) * 2 + ((value >> (exp - 1)) & 1);
+}
+
+unsigned int sccp_histogram_bucket_max(unsigned int bucket)
+{
+	unsigned int exp;
+	unsigned int min;
+
+	if (bucket < 4) {
+		return bucket;
+	}
+
+	exp = (bucket - 4) / 2 + 2;
+	min = (1U << exp) + ((bucket - 4) % 2) * (1U << (exp - 1));
+
+	return min + (1U << (exp - 1)) - 1;
+}
+
+void sccp_histogram_add(struct sccp_histogram *hist, unsigned int value)
+{
+	SCCP_STAT_INC(hist->buckets[histogram_bucket(value)], 1);
+	SCCP_STAT_INC(hist->total, value);
+}
+
+void sccp_msg_stats_on_msg_in(uint32_t msg_id, size_t len)
+{
+	struct msg_stats_shard *shard = sccp_thread_shards_get(&shards);
+	unsigned int slot = msg_slot(msg_id);
+
+	if (!shard) {
+		return;
+	}
+
+	SCCP_STAT_INC(shard->msgs_in[slot], 1);
+	SCCP_STAT_INC(shard->bytes_in[slot], len);
+}
+
+void sccp_msg_stats_on_msg_out(uint32_t msg_id, size_t len)
+{
+	struct msg_stats_shard *shard = sccp_thread_shards_get(&shards);
+	unsigned int slot = msg_slot(msg_id);
+
+	if (!shard) {
+		return;
+	}
+
+	SCCP_STAT_INC(shard->msgs_out[slot], 1);
+	SCCP_STAT_INC(shard->bytes_out[slot], len);
+}
+
+void sccp_msg_stats_on_handle(const struct sccp_msg_desc *desc, unsigned int time)
+{
+	struct msg_stats_shard *shard = sccp_thread_shards_get(&shards);
+	struct sccp_histogram *hist;
+
+	if (!shard) {
+		return;
+	}
+
+	hist = shard->handle[desc->index];
+	if (!hist) {
+		hist = ast_calloc(1, sizeof(*hist));
+		if (!hist) {
+			return;
+		}
+
+		/* published for the readers */
+		__atomic_store_n(&shard->handle[desc->index], hist, __ATOMIC_RELEASE);
+	}
+
+	sccp_histogram_add(hist, time);
+}
+
+void sccp_msg_stats_on_transmit(unsigned int time)
+{
+	struct msg_stats_shard *shard = sccp_thread_shards_get(&shards);
+
+	if (shard) {
+		sccp_histogram_add(&shard->transmit, time);
+	}
+}
+
+void sccp_histogram_merge(struct sccp_histogram *dst, const struct sccp_histogram *src)
+{
+	int i;
+
+	for (i = 0; i < SCCP_HISTOGRAM_BUCKETS; i++) {
+		dst->buckets[i] += SCCP_STAT_LOAD(src->buckets[i]);
+	}
+
+	dst->total += SCCP_STAT_LOAD(src->total);
+}
+
+void sccp_histogram_subtract(struct sccp_histogram *dst, const struct sccp_histogram *src)
+{
+	int i;
+
+	for (i = 0; i < SCCP_HISTOGRAM_BUCKETS; i++) {
+		dst->buckets[i] -= src->buckets[i];
+	}
+
+	dst->total -= src->total;
+}
+
+static void shard_merge(void *data, void *arg)
+{
+	const struct msg_stats_shard *shard = data;
+	struct sccp_msg_stats *dst = arg;
+	const struct sccp_histogram *hist;
+	int i;
+
+	for (i = 0; i < SCCP_MSG_STATS_SLOTS; i++) {
+		dst->msgs_in[i] += SCCP_STAT_LOAD(shard->msgs_in[i]);
+		dst->bytes_in[i] += SCCP_STAT_LOAD(shard->bytes_in[i]);
+		dst->msgs_out[i] += SCCP_STAT_LOAD(shard->msgs_out[i]);
+		dst->bytes_out[i] += SCCP_STAT_LOAD(shard->bytes_out[i]);
+	}
+
+	for (i = 0; i < SCCP_MSG_COUNT; i++) {
+		hist = __atomic_load_n(&shard->handle[i], __ATOMIC_ACQUIRE);
+		if (hist) {
+			sccp_histogram_merge(&dst->handle[i], hist);
+		}
+	}
+
+	sccp_histogram_merge(&dst->transmit, &shard->transmit);
+}
+
+static void merge_all(struct sccp_msg_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	sccp_thread_shards_foreach(&shards, shard_merge, stats);
+}
+
+void sccp_msg_stats_take(struct sccp_msg_stats *stats)
+{
+	int i;
+
+	merge_all(stats);
+
+	ast_mutex_lock(&baseline_lock);
+	for (i = 0; i < SCCP_MSG_STATS_SLOTS; i++) {
+		stats->msgs_in[i] -= baseline.msgs_in[i];
+		stats->bytes_in[i] -= baseline.bytes_in[i];
+		stats->msgs_out[i] -= baseline.msgs_out[i];
+		stats->bytes_out[i] -= baseline.bytes_out[i];
+	}
+
+	for (i = 0; i < SCCP_MSG_COUNT; i++) {
+		sccp_histogram_subtract(&stats->handle[i], &baseline.handle[i]);
+	}
+
+	sccp_histogram_subtract(&stats->transmit, &baseline.transmit);
+	ast_mutex_unlock(&baseline_lock);
+}
+
+void sccp_msg_stats_reset(void)
+{
+	ast_mutex_lock(&baseline_lock);
+	merge_all(&baseline);
+	ast_mutex_unlock(&baseline_lock);
+}
+
+static void shard_free(void *data)
+{
+	struct msg_stats_shard *shard = data;
+	int i;
+
+	for (i = 0; i < SCCP_MSG_COUNT; i++) {
+		ast_free(shard->handle[i]);
+	}
+}
+
+void sccp_msg_stats_destroy(void)
+{
+	sccp_thread_shards_destroy(&shards, shard_free);
+}
+
+unsigned int sccp_histogram_count(const struct sccp_histogram *hist)
+{
+	unsigned int count = 0;
+	int i;
+
+	for (i = 0; i < SCCP_HISTOGRAM_BUCKETS; i++) {
+		count += hist->buckets[i];
+	}
+
+	return count;
+}
+
+unsigned int sccp_histogram_percentile(const struct sccp_histogram *hist, unsigned int percent)
+{
+	unsigned int count = sccp_histogram_count(hist);
+	unsigned int rank;
+	unsigned int seen = 0;
+	int i;
+
+	if (!count) {
+		return 0;
+	}
+
+	/* the rank of the value, rounded up */
+	rank = ((uint64_t) count * percent + 99) / 100;
+	if (!rank) {
+		rank = 1;
+	}
+
+	for (i = 0; i < SCCP_HISTOGRAM_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen >= rank) {
+			return sccp_histogram_bucket_max(i);
+		}
+	}
+
+	return sccp_histogram_bucket_max(SCCP_HISTOGRAM_BUCKETS - 1);
+}
@@ -0,0 +1,108 @@
+#ifndef SCCP_MSG_STATS_H_
+#define SCCP_MSG_STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sccp_msg.h"
+
+/* one slot per message index, and one for the unknown messages */
+#define SCCP_MSG_STATS_SLOTS (SCCP_MSG_COUNT + 1)
+#define SCCP_MSG_STATS_UNKNOWN SCCP_MSG_COUNT
+
+/* values 0 to 3 have their own bucket, then 2 buckets per power of 2, up to ~16 s */
+#define SCCP_HISTOGRAM_BUCKETS 48
+
+/*!
+ * \brief Log-linear histogram of durations, in microseconds.
+ */
+struct sccp_histogram {
+	unsigned int buckets[SCCP_HISTOGRAM_BUCKETS];
+	uint64_t total;
+};
+
+struct sccp_msg_stats {
+	/* indexed by slot */
+	unsigned int msgs_in[SCCP_MSG_STATS_SLOTS];
+	uint64_t bytes_in[SCCP_MSG_STATS_SLOTS];
+	unsigned int msgs_out[SCCP_MSG_STATS_SLOTS];
+	uint64_t bytes_out[SCCP_MSG_STATS_SLOTS];
+	/* time spent in sccp_device_handle_msg, indexed by message index */
+	struct sccp_histogram handle[SCCP_MSG_COUNT];
+	/* time spent writing to the socket, directly or when flushing the staged messages */
+	struct sccp_histogram transmit;
+};
+
+/*!
+ * \brief Count a message received.
+ *
+ * \note The stats are kept per thread, so updating them takes no lock and no atomic
+ *       read-modify-write.
+ */
+void sccp_msg_stats_on_msg_in(uint32_t msg_id, size_t len);
+
+/*!
+ * \brief Count a message transmitted.
+ */
+void sccp_msg_stats_on_msg_out(uint32_t msg_id, size_t len);
+
+/*!
+ * \brief Record the time spent handling a message, in microseconds.
+ */
+void sccp_msg_stats_on_handle(const struct sccp_msg_desc *desc, unsigned int time);
+
+/*!
+ * \brief Record the time spent transmitting a message, in microseconds.
+ */
+void sccp_msg_stats_on_transmit(unsigned int time);
+
+/*!
+ * \brief Take a snapshot of the stats since the last reset, merging every thread.
+ */
+void sccp_msg_stats_take(struct sccp_msg_stats *stats);
+
+/*!
+ * \brief Reset the stats.
+ */
+void sccp_msg_stats_reset(void);
+
+/*!
+ * \brief Release the stats.
+ *
+ * \note Must be called once no thread updates the stats anymore.
+ */
+void sccp_msg_stats_destroy(void);
+
+/*!
+ * \brief Add a value to the histogram.
+ *
+ * \note The writers of a histogram must be serialized; readers can read it concurrently.
+ */
+void sccp_histogram_add(struct sccp_histogram *hist, unsigned int value);
+
+/*!
+ * \brief Add the values of src, which may be concurrently written, to dst.
+ */
+void sccp_histogram_merge(struct sccp_histogram *dst, const struct sccp_histogram *src);
+
+/*!
+ * \brief Remove the values of src from dst, src being a previous state of dst.
+ */
+void sccp_histogram_subtract(struct sccp_histogram *dst, const struct sccp_histogram *src);
+
+/*!
+ * \brief Return the number of values in the histogram.
+ */
+unsigned int sccp_histogram_count(const struct sccp_histogram *hist);
+
+/*!
+ * \brief Return the greatest value counted by the given bucket, in microseconds.
+ */
+unsigned int sccp_histogram_bucket_max(unsigned int bucket);
+
+/*!
+ * \brief Return an upper bound of the given percentile of the histogram, in microseconds.
+ */
+unsigned int sccp_histogram_percentile(const struct sccp_histogram *hist, unsigned int percent);
+
+#endif /* SCCP_MSG_STATS_H_ */
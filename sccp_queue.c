@@ -8,6 +8,7 @@
 #include <asterisk/lock.h>
 #include <asterisk/utils.h>
 
+#include "sccp_lock_profile.h"
 #include "sccp_queue.h"
 
 static struct queue_item_container *container_alloc(size_t item_size)
@@ -147,11 +148,13 @@ int sccp_sync_queue_fd(struct sccp_sync_queue *sync_q)
 	return sync_q->eventfd;
 }
 
-void sccp_sync_queue_close(struct sccp_sync_queue *sync_q)
+void sccp_sync_queue_close_at(struct sccp_sync_queue *sync_q, const char *site)
 {
-	ast_mutex_lock(&sync_q->lock);
+	struct timeval locked_at;
+
+	locked_at = sccp_lock_profile_lock(&sync_q->lock, SCCP_LOCK_SYNC_QUEUE, site);
 	sync_q->closed = 1;
-	ast_mutex_unlock(&sync_q->lock);
+	sccp_lock_profile_unlock(&sync_q->lock, SCCP_LOCK_SYNC_QUEUE, site, locked_at);
 }
 
 static int sccp_sync_queue_signal_fd(struct sccp_sync_queue *sync_q)
@@ -213,13 +216,14 @@ static int sccp_sync_queue_put_no_lock(struct sccp_sync_queue *sync_q, void *ite
 	return 0;
 }
 
-int sccp_sync_queue_put(struct sccp_sync_queue *sync_q, void *item)
+int sccp_sync_queue_put_at(struct sccp_sync_queue *sync_q, void *item, const char *site)
 {
+	struct timeval locked_at;
 	int ret;
 
-	ast_mutex_lock(&sync_q->lock);
+	locked_at = sccp_lock_profile_lock(&sync_q->lock, SCCP_LOCK_SYNC_QUEUE, site);
 	ret = sccp_sync_queue_put_no_lock(sync_q, item);
-	ast_mutex_unlock(&sync_q->lock);
+	sccp_lock_profile_unlock(&sync_q->lock, SCCP_LOCK_SYNC_QUEUE, site, locked_at);
 
 	return ret;
 }
@@ -237,13 +241,14 @@ static int sccp_sync_queue_get_no_lock(struct sccp_sync_queue *sync_q, void *ite
 	return 0;
 }
 
-int sccp_sync_queue_get(struct sccp_sync_queue *sync_q, void *item)
+int sccp_sync_queue_get_at(struct sccp_sync_queue *sync_q, void *item, const char *site)
 {
+	struct timeval locked_at;
 	int ret;
 
-	ast_mutex_lock(&sync_q->lock);
+	locked_at = sccp_lock_profile_lock(&sync_q->lock, SCCP_LOCK_SYNC_QUEUE, site);
 	ret = sccp_sync_queue_get_no_lock(sync_q, item);
-	ast_mutex_unlock(&sync_q->lock);
+	sccp_lock_profile_unlock(&sync_q->lock, SCCP_LOCK_SYNC_QUEUE, site, locked_at);
 
 	return ret;
 }
@@ -256,16 +261,18 @@ static void sccp_sync_queue_get_all_no_lock(struct sccp_sync_queue *sync_q, stru
 	}
 }
 
-int sccp_sync_queue_get_all(struct sccp_sync_queue *sync_q, struct sccp_queue *ret)
+int sccp_sync_queue_get_all_at(struct sccp_sync_queue *sync_q, struct sccp_queue *ret, const char *site)
 {
+	struct timeval locked_at;
+
 	if (!ret) {
 		ast_log(LOG_ERROR, "sccp sync queue get all failed: ret is null\n");
 		return SCCP_QUEUE_INVAL;
 	}
 
-	ast_mutex_lock(&sync_q->lock);
+	locked_at = sccp_lock_profile_lock(&sync_q->lock, SCCP_LOCK_SYNC_QUEUE, site);
 	sccp_sync_queue_get_all_no_lock(sync_q, ret);
-	ast_mutex_unlock(&sync_q->lock);
+	sccp_lock_profile_unlock(&sync_q->lock, SCCP_LOCK_SYNC_QUEUE, site, locked_at);
 
 	return 0;
 }
@@ -91,12 +91,18 @@ void sccp_sync_queue_destroy(struct sccp_sync_queue *sync_q);
  */
 int sccp_sync_queue_fd(struct sccp_sync_queue *sync_q);
 
+/*
+ * The functions below lock the queue, and are called through macros passing the name of
+ * the calling function, the acquisition site recorded by the lock profiler.
+ */
+
 /*!
  * \brief Close the queue so that no more item can be queued.
  *
  * \note This does not destroy the queue.
  */
-void sccp_sync_queue_close(struct sccp_sync_queue *sync_q);
+void sccp_sync_queue_close_at(struct sccp_sync_queue *sync_q, const char *site);
+#define sccp_sync_queue_close(sync_q) sccp_sync_queue_close_at(sync_q, __func__)
 
 /*!
  * \brief Put an item into the queue.
@@ -105,7 +111,8 @@ void sccp_sync_queue_close(struct sccp_sync_queue *sync_q);
  * \retval SCCP_QUEUE_CLOSED if the queue is closed
  * \retval -1 on other failure
  */
-int sccp_sync_queue_put(struct sccp_sync_queue *sync_q, void *item);
+int sccp_sync_queue_put_at(struct sccp_sync_queue *sync_q, void *item, const char *site);
+#define sccp_sync_queue_put(sync_q, item) sccp_sync_queue_put_at(sync_q, item, __func__)
 
 /*!
  * \brief Get an item from the queue.
@@ -113,7 +120,8 @@ int sccp_sync_queue_put(struct sccp_sync_queue *sync_q, void *item);
  * \retval 0 on success
  * \retval SCCP_QUEUE_EMPTY if the queue is empty
  */
-int sccp_sync_queue_get(struct sccp_sync_queue *sync_q, void *item);
+int sccp_sync_queue_get_at(struct sccp_sync_queue *sync_q, void *item, const char *site);
+#define sccp_sync_queue_get(sync_q, item) sccp_sync_queue_get_at(sync_q, item, __func__)
 
 /*!
  * \brief Get all the items from the queue.
@@ -124,6 +132,7 @@ int sccp_sync_queue_get(struct sccp_sync_queue *sync_q, void *item);
  * \retval 0 on success
  * \retval SCCP_QUEUE_INVAL if ret is null
  */
-int sccp_sync_queue_get_all(struct sccp_sync_queue *sync_q, struct sccp_queue *ret);
+int sccp_sync_queue_get_all_at(struct sccp_sync_queue *sync_q, struct sccp_queue *ret, const char *site);
+#define sccp_sync_queue_get_all(sync_q, ret) sccp_sync_queue_get_all_at(sync_q, ret, __func__)
 
 #endif /* SCCP_QUEUE_H_ */
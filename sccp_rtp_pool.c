@@ -0,0 +1,335 @@
+#include <asterisk.h>
+#include <asterisk/linkedlists.h>
+#include <asterisk/lock.h>
+#include <asterisk/network.h>
+#include <asterisk/rtp_engine.h>
+#include <asterisk/taskprocessor.h>
+#include <asterisk/utils.h>
+
+#include "sccp.h"
+#include "sccp_rtp_pool.h"
+#include "sccp_sched.h"
+
+/* sessions usually all share the same local address */
+#define POOL_MAX_ADDRS 16
+
+struct pool_instance {
+	struct ast_rtp_instance *rtp;
+	unsigned int shard;
+	AST_LIST_ENTRY(pool_instance) list;
+};
+
+struct pool_addr {
+	struct sockaddr_in addr;
+	AST_LIST_HEAD_NOLOCK(, pool_instance) instances;
+	size_t count;
+	AST_LIST_ENTRY(pool_addr) list;
+};
+
+/*
+ * The addresses and their idle instances are protected by the pool lock. Instances
+ * are created by the refill task, outside of the lock.
+ */
+static struct {
+	ast_mutex_t lock;
+	AST_LIST_HEAD_NOLOCK(, pool_addr) addrs;
+	size_t addr_count;
+	size_t size;
+	int refill_pending;
+	int shutting_down;
+	struct ast_taskprocessor *refiller;
+
+	unsigned int hits;
+	unsigned int misses;
+} pool;
+
+static struct ast_rtp_instance *rtp_instance_new(const struct sockaddr_in *addr, unsigned int *shard)
+{
+	struct ast_rtp_instance *rtp;
+	struct ast_sched_context *sched;
+	struct ast_sockaddr bindaddr_tmp;
+
+	sched = sccp_sched_acquire(shard);
+	if (!sched) {
+		return NULL;
+	}
+
+	ast_sockaddr_from_sin(&bindaddr_tmp, addr);
+	rtp = ast_rtp_instance_new("asterisk", sched, &bindaddr_tmp, NULL);
+	if (!rtp) {
+		sccp_sched_release(*shard);
+		return NULL;
+	}
+
+	ast_rtp_instance_set_prop(rtp, AST_RTP_PROPERTY_RTCP, 1);
+	ast_rtp_instance_set_prop(rtp, AST_RTP_PROPERTY_NAT, 0);
+
+	/*
+	 *  hack that add the 0 payload type (i.e. the G.711 mu-law payload type) to the list
+	 *  of payload that the rtp_instance knows about. It works because currently, we are
+	 *  always using G.711 mu-law, alaw or g729 (0, 8, 18)
+	 */
+	ast_rtp_codecs_payloads_set_m_type(ast_rtp_instance_get_codecs(rtp), rtp, 0);
+	ast_rtp_codecs_payloads_set_m_type(ast_rtp_instance_get_codecs(rtp), rtp, 8);
+	ast_rtp_codecs_payloads_set_m_type(ast_rtp_instance_get_codecs(rtp), rtp, 18);
+
+	return rtp;
+}
+
+static void rtp_instance_free(struct ast_rtp_instance *rtp, unsigned int shard)
+{
+	ast_rtp_instance_destroy(rtp);
+	sccp_sched_release(shard);
+}
+
+/*
+ * Must be called with the pool locked.
+ */
+static struct pool_addr *pool_find_addr(const struct sockaddr_in *addr)
+{
+	struct pool_addr *pool_addr;
+
+	AST_LIST_TRAVERSE(&pool.addrs, pool_addr, list) {
+		if (pool_addr->addr.sin_addr.s_addr == addr->sin_addr.s_addr) {
+			return pool_addr;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Must be called with the pool locked.
+ */
+static void pool_addr_trim(struct pool_addr *pool_addr, size_t size)
+{
+	struct pool_instance *instance;
+
+	while (pool_addr->count > size) {
+		instance = AST_LIST_REMOVE_HEAD(&pool_addr->instances, list);
+		pool_addr->count--;
+		rtp_instance_free(instance->rtp, instance->shard);
+		ast_free(instance);
+	}
+}
+
+/*
+ * Must be called with the pool locked.
+ */
+static struct pool_addr *pool_find_addr_to_refill(void)
+{
+	struct pool_addr *pool_addr;
+
+	AST_LIST_TRAVERSE(&pool.addrs, pool_addr, list) {
+		if (pool_addr->count < pool.size) {
+			return pool_addr;
+		}
+	}
+
+	return NULL;
+}
+
+static int pool_refill(void *data)
+{
+	struct pool_addr *pool_addr;
+	struct pool_instance *instance;
+	struct sockaddr_in addr;
+
+	for (;;) {
+		ast_mutex_lock(&pool.lock);
+		pool_addr = pool.shutting_down ? NULL : pool_find_addr_to_refill();
+		if (!pool_addr) {
+			pool.refill_pending = 0;
+			ast_mutex_unlock(&pool.lock);
+			break;
+		}
+
+		addr = pool_addr->addr;
+		ast_mutex_unlock(&pool.lock);
+
+		instance = ast_calloc(1, sizeof(*instance));
+		if (!instance) {
+			goto fail;
+		}
+
+		instance->rtp = rtp_instance_new(&addr, &instance->shard);
+		if (!instance->rtp) {
+			ast_log(LOG_WARNING, "sccp rtp pool refill failed: RTP instance creation failed\n");
+			ast_free(instance);
+			goto fail;
+		}
+
+		/* the address can't have been removed, but the size might have changed */
+		ast_mutex_lock(&pool.lock);
+		pool_addr = pool_find_addr(&addr);
+		if (!pool.shutting_down && pool_addr && pool_addr->count < pool.size) {
+			AST_LIST_INSERT_TAIL(&pool_addr->instances, instance, list);
+			pool_addr->count++;
+			instance = NULL;
+		}
+		ast_mutex_unlock(&pool.lock);
+
+		if (instance) {
+			rtp_instance_free(instance->rtp, instance->shard);
+			ast_free(instance);
+		}
+	}
+
+	return 0;
+
+fail:
+	/* the next get will retry */
+	ast_mutex_lock(&pool.lock);
+	pool.refill_pending = 0;
+	ast_mutex_unlock(&pool.lock);
+
+	return 0;
+}
+
+/*
+ * Must be called with the pool locked.
+ */
+static void pool_schedule_refill(void)
+{
+	if (pool.refill_pending || pool.shutting_down || !pool.size || !pool.refiller) {
+		return;
+	}
+
+	if (!pool_find_addr_to_refill()) {
+		return;
+	}
+
+	if (ast_taskprocessor_push(pool.refiller, pool_refill, NULL)) {
+		return;
+	}
+
+	pool.refill_pending = 1;
+}
+
+int sccp_rtp_pool_init(void)
+{
+	ast_mutex_init(&pool.lock);
+	AST_LIST_HEAD_INIT_NOLOCK(&pool.addrs);
+	pool.addr_count = 0;
+	pool.size = 0;
+	pool.refill_pending = 0;
+	pool.shutting_down = 0;
+	pool.hits = 0;
+	pool.misses = 0;
+
+	pool.refiller = ast_taskprocessor_get("sccp/rtp_pool", TPS_REF_DEFAULT);
+	if (!pool.refiller) {
+		ast_log(LOG_ERROR, "sccp rtp pool init failed: could not create taskprocessor\n");
+		ast_mutex_destroy(&pool.lock);
+		return -1;
+	}
+
+	return 0;
+}
+
+void sccp_rtp_pool_destroy(void)
+{
+	struct pool_addr *pool_addr;
+
+	ast_mutex_lock(&pool.lock);
+	pool.shutting_down = 1;
+	ast_mutex_unlock(&pool.lock);
+
+	/* waits for the refill task to finish */
+	ast_taskprocessor_unreference(pool.refiller);
+	pool.refiller = NULL;
+
+	while ((pool_addr = AST_LIST_REMOVE_HEAD(&pool.addrs, list))) {
+		pool_addr_trim(pool_addr, 0);
+		ast_free(pool_addr);
+	}
+
+	pool.addr_count = 0;
+	ast_mutex_destroy(&pool.lock);
+}
+
+void sccp_rtp_pool_set_size(size_t size)
+{
+	struct pool_addr *pool_addr;
+
+	ast_mutex_lock(&pool.lock);
+
+	pool.size = size;
+	AST_LIST_TRAVERSE(&pool.addrs, pool_addr, list) {
+		pool_addr_trim(pool_addr, size);
+	}
+
+	pool_schedule_refill();
+
+	ast_mutex_unlock(&pool.lock);
+}
+
+struct ast_rtp_instance *sccp_rtp_pool_get(const struct sockaddr_in *addr, unsigned int *shard)
+{
+	struct pool_addr *pool_addr;
+	struct pool_instance *instance = NULL;
+	struct ast_rtp_instance *rtp;
+
+	if (!addr) {
+		ast_log(LOG_ERROR, "sccp rtp pool get failed: addr is null\n");
+		return NULL;
+	}
+
+	ast_mutex_lock(&pool.lock);
+
+	if (pool.size) {
+		pool_addr = pool_find_addr(addr);
+		if (!pool_addr && pool.addr_count < POOL_MAX_ADDRS) {
+			pool_addr = ast_calloc(1, sizeof(*pool_addr));
+			if (pool_addr) {
+				pool_addr->addr.sin_family = AF_INET;
+				pool_addr->addr.sin_addr = addr->sin_addr;
+				AST_LIST_HEAD_INIT_NOLOCK(&pool_addr->instances);
+				AST_LIST_INSERT_TAIL(&pool.addrs, pool_addr, list);
+				pool.addr_count++;
+			}
+		}
+
+		if (pool_addr) {
+			instance = AST_LIST_REMOVE_HEAD(&pool_addr->instances, list);
+			if (instance) {
+				pool_addr->count--;
+			}
+		}
+
+		pool_schedule_refill();
+	}
+
+	if (instance) {
+		pool.hits++;
+	} else {
+		pool.misses++;
+	}
+
+	ast_mutex_unlock(&pool.lock);
+
+	if (instance) {
+		rtp = instance->rtp;
+		*shard = instance->shard;
+		ast_free(instance);
+		return rtp;
+	}
+
+	return rtp_instance_new(addr, shard);
+}
+
+void sccp_rtp_pool_take_stats(struct sccp_rtp_pool_stats *stats)
+{
+	struct pool_addr *pool_addr;
+
+	ast_mutex_lock(&pool.lock);
+	stats->hits = pool.hits;
+	stats->misses = pool.misses;
+	stats->idle = 0;
+	AST_LIST_TRAVERSE(&pool.addrs, pool_addr, list) {
+		stats->idle += pool_addr->count;
+	}
+	stats->addrs = pool.addr_count;
+	stats->size = pool.size;
+	ast_mutex_unlock(&pool.lock);
+}
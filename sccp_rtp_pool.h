@@ -0,0 +1,69 @@
+#ifndef SCCP_RTP_POOL_H_
+#define SCCP_RTP_POOL_H_
+
+#include <stddef.h>
+
+struct ast_rtp_instance;
+struct sockaddr_in;
+
+struct sccp_rtp_pool_stats {
+	/* instances taken from the pool */
+	unsigned int hits;
+	/* instances created on the spot because the pool was empty */
+	unsigned int misses;
+	/* idle instances, for every local address */
+	size_t idle;
+	/* number of local addresses */
+	size_t addrs;
+	/* target number of idle instances per local address */
+	size_t size;
+};
+
+/*!
+ * \brief Initialize the RTP instance pool.
+ *
+ * The pool keeps, for each local address RTP instances have been requested on, a
+ * few instances already bound and configured, so that a call doesn't have to wait
+ * for the creation of its instance. The pool is refilled in the background.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int sccp_rtp_pool_init(void);
+
+/*!
+ * \brief Destroy the pool and its idle instances.
+ *
+ * \note Must be called before the scheduler contexts used by the instances are destroyed.
+ */
+void sccp_rtp_pool_destroy(void);
+
+/*!
+ * \brief Set the number of idle instances to keep per local address.
+ *
+ * \note A size of zero disables the pool.
+ */
+void sccp_rtp_pool_set_size(size_t size);
+
+/*!
+ * \brief Get an RTP instance bound to the given local address.
+ *
+ * The instance is taken from the pool if possible, else it is created.
+ *
+ * \note Instances are returned with RTCP enabled, NAT disabled, and the G.711 and
+ *       G.729 payload types set.
+ *
+ * \param[out] shard the scheduler shard of the instance, to pass to sccp_sched_release
+ *                   once the instance is destroyed
+ *
+ * \retval non-NULL on success
+ * \retval NULL on failure
+ */
+struct ast_rtp_instance *sccp_rtp_pool_get(const struct sockaddr_in *addr, unsigned int *shard);
+
+/*!
+ * \brief Take a snapshot of the pool stats.
+ */
+void sccp_rtp_pool_take_stats(struct sccp_rtp_pool_stats *stats);
+
+#endif /* SCCP_RTP_POOL_H_ */
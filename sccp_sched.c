@@ -0,0 +1,125 @@
+#include <unistd.h>
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/sched.h>
+#include <asterisk/utils.h>
+
+#include "sccp_sched.h"
+
+struct sched_shard {
+	struct ast_sched_context *sched;
+	/* number of RTP instances using the context */
+	unsigned int instances;
+	unsigned int highwater;
+};
+
+static struct sched_shard shards[SCCP_SCHED_MAX_SHARDS];
+static size_t shard_count;
+static unsigned int shard_next;
+
+static size_t shard_count_from_cpus(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (cpus < 1) {
+		return 1;
+	}
+
+	if (cpus > SCCP_SCHED_MAX_SHARDS) {
+		return SCCP_SCHED_MAX_SHARDS;
+	}
+
+	return cpus;
+}
+
+int sccp_sched_init(void)
+{
+	size_t count = shard_count_from_cpus();
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		shards[i].sched = ast_sched_context_create();
+		if (!shards[i].sched) {
+			goto fail;
+		}
+
+		shards[i].instances = 0;
+		shards[i].highwater = 0;
+		shard_count++;
+
+		if (ast_sched_start_thread(shards[i].sched)) {
+			ast_log(LOG_ERROR, "sccp sched init failed: could not start scheduler thread\n");
+			goto fail;
+		}
+	}
+
+	ast_debug(1, "%zu scheduler thread(s) started\n", shard_count);
+
+	return 0;
+
+fail:
+	sccp_sched_destroy();
+
+	return -1;
+}
+
+void sccp_sched_destroy(void)
+{
+	size_t count = shard_count;
+	size_t i;
+
+	__atomic_store_n(&shard_count, 0, __ATOMIC_RELAXED);
+
+	/* also stops the scheduler thread */
+	for (i = 0; i < count; i++) {
+		ast_sched_context_destroy(shards[i].sched);
+		shards[i].sched = NULL;
+	}
+}
+
+struct ast_sched_context *sccp_sched_acquire(unsigned int *shard)
+{
+	size_t count = __atomic_load_n(&shard_count, __ATOMIC_RELAXED);
+	unsigned int n;
+	unsigned int instances;
+	unsigned int highwater;
+
+	if (!count) {
+		ast_log(LOG_ERROR, "sccp sched acquire failed: no scheduler context\n");
+		return NULL;
+	}
+
+	n = __atomic_fetch_add(&shard_next, 1, __ATOMIC_RELAXED) % count;
+
+	instances = __atomic_add_fetch(&shards[n].instances, 1, __ATOMIC_RELAXED);
+	highwater = __atomic_load_n(&shards[n].highwater, __ATOMIC_RELAXED);
+	while (instances > highwater && !__atomic_compare_exchange_n(&shards[n].highwater, &highwater, instances, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+
+	*shard = n;
+
+	return shards[n].sched;
+}
+
+void sccp_sched_release(unsigned int shard)
+{
+	if (shard >= SCCP_SCHED_MAX_SHARDS) {
+		return;
+	}
+
+	__atomic_sub_fetch(&shards[shard].instances, 1, __ATOMIC_RELAXED);
+}
+
+void sccp_sched_take_stats(struct sccp_sched_stats *stats)
+{
+	size_t i;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->shard_count = __atomic_load_n(&shard_count, __ATOMIC_RELAXED);
+
+	for (i = 0; i < stats->shard_count; i++) {
+		stats->instances[i] = __atomic_load_n(&shards[i].instances, __ATOMIC_RELAXED);
+		stats->highwater[i] = __atomic_load_n(&shards[i].highwater, __ATOMIC_RELAXED);
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef SCCP_SCHED_H_
+#define SCCP_SCHED_H_
+
+#include <stddef.h>
+
+struct ast_sched_context;
+
+#define SCCP_SCHED_MAX_SHARDS 8
+
+struct sccp_sched_stats {
+	size_t shard_count;
+	/* number of RTP instances, each with its RTCP entry, using each shard */
+	unsigned int instances[SCCP_SCHED_MAX_SHARDS];
+	/* highest number of RTP instances using each shard */
+	unsigned int highwater[SCCP_SCHED_MAX_SHARDS];
+};
+
+/*!
+ * \brief Create and start the scheduler contexts used by the RTP instances.
+ *
+ * One context, with its own thread, is created per CPU, up to SCCP_SCHED_MAX_SHARDS.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int sccp_sched_init(void);
+
+/*!
+ * \brief Stop and destroy the scheduler contexts.
+ *
+ * \note There must be no RTP instance left using the contexts.
+ */
+void sccp_sched_destroy(void);
+
+/*!
+ * \brief Return the scheduler context to use for a new RTP instance.
+ *
+ * Contexts are handed out in turn, so that the RTP instances, and thus the RTCP
+ * reports, are spread over the scheduler threads.
+ *
+ * \param[out] shard the shard of the context, to pass to sccp_sched_release once the
+ *                   RTP instance is destroyed
+ *
+ * \retval non-NULL on success
+ * \retval NULL if the contexts are not initialized
+ */
+struct ast_sched_context *sccp_sched_acquire(unsigned int *shard);
+
+/*!
+ * \brief Release a shard acquired with sccp_sched_acquire.
+ */
+void sccp_sched_release(unsigned int shard);
+
+/*!
+ * \brief Take a snapshot of the scheduler stats.
+ */
+void sccp_sched_take_stats(struct sccp_sched_stats *stats);
+
+#endif /* SCCP_SCHED_H_ */
@@ -6,6 +6,8 @@
 #include <asterisk/network.h>
 
 #include "sccp_config.h"
+#include "sccp_device.h"
+#include "sccp_device_registry.h"
 #include "sccp_queue.h"
 #include "sccp_server.h"
 #include "sccp_session.h"
@@ -43,7 +45,6 @@ struct server_session {
 
 enum server_msg_id {
 	MSG_RELOAD_CONFIG,
-	MSG_RELOAD_DEBUG,
 	MSG_SESSION_END,
 	MSG_STOP,
 };
@@ -97,11 +98,6 @@ static void server_msg_init_reload_config(struct server_msg *msg, struct sccp_cf
 	ao2_ref(cfg, +1);
 }
 
-static void server_msg_init_reload_debug(struct server_msg *msg)
-{
-	msg->id = MSG_RELOAD_DEBUG;
-}
-
 static void server_msg_init_session_end(struct server_msg *msg, struct server_session *srv_session)
 {
 	msg->id = MSG_SESSION_END;
@@ -119,7 +115,6 @@ static void server_msg_destroy(struct server_msg *msg)
 	case MSG_RELOAD_CONFIG:
 		ao2_ref(msg->data.reload_config.cfg, -1);
 		break;
-	case MSG_RELOAD_DEBUG:
 	case MSG_SESSION_END:
 	case MSG_STOP:
 		break;
@@ -165,15 +160,6 @@ static int server_queue_msg_reload_config(struct sccp_server *server, struct scc
 	return server_queue_msg(server, &msg);
 }
 
-static int server_queue_msg_reload_debug(struct sccp_server *server)
-{
-	struct server_msg msg;
-
-	server_msg_init_reload_debug(&msg);
-
-	return server_queue_msg(server, &msg);
-}
-
 static int server_queue_msg_session_end(struct sccp_server *server, struct server_session *srv_session)
 {
 	struct server_msg msg;
@@ -221,6 +207,8 @@ static void server_stop_sessions(struct sccp_server *server)
 static void server_reload_config(struct sccp_server *server, struct sccp_cfg *cfg)
 {
 	struct server_session *srv_session;
+	struct sccp_device *device;
+	size_t i;
 
 	sccp_socket_set_tos(server->sockfd, cfg, server->cfg);
 
@@ -228,28 +216,36 @@ static void server_reload_config(struct sccp_server *server, struct sccp_cfg *cf
 	server->cfg = cfg;
 	ao2_ref(cfg, +1);
 
-	AST_LIST_TRAVERSE(&server->srv_sessions, srv_session, list) {
-		sccp_session_reload_config(srv_session->session, cfg);
-	}
-}
+	if (cfg->changes.all) {
+		AST_LIST_TRAVERSE(&server->srv_sessions, srv_session, list) {
+			sccp_session_reload_config(srv_session->session, cfg);
+		}
 
-static void server_reload_debug(struct sccp_server *server)
-{
-	struct server_session *srv_session;
+		return;
+	}
 
-	AST_LIST_TRAVERSE(&server->srv_sessions, srv_session, list) {
-		sccp_session_reload_debug(srv_session->session);
+	/* only the sessions of the registered devices whose config changed need to reload;
+	 * the other sessions pick up the new config when they register
+	 */
+	for (i = 0; i < cfg->changes.count; i++) {
+		device = sccp_device_registry_find(server->registry, cfg->changes.device_names[i]);
+		if (device) {
+			sccp_session_reload_config(sccp_device_session(device), cfg);
+			ao2_ref(device, -1);
+		}
 	}
 }
 
 static void server_add_srv_session(struct sccp_server *server, struct server_session *srv_session)
 {
 	AST_LIST_INSERT_TAIL(&server->srv_sessions, srv_session, list);
+	sccp_stat_on_session_start();
 }
 
 static void server_remove_srv_session(struct sccp_server *server, struct server_session *srv_session)
 {
 	AST_LIST_REMOVE(&server->srv_sessions, srv_session, list);
+	sccp_stat_on_session_end();
 }
 
 static void *session_run(void *data)
@@ -292,6 +288,7 @@ static void server_join_sessions(struct sccp_server *server)
 		}
 
 		AST_LIST_REMOVE_CURRENT(list);
+		sccp_stat_on_session_end();
 		server_session_destroy(srv_session);
 	}
 	AST_LIST_TRAVERSE_SAFE_END;
@@ -369,9 +366,6 @@ static void server_process_msg(struct sccp_server *server, struct server_msg *ms
 	case MSG_RELOAD_CONFIG:
 		server_reload_config(server, msg->data.reload_config.cfg);
 		break;
-	case MSG_RELOAD_DEBUG:
-		server_reload_debug(server);
-		break;
 	case MSG_SESSION_END:
 		server_on_session_end(server, msg->data.session_end.srv_session);
 		break;
@@ -576,18 +570,3 @@ int sccp_server_reload_config(struct sccp_server *server, struct sccp_cfg *cfg)
 
 	return 0;
 }
-
-int sccp_server_reload_debug(struct sccp_server *server)
-{
-	if (server->state != STATE_STARTED) {
-		ast_log(LOG_ERROR, "sccp server reload debug failed: server not in started state\n");
-		return -1;
-	}
-
-	if (server_queue_msg_reload_debug(server)) {
-		ast_log(LOG_WARNING, "sccp server reload debug failed: could not ask server to reload debug\n");
-		return -1;
-	}
-
-	return 0;
-}
@@ -39,9 +39,4 @@ int sccp_server_start(struct sccp_server *server);
  */
 int sccp_server_reload_config(struct sccp_server *server, struct sccp_cfg *cfg);
 
-/*!
- * \brief Reload the debug status of all sessions.
- */
-int sccp_server_reload_debug(struct sccp_server *server);
-
 #endif /* SCCP_SERVER_H_ */
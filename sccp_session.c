@@ -1,35 +1,87 @@
 #include <errno.h>
+#include <pthread.h>
 
 #include <asterisk.h>
 #include <asterisk/astobj2.h>
 #include <asterisk/network.h>
 #include <asterisk/utils.h>
 
+#include "sccp_capture.h"
 #include "sccp_debug.h"
 #include "sccp_config.h"
 #include "sccp_device.h"
 #include "sccp_device_registry.h"
+#include "sccp_flight_recorder.h"
 #include "sccp_msg.h"
+#include "sccp_msg_stats.h"
 #include "sccp_queue.h"
 #include "sccp_session.h"
 #include "sccp_task.h"
 #include "sccp_utils.h"
 
+struct device_cfg_lookup;
+
 static void sccp_session_empty_queue(struct sccp_session *session);
+static void on_device_cfg_lookup_done(struct sccp_session *session, struct device_cfg_lookup *lookup);
+
+/* wire format messages, back to back */
+struct outbound_buf {
+	char *data;
+	size_t len;
+	size_t size;
+};
+
+#define OUTBOUND_BUF_INITIAL_SIZE 1024
+/* beyond this, the device is not reading its socket and the session is dropped */
+#define OUTBOUND_BUF_MAX_SIZE (256 * 1024)
+/* beyond this, the device is assumed to be broken or hostile and the session is dropped */
+#define MAX_INVALID_MSGS 32
 
 struct sccp_session {
 	struct sccp_deserializer deserializer;
 	struct sockaddr_in local_addr;
+	struct sockaddr_in remote_addr;
 	int sockfd;
 	int stop;
 	int remote_port;
 	int debug;
+	/* generation of the debug filters debug was computed from */
+	unsigned int debug_generation;
+	int authtimeout;
+	unsigned int tos;
 
-	struct sccp_cfg *cfg;
 	struct sccp_device_registry *registry;
 	struct sccp_sync_queue *sync_q;
 	struct sccp_task_runner *task_runner;
 	struct sccp_device *device;
+	pthread_t thread;
+	int running;
+
+	/* messages staged by sccp_session_stage_msg, written by the session thread */
+	ast_mutex_t outbound_lock;
+	struct outbound_buf outbound;
+	int outbound_signaled;
+	/* set when a message was refused because the buffer was full */
+	int outbound_overflow;
+	/* only used by the session thread, swapped with outbound on flush */
+	struct outbound_buf outbound_spare;
+
+	/* written by the session thread only */
+	struct sccp_flight_recorder recorder;
+	/* number of truncated or oversized messages received, written by the session thread only */
+	unsigned int invalid_msgs;
+	/* why the session is being aborted, if it is */
+	const char *abort_reason;
+	/* bytes received and transmitted, for the TCP sequence numbers of the capture */
+	uint32_t capture_seq[2];
+	/* sequence number of the last realtime lookup started, see start_device_cfg_lookup */
+	unsigned int lookup_seq;
+	/* non-zero while the device config of a registering device is looked up */
+	int lookup_registering;
+	/* optional, written by the session thread only */
+	struct sccp_session_msg_timing *msg_timing;
+	/* written by the session thread only, read lock-free */
+	struct sccp_session_stats stats;
 
 	char remote_addr_ch[INET_ADDRSTRLEN];
 };
@@ -37,15 +89,38 @@ struct sccp_session {
 enum session_msg_id {
 	MSG_NOOP,
 	MSG_RELOAD_CONFIG,
-	MSG_RELOAD_DEBUG,
+	MSG_FLUSH,
+	MSG_LOOKUP_DONE,
 };
 
 struct session_msg_reload {
 	struct sccp_cfg *cfg;
 };
 
+/*
+ * A device config looked up in realtime by the device task pool, on registration or on
+ * config reload, so that a slow realtime backend doesn't block the session thread.
+ */
+struct device_cfg_lookup {
+	struct sccp_session *session;
+	struct sccp_cfg *cfg;
+	/* the result, set by the pool */
+	struct sccp_device_cfg *device_cfg;
+	unsigned int seq;
+	/* non-zero on registration, else on config reload */
+	int registering;
+	enum sccp_device_type type;
+	uint8_t proto_version;
+	char name[SCCP_DEVICE_NAME_MAX];
+};
+
+struct session_msg_lookup_done {
+	struct device_cfg_lookup *lookup;
+};
+
 union session_msg_data {
 	struct session_msg_reload reload;
+	struct session_msg_lookup_done lookup_done;
 };
 
 struct session_msg {
@@ -74,9 +149,26 @@ static void session_msg_init_reload_config(struct session_msg *msg, struct sccp_
 	ao2_ref(cfg, +1);
 }
 
-static void session_msg_init_reload_debug(struct session_msg *msg)
+static void session_msg_init_flush(struct session_msg *msg)
+{
+	msg->id = MSG_FLUSH;
+}
+
+/*
+ * The lookup is owned by the message.
+ */
+static void session_msg_init_lookup_done(struct session_msg *msg, struct device_cfg_lookup *lookup)
+{
+	msg->id = MSG_LOOKUP_DONE;
+	msg->data.lookup_done.lookup = lookup;
+}
+
+static void device_cfg_lookup_destroy(struct device_cfg_lookup *lookup)
 {
-	msg->id = MSG_RELOAD_DEBUG;
+	ao2_cleanup(lookup->device_cfg);
+	ao2_ref(lookup->cfg, -1);
+	ao2_ref(lookup->session, -1);
+	ast_free(lookup);
 }
 
 static void session_msg_destroy(struct session_msg *msg)
@@ -85,7 +177,10 @@ static void session_msg_destroy(struct session_msg *msg)
 	case MSG_RELOAD_CONFIG:
 		ao2_ref(msg->data.reload.cfg, -1);
 		break;
-	case MSG_RELOAD_DEBUG:
+	case MSG_LOOKUP_DONE:
+		device_cfg_lookup_destroy(msg->data.lookup_done.lookup);
+		break;
+	case MSG_FLUSH:
 	case MSG_NOOP:
 		break;
 	}
@@ -121,7 +216,9 @@ static void sccp_session_destructor(void *data)
 	sccp_session_empty_queue(session);
 	sccp_sync_queue_destroy(session->sync_q);
 	sccp_task_runner_destroy(session->task_runner);
-	ao2_ref(session->cfg, -1);
+	ast_free(session->outbound.data);
+	ast_free(session->outbound_spare.data);
+	ast_mutex_destroy(&session->outbound_lock);
 }
 
 static int get_sock_local_addr(int sockfd, struct sockaddr_in *addr)
@@ -170,7 +267,21 @@ static void sccp_session_update_debug(struct sccp_session *session)
 		device_name = sccp_device_name(session->device);
 	}
 
-	session->debug = sccp_debug_enabled(device_name, session->remote_addr_ch);
+	session->debug_generation = sccp_debug_generation();
+	session->debug = sccp_debug_enabled(device_name, &session->remote_addr.sin_addr);
+}
+
+/*
+ * Return if the messages of the session are dumped. The debug filters are only
+ * reevaluated when they have changed since the last time.
+ */
+static int is_session_debugged(struct sccp_session *session)
+{
+	if (session->debug_generation != sccp_debug_generation()) {
+		sccp_session_update_debug(session);
+	}
+
+	return session->debug;
 }
 
 struct sccp_session *sccp_session_create(struct sccp_cfg *cfg, struct sccp_device_registry *registry, struct sockaddr_in *addr, int sockfd)
@@ -223,14 +334,27 @@ struct sccp_session *sccp_session_create(struct sccp_cfg *cfg, struct sccp_devic
 
 	sccp_deserializer_init(&session->deserializer, sockfd);
 	session->local_addr = local_addr;
+	session->remote_addr = *addr;
 	session->sockfd = sockfd;
 	session->sync_q = sync_q;
 	session->task_runner = task_runner;
 	session->stop = 0;
 	session->debug = 0;
 	session->device = NULL;
-	session->cfg = cfg;
-	ao2_ref(cfg, +1);
+	session->running = 0;
+	ast_mutex_init(&session->outbound_lock);
+	memset(&session->outbound, 0, sizeof(session->outbound));
+	memset(&session->outbound_spare, 0, sizeof(session->outbound_spare));
+	session->outbound_signaled = 0;
+	session->outbound_overflow = 0;
+	sccp_flight_recorder_init(&session->recorder);
+	session->invalid_msgs = 0;
+	session->abort_reason = NULL;
+	session->lookup_seq = 0;
+	session->lookup_registering = 0;
+	session->msg_timing = NULL;
+	session->authtimeout = cfg->general_cfg->authtimeout;
+	session->tos = cfg->general_cfg->tos;
 	session->registry = registry;
 	session->remote_port = ntohs(addr->sin_port);
 	ast_copy_string(session->remote_addr_ch, ast_inet_ntoa(addr->sin_addr), sizeof(session->remote_addr_ch));
@@ -288,15 +412,193 @@ static int sccp_session_queue_msg_reload_config(struct sccp_session *session, st
 	return sccp_session_queue_msg(session, &msg);
 }
 
-static int sccp_session_queue_msg_reload_debug(struct sccp_session *session)
+static int sccp_session_queue_msg_flush(struct sccp_session *session)
 {
 	struct session_msg msg;
 
-	session_msg_init_reload_debug(&msg);
+	session_msg_init_flush(&msg);
 
 	return sccp_session_queue_msg(session, &msg);
 }
 
+static int sccp_session_queue_msg_lookup_done(struct sccp_session *session, struct device_cfg_lookup *lookup)
+{
+	struct session_msg msg;
+
+	session_msg_init_lookup_done(&msg, lookup);
+
+	return sccp_session_queue_msg(session, &msg);
+}
+
+static int is_session_thread(struct sccp_session *session)
+{
+	return session->running && pthread_equal(pthread_self(), session->thread);
+}
+
+/*
+ * Stop the session because something went wrong. The flight recorder is dumped once
+ * the session thread is done. Must be called from the session thread.
+ */
+static void sccp_session_abort(struct sccp_session *session, const char *reason)
+{
+	session->stop = 1;
+	if (!session->abort_reason) {
+		session->abort_reason = reason;
+	}
+}
+
+/*
+ * Make room for len more bytes in the buffer.
+ */
+static int outbound_buf_reserve(struct outbound_buf *buf, size_t len)
+{
+	size_t size;
+	char *data;
+
+	if (buf->size - buf->len >= len) {
+		return 0;
+	}
+
+	size = buf->size ? buf->size : OUTBOUND_BUF_INITIAL_SIZE;
+	while (size - buf->len < len) {
+		size *= 2;
+	}
+
+	data = ast_realloc(buf->data, size);
+	if (!data) {
+		return -1;
+	}
+
+	buf->data = data;
+	buf->size = size;
+
+	return 0;
+}
+
+static void on_write_done(struct sccp_session *session, struct timeval start)
+{
+	int64_t elapsed = ast_tvdiff_us(ast_tvnow(), start);
+
+	sccp_msg_stats_on_transmit(elapsed);
+
+	/* the socket is blocking, so a slow write means the socket send buffer was full */
+	if (elapsed >= SCCP_SESSION_STALL_MS * 1000) {
+		SCCP_STAT_INC(session->stats.send_stalls, 1);
+	}
+}
+
+static int sccp_session_write(struct sccp_session *session, const char *buf, size_t count)
+{
+	struct timeval start = ast_tvnow();
+	ssize_t n;
+
+	while (count) {
+		n = write(session->sockfd, buf, count);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			ast_log(LOG_WARNING, "sccp session write failed: write: %s\n", strerror(errno));
+			sccp_session_abort(session, "write failed");
+			return -1;
+		}
+
+		buf += n;
+		count -= (size_t) n;
+	}
+
+	on_write_done(session, start);
+
+	return 0;
+}
+
+static void count_msg_out(struct sccp_session *session, uint32_t msg_id, size_t len)
+{
+	sccp_msg_stats_on_msg_out(msg_id, len);
+	SCCP_STAT_INC(session->stats.msgs_out, 1);
+	SCCP_STAT_INC(session->stats.bytes_out, len);
+}
+
+/*
+ * Must be called from the session thread, in the order the messages are received or
+ * written.
+ */
+static void capture_msg(struct sccp_session *session, enum sccp_capture_dir dir, const void *msg, size_t len)
+{
+	const char *device_name = session->device ? sccp_device_name(session->device) : NULL;
+	uint32_t *seq = &session->capture_seq[dir];
+
+	sccp_capture_msg(dir, device_name, &session->local_addr, &session->remote_addr, *seq, session->capture_seq[!dir], msg, len);
+	*seq += len;
+}
+
+static void record_staged_msgs(struct sccp_session *session, const char *buf, size_t len)
+{
+	struct sccp_msg msg;
+	uint32_t msg_length;
+	uint32_t msg_id;
+	size_t total_length;
+
+	while (len >= SCCP_MSG_HEADER_LEN) {
+		memcpy(&msg_length, buf, sizeof(msg_length));
+		memcpy(&msg_id, buf + 8, sizeof(msg_id));
+		total_length = SCCP_MSG_TOTAL_LEN_FROM_LEN(letohl(msg_length));
+
+		sccp_flight_recorder_record(&session->recorder, SCCP_FLIGHT_OUT, buf, total_length);
+		capture_msg(session, SCCP_CAPTURE_OUT, buf, total_length);
+		count_msg_out(session, letohl(msg_id), total_length);
+
+		if (is_session_debugged(session)) {
+			memcpy(&msg, buf, MIN(total_length, sizeof(msg)));
+			sccp_dump_message_transmitting(&msg, session->remote_addr_ch, session->remote_port);
+		}
+
+		buf += total_length;
+		len -= total_length;
+	}
+}
+
+/*
+ * Write the staged messages. Must be called from the session thread.
+ */
+static void sccp_session_flush(struct sccp_session *session)
+{
+	struct outbound_buf buf;
+
+	ast_mutex_lock(&session->outbound_lock);
+	if (session->outbound_overflow) {
+		/* the device would miss messages anyway, so drop the session */
+		session->outbound.len = 0;
+		session->outbound_signaled = 0;
+		ast_mutex_unlock(&session->outbound_lock);
+		sccp_session_abort(session, "outbound buffer overflow");
+		return;
+	}
+
+	if (!session->outbound.len) {
+		ast_mutex_unlock(&session->outbound_lock);
+		return;
+	}
+
+	buf = session->outbound;
+	session->outbound = session->outbound_spare;
+	session->outbound_signaled = 0;
+	ast_mutex_unlock(&session->outbound_lock);
+
+	if (buf.len > session->stats.outbound_highwater) {
+		SCCP_STAT_SET(session->stats.outbound_highwater, buf.len);
+	}
+
+	record_staged_msgs(session, buf.data, buf.len);
+
+	/* every staged message in a single write */
+	sccp_session_write(session, buf.data, buf.len);
+
+	buf.len = 0;
+	session->outbound_spare = buf;
+}
+
 static void on_auth_timeout(struct sccp_session *session, void __attribute__((unused)) *data)
 {
 	ast_log(LOG_WARNING, "Device authentication timed out\n");
@@ -310,7 +612,7 @@ static int add_auth_timeout_task(struct sccp_session *session)
 
 	session_task_zero(&task_data);
 
-	return sccp_task_runner_add(session->task_runner, on_auth_timeout, &task_data, session->cfg->general_cfg->authtimeout);
+	return sccp_task_runner_add(session->task_runner, on_auth_timeout, &task_data, session->authtimeout);
 }
 
 static void remove_auth_timeout_task(struct sccp_session *session)
@@ -322,30 +624,97 @@ static void remove_auth_timeout_task(struct sccp_session *session)
 	sccp_task_runner_remove(session->task_runner, on_auth_timeout, &task_data);
 }
 
-static void process_reload_config(struct sccp_session *session, struct sccp_cfg *cfg)
+static int exec_device_cfg_lookup(void *data)
 {
-	struct sccp_device_cfg *device_cfg;
+	struct device_cfg_lookup *lookup = data;
+
+	lookup->device_cfg = sccp_cfg_lookup_device_or_guest(lookup->cfg, lookup->name);
+
+	/* on failure, the session is stopping and the lookup has been destroyed */
+	sccp_session_queue_msg_lookup_done(lookup->session, lookup);
+
+	return 0;
+}
+
+/*
+ * Look the device config up in realtime on the device task pool. The lookup continues
+ * in on_device_cfg_lookup_done, on the session thread.
+ *
+ * Only the result of the last lookup started is used, so that a lookup for an old
+ * config can't override the result of a newer one.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure, e.g. there's no task pool and the caller must block
+ */
+static int start_device_cfg_lookup(struct sccp_session *session, struct sccp_cfg *cfg, const char *name, struct sccp_device_info *info)
+{
+	struct device_cfg_lookup *lookup;
 
-	sccp_socket_set_tos(session->sockfd, cfg, session->cfg);
+	lookup = ast_calloc(1, sizeof(*lookup));
+	if (!lookup) {
+		return -1;
+	}
 
-	ao2_ref(session->cfg, -1);
-	session->cfg = cfg;
+	lookup->session = session;
+	ao2_ref(session, +1);
+	lookup->cfg = cfg;
 	ao2_ref(cfg, +1);
+	lookup->device_cfg = NULL;
+	lookup->seq = session->lookup_seq + 1;
+	lookup->registering = info != NULL;
+	if (info) {
+		lookup->type = info->type;
+		lookup->proto_version = info->proto_version;
+	}
+	ast_copy_string(lookup->name, name, sizeof(lookup->name));
 
-	if (!session->device) {
-		return;
+	if (sccp_device_task_pool_push(exec_device_cfg_lookup, lookup)) {
+		device_cfg_lookup_destroy(lookup);
+		return -1;
 	}
 
-	device_cfg = sccp_cfg_find_device_or_guest(cfg, sccp_device_name(session->device));
+	session->lookup_seq = lookup->seq;
+
+	return 0;
+}
+
+static void reload_device_config(struct sccp_session *session, struct sccp_device_cfg *device_cfg)
+{
 	if (!device_cfg) {
 		session->stop = 1;
-	} else {
-		if (sccp_device_reload_config(session->device, device_cfg)) {
-			session->stop = 1;
+	} else if (sccp_device_reload_config(session->device, device_cfg)) {
+		session->stop = 1;
+	}
+}
+
+static void process_reload_config(struct sccp_session *session, struct sccp_cfg *cfg)
+{
+	struct sccp_device_cfg *device_cfg;
+	const char *name;
+
+	if (session->tos != cfg->general_cfg->tos) {
+		sccp_socket_set_tos(session->sockfd, cfg, NULL);
+		session->tos = cfg->general_cfg->tos;
+	}
+
+	if (!session->device) {
+		return;
+	}
+
+	name = sccp_device_name(session->device);
+	if (sccp_cfg_try_find_device_or_guest(cfg, name, &device_cfg) == SCCP_CFG_REALTIME_LOOKUP) {
+		if (!start_device_cfg_lookup(session, cfg, name, NULL)) {
+			return;
 		}
 
-		ao2_ref(device_cfg, -1);
+		device_cfg = sccp_cfg_lookup_device_or_guest(cfg, name);
+	} else {
+		/* a lookup still running is for an older config */
+		session->lookup_seq++;
 	}
+
+	reload_device_config(session, device_cfg);
+	ao2_cleanup(device_cfg);
 }
 
 static void sccp_session_process_msg(struct sccp_session *session, struct session_msg *msg)
@@ -356,8 +725,11 @@ static void sccp_session_process_msg(struct sccp_session *session, struct sessio
 	case MSG_RELOAD_CONFIG:
 		process_reload_config(session, msg->data.reload.cfg);
 		break;
-	case MSG_RELOAD_DEBUG:
-		sccp_session_update_debug(session);
+	case MSG_FLUSH:
+		sccp_session_flush(session);
+		break;
+	case MSG_LOOKUP_DONE:
+		on_device_cfg_lookup_done(session, msg->data.lookup_done.lookup);
 		break;
 	}
 
@@ -399,9 +771,15 @@ static int sccp_session_read_sock(struct sccp_session *session)
 			sccp_device_on_connection_lost(session->device);
 		}
 
+		/* an ordinary close, not worth dumping the flight recorder */
+		session->stop = 1;
 		break;
 	case SCCP_DESERIALIZER_FULL:
 		ast_log(LOG_WARNING, "Deserializer buffer is full -- probably invalid or too big message\n");
+		sccp_session_abort(session, "deserializer buffer full");
+		break;
+	default:
+		sccp_session_abort(session, "read failed");
 		break;
 	}
 
@@ -413,37 +791,35 @@ static int sccp_session_transmit_register_rej(struct sccp_session *session)
 	struct sccp_msg msg;
 
 	sccp_msg_register_rej(&msg);
+	sccp_stat_on_registration(1);
 
 	return sccp_session_transmit_msg(session, &msg);
 }
 
-static void sccp_session_handle_msg_register(struct sccp_session *session, struct sccp_msg *msg)
+/*
+ * Consume the references of cfg and device_cfg.
+ */
+static void register_device(struct sccp_session *session, struct sccp_cfg *cfg, struct sccp_device_cfg *device_cfg, struct sccp_device_info *device_info)
 {
-	struct sccp_device_info device_info;
 	struct sccp_device *device;
-	struct sccp_device_cfg *device_cfg;
-	char *name;
+	struct sccp_cfg *cur_cfg;
+	const char *name = device_info->name;
 	int ret;
 
 	/* A: session->device is null */
 
-	name = msg->data.reg.name;
-	name[sizeof(msg->data.reg.name)] = '\0';
-
-	device_cfg = sccp_cfg_find_device_or_guest(session->cfg, name);
 	if (!device_cfg) {
 		ast_log(LOG_WARNING, "Device is not configured [%s]\n", name);
 		sccp_session_transmit_register_rej(session);
+		ao2_ref(cfg, -1);
 		return;
 	}
 
-	device_info.name = name;
-	device_info.type = letohl(msg->data.reg.type);
-	device_info.proto_version = letohl(msg->data.reg.protoVersion);
-	device = sccp_device_create(device_cfg, session, &device_info);
+	device = sccp_device_create(device_cfg, session, device_info);
 	ao2_ref(device_cfg, -1);
 	if (!device) {
 		sccp_session_transmit_register_rej(session);
+		ao2_ref(cfg, -1);
 		return;
 	}
 
@@ -458,39 +834,180 @@ static void sccp_session_handle_msg_register(struct sccp_session *session, struc
 		sccp_session_transmit_register_rej(session);
 		sccp_device_destroy(device);
 		ao2_ref(device, -1);
+		ao2_ref(cfg, -1);
 		return;
 	}
 
-	ast_verb(3, "Registered SCCP(%d) '%s' at %s:%d\n", device_info.proto_version, name, session->remote_addr_ch, session->remote_port);
+	ast_verb(3, "Registered SCCP(%d) '%s' at %s:%d\n", device_info->proto_version, name, session->remote_addr_ch, session->remote_port);
 
 	/* steal the reference ownership */
 	session->device = device;
+	sccp_stat_on_registration(0);
 
 	remove_auth_timeout_task(session);
 	sccp_session_update_debug(session);
 	sccp_device_on_registration_success(device);
+
+	/* a reload only notifies the sessions of the devices in the registry, so catch up
+	 * with a config published between the config lookup and the registry add
+	 */
+	cur_cfg = sccp_config_get();
+	if (cur_cfg && cur_cfg != cfg) {
+		process_reload_config(session, cur_cfg);
+	}
+
+	ao2_cleanup(cur_cfg);
+	ao2_ref(cfg, -1);
 }
 
-static void sccp_session_handle_msg(struct sccp_session *session, struct sccp_msg *msg)
+static void on_device_cfg_lookup_done(struct sccp_session *session, struct device_cfg_lookup *lookup)
+{
+	struct sccp_device_info device_info;
+	struct sccp_device_cfg *device_cfg = lookup->device_cfg;
+
+	if (lookup->seq != session->lookup_seq) {
+		return;
+	}
+
+	if (lookup->registering) {
+		session->lookup_registering = 0;
+		if (session->device) {
+			return;
+		}
+
+		device_info.name = lookup->name;
+		device_info.type = lookup->type;
+		device_info.proto_version = lookup->proto_version;
+
+		/* the references are now owned by register_device */
+		lookup->device_cfg = NULL;
+		ao2_ref(lookup->cfg, +1);
+		register_device(session, lookup->cfg, device_cfg, &device_info);
+	} else if (session->device) {
+		reload_device_config(session, device_cfg);
+	}
+}
+
+static void sccp_session_handle_msg_register(struct sccp_session *session, struct sccp_msg *msg)
+{
+	struct sccp_device_info device_info;
+	struct sccp_device_cfg *device_cfg;
+	struct sccp_cfg *cfg;
+	char *name;
+
+	/* A: session->device is null */
+
+	/* the device is retrying while its config is being looked up */
+	if (session->lookup_registering) {
+		return;
+	}
+
+	name = msg->data.reg.name;
+	name[sizeof(msg->data.reg.name)] = '\0';
+
+	cfg = sccp_config_get();
+	if (!cfg) {
+		sccp_session_transmit_register_rej(session);
+		return;
+	}
+
+	device_info.name = name;
+	device_info.type = letohl(msg->data.reg.type);
+	device_info.proto_version = letohl(msg->data.reg.protoVersion);
+
+	if (sccp_cfg_try_find_device_or_guest(cfg, name, &device_cfg) == SCCP_CFG_REALTIME_LOOKUP) {
+		if (!start_device_cfg_lookup(session, cfg, name, &device_info)) {
+			session->lookup_registering = 1;
+			ao2_ref(cfg, -1);
+			return;
+		}
+
+		/* without the task pool, the session thread has no choice but to block */
+		device_cfg = sccp_cfg_lookup_device_or_guest(cfg, name);
+	}
+
+	register_device(session, cfg, device_cfg, &device_info);
+}
+
+static void record_msg_timing(struct sccp_session *session, const struct sccp_msg_desc *desc, struct timeval start)
 {
-	uint32_t msg_id = letohl(msg->id);
+	struct sccp_session_msg_timing *timing = session->msg_timing;
+	unsigned int time = ast_tvdiff_us(ast_tvnow(), start);
 
-	if (session->debug) {
+	timing->count[desc->index]++;
+	timing->time_total[desc->index] += time;
+	if (time > timing->time_max[desc->index]) {
+		timing->time_max[desc->index] = time;
+	}
+}
+
+/*
+ * The invalid messages are only logged at debug level, since a device could otherwise
+ * flood the log; the flight recorder still has them.
+ */
+static void session_on_invalid_msg(struct sccp_session *session)
+{
+	if (++session->invalid_msgs == MAX_INVALID_MSGS) {
+		ast_log(LOG_WARNING, "sccp session %s: too many invalid messages\n", session->remote_addr_ch);
+		sccp_session_abort(session, "too many invalid messages");
+	}
+}
+
+static void sccp_session_handle_msg(struct sccp_session *session, struct sccp_msg *msg)
+{
+	struct timeval start;
+	struct timeval handle_start;
+	const struct sccp_msg_desc *desc;
+	size_t total_length = SCCP_MSG_TOTAL_LEN_FROM_LEN(letohl(msg->length));
+
+	sccp_flight_recorder_record(&session->recorder, SCCP_FLIGHT_IN, msg, total_length);
+	capture_msg(session, SCCP_CAPTURE_IN, msg, total_length);
+	sccp_msg_stats_on_msg_in(letohl(msg->id), total_length);
+	SCCP_STAT_INC(session->stats.msgs_in, 1);
+	SCCP_STAT_INC(session->stats.bytes_in, total_length);
+
+	if (is_session_debugged(session)) {
 		sccp_dump_message_received(msg, session->remote_addr_ch, session->remote_port);
 	}
 
+	/* no handler ever sees an unknown or truncated message */
+	switch (sccp_msg_validate(msg, &desc)) {
+	case SCCP_MSG_VALID:
+		break;
+	case SCCP_MSG_UNKNOWN:
+		ast_debug(1, "ignoring message with ID 0x%04X\n", letohl(msg->id));
+		return;
+	case SCCP_MSG_TOO_SHORT:
+		ast_debug(1, "ignoring %s message from %s: body is too short (%u bytes)\n", desc->name, session->remote_addr_ch, letohl(msg->length) - 4);
+		session_on_invalid_msg(session);
+		return;
+	default:
+		ast_debug(1, "ignoring %s message from %s: body is too long (%u bytes)\n", desc->name, session->remote_addr_ch, letohl(msg->length) - 4);
+		session_on_invalid_msg(session);
+		return;
+	}
+
+	if (session->msg_timing) {
+		start = ast_tvnow();
+	}
+
 	if (!session->device) {
-		switch (msg_id) {
-		case REGISTER_MESSAGE:
+		if (desc->id == REGISTER_MESSAGE) {
 			sccp_session_handle_msg_register(session, msg);
-			break;
 		}
 	}
 
 	if (session->device) {
-		if (sccp_device_handle_msg(session->device, msg)) {
+		handle_start = ast_tvnow();
+		if (sccp_device_handle_msg(session->device, msg, desc)) {
 			session->stop = 1;
 		}
+
+		sccp_msg_stats_on_handle(desc, ast_tvdiff_us(ast_tvnow(), handle_start));
+	}
+
+	if (session->msg_timing) {
+		record_msg_timing(session, desc, start);
 	}
 }
 
@@ -501,7 +1018,6 @@ static void sccp_session_on_sock_events(struct sccp_session *session, int events
 
 	if (events & POLLIN) {
 		if (sccp_session_read_sock(session)) {
-			session->stop = 1;
 			return;
 		}
 
@@ -514,14 +1030,14 @@ static void sccp_session_on_sock_events(struct sccp_session *session, int events
 			break;
 		case SCCP_DESERIALIZER_MALFORMED:
 			ast_log(LOG_WARNING, "sccp session on sock events failed: malformed message\n");
-			session->stop = 1;
+			sccp_session_abort(session, "malformed message");
 			break;
 		}
 	}
 
 	if (events & ~POLLIN) {
 		ast_log(LOG_WARNING, "sccp session on sock events failed: unexpected event 0x%X\n", events);
-		session->stop = 1;
+		sccp_session_abort(session, "unexpected socket event");
 	}
 }
 
@@ -536,6 +1052,9 @@ void sccp_session_run(struct sccp_session *session)
 	fds[1].fd = sccp_sync_queue_fd(session->sync_q);
 	fds[1].events = POLLIN;
 
+	session->thread = pthread_self();
+	session->running = 1;
+
 	add_auth_timeout_task(session);
 
 	for (;;) {
@@ -571,6 +1090,9 @@ void sccp_session_run(struct sccp_session *session)
 				}
 			}
 		}
+
+		/* messages staged outside of a device lock, e.g. by a device task */
+		sccp_session_flush(session);
 	}
 
 end:
@@ -589,6 +1111,15 @@ end:
 		ao2_ref(session->device, -1);
 		session->device = NULL;
 	}
+
+	/* e.g. the reset message sent on device destroy */
+	sccp_session_flush(session);
+
+	if (session->abort_reason) {
+		sccp_session_dump_flight_recorder(session, -1, session->abort_reason);
+	}
+
+	session->running = 0;
 }
 
 int sccp_session_stop(struct sccp_session *session)
@@ -618,11 +1149,6 @@ int sccp_session_reload_config(struct sccp_session *session, struct sccp_cfg *cf
 	return sccp_session_queue_msg_reload_config(session, cfg);
 }
 
-int sccp_session_reload_debug(struct sccp_session *session)
-{
-	return sccp_session_queue_msg_reload_debug(session);
-}
-
 static void on_device_task_timeout(struct sccp_session *session, void *data)
 {
 	union session_task_data *task_data = data;
@@ -660,18 +1186,25 @@ void sccp_session_remove_device_task(struct sccp_session *session, sccp_device_t
 int sccp_session_transmit_msg(struct sccp_session *session, struct sccp_msg *msg)
 {
 	size_t count = SCCP_MSG_TOTAL_LEN_FROM_LEN(letohl(msg->length));
+	struct timeval start;
 	ssize_t n;
 
-	if (session->debug) {
+	sccp_flight_recorder_record(&session->recorder, SCCP_FLIGHT_OUT, msg, count);
+	capture_msg(session, SCCP_CAPTURE_OUT, msg, count);
+	count_msg_out(session, letohl(msg->id), count);
+
+	if (is_session_debugged(session)) {
 		sccp_dump_message_transmitting(msg, session->remote_addr_ch, session->remote_port);
 	}
 
+	start = ast_tvnow();
 	n = write(session->sockfd, msg, count);
+	on_write_done(session, start);
 	if (n == (ssize_t) count) {
 		return 0;
 	}
 
-	session->stop = 1;
+	sccp_session_abort(session, "write failed");
 	if (n == -1) {
 		ast_log(LOG_WARNING, "sccp session transmit msg failed: write: %s\n", strerror(errno));
 	} else {
@@ -681,6 +1214,105 @@ int sccp_session_transmit_msg(struct sccp_session *session, struct sccp_msg *msg
 	return -1;
 }
 
+int sccp_session_stage_encoded(struct sccp_session *session, size_t len, void (*encode)(void *buf, const void *data), const void *data)
+{
+	int signal = 0;
+
+	ast_mutex_lock(&session->outbound_lock);
+
+	/* the session thread still stages the messages sent when the device is destroyed */
+	if (session->stop && !is_session_thread(session)) {
+		ast_mutex_unlock(&session->outbound_lock);
+		ast_debug(1, "sccp session stage encoded failed: session is stopping\n");
+		return -1;
+	}
+
+	if (session->outbound_overflow) {
+		ast_mutex_unlock(&session->outbound_lock);
+		return -1;
+	}
+
+	if (session->outbound.len + len > OUTBOUND_BUF_MAX_SIZE) {
+		session->outbound_overflow = 1;
+		if (!session->outbound_signaled && !is_session_thread(session)) {
+			session->outbound_signaled = 1;
+			signal = 1;
+		}
+
+		ast_mutex_unlock(&session->outbound_lock);
+		ast_log(LOG_WARNING, "sccp session stage encoded failed: more than %d bytes staged\n", OUTBOUND_BUF_MAX_SIZE);
+
+		if (signal) {
+			sccp_session_queue_msg_flush(session);
+		}
+
+		return -1;
+	}
+
+	if (outbound_buf_reserve(&session->outbound, len)) {
+		ast_mutex_unlock(&session->outbound_lock);
+		ast_log(LOG_ERROR, "sccp session stage encoded failed: could not grow buffer\n");
+		return -1;
+	}
+
+	encode(session->outbound.data + session->outbound.len, data);
+	session->outbound.len += len;
+	if (!session->outbound_signaled && !is_session_thread(session)) {
+		session->outbound_signaled = 1;
+		signal = 1;
+	}
+
+	ast_mutex_unlock(&session->outbound_lock);
+
+	if (signal && sccp_session_queue_msg_flush(session)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static void encode_msg(void *buf, const void *data)
+{
+	const struct sccp_msg *msg = data;
+
+	memcpy(buf, msg, SCCP_MSG_TOTAL_LEN_FROM_LEN(letohl(msg->length)));
+}
+
+int sccp_session_stage_msg(struct sccp_session *session, struct sccp_msg *msg)
+{
+	return sccp_session_stage_encoded(session, SCCP_MSG_TOTAL_LEN_FROM_LEN(letohl(msg->length)), encode_msg, msg);
+}
+
+void sccp_session_flush_msgs(struct sccp_session *session)
+{
+	if (is_session_thread(session)) {
+		sccp_session_flush(session);
+	}
+}
+
+void sccp_session_dump_flight_recorder(struct sccp_session *session, int fd, const char *reason)
+{
+	char title[128];
+
+	snprintf(title, sizeof(title), "Flight recorder of session %s:%d (%s):", session->remote_addr_ch, session->remote_port, reason);
+	sccp_flight_recorder_dump(&session->recorder, fd, title);
+}
+
+void sccp_session_set_msg_timing(struct sccp_session *session, struct sccp_session_msg_timing *timing)
+{
+	session->msg_timing = timing;
+}
+
+void sccp_session_take_stats(const struct sccp_session *session, struct sccp_session_stats *stats)
+{
+	stats->msgs_in = SCCP_STAT_LOAD(session->stats.msgs_in);
+	stats->msgs_out = SCCP_STAT_LOAD(session->stats.msgs_out);
+	stats->bytes_in = SCCP_STAT_LOAD(session->stats.bytes_in);
+	stats->bytes_out = SCCP_STAT_LOAD(session->stats.bytes_out);
+	stats->outbound_highwater = SCCP_STAT_LOAD(session->stats.outbound_highwater);
+	stats->send_stalls = SCCP_STAT_LOAD(session->stats.send_stalls);
+}
+
 const char *sccp_session_remote_addr_ch(const struct sccp_session *session)
 {
 	return session->remote_addr_ch;
@@ -690,3 +1322,8 @@ const struct sockaddr_in *sccp_session_local_addr(const struct sccp_session *ses
 {
 	return &session->local_addr;
 }
+
+const struct sockaddr_in *sccp_session_remote_addr(const struct sccp_session *session)
+{
+	return &session->remote_addr;
+}
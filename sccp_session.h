@@ -1,13 +1,37 @@
 #ifndef SCCP_SESSION_H_
 #define SCCP_SESSION_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sccp_msg.h"
+
 struct sccp_cfg;
 struct sccp_device;
 struct sccp_device_registry;
-struct sccp_msg;
 struct sccp_session;
 struct sockaddr_in;
 
+struct sccp_session_msg_timing {
+	/* indexed by message index, times in microseconds */
+	unsigned int count[SCCP_MSG_COUNT];
+	unsigned int time_total[SCCP_MSG_COUNT];
+	unsigned int time_max[SCCP_MSG_COUNT];
+};
+
+struct sccp_session_stats {
+	unsigned int msgs_in;
+	unsigned int msgs_out;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	/* largest number of bytes staged between two flushes */
+	size_t outbound_highwater;
+	/* writes that blocked for at least SCCP_SESSION_STALL_MS */
+	unsigned int send_stalls;
+};
+
+#define SCCP_SESSION_STALL_MS 50
+
 /*!
  * \brief Create a new session (astobj2 object).
  *
@@ -44,14 +68,6 @@ int sccp_session_stop(struct sccp_session *session);
  */
 int sccp_session_reload_config(struct sccp_session *session, struct sccp_cfg *cfg);
 
-/*!
- * \brief Reload the debug status.
- *
- * \retval 0 on success
- * \retval non-zero on failure
- */
-int sccp_session_reload_debug(struct sccp_session *session);
-
 /*!
  * \brief Function type for device task callback
  *
@@ -82,12 +98,79 @@ void sccp_session_remove_device_task(struct sccp_session *session, sccp_device_t
  * \brief Transmit a message on the session socket.
  *
  * \note Part of the device API.
+ * \note Must be called only from the session thread.
  *
  * \retval 0 on success
  * \retval non-zero on failure
  */
 int sccp_session_transmit_msg(struct sccp_session *session, struct sccp_msg *msg);
 
+/*!
+ * \brief Stage a message, to be written on the session socket by the session thread.
+ *
+ * Staging never blocks on the socket, so it can be done while holding a device lock
+ * and from any thread. Messages are written in the order they have been staged: by
+ * sccp_session_flush_msgs when called from the session thread, else as soon as the
+ * session thread wakes up.
+ *
+ * Staging fails once the session is stopping, except from the session thread. If the
+ * staged messages grow past a limit, i.e. the device doesn't read them, staging fails
+ * and the session is dropped.
+ *
+ * \note Part of the device API.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int sccp_session_stage_msg(struct sccp_session *session, struct sccp_msg *msg);
+
+/*!
+ * \brief Stage a message of len bytes, encoded directly at the end of the staged messages.
+ *
+ * The encode function is called once, with data and a buffer of len bytes where it
+ * writes the message in its wire format. The staged messages are locked while it runs,
+ * so it must do nothing else, i.e. neither block nor call back into the session.
+ *
+ * \note Part of the device API.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int sccp_session_stage_encoded(struct sccp_session *session, size_t len, void (*encode)(void *buf, const void *data), const void *data);
+
+/*!
+ * \brief Dump the last messages received and transmitted on the session.
+ *
+ * \param fd the CLI file descriptor to write to, or -1 to write to the log
+ * \param reason why the dump is done
+ *
+ * \note Can be called from any thread.
+ */
+void sccp_session_dump_flight_recorder(struct sccp_session *session, int fd, const char *reason);
+
+/*!
+ * \brief Write the staged messages, if called from the session thread.
+ *
+ * \note Part of the device API.
+ */
+void sccp_session_flush_msgs(struct sccp_session *session);
+
+/*!
+ * \brief Time the handling of every valid message received by the session.
+ *
+ * \note Must be called before the session is run. The timing is updated by the session
+ *       thread without locking, and must only be read once the session has stopped.
+ */
+void sccp_session_set_msg_timing(struct sccp_session *session, struct sccp_session_msg_timing *timing);
+
+/*!
+ * \brief Take a snapshot of the session stats.
+ *
+ * The stats are written by the session thread only, so this function does not
+ * acquire any lock, and can be called from any thread.
+ */
+void sccp_session_take_stats(const struct sccp_session *session, struct sccp_session_stats *stats);
+
 /*!
  * \brief Return the remote (i.e. peer) IPv4 address of the session, as a char*.
  *
@@ -102,4 +185,11 @@ const char *sccp_session_remote_addr_ch(const struct sccp_session *session);
  */
 const struct sockaddr_in *sccp_session_local_addr(const struct sccp_session *session);
 
+/*!
+ * \brief Return the remote (i.e. peer) IPv4 address of the session.
+ *
+ * \note The returned pointer becomes invalid when the session reference count reach zero.
+ */
+const struct sockaddr_in *sccp_session_remote_addr(const struct sccp_session *session);
+
 #endif /* SCCP_SESSION_H_ */
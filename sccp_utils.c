@@ -1,12 +1,31 @@
+#include <pthread.h>
+#include <sched.h>
+
 #include <asterisk.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/format_cap.h>
 #include <asterisk/lock.h>
 #include <asterisk/logger.h>
+#include <asterisk/utils.h>
 
 #include "sccp_config.h"
 #include "sccp_utils.h"
 
 static struct sccp_stat stat;
 
+struct sccp_thread_shard {
+	struct sccp_thread_shards *owner;
+	/* non-zero while a thread owns the shard */
+	int in_use;
+	void *data;
+};
+
+/*
+ * Protects every sccp_thread_shards. It's only taken when a thread gets its shard, when
+ * it exits and by the readers.
+ */
+AST_MUTEX_DEFINE_STATIC(thread_shards_lock);
+
 void sccp_stat_on_device_fault(void)
 {
 	time_t now = time(NULL);
@@ -23,11 +42,227 @@ void sccp_stat_on_device_panic(void)
 	ast_atomic_fetchadd_int(&stat.device_panic_count, 1);
 }
 
+void sccp_stat_on_session_start(void)
+{
+	ast_atomic_fetchadd_int(&stat.connection_count, 1);
+	ast_atomic_fetchadd_int(&stat.session_count, 1);
+}
+
+void sccp_stat_on_session_end(void)
+{
+	ast_atomic_fetchadd_int(&stat.session_count, -1);
+}
+
+void sccp_stat_on_registration(int rejected)
+{
+	if (rejected) {
+		ast_atomic_fetchadd_int(&stat.registration_reject_count, 1);
+	} else {
+		ast_atomic_fetchadd_int(&stat.registration_count, 1);
+	}
+}
+
+void sccp_stat_on_reload(unsigned int time)
+{
+	__atomic_store_n(&stat.reload_time_last, time, __ATOMIC_RELAXED);
+	if (time > stat.reload_time_max) {
+		__atomic_store_n(&stat.reload_time_max, time, __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&stat.reload_time_total, stat.reload_time_total + time, __ATOMIC_RELAXED);
+	ast_atomic_fetchadd_int(&stat.reload_count, 1);
+}
+
 void sccp_stat_take_snapshot(struct sccp_stat *dst)
 {
 	memcpy(dst, &stat, sizeof(*dst));
 }
 
+unsigned int sccp_cpu_shard(void)
+{
+	int cpu = sched_getcpu();
+
+	if (cpu < 0) {
+		/* threads are then spread by their ID */
+		return (unsigned int) (((uintptr_t) pthread_self() >> 12) & (SCCP_CPU_SHARDS - 1));
+	}
+
+	return (unsigned int) cpu & (SCCP_CPU_SHARDS - 1);
+}
+
+/*
+ * Called on thread exit, for the threads that got a shard.
+ */
+static void thread_shard_release(void *data)
+{
+	struct sccp_thread_shard *shard = data;
+
+	ast_mutex_lock(&thread_shards_lock);
+	shard->in_use = 0;
+	ast_mutex_unlock(&thread_shards_lock);
+}
+
+static struct sccp_thread_shard *thread_shard_alloc(struct sccp_thread_shards *shards)
+{
+	struct sccp_thread_shard **array;
+	struct sccp_thread_shard *shard;
+	size_t capacity;
+
+	if (shards->count == shards->capacity) {
+		capacity = shards->capacity ? shards->capacity * 2 : 16;
+		array = ast_realloc(shards->shards, capacity * sizeof(*array));
+		if (!array) {
+			return NULL;
+		}
+
+		shards->shards = array;
+		shards->capacity = capacity;
+	}
+
+	shard = ast_calloc(1, sizeof(*shard));
+	if (!shard) {
+		return NULL;
+	}
+
+	shard->data = ast_calloc(1, shards->size);
+	if (!shard->data) {
+		ast_free(shard);
+		return NULL;
+	}
+
+	shard->owner = shards;
+	shards->shards[shards->count++] = shard;
+
+	return shard;
+}
+
+static void *thread_shard_take(struct sccp_thread_shards *shards)
+{
+	struct sccp_thread_shard *shard = NULL;
+	size_t i;
+
+	ast_mutex_lock(&thread_shards_lock);
+
+	if (!shards->key_created) {
+		if (pthread_key_create(&shards->key, thread_shard_release)) {
+			ast_log(LOG_ERROR, "thread shard take failed: pthread_key_create\n");
+			goto unlock;
+		}
+
+		__atomic_store_n(&shards->key_created, 1, __ATOMIC_RELEASE);
+	}
+
+	for (i = 0; i < shards->count; i++) {
+		if (!shards->shards[i]->in_use) {
+			shard = shards->shards[i];
+			break;
+		}
+	}
+
+	if (!shard) {
+		shard = thread_shard_alloc(shards);
+		if (!shard) {
+			goto unlock;
+		}
+	}
+
+	if (pthread_setspecific(shards->key, shard)) {
+		shard = NULL;
+		goto unlock;
+	}
+
+	shard->in_use = 1;
+
+unlock:
+	ast_mutex_unlock(&thread_shards_lock);
+
+	return shard ? shard->data : NULL;
+}
+
+void *sccp_thread_shards_get(struct sccp_thread_shards *shards)
+{
+	struct sccp_thread_shard *shard;
+
+	if (__atomic_load_n(&shards->key_created, __ATOMIC_ACQUIRE)) {
+		shard = pthread_getspecific(shards->key);
+		if (shard) {
+			return shard->data;
+		}
+	}
+
+	return thread_shard_take(shards);
+}
+
+void sccp_thread_shards_foreach(struct sccp_thread_shards *shards, void (*fn)(void *data, void *arg), void *arg)
+{
+	size_t i;
+
+	ast_mutex_lock(&thread_shards_lock);
+	for (i = 0; i < shards->count; i++) {
+		fn(shards->shards[i]->data, arg);
+	}
+	ast_mutex_unlock(&thread_shards_lock);
+}
+
+void sccp_thread_shards_destroy(struct sccp_thread_shards *shards, void (*free_data)(void *data))
+{
+	size_t i;
+
+	ast_mutex_lock(&thread_shards_lock);
+
+	/* the threads still running won't release their shard anymore */
+	if (shards->key_created) {
+		pthread_key_delete(shards->key);
+		__atomic_store_n(&shards->key_created, 0, __ATOMIC_RELAXED);
+	}
+
+	for (i = 0; i < shards->count; i++) {
+		if (free_data) {
+			free_data(shards->shards[i]->data);
+		}
+
+		ast_free(shards->shards[i]->data);
+		ast_free(shards->shards[i]);
+	}
+
+	ast_free(shards->shards);
+	shards->shards = NULL;
+	shards->count = 0;
+	shards->capacity = 0;
+
+	ast_mutex_unlock(&thread_shards_lock);
+}
+
+void sccp_seqlock_write_begin(struct sccp_seqlock *seqlock)
+{
+	__atomic_store_n(&seqlock->seq, seqlock->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void sccp_seqlock_write_end(struct sccp_seqlock *seqlock)
+{
+	__atomic_store_n(&seqlock->seq, seqlock->seq + 1, __ATOMIC_RELEASE);
+}
+
+unsigned int sccp_seqlock_read_begin(const struct sccp_seqlock *seqlock)
+{
+	unsigned int seq;
+
+	/* an odd value means a write is in progress */
+	while ((seq = __atomic_load_n(&seqlock->seq, __ATOMIC_ACQUIRE)) & 1) {
+		sched_yield();
+	}
+
+	return seq;
+}
+
+int sccp_seqlock_read_retry(const struct sccp_seqlock *seqlock, unsigned int seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&seqlock->seq, __ATOMIC_RELAXED) != seq;
+}
+
 int sccp_socket_set_tos(int sockfd, struct sccp_cfg *new_cfg, struct sccp_cfg *old_cfg)
 {
 	unsigned int tos = new_cfg->general_cfg->tos;
@@ -43,3 +278,20 @@ int sccp_socket_set_tos(int sockfd, struct sccp_cfg *new_cfg, struct sccp_cfg *o
 
 	return 0;
 }
+
+struct ast_format_cap *sccp_format_cap_single(struct ast_format *format, unsigned int framing)
+{
+	struct ast_format_cap *cap;
+
+	cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	if (!cap) {
+		return NULL;
+	}
+
+	if (ast_format_cap_append(cap, format, framing)) {
+		ao2_ref(cap, -1);
+		return NULL;
+	}
+
+	return cap;
+}
@@ -1,8 +1,12 @@
 #ifndef SCCP_UTILS_H_
 #define SCCP_UTILS_H_
 
+#include <pthread.h>
+#include <stddef.h>
 #include <time.h>
 
+struct ast_format;
+struct ast_format_cap;
 struct sccp_cfg;
 
 #if __BYTE_ORDER == __LITTLE_ENDIAN
@@ -23,6 +27,15 @@ struct sccp_stat {
 	time_t device_fault_last;
 	int device_panic_count;
 	time_t device_panic_last;
+	int connection_count;
+	int session_count;
+	int registration_count;
+	int registration_reject_count;
+	int reload_count;
+	/* in microseconds */
+	unsigned int reload_time_last;
+	unsigned int reload_time_max;
+	unsigned long long reload_time_total;
 };
 
 /*!
@@ -39,12 +52,143 @@ void sccp_stat_on_device_fault(void);
  */
 void sccp_stat_on_device_panic(void);
 
+/*!
+ * \brief Update the global connection count and the current session count.
+ *
+ * This function is thread safe.
+ */
+void sccp_stat_on_session_start(void);
+
+/*!
+ * \brief Update the current session count.
+ *
+ * This function is thread safe.
+ */
+void sccp_stat_on_session_end(void);
+
+/*!
+ * \brief Update the global registration count or registration reject count.
+ *
+ * This function is thread safe.
+ */
+void sccp_stat_on_registration(int rejected);
+
+/*!
+ * \brief Update the global reload count and reload times, in microseconds.
+ *
+ * \note Reloads are serialized by the module loader, so there's a single writer.
+ */
+void sccp_stat_on_reload(unsigned int time);
+
 /*!
  * \brief Take a snapshot of the global stat and copy it into dst.
  *
  */
 void sccp_stat_take_snapshot(struct sccp_stat *dst);
 
+/*!
+ * \brief Sequence lock, for small data with a single writer and lock-free readers.
+ *
+ * The writer brackets its updates with sccp_seqlock_write_begin/end. Readers copy the
+ * data between sccp_seqlock_read_begin and sccp_seqlock_read_retry, and start over
+ * if sccp_seqlock_read_retry returns non-zero.
+ */
+struct sccp_seqlock {
+	unsigned int seq;
+};
+
+/*!
+ * \brief Add n to a counter written by a single thread (or with a lock held) and read lock-free.
+ *
+ * The writers being serialized, a relaxed store is enough, i.e. no atomic read-modify-write.
+ */
+#define SCCP_STAT_INC(field, n) __atomic_store_n(&(field), (field) + (n), __ATOMIC_RELAXED)
+#define SCCP_STAT_SET(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+#define SCCP_STAT_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+/*!
+ * \brief Add n to a counter written by several threads, e.g. in a per CPU shard.
+ */
+#define SCCP_STAT_ADD(field, n) __atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED)
+
+#define SCCP_SEQLOCK_INIT { 0 }
+
+/*
+ * Number of shards of the per CPU counters, must be a power of 2. CPUs above that
+ * share a shard, which is still correct.
+ */
+#define SCCP_CPU_SHARDS 64
+#define SCCP_CACHE_LINE_SIZE 64
+
+/*!
+ * \brief Return the per CPU shard of the calling thread, in [0, SCCP_CPU_SHARDS).
+ *
+ * Threads can migrate at any time, so a shard may be updated by more than one thread:
+ * updates must still be atomic, but they rarely contend.
+ */
+unsigned int sccp_cpu_shard(void);
+
+struct sccp_thread_shard;
+
+/*!
+ * \brief Shards written by a single thread each, so that updates need no atomic
+ *        read-modify-write, only relaxed stores.
+ *
+ * A thread gets a shard of its own on its first call to sccp_thread_shards_get. When the
+ * thread exits, the shard keeps its values and is handed to the next thread needing one,
+ * so there are as many shards as threads ever updating them concurrently.
+ */
+struct sccp_thread_shards {
+	/* (static) size of the data of a shard */
+	size_t size;
+	/* the fields below are protected by the thread shards lock */
+	pthread_key_t key;
+	int key_created;
+	struct sccp_thread_shard **shards;
+	size_t count;
+	size_t capacity;
+};
+
+#define SCCP_THREAD_SHARDS_INIT(data_size) { .size = (data_size) }
+
+/*!
+ * \brief Return the zero-initialized data of the shard of the calling thread.
+ *
+ * \note Only the calling thread writes to the returned data, until it exits.
+ *
+ * \retval non-NULL on success
+ * \retval NULL on failure
+ */
+void *sccp_thread_shards_get(struct sccp_thread_shards *shards);
+
+/*!
+ * \brief Call fn on the data of every shard, including the ones of the threads that exited.
+ *
+ * \note The shards can be concurrently written, and must be read with relaxed loads.
+ */
+void sccp_thread_shards_foreach(struct sccp_thread_shards *shards, void (*fn)(void *data, void *arg), void *arg);
+
+/*!
+ * \brief Free the shards, calling free_data, if not NULL, on the data of each shard first.
+ *
+ * \note Must be called once no thread updates the shards anymore. The shards can then be
+ *       used again.
+ */
+void sccp_thread_shards_destroy(struct sccp_thread_shards *shards, void (*free_data)(void *data));
+
+/*!
+ * \note Writers must be serialized by the caller.
+ */
+void sccp_seqlock_write_begin(struct sccp_seqlock *seqlock);
+void sccp_seqlock_write_end(struct sccp_seqlock *seqlock);
+
+unsigned int sccp_seqlock_read_begin(const struct sccp_seqlock *seqlock);
+
+/*!
+ * \retval non-zero if the data read since the matching sccp_seqlock_read_begin might be inconsistent
+ */
+int sccp_seqlock_read_retry(const struct sccp_seqlock *seqlock, unsigned int seq);
+
 /*!
  * \brief Set the TOS / DSCP value on the given socket from the config.
  *
@@ -53,4 +197,16 @@ void sccp_stat_take_snapshot(struct sccp_stat *dst);
  */
 int sccp_socket_set_tos(int sockfd, struct sccp_cfg *new_cfg, struct sccp_cfg *old_cfg);
 
+/*!
+ * \brief Return a new capabilities object containing only the given format.
+ *
+ * \note The returned object is not shared, and can thus be set as the native formats
+ *       of a channel.
+ * \note The returned object has its reference count incremented by one.
+ *
+ * \retval non-NULL on success
+ * \retval NULL on failure
+ */
+struct ast_format_cap *sccp_format_cap_single(struct ast_format *format, unsigned int framing);
+
 #endif /* SCCP_UTILS_H_ */
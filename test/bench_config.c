@@ -0,0 +1,313 @@
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <asterisk.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/time.h>
+
+#include "../sccp_config.h"
+#include "harness.h"
+
+/*
+ * Time the load of configuration files generated like utils/sccp-confgen does, i.e. with
+ * one line per device, and report the peak RSS of each load.
+ *
+ * Three loads are measured for each size:
+ *
+ *  - the first load, parsing the file and writing the cache
+ *  - a reload, after the file has been changed
+ *  - the load at the next startup, from the cache, in a new process
+ */
+
+static const unsigned int default_sizes[] = { 1000, 10000, 50000 };
+
+struct bench_result {
+	unsigned int workers;
+	long load_time;
+	long load_peak;
+	long reload_time;
+	long reload_peak;
+	long cached_time;
+	long cached_peak;
+	int from_cache;
+	size_t cache_size;
+};
+
+static int write_confgen_config(const char *dir, unsigned int n)
+{
+	char path[PATH_MAX + sizeof("/sccp.conf")];
+	unsigned int i;
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/sccp.conf", dir);
+	file = fopen(path, "w");
+	if (!file) {
+		fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		fprintf(file, "\n[SEP%012u]\ntype = device\nline = %u\n", i, i);
+	}
+
+	fprintf(file, "\n");
+
+	for (i = 0; i < n; i++) {
+		fprintf(file, "\n[%u]\ntype = line\ncid_name = John\ncid_num = %u\n", i, i);
+	}
+
+	return fclose(file) ? -1 : 0;
+}
+
+static int append_comment(const char *dir)
+{
+	char path[PATH_MAX + sizeof("/sccp.conf")];
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/sccp.conf", dir);
+	file = fopen(path, "a");
+	if (!file) {
+		return -1;
+	}
+
+	fprintf(file, "; changed\n");
+
+	return fclose(file) ? -1 : 0;
+}
+
+static long elapsed_us(struct timeval start)
+{
+	return ast_tvdiff_us(ast_tvnow(), start);
+}
+
+/*
+ * Load the config from the file and reload it, like at the first startup.
+ */
+static int bench_load(const char *dir, unsigned int n, struct bench_result *result)
+{
+	struct timeval start;
+	struct sccp_cfg *cfg;
+
+	if (sccp_config_init()) {
+		return -1;
+	}
+
+	harness_reset_peak_rss();
+	start = ast_tvnow();
+	if (sccp_config_load()) {
+		fprintf(stderr, "could not load the config of %u devices\n", n);
+		sccp_config_destroy();
+		return -1;
+	}
+
+	result->load_time = elapsed_us(start);
+	result->load_peak = harness_peak_rss();
+
+	cfg = sccp_config_get();
+	result->workers = cfg->pre_apply_workers;
+	ao2_ref(cfg, -1);
+
+	if (append_comment(dir)) {
+		sccp_config_destroy();
+		return -1;
+	}
+
+	harness_reset_peak_rss();
+	start = ast_tvnow();
+	if (sccp_config_reload()) {
+		fprintf(stderr, "could not reload the config of %u devices\n", n);
+		sccp_config_destroy();
+		return -1;
+	}
+
+	result->reload_time = elapsed_us(start);
+	result->reload_peak = harness_peak_rss();
+
+	sccp_config_destroy();
+
+	return 0;
+}
+
+/*
+ * Load the config from the cache written by bench_load, like at the next startup.
+ */
+static int bench_cached_load(const char *dir, unsigned int n, struct bench_result *result)
+{
+	struct sccp_config_cache_status status;
+	struct timeval start;
+
+	if (sccp_config_init()) {
+		return -1;
+	}
+
+	harness_reset_peak_rss();
+	start = ast_tvnow();
+	if (sccp_config_load()) {
+		fprintf(stderr, "could not load the cached config of %u devices\n", n);
+		sccp_config_destroy();
+		return -1;
+	}
+
+	result->cached_time = elapsed_us(start);
+	result->cached_peak = harness_peak_rss();
+
+	sccp_config_cache_get_status(&status);
+	result->from_cache = status.loaded;
+	result->cache_size = status.size;
+
+	sccp_config_destroy();
+
+	return 0;
+}
+
+/*
+ * Run a benchmark in a child process, so that it starts with the memory of a new
+ * process, and read back the result it updated.
+ */
+static int run_child(int (*bench)(const char *dir, unsigned int n, struct bench_result *result),
+		const char *dir, unsigned int n, struct bench_result *result)
+{
+	int fds[2];
+	pid_t pid;
+	int status;
+	ssize_t len;
+
+	if (pipe(fds)) {
+		return -1;
+	}
+
+	pid = fork();
+	if (pid == -1) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+
+	if (!pid) {
+		close(fds[0]);
+		stub_set_dirs(dir, dir, dir);
+		if (bench(dir, n, result)) {
+			_exit(1);
+		}
+
+		len = write(fds[1], result, sizeof(*result));
+		_exit(len == sizeof(*result) ? 0 : 1);
+	}
+
+	close(fds[1]);
+	len = read(fds[0], result, sizeof(*result));
+	close(fds[0]);
+	waitpid(pid, &status, 0);
+
+	if (len != sizeof(*result) || !WIFEXITED(status) || WEXITSTATUS(status)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int run_size(unsigned int n, struct bench_result *result)
+{
+	char dir[PATH_MAX];
+	int ret = -1;
+
+	if (harness_mkdtemp(dir, sizeof(dir))) {
+		fprintf(stderr, "could not create a temporary directory: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (!write_confgen_config(dir, n) && !run_child(bench_load, dir, n, result) &&
+			!run_child(bench_cached_load, dir, n, result)) {
+		ret = 0;
+	}
+
+	harness_rmdir(dir);
+
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-v] [devices...]\n"
+		"\n"
+		"  devices  number of devices of each configuration file (default: 1000 10000 50000)\n"
+		"  -v       log the notices and debug messages of the driver\n",
+		prog);
+}
+
+int main(int argc, char *argv[])
+{
+#define FORMAT_STRING  "%-8s %-8s %-18s %-18s %-18s %-10s\n"
+#define FORMAT_STRING2 "%-8u %-8u %6ld ms %6ld MiB %6ld ms %6ld MiB %6ld ms %6ld MiB %6zu KiB\n"
+	struct bench_result result;
+	const unsigned int *sizes = default_sizes;
+	unsigned int *parsed = NULL;
+	size_t count = ARRAY_LEN(default_sizes);
+	size_t i;
+	int opt;
+	int ret = 0;
+
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		switch (opt) {
+		case 'v':
+			stub_option_verbose = 1;
+			stub_option_debug = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (optind < argc) {
+		count = argc - optind;
+		parsed = ast_calloc(count, sizeof(*parsed));
+		if (!parsed) {
+			return 1;
+		}
+
+		for (i = 0; i < count; i++) {
+			if (sscanf(argv[optind + i], "%u", &parsed[i]) != 1 || !parsed[i]) {
+				usage(argv[0]);
+				ast_free(parsed);
+				return 2;
+			}
+		}
+
+		sizes = parsed;
+	}
+
+	printf(FORMAT_STRING, "Devices", "Workers", "Load", "Reload", "Cached load", "Cache");
+	printf(FORMAT_STRING, "", "", "time, peak RSS", "time, peak RSS", "time, peak RSS", "size");
+
+	for (i = 0; i < count; i++) {
+		memset(&result, 0, sizeof(result));
+		if (run_size(sizes[i], &result)) {
+			fprintf(stderr, "benchmark of %u devices failed\n", sizes[i]);
+			ret = 1;
+			continue;
+		}
+
+		if (!result.from_cache) {
+			fprintf(stderr, "config of %u devices not loaded from the cache at the second startup\n", sizes[i]);
+			ret = 1;
+		}
+
+		printf(FORMAT_STRING2, sizes[i], result.workers,
+				result.load_time / 1000, result.load_peak / 1024,
+				result.reload_time / 1000, result.reload_peak / 1024,
+				result.cached_time / 1000, result.cached_peak / 1024, result.cache_size / 1024);
+	}
+
+	ast_free(parsed);
+
+	return ret;
+
+#undef FORMAT_STRING
+#undef FORMAT_STRING2
+}
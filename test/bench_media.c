@@ -0,0 +1,623 @@
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <asterisk.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/channel.h>
+#include <asterisk/format_cache.h>
+#include <asterisk/frame.h>
+#include <asterisk/utils.h>
+
+#include "../sccp_msg.h"
+#include "../sccp_utils.h"
+#include "harness.h"
+
+/*
+ * Measure the media path of a call while the device is handling signalling messages.
+ *
+ * A device registers over a loopback connection, dials, and opens its receive channel,
+ * like a phone would. Then the frames of the call are read and written through the
+ * channel tech callbacks, like the bridge of a call would do, and signalling rounds are
+ * sent by the device, each one made of a line status request, a time date request and a
+ * keep alive, whose acknowledgement ends the round.
+ *
+ * Each phase runs for the same duration: media only, signalling only, then both at
+ * the same time. Frames and rounds are sent as fast as possible.
+ */
+
+#define BENCH_DEVICE "SEP00000000BE7C"
+#define WAIT_MS 2000
+#define LATENCY_BUCKETS 40
+
+enum phase_flags {
+	PHASE_MEDIA = 1 << 0,
+	PHASE_SIGNALLING = 1 << 1,
+};
+
+/* latency, with a histogram of powers of 2 nanoseconds */
+struct latency {
+	unsigned long long count;
+	unsigned long long total;
+	unsigned long long max;
+	unsigned long long buckets[LATENCY_BUCKETS];
+};
+
+/* the device end of the connection, whose messages are read by a thread of its own */
+struct phone {
+	int sockfd;
+	pthread_t reader;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/* received messages, by message ID */
+	unsigned int received[0x200];
+	uint32_t call_id;
+	int closed;
+	int stop;
+};
+
+struct worker {
+	pthread_t thread;
+	struct ast_channel *channel;
+	struct phone *phone;
+	const int *stop;
+	struct latency latency;
+};
+
+static unsigned char payload[160];
+static struct ast_frame voice_frame = {
+	.frametype = AST_FRAME_VOICE,
+	.datalen = sizeof(payload),
+	.samples = sizeof(payload),
+	.data.ptr = payload,
+	.src = "bench media",
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void latency_add(struct latency *latency, unsigned long long ns)
+{
+	unsigned int bucket = 0;
+
+	latency->count++;
+	latency->total += ns;
+	if (ns > latency->max) {
+		latency->max = ns;
+	}
+
+	while (bucket < LATENCY_BUCKETS - 1 && ns >> (bucket + 1)) {
+		bucket++;
+	}
+
+	latency->buckets[bucket]++;
+}
+
+/*
+ * Return the upper bound of the bucket holding the 99th percentile, in nanoseconds.
+ */
+static unsigned long long latency_p99(const struct latency *latency)
+{
+	unsigned long long seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += latency->buckets[i];
+		if (seen * 100 >= latency->count * 99) {
+			break;
+		}
+	}
+
+	return 2ULL << i;
+}
+
+static void latency_print(const char *name, const struct latency *latency, const char *unit, double seconds)
+{
+	if (!latency->count) {
+		printf("  %-12s none\n", name);
+		return;
+	}
+
+	printf("  %-12s %10.0f %s/s   avg %8.2f us   p99 < %8.2f us   max %9.2f us\n", name,
+		latency->count / seconds, unit, latency->total / 1000.0 / latency->count,
+		latency_p99(latency) / 1000.0, latency->max / 1000.0);
+}
+
+static int phone_send(struct phone *phone, uint32_t msg_id, const void *body, size_t body_len)
+{
+	struct sccp_msg msg;
+	const char *buf = (const char *) &msg;
+	size_t count = SCCP_MSG_TOTAL_LEN_FROM_LEN(SCCP_MSG_LEN_FROM_DATA_LEN(body_len));
+	ssize_t n;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.length = htolel(SCCP_MSG_LEN_FROM_DATA_LEN(body_len));
+	msg.id = htolel(msg_id);
+	if (body_len) {
+		memcpy(&msg.data, body, body_len);
+	}
+
+	while (count) {
+		n = write(phone->sockfd, buf, count);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return -1;
+		}
+
+		buf += n;
+		count -= n;
+	}
+
+	return 0;
+}
+
+static void *phone_reader_run(void *data)
+{
+	struct phone *phone = data;
+	struct sccp_deserializer deserializer;
+	struct pollfd pfd = { .fd = phone->sockfd, .events = POLLIN };
+	struct sccp_msg *msg;
+	uint32_t msg_id;
+	int ret;
+
+	sccp_deserializer_init(&deserializer, phone->sockfd);
+
+	while (!__atomic_load_n(&phone->stop, __ATOMIC_RELAXED)) {
+		ret = poll(&pfd, 1, 100);
+		if (ret <= 0) {
+			if (ret == -1 && errno != EINTR) {
+				break;
+			}
+
+			continue;
+		}
+
+		if (sccp_deserializer_read(&deserializer)) {
+			break;
+		}
+
+		pthread_mutex_lock(&phone->lock);
+		while (!(ret = sccp_deserializer_pop(&deserializer, &msg))) {
+			msg_id = letohl(msg->id);
+			if (msg_id == OPEN_RECEIVE_CHANNEL_MESSAGE) {
+				phone->call_id = letohl(msg->data.openreceivechannel.conferenceId);
+			}
+
+			if (msg_id < ARRAY_LEN(phone->received)) {
+				phone->received[msg_id]++;
+			}
+		}
+		pthread_cond_broadcast(&phone->cond);
+		pthread_mutex_unlock(&phone->lock);
+
+		if (ret == SCCP_DESERIALIZER_MALFORMED) {
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&phone->lock);
+	phone->closed = 1;
+	pthread_cond_broadcast(&phone->cond);
+	pthread_mutex_unlock(&phone->lock);
+
+	return NULL;
+}
+
+static unsigned int phone_received(struct phone *phone, uint32_t msg_id)
+{
+	unsigned int count;
+
+	pthread_mutex_lock(&phone->lock);
+	count = phone->received[msg_id];
+	pthread_mutex_unlock(&phone->lock);
+
+	return count;
+}
+
+/*
+ * Wait until count messages of the given ID have been received.
+ */
+static int phone_wait(struct phone *phone, uint32_t msg_id, unsigned int count, int timeout_ms)
+{
+	struct timeval tv = ast_tvadd(ast_tvnow(), ast_samp2tv(timeout_ms, 1000));
+	struct timespec deadline = { .tv_sec = tv.tv_sec, .tv_nsec = tv.tv_usec * 1000 };
+	int ret = 0;
+
+	pthread_mutex_lock(&phone->lock);
+	while (phone->received[msg_id] < count && !phone->closed && !ret) {
+		ret = pthread_cond_timedwait(&phone->cond, &phone->lock, &deadline);
+	}
+
+	ret = phone->received[msg_id] < count ? -1 : 0;
+	pthread_mutex_unlock(&phone->lock);
+
+	return ret;
+}
+
+static int phone_start(struct phone *phone, int sockfd)
+{
+	memset(phone, 0, sizeof(*phone));
+	phone->sockfd = sockfd;
+	pthread_mutex_init(&phone->lock, NULL);
+	pthread_cond_init(&phone->cond, NULL);
+
+	if (ast_pthread_create(&phone->reader, NULL, phone_reader_run, phone)) {
+		pthread_cond_destroy(&phone->cond);
+		pthread_mutex_destroy(&phone->lock);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void phone_stop(struct phone *phone)
+{
+	__atomic_store_n(&phone->stop, 1, __ATOMIC_RELAXED);
+	pthread_join(phone->reader, NULL);
+	pthread_cond_destroy(&phone->cond);
+	pthread_mutex_destroy(&phone->lock);
+}
+
+static int press_button(struct phone *phone, uint32_t button)
+{
+	struct keypad_button_message keypad = { .button = htolel(button), .lineInstance = htolel(1) };
+
+	return phone_send(phone, KEYPAD_BUTTON_MESSAGE, &keypad, sizeof(keypad));
+}
+
+static struct ast_channel *wait_started_channel(void)
+{
+	struct ast_channel *channel;
+	int i;
+
+	for (i = 0; i < WAIT_MS; i++) {
+		channel = stub_channel_find_started();
+		if (channel) {
+			return channel;
+		}
+
+		usleep(1000);
+	}
+
+	return NULL;
+}
+
+/*
+ * Write frames until one is sent by RTP, i.e. until the media path is established.
+ */
+static int wait_media(struct ast_channel *channel)
+{
+	struct stub_rtp_stats stats;
+	int i;
+
+	for (i = 0; i < WAIT_MS; i++) {
+		stub_rtp_take_stats(&stats);
+		if (stats.frames_written) {
+			return 0;
+		}
+
+		stub_channel_write(channel, &voice_frame);
+		usleep(1000);
+	}
+
+	return -1;
+}
+
+/*
+ * Register the device, dial, and open the receive channel.
+ */
+static struct ast_channel *setup_call(struct phone *phone)
+{
+	struct register_message reg = {
+		.name = BENCH_DEVICE,
+		.lineInstance = htolel(1),
+		.type = htolel(SCCP_DEVICE_7940),
+		.maxStreams = htolel(5),
+		.protoVersion = 17,
+	};
+	struct capabilities_res_message caps = { .count = htolel(1) };
+	struct offhook_message offhook = { 0 };
+	struct open_receive_channel_ack_message ack = { 0 };
+	struct ast_channel *channel;
+
+	if (phone_send(phone, REGISTER_MESSAGE, &reg, sizeof(reg)) || phone_wait(phone, REGISTER_ACK_MESSAGE, 1, WAIT_MS)) {
+		fprintf(stderr, "device did not register\n");
+		return NULL;
+	}
+
+	caps.caps[0].codec = htolel(SCCP_CODEC_G711_ULAW);
+	caps.caps[0].frames = htolel(20);
+	if (phone_send(phone, CAPABILITIES_RES_MESSAGE, &caps, SCCP_MSG_BODY_LEN_UPTO(capabilities_res_message, caps[0]))) {
+		return NULL;
+	}
+
+	/* a line instance of 0 is a new call */
+	if (phone_send(phone, OFFHOOK_MESSAGE, &offhook, sizeof(offhook)) || press_button(phone, 1) || press_button(phone, 15)) {
+		return NULL;
+	}
+
+	channel = wait_started_channel();
+	if (!channel) {
+		fprintf(stderr, "call did not start\n");
+		return NULL;
+	}
+
+	/* the first frame written opens the receive channel, for early media */
+	stub_channel_write(channel, &voice_frame);
+	if (phone_wait(phone, OPEN_RECEIVE_CHANNEL_MESSAGE, 1, WAIT_MS)) {
+		fprintf(stderr, "receive channel not opened\n");
+		goto fail;
+	}
+
+	ack.ipAddr = htonl(INADDR_LOOPBACK);
+	ack.port = htolel(20000);
+	ack.passThruId = htolel(phone->call_id);
+	if (phone_send(phone, OPEN_RECEIVE_CHANNEL_ACK_MESSAGE, &ack, sizeof(ack)) || wait_media(channel)) {
+		fprintf(stderr, "media not established\n");
+		goto fail;
+	}
+
+	return channel;
+
+fail:
+	ao2_ref(channel, -1);
+
+	return NULL;
+}
+
+static void *reader_run(void *data)
+{
+	struct worker *worker = data;
+	unsigned long long start;
+
+	while (!__atomic_load_n(worker->stop, __ATOMIC_RELAXED)) {
+		start = now_ns();
+		stub_channel_read(worker->channel, 0);
+		latency_add(&worker->latency, now_ns() - start);
+	}
+
+	return NULL;
+}
+
+static void *writer_run(void *data)
+{
+	struct worker *worker = data;
+	unsigned long long start;
+
+	while (!__atomic_load_n(worker->stop, __ATOMIC_RELAXED)) {
+		start = now_ns();
+		stub_channel_write(worker->channel, &voice_frame);
+		latency_add(&worker->latency, now_ns() - start);
+	}
+
+	return NULL;
+}
+
+static void *signalling_run(void *data)
+{
+	struct worker *worker = data;
+	struct phone *phone = worker->phone;
+	struct line_status_req_message line = { .lineInstance = htolel(1) };
+	unsigned long long start;
+	unsigned int acks = phone_received(phone, KEEP_ALIVE_ACK_MESSAGE);
+
+	while (!__atomic_load_n(worker->stop, __ATOMIC_RELAXED)) {
+		start = now_ns();
+		if (phone_send(phone, LINE_STATUS_REQ_MESSAGE, &line, sizeof(line)) ||
+				phone_send(phone, TIME_DATE_REQ_MESSAGE, NULL, 0) ||
+				phone_send(phone, KEEP_ALIVE_MESSAGE, NULL, 0) ||
+				phone_wait(phone, KEEP_ALIVE_ACK_MESSAGE, ++acks, WAIT_MS)) {
+			fprintf(stderr, "signalling round failed\n");
+			break;
+		}
+
+		latency_add(&worker->latency, now_ns() - start);
+	}
+
+	return NULL;
+}
+
+static int run_phase(const char *name, unsigned int flags, struct ast_channel *channel, struct phone *phone, int duration)
+{
+	struct worker workers[3];
+	struct stub_rtp_stats before;
+	struct stub_rtp_stats after;
+	void *(*run[3])(void *) = { reader_run, writer_run, signalling_run };
+	int enabled[3] = { flags & PHASE_MEDIA, flags & PHASE_MEDIA, flags & PHASE_SIGNALLING };
+	int stop = 0;
+	double seconds;
+	unsigned long long start;
+	int ret = 0;
+	int i;
+
+	memset(workers, 0, sizeof(workers));
+	stub_rtp_take_stats(&before);
+	start = now_ns();
+
+	for (i = 0; i < 3; i++) {
+		workers[i].channel = channel;
+		workers[i].phone = phone;
+		workers[i].stop = &stop;
+		if (enabled[i] && ast_pthread_create(&workers[i].thread, NULL, run[i], &workers[i])) {
+			enabled[i] = 0;
+			ret = -1;
+		}
+	}
+
+	sleep(duration);
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+	for (i = 0; i < 3; i++) {
+		if (enabled[i]) {
+			pthread_join(workers[i].thread, NULL);
+		}
+	}
+
+	seconds = (now_ns() - start) / 1e9;
+	stub_rtp_take_stats(&after);
+
+	printf("%s\n", name);
+	if (flags & PHASE_MEDIA) {
+		latency_print("read", &workers[0].latency, "frames", seconds);
+		latency_print("write", &workers[1].latency, "frames", seconds);
+
+		/* every frame must have gone through RTP, none dropped by the driver */
+		if (after.frames_read - before.frames_read != workers[0].latency.count ||
+				after.frames_written - before.frames_written != workers[1].latency.count) {
+			fprintf(stderr, "frames were not read from or written to RTP\n");
+			ret = -1;
+		}
+	}
+
+	if (flags & PHASE_SIGNALLING) {
+		latency_print("signalling", &workers[2].latency, "rounds", seconds);
+		if (!workers[2].latency.count) {
+			ret = -1;
+		}
+	}
+
+	return ret;
+}
+
+static int write_config(const char *dir)
+{
+	char path[PATH_MAX + sizeof("/sccp.conf")];
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/sccp.conf", dir);
+	file = fopen(path, "w");
+	if (!file) {
+		fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	fprintf(file,
+		"[general]\n"
+		"\n"
+		"[" BENCH_DEVICE "]\n"
+		"type = device\n"
+		"line = bench\n"
+		"\n"
+		"[bench]\n"
+		"type = line\n"
+		"context = default\n");
+
+	return fclose(file) ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct harness harness;
+	struct harness_session hs;
+	struct phone phone;
+	struct stub_channel_stats stats;
+	struct ast_channel *channel;
+	struct onhook_message onhook = { 0 };
+	int i;
+	char dir[PATH_MAX];
+	int duration = 2;
+	int opt;
+	int ret = 1;
+
+	while ((opt = getopt(argc, argv, "d:v")) != -1) {
+		switch (opt) {
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'v':
+			stub_option_verbose = 1;
+			stub_option_debug = 1;
+			break;
+		default:
+			duration = 0;
+			break;
+		}
+	}
+
+	if (duration <= 0 || optind != argc) {
+		fprintf(stderr,
+			"usage: %s [-d seconds] [-v]\n"
+			"\n"
+			"  -d  duration of each phase, in seconds (default: 2)\n"
+			"  -v  log the notices and debug messages of the driver\n",
+			argv[0]);
+		return 2;
+	}
+
+	voice_frame.subclass.format = ast_format_ulaw;
+
+	if (harness_mkdtemp(dir, sizeof(dir))) {
+		fprintf(stderr, "could not create a temporary directory: %s\n", strerror(errno));
+		return 1;
+	}
+
+	if (write_config(dir) || harness_start(&harness, dir)) {
+		goto end;
+	}
+
+	if (harness_session_start(&harness, &hs, NULL)) {
+		goto end_harness;
+	}
+
+	if (phone_start(&phone, hs.sockfd)) {
+		goto end_session;
+	}
+
+	channel = setup_call(&phone);
+	if (!channel) {
+		goto end_phone;
+	}
+
+	printf("One call on device " BENCH_DEVICE ", %d s per phase\n\n", duration);
+
+	ret = 0;
+	ret |= run_phase("media only", PHASE_MEDIA, channel, &phone, duration);
+	ret |= run_phase("signalling only", PHASE_SIGNALLING, channel, &phone, duration);
+	ret |= run_phase("media and signalling", PHASE_MEDIA | PHASE_SIGNALLING, channel, &phone, duration);
+	ret = ret ? 1 : 0;
+
+	ao2_ref(channel, -1);
+
+	/* the call instance is the one of the receive channel */
+	onhook.lineInstance = htolel(1);
+	onhook.callInstance = htolel(phone.call_id);
+	phone_send(&phone, ONHOOK_MESSAGE, &onhook, sizeof(onhook));
+	for (i = 0; i < WAIT_MS; i++) {
+		stub_channels_take_stats(&stats);
+		if (!stats.live) {
+			break;
+		}
+
+		usleep(1000);
+	}
+
+	if (stats.live) {
+		fprintf(stderr, "call not hung up after onhook\n");
+		ret = 1;
+	}
+
+end_phone:
+	phone_stop(&phone);
+end_session:
+	harness_session_stop(&hs);
+end_harness:
+	harness_stop(&harness);
+end:
+	harness_rmdir(dir);
+
+	return ret;
+}
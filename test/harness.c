@@ -0,0 +1,316 @@
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include <asterisk.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/channel.h>
+#include <asterisk/format_cap.h>
+#include <asterisk/module.h>
+
+#include "../device/sccp_channel_tech.h"
+#include "../sccp.h"
+#include "../sccp_config.h"
+#include "../sccp_device.h"
+#include "../sccp_device_registry.h"
+#include "../sccp_devstate_cache.h"
+#include "../sccp_lock_profile.h"
+#include "../sccp_msg_stats.h"
+#include "../sccp_rtp_pool.h"
+#include "../sccp_sched.h"
+#include "../sccp_session.h"
+#include "../sccp_utils.h"
+#include "harness.h"
+
+static struct ast_module_info module_info;
+
+const struct ast_module_info *sccp_module_info = &module_info;
+
+/* like the one of sccp.c, without the callbacks looking up the global registry */
+struct ast_channel_tech sccp_tech = {
+	.type = "sccp",
+	.description = "Skinny Client Control Protocol",
+	.properties = AST_CHAN_TP_WANTSJITTER | AST_CHAN_TP_CREATESJITTER,
+	.call = sccp_channel_tech_call,
+	.hangup = sccp_channel_tech_hangup,
+	.answer = sccp_channel_tech_answer,
+	.read = sccp_channel_tech_read,
+	.write = sccp_channel_tech_write,
+	.indicate = sccp_channel_tech_indicate,
+	.fixup = sccp_channel_tech_fixup,
+	.send_digit_end = sccp_channel_tech_send_digit_end,
+	.func_channel_read = sccp_channel_tech_acf_channel_read,
+};
+
+int harness_start(struct harness *harness, const char *config_dir)
+{
+	harness->cfg = NULL;
+	harness->registry = NULL;
+
+	stub_set_dirs(config_dir, config_dir, config_dir);
+
+	if (stub_channels_init()) {
+		return -1;
+	}
+
+	sccp_tech.capabilities = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	if (!sccp_tech.capabilities) {
+		goto fail1;
+	}
+
+	ast_format_cap_append_by_type(sccp_tech.capabilities, AST_MEDIA_TYPE_AUDIO);
+
+	if (sccp_config_init()) {
+		goto fail2;
+	}
+
+	if (sccp_config_load()) {
+		goto fail3;
+	}
+
+	if (sccp_devstate_cache_init()) {
+		goto fail3;
+	}
+
+	sccp_device_task_pool_init();
+
+	harness->cfg = sccp_config_get();
+	harness->registry = sccp_device_registry_create(harness->cfg);
+	if (!harness->registry) {
+		goto fail4;
+	}
+
+	if (sccp_sched_init()) {
+		goto fail5;
+	}
+
+	if (sccp_rtp_pool_init()) {
+		goto fail6;
+	}
+
+	sccp_rtp_pool_set_size(harness->cfg->general_cfg->rtp_pool_size);
+
+	return 0;
+
+fail6:
+	sccp_sched_destroy();
+fail5:
+	sccp_device_registry_destroy(harness->registry);
+fail4:
+	sccp_device_task_pool_destroy();
+	sccp_lock_profile_destroy();
+	sccp_devstate_cache_destroy();
+fail3:
+	ao2_cleanup(harness->cfg);
+	sccp_config_destroy();
+fail2:
+	ao2_ref(sccp_tech.capabilities, -1);
+fail1:
+	stub_channels_destroy();
+
+	return -1;
+}
+
+void harness_stop(struct harness *harness)
+{
+	/* the channels still up are hung up first, since they reference the devices */
+	stub_channels_destroy();
+	sccp_rtp_pool_destroy();
+	sccp_sched_destroy();
+	sccp_device_registry_destroy(harness->registry);
+	sccp_device_task_pool_destroy();
+	sccp_lock_profile_destroy();
+	sccp_msg_stats_destroy();
+	sccp_devstate_cache_destroy();
+	ao2_ref(harness->cfg, -1);
+	sccp_config_destroy();
+	ao2_ref(sccp_tech.capabilities, -1);
+}
+
+static int loopback_connect(int *client_fd, int *server_fd, struct sockaddr_in *client_addr)
+{
+	struct sockaddr_in addr = { .sin_family = AF_INET };
+	socklen_t addrlen = sizeof(addr);
+	int listen_fd;
+	int ret = -1;
+
+	*client_fd = -1;
+	*server_fd = -1;
+
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd == -1) {
+		ast_log(LOG_ERROR, "harness session start failed: socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(listen_fd, 1) ||
+			getsockname(listen_fd, (struct sockaddr *) &addr, &addrlen)) {
+		ast_log(LOG_ERROR, "harness session start failed: listen: %s\n", strerror(errno));
+		goto end;
+	}
+
+	*client_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (*client_fd == -1 || connect(*client_fd, (struct sockaddr *) &addr, sizeof(addr))) {
+		ast_log(LOG_ERROR, "harness session start failed: connect: %s\n", strerror(errno));
+		goto end;
+	}
+
+	addrlen = sizeof(*client_addr);
+	*server_fd = accept(listen_fd, (struct sockaddr *) client_addr, &addrlen);
+	if (*server_fd == -1) {
+		ast_log(LOG_ERROR, "harness session start failed: accept: %s\n", strerror(errno));
+		goto end;
+	}
+
+	ret = 0;
+
+end:
+	if (ret && *client_fd != -1) {
+		close(*client_fd);
+		*client_fd = -1;
+	}
+
+	close(listen_fd);
+
+	return ret;
+}
+
+static void *session_run(void *data)
+{
+	sccp_session_run(data);
+
+	return NULL;
+}
+
+int harness_session_start(struct harness *harness, struct harness_session *hs, struct sccp_session_msg_timing *timing)
+{
+	struct sockaddr_in client_addr;
+	int server_fd;
+
+	hs->session = NULL;
+
+	if (loopback_connect(&hs->sockfd, &server_fd, &client_addr)) {
+		return -1;
+	}
+
+	hs->session = sccp_session_create(harness->cfg, harness->registry, &client_addr, server_fd);
+	if (!hs->session) {
+		close(server_fd);
+		goto fail;
+	}
+
+	if (timing) {
+		sccp_session_set_msg_timing(hs->session, timing);
+	}
+
+	if (ast_pthread_create(&hs->thread, NULL, session_run, hs->session)) {
+		ast_log(LOG_ERROR, "harness session start failed: pthread create\n");
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	ao2_cleanup(hs->session);
+	hs->session = NULL;
+	close(hs->sockfd);
+	hs->sockfd = -1;
+
+	return -1;
+}
+
+void harness_session_stop(struct harness_session *hs)
+{
+	sccp_session_stop(hs->session);
+	pthread_join(hs->thread, NULL);
+	ao2_ref(hs->session, -1);
+	hs->session = NULL;
+	close(hs->sockfd);
+	hs->sockfd = -1;
+}
+
+static long read_status_kib(const char *field)
+{
+	char line[256];
+	size_t len = strlen(field);
+	long value = -1;
+	FILE *fp;
+
+	fp = fopen("/proc/self/status", "r");
+	if (!fp) {
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (!strncmp(line, field, len) && line[len] == ':') {
+			value = strtol(line + len + 1, NULL, 10);
+			break;
+		}
+	}
+
+	fclose(fp);
+
+	return value;
+}
+
+long harness_peak_rss(void)
+{
+	return read_status_kib("VmHWM");
+}
+
+long harness_rss(void)
+{
+	return read_status_kib("VmRSS");
+}
+
+int harness_reset_peak_rss(void)
+{
+	FILE *fp;
+	int ret;
+
+	fp = fopen("/proc/self/clear_refs", "w");
+	if (!fp) {
+		return -1;
+	}
+
+	ret = fputs("5", fp) < 0;
+	ret |= fclose(fp) != 0;
+
+	return ret;
+}
+
+int harness_mkdtemp(char *buf, size_t size)
+{
+	const char *tmpdir = getenv("TMPDIR");
+
+	snprintf(buf, size, "%s/sccp-test-XXXXXX", tmpdir ? tmpdir : "/tmp");
+
+	return mkdtemp(buf) ? 0 : -1;
+}
+
+void harness_rmdir(const char *path)
+{
+	struct dirent *entry;
+	char file[PATH_MAX];
+	DIR *dir;
+
+	dir = opendir(path);
+	if (!dir) {
+		return;
+	}
+
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+
+		snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+		unlink(file);
+	}
+
+	closedir(dir);
+	rmdir(path);
+}
@@ -0,0 +1,91 @@
+#ifndef HARNESS_H_
+#define HARNESS_H_
+
+#include <pthread.h>
+#include <stddef.h>
+
+struct sccp_cfg;
+struct sccp_device_registry;
+struct sccp_session;
+struct sccp_session_msg_timing;
+
+/*
+ * The harness starts the parts of the driver the tests and benchmarks need, like
+ * load_module does, but against the stubbed Asterisk APIs and with a registry of its
+ * own, i.e. without the server nor the global registry.
+ */
+
+struct harness {
+	struct sccp_cfg *cfg;
+	struct sccp_device_registry *registry;
+};
+
+/*!
+ * \brief Load sccp.conf from config_dir, and start the driver.
+ *
+ * The config cache is written to, and read from, config_dir.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int harness_start(struct harness *harness, const char *config_dir);
+
+/*!
+ * \brief Stop the driver, once every session has been stopped.
+ */
+void harness_stop(struct harness *harness);
+
+struct harness_session {
+	struct sccp_session *session;
+	/* the device end of the connection */
+	int sockfd;
+	pthread_t thread;
+};
+
+/*!
+ * \brief Connect a new session over the loopback interface, and run it in a thread.
+ *
+ * \param timing if not NULL, the message timing of the session
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int harness_session_start(struct harness *harness, struct harness_session *hs, struct sccp_session_msg_timing *timing);
+
+/*!
+ * \brief Stop the session, wait for its thread, and close the device end of the connection.
+ */
+void harness_session_stop(struct harness_session *hs);
+
+/*!
+ * \brief Return the peak resident set size of the process, in KiB.
+ */
+long harness_peak_rss(void);
+
+/*!
+ * \brief Reset the peak resident set size to the current one, if the kernel supports it.
+ *
+ * \retval 0 on success
+ * \retval non-zero if the peak can't be reset
+ */
+int harness_reset_peak_rss(void);
+
+/*!
+ * \brief Return the current resident set size of the process, in KiB.
+ */
+long harness_rss(void);
+
+/*!
+ * \brief Create a temporary directory, whose path is written to buf.
+ *
+ * \retval 0 on success
+ * \retval non-zero on failure
+ */
+int harness_mkdtemp(char *buf, size_t size);
+
+/*!
+ * \brief Remove the directory and the files it contains.
+ */
+void harness_rmdir(const char *path);
+
+#endif /* HARNESS_H_ */
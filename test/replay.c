@@ -0,0 +1,718 @@
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+
+#include <asterisk.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/network.h>
+#include <asterisk/utils.h>
+
+#include "../sccp_config.h"
+#include "../sccp_msg.h"
+#include "../sccp_msg_stats.h"
+#include "../sccp_session.h"
+#include "../sccp_utils.h"
+#include "harness.h"
+
+/*
+ * Replay the messages a device sent in a capture file against a new session.
+ *
+ * The messages of the first device registering in the pcap file are sent, over a
+ * loopback connection, to a session running like any other, i.e. decoding them with
+ * sccp_deserializer_pop and handling them with sccp_session_handle_msg and
+ * sccp_device_handle_msg. The messages received back are compared, by message ID, with
+ * the ones recorded, and the time spent handling each type of message is reported.
+ *
+ * The session uses a registry of its own and the stubbed Asterisk APIs, so the replayed
+ * device places no real call.
+ */
+
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_MAGIC_SWAPPED 0xd4c3b2a1
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAP_LINKTYPE_RAW 101
+#define PCAP_LINKTYPE_LINUX_SLL 113
+#define PCAP_MAX_PACKET_LEN 262144
+
+/* a recorded response is looked for in the next few ones before being unexpected */
+#define REPLAY_RESYNC_WINDOW 8
+/* the replay ends once no message has been received for that long */
+#define REPLAY_IDLE_MS 1000
+#define REPLAY_MAX_REPORTED 20
+
+struct replay_msg {
+	struct timeval tv;
+	/* non-zero if sent by the device */
+	int inbound;
+	size_t len;
+	char *data;
+};
+
+struct replay_msgs {
+	struct replay_msg *msgs;
+	size_t count;
+	size_t size;
+};
+
+/* one direction of the TCP connection, reassembled */
+struct replay_stream {
+	int started;
+	uint32_t next_seq;
+	char buf[sizeof(((struct sccp_deserializer *) 0)->buf)];
+	size_t len;
+};
+
+struct replay_capture {
+	int found;
+	struct in_addr device_addr;
+	uint16_t device_port;
+	struct in_addr server_addr;
+	uint16_t server_port;
+	struct replay_stream streams[2];
+	unsigned int skipped;
+};
+
+enum replay_speed {
+	/* messages are sent with their original spacing */
+	REPLAY_ORIGINAL,
+	/* messages are sent as fast as possible */
+	REPLAY_MAX,
+};
+
+struct replay {
+	int sockfd;
+	struct replay_msgs *msgs;
+	struct sccp_deserializer deserializer;
+	/* index of the next recorded response */
+	size_t expected;
+	/* last message sent, and number of messages sent */
+	const struct replay_msg *last_sent;
+	unsigned int sent;
+	unsigned int matched;
+	unsigned int missing;
+	unsigned int unexpected;
+	unsigned int reported;
+	/* when the last message was sent or received */
+	struct timeval last_activity;
+};
+
+static uint32_t msg_id_of(const char *data)
+{
+	uint32_t id;
+
+	memcpy(&id, data + 8, sizeof(id));
+
+	return letohl(id);
+}
+
+static int replay_msgs_add(struct replay_msgs *msgs, const struct timeval *tv, int inbound, const char *data, size_t len)
+{
+	struct replay_msg *tmp;
+	struct replay_msg *msg;
+
+	if (msgs->count == msgs->size) {
+		tmp = ast_realloc(msgs->msgs, (msgs->size ? msgs->size * 2 : 64) * sizeof(*tmp));
+		if (!tmp) {
+			return -1;
+		}
+
+		msgs->msgs = tmp;
+		msgs->size = msgs->size ? msgs->size * 2 : 64;
+	}
+
+	msg = &msgs->msgs[msgs->count];
+	msg->data = ast_malloc(len);
+	if (!msg->data) {
+		return -1;
+	}
+
+	memcpy(msg->data, data, len);
+	msg->len = len;
+	msg->tv = *tv;
+	msg->inbound = inbound;
+	msgs->count++;
+
+	return 0;
+}
+
+static void replay_msgs_destroy(struct replay_msgs *msgs)
+{
+	size_t i;
+
+	for (i = 0; i < msgs->count; i++) {
+		ast_free(msgs->msgs[i].data);
+	}
+
+	ast_free(msgs->msgs);
+}
+
+static int replay_stream_add(struct replay_stream *stream, struct replay_msgs *msgs, const struct timeval *tv, int inbound,
+		uint32_t seq, const char *payload, size_t len)
+{
+	uint32_t msg_length;
+	size_t total_length;
+
+	if (!stream->started) {
+		stream->started = 1;
+		stream->next_seq = seq;
+	}
+
+	/* retransmissions and reordered segments are ignored */
+	if (seq != stream->next_seq) {
+		return 1;
+	}
+
+	if (len > sizeof(stream->buf) - stream->len) {
+		ast_log(LOG_WARNING, "sccp replay failed: message too large\n");
+		return -1;
+	}
+
+	stream->next_seq += len;
+	memcpy(&stream->buf[stream->len], payload, len);
+	stream->len += len;
+
+	while (stream->len >= SCCP_MSG_MIN_TOTAL_LEN) {
+		memcpy(&msg_length, stream->buf, sizeof(msg_length));
+		total_length = SCCP_MSG_TOTAL_LEN_FROM_LEN(letohl(msg_length));
+		if (total_length < SCCP_MSG_MIN_TOTAL_LEN || total_length > sizeof(stream->buf)) {
+			ast_log(LOG_WARNING, "sccp replay failed: malformed message\n");
+			return -1;
+		}
+
+		if (stream->len < total_length) {
+			break;
+		}
+
+		if (replay_msgs_add(msgs, tv, inbound, stream->buf, total_length)) {
+			return -1;
+		}
+
+		stream->len -= total_length;
+		memmove(stream->buf, &stream->buf[total_length], stream->len);
+	}
+
+	return 0;
+}
+
+/*
+ * Return the offset of the IPv4 header in the packet, or -1 if it isn't IPv4.
+ */
+static int link_header_len(uint32_t linktype, const uint8_t *packet, size_t len)
+{
+	switch (linktype) {
+	case PCAP_LINKTYPE_RAW:
+		return 0;
+	case PCAP_LINKTYPE_ETHERNET:
+		if (len < 14 || packet[12] != 0x08 || packet[13] != 0x00) {
+			return -1;
+		}
+
+		return 14;
+	case PCAP_LINKTYPE_LINUX_SLL:
+		if (len < 16 || packet[14] != 0x08 || packet[15] != 0x00) {
+			return -1;
+		}
+
+		return 16;
+	}
+
+	return -1;
+}
+
+static int capture_add_packet(struct replay_capture *capture, struct replay_msgs *msgs, const struct timeval *tv, uint32_t linktype,
+		const uint8_t *packet, size_t len)
+{
+	const uint8_t *ip;
+	const uint8_t *tcp;
+	struct in_addr src;
+	struct in_addr dst;
+	uint16_t sport;
+	uint16_t dport;
+	uint32_t seq;
+	size_t ip_len;
+	size_t ip_header_len;
+	size_t tcp_header_len;
+	int offset;
+	int inbound;
+	int ret;
+
+	offset = link_header_len(linktype, packet, len);
+	if (offset < 0 || len - offset < 20) {
+		return 0;
+	}
+
+	ip = packet + offset;
+	ip_header_len = (ip[0] & 0x0f) * 4;
+	ip_len = (ip[2] << 8) | ip[3];
+	if ((ip[0] >> 4) != 4 || ip[9] != IPPROTO_TCP || ip_header_len < 20 || ip_len > len - offset || ip_header_len + 20 > ip_len) {
+		return 0;
+	}
+
+	tcp = ip + ip_header_len;
+	tcp_header_len = (tcp[12] >> 4) * 4;
+	if (tcp_header_len < 20 || ip_header_len + tcp_header_len > ip_len) {
+		return 0;
+	}
+
+	memcpy(&src, &ip[12], sizeof(src));
+	memcpy(&dst, &ip[16], sizeof(dst));
+	sport = (tcp[0] << 8) | tcp[1];
+	dport = (tcp[2] << 8) | tcp[3];
+	seq = ((uint32_t) tcp[4] << 24) | (tcp[5] << 16) | (tcp[6] << 8) | tcp[7];
+	len = ip_len - ip_header_len - tcp_header_len;
+	packet = tcp + tcp_header_len;
+
+	if (!len) {
+		return 0;
+	}
+
+	/* the session replayed is the one of the first device registering */
+	if (!capture->found) {
+		if (len < SCCP_MSG_MIN_TOTAL_LEN || msg_id_of((const char *) packet) != REGISTER_MESSAGE) {
+			return 0;
+		}
+
+		capture->found = 1;
+		capture->device_addr = src;
+		capture->device_port = sport;
+		capture->server_addr = dst;
+		capture->server_port = dport;
+	}
+
+	if (src.s_addr == capture->device_addr.s_addr && sport == capture->device_port &&
+			dst.s_addr == capture->server_addr.s_addr && dport == capture->server_port) {
+		inbound = 1;
+	} else if (src.s_addr == capture->server_addr.s_addr && sport == capture->server_port &&
+			dst.s_addr == capture->device_addr.s_addr && dport == capture->device_port) {
+		inbound = 0;
+	} else {
+		return 0;
+	}
+
+	ret = replay_stream_add(&capture->streams[inbound], msgs, tv, inbound, seq, (const char *) packet, len);
+	if (ret > 0) {
+		capture->skipped++;
+		return 0;
+	}
+
+	return ret;
+}
+
+static int load_capture(const char *path, struct replay_msgs *msgs)
+{
+	struct replay_capture *capture;
+	uint32_t header[6];
+	uint32_t record[4];
+	uint8_t *packet = NULL;
+	struct timeval tv;
+	int swapped;
+	int ret = -1;
+	int i;
+	FILE *file;
+
+	file = fopen(path, "r");
+	if (!file) {
+		printf("Could not open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	capture = ast_calloc(1, sizeof(*capture));
+	packet = ast_malloc(PCAP_MAX_PACKET_LEN);
+	if (!capture || !packet) {
+		goto end;
+	}
+
+	if (fread(header, sizeof(header), 1, file) != 1 || (header[0] != PCAP_MAGIC && header[0] != PCAP_MAGIC_SWAPPED)) {
+		printf("%s is not a pcap file\n", path);
+		goto end;
+	}
+
+	swapped = header[0] == PCAP_MAGIC_SWAPPED;
+	if (swapped) {
+		header[5] = __builtin_bswap32(header[5]);
+	}
+
+	while (fread(record, sizeof(record), 1, file) == 1) {
+		if (swapped) {
+			for (i = 0; i < 4; i++) {
+				record[i] = __builtin_bswap32(record[i]);
+			}
+		}
+
+		if (record[2] > PCAP_MAX_PACKET_LEN || fread(packet, 1, record[2], file) != record[2]) {
+			printf("%s is truncated\n", path);
+			goto end;
+		}
+
+		tv.tv_sec = record[0];
+		tv.tv_usec = record[1];
+		if (capture_add_packet(capture, msgs, &tv, header[5], packet, record[2])) {
+			printf("%s has malformed SCCP messages\n", path);
+			goto end;
+		}
+	}
+
+	if (!msgs->count) {
+		printf("%s has no device registering\n", path);
+		goto end;
+	}
+
+	printf("Replaying device at %s:%u, %zu messages, %u segments ignored\n", ast_inet_ntoa(capture->device_addr),
+			capture->device_port, msgs->count, capture->skipped);
+
+	ret = 0;
+
+end:
+	ast_free(packet);
+	ast_free(capture);
+	fclose(file);
+
+	return ret;
+}
+
+static void report_divergence(struct replay *replay, const char *what, uint32_t msg_id)
+{
+	const char *after = "start";
+
+	if (replay->reported++ >= REPLAY_MAX_REPORTED) {
+		return;
+	}
+
+	if (replay->last_sent) {
+		after = sccp_msg_id_str(msg_id_of(replay->last_sent->data));
+	}
+
+	printf("  %s %s (0x%04X), after %s #%u\n", what, sccp_msg_id_str(msg_id), msg_id, after, replay->sent);
+}
+
+/*
+ * Return the index of the next recorded response, starting at from, or the count of
+ * messages if there's none.
+ */
+static size_t next_expected(struct replay *replay, size_t from)
+{
+	while (from < replay->msgs->count && replay->msgs->msgs[from].inbound) {
+		from++;
+	}
+
+	return from;
+}
+
+static void check_response(struct replay *replay, uint32_t msg_id)
+{
+	struct replay_msg *msgs = replay->msgs->msgs;
+	size_t i = next_expected(replay, replay->expected);
+	int n;
+
+	for (n = 0; n < REPLAY_RESYNC_WINDOW && i < replay->msgs->count; n++) {
+		if (msg_id_of(msgs[i].data) == msg_id) {
+			break;
+		}
+
+		i = next_expected(replay, i + 1);
+	}
+
+	if (n == REPLAY_RESYNC_WINDOW || i == replay->msgs->count) {
+		replay->unexpected++;
+		report_divergence(replay, "unexpected", msg_id);
+		return;
+	}
+
+	/* the recorded responses skipped are missing */
+	for (replay->expected = next_expected(replay, replay->expected); replay->expected < i;
+			replay->expected = next_expected(replay, replay->expected + 1)) {
+		replay->missing++;
+		report_divergence(replay, "missing", msg_id_of(msgs[replay->expected].data));
+	}
+
+	replay->matched++;
+	replay->expected = i + 1;
+}
+
+/*
+ * Read the responses of the session, waiting at most timeout ms for the first.
+ *
+ * Return 1 if responses were read, 0 if none, or -1 if the session closed the connection.
+ */
+static int read_responses(struct replay *replay, int timeout)
+{
+	struct pollfd pfd = { .fd = replay->sockfd, .events = POLLIN };
+	struct sccp_msg *msg;
+	int ret;
+
+	ret = poll(&pfd, 1, timeout);
+	if (ret == -1) {
+		return errno == EINTR ? 0 : -1;
+	} else if (!ret) {
+		return 0;
+	}
+
+	if (sccp_deserializer_read(&replay->deserializer)) {
+		return -1;
+	}
+
+	replay->last_activity = ast_tvnow();
+
+	while (!(ret = sccp_deserializer_pop(&replay->deserializer, &msg))) {
+		check_response(replay, letohl(msg->id));
+	}
+
+	return ret == SCCP_DESERIALIZER_MALFORMED ? -1 : 1;
+}
+
+static int send_msg(struct replay *replay, const struct replay_msg *msg)
+{
+	const char *buf = msg->data;
+	size_t count = msg->len;
+	ssize_t n;
+
+	while (count) {
+		n = write(replay->sockfd, buf, count);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return -1;
+		}
+
+		buf += n;
+		count -= (size_t) n;
+	}
+
+	return 0;
+}
+
+static int replay_msgs(struct replay *replay, enum replay_speed speed)
+{
+	struct replay_msg *msgs = replay->msgs->msgs;
+	struct timeval start = ast_tvnow();
+	struct timeval first = msgs[0].tv;
+	int64_t wait;
+	size_t i;
+
+	for (i = 0; i < replay->msgs->count; i++) {
+		if (!msgs[i].inbound) {
+			continue;
+		}
+
+		if (speed == REPLAY_ORIGINAL) {
+			while ((wait = ast_tvdiff_ms(msgs[i].tv, first) - ast_tvdiff_ms(ast_tvnow(), start)) > 0) {
+				if (read_responses(replay, wait) < 0) {
+					return -1;
+				}
+			}
+		}
+
+		/* the session must not block writing to us while we're writing to it */
+		if (read_responses(replay, 0) < 0) {
+			return -1;
+		}
+
+		if (send_msg(replay, &msgs[i])) {
+			return -1;
+		}
+
+		replay->last_sent = &msgs[i];
+		replay->sent++;
+		replay->last_activity = ast_tvnow();
+	}
+
+	return 0;
+}
+
+static void report_timing(const struct sccp_session_msg_timing *timing)
+{
+#define FORMAT_STRING  "%-32.32s %8s %10s %10s\n"
+#define FORMAT_STRING2 "%-32.32s %8u %10u %10u\n"
+	const struct sccp_msg_desc *desc;
+	uint32_t id;
+
+	printf(FORMAT_STRING, "Message", "Count", "Avg (us)", "Max (us)");
+
+	for (id = 0; id < SCCP_MSG_ID_LIMIT; id++) {
+		desc = sccp_msg_desc_get(id);
+		if (!desc || !timing->count[desc->index]) {
+			continue;
+		}
+
+		printf(FORMAT_STRING2, desc->name, timing->count[desc->index],
+				timing->time_total[desc->index] / timing->count[desc->index], timing->time_max[desc->index]);
+	}
+
+#undef FORMAT_STRING
+#undef FORMAT_STRING2
+}
+
+static int replay_run(const char *path, enum replay_speed speed, struct harness *harness)
+{
+	struct replay_msgs msgs = { NULL, 0, 0 };
+	struct replay replay;
+	struct sccp_session_msg_timing *timing = NULL;
+	struct harness_session hs;
+	struct timeval start;
+	int closed;
+	int n;
+	int ret = -1;
+
+	if (load_capture(path, &msgs)) {
+		goto end;
+	}
+
+	timing = ast_calloc(1, sizeof(*timing));
+	if (!timing) {
+		goto end;
+	}
+
+	if (harness_session_start(harness, &hs, timing)) {
+		goto end;
+	}
+
+	memset(&replay, 0, sizeof(replay));
+	replay.sockfd = hs.sockfd;
+	replay.msgs = &msgs;
+	sccp_deserializer_init(&replay.deserializer, hs.sockfd);
+
+	printf("Divergences from the recorded responses:\n");
+
+	start = ast_tvnow();
+	replay.last_activity = start;
+
+	closed = replay_msgs(&replay, speed);
+	if (!closed) {
+		/* until the session has been quiet for a while */
+		while ((n = read_responses(&replay, REPLAY_IDLE_MS)) > 0) {
+			continue;
+		}
+
+		closed = n < 0;
+	}
+
+	if (closed) {
+		printf("  connection closed by the session\n");
+	}
+
+	harness_session_stop(&hs);
+
+	/* the recorded responses never received */
+	for (replay.expected = next_expected(&replay, replay.expected); replay.expected < msgs.count;
+			replay.expected = next_expected(&replay, replay.expected + 1)) {
+		replay.missing++;
+		report_divergence(&replay, "missing", msg_id_of(msgs.msgs[replay.expected].data));
+	}
+
+	if (replay.reported > REPLAY_MAX_REPORTED) {
+		printf("  ... %u more\n", replay.reported - REPLAY_MAX_REPORTED);
+	}
+
+	printf("Responses: %u matched, %u missing, %u unexpected\n", replay.matched, replay.missing, replay.unexpected);
+	printf("Replayed in %d ms (%s speed)\n", (int) ast_tvdiff_ms(replay.last_activity, start), speed == REPLAY_MAX ? "max" : "original");
+	report_timing(timing);
+
+	ret = 0;
+
+end:
+	ast_free(timing);
+	replay_msgs_destroy(&msgs);
+
+	return ret;
+}
+
+static int write_guest_config(const char *dir)
+{
+	char path[PATH_MAX];
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/sccp.conf", dir);
+	file = fopen(path, "w");
+	if (!file) {
+		fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	fprintf(file,
+		"[general]\n"
+		"guest = yes\n"
+		"\n"
+		"[guest]\n"
+		"type = device\n"
+		"line = guestline\n"
+		"\n"
+		"[guestline]\n"
+		"type = line\n"
+		"context = default\n");
+	fclose(file);
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-m] [-c config_dir] [-v] capture.pcap\n"
+		"\n"
+		"  -m  send the messages as fast as possible instead of at their original pace\n"
+		"  -c  load sccp.conf from config_dir instead of accepting the device as a guest\n"
+		"  -v  log the notices and debug messages of the driver\n",
+		prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct harness harness;
+	enum replay_speed speed = REPLAY_ORIGINAL;
+	const char *config_dir = NULL;
+	char tmp_dir[PATH_MAX] = "";
+	int opt;
+	int ret = 1;
+
+	while ((opt = getopt(argc, argv, "mc:v")) != -1) {
+		switch (opt) {
+		case 'm':
+			speed = REPLAY_MAX;
+			break;
+		case 'c':
+			config_dir = optarg;
+			break;
+		case 'v':
+			stub_option_verbose = 1;
+			stub_option_debug = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (!config_dir) {
+		if (harness_mkdtemp(tmp_dir, sizeof(tmp_dir)) || write_guest_config(tmp_dir)) {
+			goto end;
+		}
+
+		config_dir = tmp_dir;
+	}
+
+	if (harness_start(&harness, config_dir)) {
+		goto end;
+	}
+
+	if (!replay_run(argv[optind], speed, &harness)) {
+		ret = 0;
+	}
+
+	harness_stop(&harness);
+
+end:
+	if (tmp_dir[0]) {
+		harness_rmdir(tmp_dir);
+	}
+
+	return ret;
+}
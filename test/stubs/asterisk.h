@@ -0,0 +1 @@
+#include "asterisk/stubs.h"
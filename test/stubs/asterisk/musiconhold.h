@@ -0,0 +1 @@
+#include "stubs.h"
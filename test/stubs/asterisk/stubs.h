@@ -0,0 +1,1216 @@
+#ifndef ASTERISK_STUBS_H_
+#define ASTERISK_STUBS_H_
+
+/*
+ * Minimal stand-in for the Asterisk API used by the channel driver, so that the
+ * decoder, session, device and config code can be linked outside of Asterisk.
+ *
+ * The declarations follow the Asterisk 16 API. Everything the harness relies on is
+ * implemented for real (ao2 objects and containers, locks, threadpools, the config
+ * framework, realtime backed by SQLite); the channel, RTP and PBX functions only keep
+ * enough state for the driver to run, and count what they're asked to do.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+/* compiler */
+#define attribute_unused __attribute__((unused))
+#define force_inline inline __attribute__((always_inline))
+#define SENTINEL ((char *) NULL)
+#define ARRAY_LEN(a) (size_t) (sizeof(a) / sizeof(0[a]))
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#define ast_assert(x) ((void) 0)
+
+#define ASTERISK_GPL_KEY "stub"
+
+/* logger */
+#define __LOG_DEBUG 0
+#define __LOG_NOTICE 2
+#define __LOG_WARNING 3
+#define __LOG_ERROR 4
+#define __LOG_VERBOSE 5
+#define _A_ __FILE__, __LINE__, __func__
+#define LOG_DEBUG __LOG_DEBUG, _A_
+#define LOG_NOTICE __LOG_NOTICE, _A_
+#define LOG_WARNING __LOG_WARNING, _A_
+#define LOG_ERROR __LOG_ERROR, _A_
+
+void ast_log(int level, const char *file, int line, const char *function, const char *fmt, ...) __attribute__((format(printf, 5, 6)));
+void __ast_verbose(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+#define ast_verbose(...) __ast_verbose(0, __VA_ARGS__)
+#define ast_verb(level, ...) __ast_verbose(level, __VA_ARGS__)
+#define ast_debug(level, ...) do { if (stub_option_debug >= (level)) { ast_log(LOG_DEBUG, __VA_ARGS__); } } while (0)
+
+/* log level of the harness: errors and warnings are always printed, verbose messages up to stub_option_verbose */
+extern int stub_option_verbose;
+extern int stub_option_debug;
+
+/* memory */
+#define ast_malloc(len) malloc(len)
+#define ast_calloc(num, len) calloc(num, len)
+#define ast_realloc(p, len) realloc(p, len)
+#define ast_free(p) free(p)
+#define ast_std_free(p) free(p)
+#define ast_strdup(str) ((str) ? strdup(str) : NULL)
+#define ast_strndup(str, len) ((str) ? strndup(str, len) : NULL)
+#define ast_strdupa(str) strdupa(str)
+#define ast_alloca(len) __builtin_alloca(len)
+int ast_asprintf(char **ret, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* locks, recursive like the Asterisk ones */
+typedef pthread_mutex_t ast_mutex_t;
+typedef pthread_cond_t ast_cond_t;
+typedef pthread_rwlock_t ast_rwlock_t;
+
+#define AST_MUTEX_DEFINE_STATIC(mutex) static ast_mutex_t mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+#define AST_RWLOCK_DEFINE_STATIC(rwlock) static ast_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER
+
+int ast_mutex_init(ast_mutex_t *mutex);
+int ast_mutex_destroy(ast_mutex_t *mutex);
+#define ast_mutex_lock(mutex) pthread_mutex_lock(mutex)
+#define ast_mutex_unlock(mutex) pthread_mutex_unlock(mutex)
+#define ast_mutex_trylock(mutex) pthread_mutex_trylock(mutex)
+#define ast_cond_init(cond, attr) pthread_cond_init(cond, attr)
+#define ast_cond_destroy(cond) pthread_cond_destroy(cond)
+#define ast_cond_signal(cond) pthread_cond_signal(cond)
+#define ast_cond_broadcast(cond) pthread_cond_broadcast(cond)
+#define ast_cond_wait(cond, mutex) pthread_cond_wait(cond, mutex)
+#define ast_cond_timedwait(cond, mutex, abstime) pthread_cond_timedwait(cond, mutex, abstime)
+#define ast_rwlock_init(rwlock) pthread_rwlock_init(rwlock, NULL)
+#define ast_rwlock_destroy(rwlock) pthread_rwlock_destroy(rwlock)
+#define ast_rwlock_rdlock(rwlock) pthread_rwlock_rdlock(rwlock)
+#define ast_rwlock_wrlock(rwlock) pthread_rwlock_wrlock(rwlock)
+#define ast_rwlock_unlock(rwlock) pthread_rwlock_unlock(rwlock)
+
+#define AST_PTHREADT_NULL (pthread_t) -1
+int ast_pthread_create(pthread_t *thread, pthread_attr_t *attr, void *(*start_routine)(void *), void *data);
+int ast_pthread_create_detached(pthread_t *thread, pthread_attr_t *attr, void *(*start_routine)(void *), void *data);
+#define ast_pthread_create_background ast_pthread_create
+
+int ast_atomic_fetchadd_int(volatile int *p, int v);
+int ast_atomic_dec_and_test(volatile int *p);
+
+/* flags */
+#define ast_test_flag(p, flag) ((p)->flags & (flag))
+#define ast_set_flag(p, flag) ((p)->flags |= (flag))
+#define ast_clear_flag(p, flag) ((p)->flags &= ~(flag))
+
+/* strings */
+#define ast_strlen_zero(s) (!(s) || (*(s) == '\0'))
+#define S_OR(a, b) (!ast_strlen_zero(a) ? (a) : (b))
+#define S_COR(a, b, c) ((a) ? (b) : (c))
+#define AST_YESNO(x) ((x) ? "Yes" : "No")
+#define AST_CLI_YESNO(x) ((x) ? "Yes" : "No")
+#define AST_CLI_ONOFF(x) ((x) ? "On" : "Off")
+
+void ast_copy_string(char *dst, const char *src, size_t size);
+int ast_true(const char *val);
+int ast_false(const char *val);
+char *ast_skip_blanks(const char *str);
+char *ast_trim_blanks(char *str);
+char *ast_strip(char *s);
+int ast_str_hash(const char *str);
+int ast_str_case_hash(const char *str);
+int ast_get_encoded_str(const char *stream, char *result, size_t result_len);
+const char *ast_inet_ntoa(struct in_addr ia);
+int ast_str2tos(const char *value, unsigned int *tos);
+
+struct ast_str {
+	size_t __AST_STR_LEN;
+	size_t __AST_STR_USED;
+	char __AST_STR_STR[0];
+};
+
+struct ast_str *ast_str_create(size_t init_len);
+#define ast_str_alloca(init_len) ({ \
+		struct ast_str *__ast_str_buf = __builtin_alloca(sizeof(*__ast_str_buf) + (init_len)); \
+		__ast_str_buf->__AST_STR_LEN = (init_len); \
+		__ast_str_buf->__AST_STR_USED = 0; \
+		__ast_str_buf->__AST_STR_STR[0] = '\0'; \
+		__ast_str_buf; \
+	})
+char *ast_str_buffer(const struct ast_str *buf);
+size_t ast_str_strlen(const struct ast_str *buf);
+void ast_str_reset(struct ast_str *buf);
+int ast_str_set(struct ast_str **buf, ssize_t max_len, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+int ast_str_append(struct ast_str **buf, ssize_t max_len, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+/* time */
+struct timeval ast_tvnow(void);
+struct timeval ast_tv(time_t sec, suseconds_t usec);
+int64_t ast_tvdiff_ms(struct timeval end, struct timeval start);
+int64_t ast_tvdiff_us(struct timeval end, struct timeval start);
+struct timeval ast_tvadd(struct timeval a, struct timeval b);
+struct timeval ast_tvsub(struct timeval a, struct timeval b);
+int ast_tvzero(const struct timeval t);
+int ast_tvcmp(struct timeval a, struct timeval b);
+struct timeval ast_samp2tv(unsigned int _nsamp, unsigned int _rate);
+
+struct ast_tm {
+	int tm_sec;
+	int tm_min;
+	int tm_hour;
+	int tm_mday;
+	int tm_mon;
+	int tm_year;
+	int tm_wday;
+	int tm_yday;
+	int tm_isdst;
+	long int tm_gmtoff;
+	char *tm_zone;
+	int tm_usec;
+};
+
+struct ast_tm *ast_localtime(const struct timeval *timep, struct ast_tm *p_tm, const char *zone);
+int ast_strftime(char *buf, size_t len, const char *format, const struct ast_tm *tm);
+
+/* linked lists */
+#define AST_LIST_HEAD_NOLOCK(name, type) \
+struct name { \
+	struct type *first; \
+	struct type *last; \
+}
+#define AST_LIST_HEAD_NOLOCK_STATIC(name, type) \
+struct name { \
+	struct type *first; \
+	struct type *last; \
+} name = { NULL, NULL }
+#define AST_LIST_HEAD_NOLOCK_INIT_VALUE { NULL, NULL }
+#define AST_LIST_HEAD_INIT_NOLOCK(head) do { (head)->first = NULL; (head)->last = NULL; } while (0)
+#define AST_LIST_ENTRY(type) struct { struct type *next; }
+#define AST_LIST_FIRST(head) ((head)->first)
+#define AST_LIST_LAST(head) ((head)->last)
+#define AST_LIST_NEXT(elm, field) ((elm)->field.next)
+#define AST_LIST_EMPTY(head) (AST_LIST_FIRST(head) == NULL)
+#define AST_LIST_TRAVERSE(head, var, field) for ((var) = (head)->first; (var); (var) = (var)->field.next)
+#define AST_LIST_TRAVERSE_SAFE_BEGIN(head, var, field) { \
+	typeof((head)) __list_head = head; \
+	typeof(__list_head->first) __list_next; \
+	typeof(__list_head->first) __list_prev = NULL; \
+	typeof(__list_head->first) __list_current; \
+	for ((var) = __list_head->first, \
+		__list_current = (var), \
+		__list_next = (var) ? (var)->field.next : NULL; \
+		(var); \
+		__list_prev = __list_current ? __list_current : __list_prev, \
+		(var) = __list_next, \
+		__list_current = (var), \
+		__list_next = (var) ? (var)->field.next : NULL)
+#define AST_LIST_REMOVE_CURRENT(field) do { \
+		__list_current->field.next = NULL; \
+		__list_current = NULL; \
+		if (__list_prev) { \
+			__list_prev->field.next = __list_next; \
+		} else { \
+			__list_head->first = __list_next; \
+		} \
+		if (!__list_next) { \
+			__list_head->last = __list_prev; \
+		} \
+	} while (0)
+#define AST_LIST_TRAVERSE_SAFE_END }
+#define AST_LIST_INSERT_HEAD(head, elm, field) do { \
+		(elm)->field.next = (head)->first; \
+		(head)->first = (elm); \
+		if (!(head)->last) { \
+			(head)->last = (elm); \
+		} \
+	} while (0)
+#define AST_LIST_INSERT_TAIL(head, elm, field) do { \
+		if (!(head)->first) { \
+			(head)->first = (elm); \
+			(head)->last = (elm); \
+		} else { \
+			(head)->last->field.next = (elm); \
+			(head)->last = (elm); \
+		} \
+		(elm)->field.next = NULL; \
+	} while (0)
+#define AST_LIST_APPEND_LIST(head, list, field) do { \
+		if (!(list)->first) { \
+			break; \
+		} \
+		if (!(head)->first) { \
+			(head)->first = (list)->first; \
+			(head)->last = (list)->last; \
+		} else { \
+			(head)->last->field.next = (list)->first; \
+			(head)->last = (list)->last; \
+		} \
+		(list)->first = NULL; \
+		(list)->last = NULL; \
+	} while (0)
+#define AST_LIST_REMOVE_HEAD(head, field) ({ \
+		typeof((head)->first) __cur = (head)->first; \
+		if (__cur) { \
+			(head)->first = __cur->field.next; \
+			__cur->field.next = NULL; \
+			if ((head)->last == __cur) { \
+				(head)->last = NULL; \
+			} \
+		} \
+		__cur; \
+	})
+#define AST_LIST_REMOVE(head, elm, field) ({ \
+		typeof(elm) __elm = (elm); \
+		typeof(elm) __prev = NULL; \
+		typeof(elm) __cur = (head)->first; \
+		while (__cur && __cur != __elm) { \
+			__prev = __cur; \
+			__cur = __cur->field.next; \
+		} \
+		if (__cur) { \
+			if (__prev) { \
+				__prev->field.next = __cur->field.next; \
+			} else { \
+				(head)->first = __cur->field.next; \
+			} \
+			if ((head)->last == __cur) { \
+				(head)->last = __prev; \
+			} \
+			__cur->field.next = NULL; \
+		} \
+		__cur; \
+	})
+
+/* doubly linked lists */
+#define AST_DLLIST_HEAD_NOLOCK(name, type) \
+struct name { \
+	struct type *first; \
+	struct type *last; \
+}
+#define AST_DLLIST_HEAD_INIT_NOLOCK(head) do { (head)->first = NULL; (head)->last = NULL; } while (0)
+#define AST_DLLIST_ENTRY(type) struct { struct type *prev; struct type *next; }
+#define AST_DLLIST_FIRST(head) ((head)->first)
+#define AST_DLLIST_LAST(head) ((head)->last)
+#define AST_DLLIST_INSERT_HEAD(head, elm, field) do { \
+		(elm)->field.prev = NULL; \
+		(elm)->field.next = (head)->first; \
+		if ((head)->first) { \
+			(head)->first->field.prev = (elm); \
+		} else { \
+			(head)->last = (elm); \
+		} \
+		(head)->first = (elm); \
+	} while (0)
+#define AST_DLLIST_REMOVE(head, elm, field) ({ \
+		typeof(elm) __elm = (elm); \
+		if (__elm->field.prev) { \
+			__elm->field.prev->field.next = __elm->field.next; \
+		} else { \
+			(head)->first = __elm->field.next; \
+		} \
+		if (__elm->field.next) { \
+			__elm->field.next->field.prev = __elm->field.prev; \
+		} else { \
+			(head)->last = __elm->field.prev; \
+		} \
+		__elm->field.prev = NULL; \
+		__elm->field.next = NULL; \
+		__elm; \
+	})
+
+/* vectors */
+#define AST_VECTOR(name, type) \
+struct name { \
+	type *elems; \
+	size_t max; \
+	size_t current; \
+}
+
+/* astobj2 */
+enum ao2_alloc_opts {
+	AO2_ALLOC_OPT_LOCK_MUTEX = (0 << 0),
+	AO2_ALLOC_OPT_LOCK_RWLOCK = (1 << 0),
+	AO2_ALLOC_OPT_LOCK_NOLOCK = (2 << 0),
+	AO2_ALLOC_OPT_LOCK_OBJ = AO2_ALLOC_OPT_LOCK_MUTEX,
+	AO2_ALLOC_OPT_LOCK_MASK = (3 << 0),
+	AO2_ALLOC_OPT_NO_REF_DEBUG = (1 << 2),
+};
+
+enum search_flags {
+	OBJ_UNLINK = (1 << 0),
+	OBJ_NODATA = (1 << 1),
+	OBJ_MULTIPLE = (1 << 2),
+	OBJ_NOLOCK = (1 << 4),
+	OBJ_SEARCH_MASK = (0x07 << 5),
+	OBJ_SEARCH_NONE = (0 << 5),
+	OBJ_SEARCH_OBJECT = (1 << 5),
+	OBJ_SEARCH_KEY = (2 << 5),
+	OBJ_SEARCH_PARTIAL_KEY = (4 << 5),
+	OBJ_ORDER_MASK = (0x03 << 8),
+	OBJ_ORDER_ASCENDING = (0 << 8),
+};
+
+enum _cb_results {
+	CMP_MATCH = 0x1,
+	CMP_STOP = 0x2,
+};
+
+enum ao2_container_opts {
+	AO2_CONTAINER_ALLOC_OPT_DUPS_ALLOW = (0 << 1),
+	AO2_CONTAINER_ALLOC_OPT_DUPS_REJECT = (1 << 1),
+	AO2_CONTAINER_ALLOC_OPT_DUPS_OBJ_REJECT = (2 << 1),
+	AO2_CONTAINER_ALLOC_OPT_DUPS_REPLACE = (3 << 1),
+};
+
+typedef void (*ao2_destructor_fn)(void *vdoomed);
+typedef int (ao2_callback_fn)(void *obj, void *arg, int flags);
+typedef int (ao2_hash_fn)(const void *obj, int flags);
+typedef int (ao2_sort_fn)(const void *obj_left, const void *obj_right, int flags);
+
+struct ao2_container;
+
+void *ao2_alloc_options(size_t data_size, ao2_destructor_fn destructor_fn, unsigned int options);
+#define ao2_alloc(data_size, destructor_fn) ao2_alloc_options(data_size, destructor_fn, AO2_ALLOC_OPT_LOCK_MUTEX)
+int ao2_ref(void *o, int delta);
+void ao2_cleanup(void *obj);
+#define ao2_bump(obj) ({ \
+		typeof(obj) __obj_ao2_bump = (obj); \
+		if (__obj_ao2_bump) { \
+			ao2_ref(__obj_ao2_bump, +1); \
+		} \
+		__obj_ao2_bump; \
+	})
+#define ao2_replace(dst, src) do { \
+		typeof(dst) *__dst_ao2_replace = &(dst); \
+		typeof(src) __src_ao2_replace = (src); \
+		if (__src_ao2_replace) { \
+			ao2_ref(__src_ao2_replace, +1); \
+		} \
+		if (*__dst_ao2_replace) { \
+			ao2_ref(*__dst_ao2_replace, -1); \
+		} \
+		*__dst_ao2_replace = __src_ao2_replace; \
+	} while (0)
+int ao2_lock(void *a);
+int ao2_unlock(void *a);
+int ao2_trylock(void *a);
+#define ao2_rdlock(a) ao2_lock(a)
+#define ao2_wrlock(a) ao2_lock(a)
+
+struct ao2_container *ao2_container_alloc_hash(unsigned int ao2_options, unsigned int container_options, unsigned int n_buckets,
+		ao2_hash_fn *hash_fn, ao2_sort_fn *sort_fn, ao2_callback_fn *cmp_fn);
+#define ao2_container_alloc_options(options, n_buckets, hash_fn, cmp_fn) \
+	ao2_container_alloc_hash(options, 0, n_buckets, hash_fn, NULL, cmp_fn)
+#define ao2_container_alloc_list(ao2_options, container_options, sort_fn, cmp_fn) \
+	ao2_container_alloc_hash(ao2_options, container_options, 1, NULL, sort_fn, cmp_fn)
+struct ao2_container *ao2_container_clone(struct ao2_container *orig, enum search_flags flags);
+int ao2_container_count(struct ao2_container *c);
+int ao2_link_flags(struct ao2_container *c, void *obj, int flags);
+#define ao2_link(c, obj) ao2_link_flags(c, obj, 0)
+void *ao2_unlink_flags(struct ao2_container *c, void *obj, int flags);
+#define ao2_unlink(c, obj) ao2_unlink_flags(c, obj, 0)
+void *ao2_callback(struct ao2_container *c, enum search_flags flags, ao2_callback_fn *cb_fn, void *arg);
+void *ao2_find(struct ao2_container *c, const void *arg, enum search_flags flags);
+
+struct ao2_iterator {
+	struct ao2_container *c;
+	void **objs;
+	size_t count;
+	size_t pos;
+	int flags;
+};
+
+enum ao2_iterator_flags {
+	AO2_ITERATOR_DONTLOCK = (1 << 0),
+	AO2_ITERATOR_MALLOCD = (1 << 1),
+	AO2_ITERATOR_UNLINK = (1 << 2),
+};
+
+struct ao2_iterator ao2_iterator_init(struct ao2_container *c, int flags);
+void *ao2_iterator_next(struct ao2_iterator *iter);
+void ao2_iterator_destroy(struct ao2_iterator *iter);
+
+struct ao2_global_obj {
+	pthread_rwlock_t lock;
+	void *obj;
+};
+
+#define AO2_GLOBAL_OBJ_STATIC(name) struct ao2_global_obj name = { PTHREAD_RWLOCK_INITIALIZER, NULL }
+void *__ao2_global_obj_ref(struct ao2_global_obj *holder);
+void *__ao2_global_obj_replace(struct ao2_global_obj *holder, void *obj);
+int __ao2_global_obj_replace_unref(struct ao2_global_obj *holder, void *obj);
+#define ao2_global_obj_ref(holder) __ao2_global_obj_ref(&(holder))
+#define ao2_global_obj_replace(holder, obj) __ao2_global_obj_replace(&(holder), (obj))
+#define ao2_global_obj_replace_unref(holder, obj) __ao2_global_obj_replace_unref(&(holder), (obj))
+#define ao2_global_obj_release(holder) ao2_cleanup(__ao2_global_obj_replace(&(holder), NULL))
+
+struct ao2_container *ast_str_container_alloc_options(enum ao2_alloc_opts opts, int buckets);
+#define ast_str_container_alloc(buckets) ast_str_container_alloc_options(AO2_ALLOC_OPT_LOCK_MUTEX, buckets)
+int ast_str_container_add(struct ao2_container *str_container, const char *add);
+void ast_str_container_remove(struct ao2_container *str_container, const char *remove);
+
+/* heap */
+struct ast_heap;
+typedef int (*ast_heap_cmp_fn)(void *elm1, void *elm2);
+struct ast_heap *ast_heap_create(unsigned int init_height, ast_heap_cmp_fn cmp_fn, ssize_t index_offset);
+struct ast_heap *ast_heap_destroy(struct ast_heap *h);
+int ast_heap_push(struct ast_heap *h, void *elm);
+void *ast_heap_pop(struct ast_heap *h);
+void *ast_heap_remove(struct ast_heap *h, void *elm);
+void *ast_heap_peek(struct ast_heap *h, unsigned int index);
+size_t ast_heap_size(struct ast_heap *h);
+
+/* sched */
+struct ast_sched_context;
+struct ast_sched_context *ast_sched_context_create(void);
+void ast_sched_context_destroy(struct ast_sched_context *c);
+int ast_sched_start_thread(struct ast_sched_context *con);
+
+/* threadpool and taskprocessor */
+struct ast_threadpool;
+struct ast_threadpool_listener;
+struct ast_taskprocessor;
+
+#define AST_THREADPOOL_OPTIONS_VERSION 1
+#define AST_TASKPROCESSOR_MAX_NAME 70
+
+struct ast_threadpool_options {
+	int version;
+	int idle_timeout;
+	int auto_increment;
+	int initial_size;
+	int max_size;
+	void (*thread_start)(void);
+	void (*thread_end)(void);
+};
+
+enum ast_tps_options {
+	TPS_REF_DEFAULT = 0,
+	TPS_REF_IF_EXISTS = (1 << 0),
+};
+
+struct ast_threadpool *ast_threadpool_create(const char *name, struct ast_threadpool_listener *listener, const struct ast_threadpool_options *options);
+void ast_threadpool_shutdown(struct ast_threadpool *pool);
+int ast_threadpool_push(struct ast_threadpool *pool, int (*task)(void *data), void *data);
+struct ast_taskprocessor *ast_threadpool_serializer(const char *name, struct ast_threadpool *pool);
+struct ast_taskprocessor *ast_taskprocessor_get(const char *name, enum ast_tps_options create);
+void *ast_taskprocessor_unreference(struct ast_taskprocessor *tps);
+int ast_taskprocessor_push(struct ast_taskprocessor *tps, int (*task_exe)(void *datap), void *datap);
+void ast_taskprocessor_build_name(char *buf, unsigned int size, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+/* module */
+struct ast_module;
+
+struct ast_module_info {
+	struct ast_module *self;
+};
+
+#define ast_module_ref(mod) ((void) (mod))
+#define ast_module_unref(mod) ((void) (mod))
+
+/* paths */
+extern const char *ast_config_AST_CONFIG_DIR;
+extern const char *ast_config_AST_LOG_DIR;
+extern const char *ast_config_AST_CACHE_DIR;
+
+/* cli */
+struct ast_cli_args {
+	const int fd;
+	const int argc;
+	const char * const *argv;
+	const char *line;
+	const char *word;
+	const int pos;
+	int n;
+};
+
+void ast_cli(int fd, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* network */
+struct ast_sockaddr {
+	struct sockaddr_storage ss;
+	socklen_t len;
+};
+
+void ast_sockaddr_setnull(struct ast_sockaddr *addr);
+int ast_sockaddr_from_sin(struct ast_sockaddr *addr, const struct sockaddr_in *sin);
+int ast_sockaddr_to_sin(const struct ast_sockaddr *addr, struct sockaddr_in *sin);
+const char *ast_sockaddr_stringify(const struct ast_sockaddr *addr);
+
+/* config */
+#define AST_MAX_EXTENSION 80
+#define AST_MAX_CONTEXT 80
+#define AST_MAX_ACCOUNT_CODE 80
+#define MAX_LANGUAGE 40
+#define AST_MAX_MAILBOX_UNIQUEID (AST_MAX_EXTENSION + AST_MAX_CONTEXT + 2)
+
+struct ast_variable {
+	const char *name;
+	const char *value;
+	struct ast_variable *next;
+	const char *file;
+	char stuff[0];
+};
+
+struct ast_variable *ast_variable_new(const char *name, const char *value, const char *filename);
+void ast_variables_destroy(struct ast_variable *var);
+int ast_check_realtime(const char *family);
+struct ast_variable *ast_load_realtime(const char *family, ...) __attribute__((sentinel));
+
+/* database */
+int ast_db_get(const char *family, const char *key, char *value, int valuelen);
+int ast_db_put(const char *family, const char *key, const char *value);
+int ast_db_del(const char *family, const char *key);
+
+/* groups */
+typedef unsigned long long ast_group_t;
+struct ast_namedgroups;
+ast_group_t ast_get_group(const char *s);
+struct ast_namedgroups *ast_get_namedgroups(const char *s);
+struct ast_namedgroups *ast_unref_namedgroups(struct ast_namedgroups *groups);
+struct ast_namedgroups *ast_ref_namedgroups(struct ast_namedgroups *groups);
+char *ast_print_namedgroups(struct ast_str **buf, struct ast_namedgroups *groups);
+
+/* formats */
+enum ast_media_type {
+	AST_MEDIA_TYPE_UNKNOWN = 0,
+	AST_MEDIA_TYPE_AUDIO,
+	AST_MEDIA_TYPE_VIDEO,
+	AST_MEDIA_TYPE_IMAGE,
+	AST_MEDIA_TYPE_TEXT,
+	AST_MEDIA_TYPE_END,
+};
+
+enum ast_format_cmp_res {
+	AST_FORMAT_CMP_EQUAL = 0,
+	AST_FORMAT_CMP_NOT_EQUAL,
+	AST_FORMAT_CMP_SUBSET,
+};
+
+enum ast_format_cap_flags {
+	AST_FORMAT_CAP_FLAG_DEFAULT = 0,
+};
+
+struct ast_format;
+struct ast_format_cap;
+
+extern struct ast_format *ast_format_ulaw;
+extern struct ast_format *ast_format_alaw;
+extern struct ast_format *ast_format_g722;
+extern struct ast_format *ast_format_g723;
+extern struct ast_format *ast_format_g726;
+extern struct ast_format *ast_format_g729;
+extern struct ast_format *ast_format_h261;
+extern struct ast_format *ast_format_h263;
+
+const char *ast_format_get_name(const struct ast_format *format);
+unsigned int ast_format_get_codec_id(const struct ast_format *format);
+enum ast_media_type ast_format_get_type(const struct ast_format *format);
+void *ast_format_get_attribute_data(const struct ast_format *format);
+enum ast_format_cmp_res ast_format_cmp(const struct ast_format *format1, const struct ast_format *format2);
+struct ast_format *ast_format_cache_get(const char *name);
+
+struct ast_format_cap *ast_format_cap_alloc(enum ast_format_cap_flags flags);
+int ast_format_cap_append(struct ast_format_cap *cap, struct ast_format *format, unsigned int framing);
+int ast_format_cap_append_by_type(struct ast_format_cap *cap, enum ast_media_type type);
+void ast_format_cap_remove_by_type(struct ast_format_cap *cap, enum ast_media_type type);
+int ast_format_cap_update_by_allow_disallow(struct ast_format_cap *cap, const char *list, int allowing);
+size_t ast_format_cap_count(const struct ast_format_cap *cap);
+int ast_format_cap_empty(const struct ast_format_cap *cap);
+struct ast_format *ast_format_cap_get_format(const struct ast_format_cap *cap, int position);
+unsigned int ast_format_cap_get_format_framing(const struct ast_format_cap *cap, const struct ast_format *format);
+int ast_format_cap_get_compatible(const struct ast_format_cap *cap1, const struct ast_format_cap *cap2, struct ast_format_cap *result);
+enum ast_format_cmp_res ast_format_cap_iscompatible_format(const struct ast_format_cap *cap, const struct ast_format *format);
+const char *ast_format_cap_get_names(const struct ast_format_cap *cap, struct ast_str **buf);
+
+/* frames */
+enum ast_frame_type {
+	AST_FRAME_DTMF_END = 1,
+	AST_FRAME_VOICE,
+	AST_FRAME_VIDEO,
+	AST_FRAME_CONTROL,
+	AST_FRAME_NULL,
+	AST_FRAME_IAX,
+	AST_FRAME_TEXT,
+	AST_FRAME_IMAGE,
+	AST_FRAME_HTML,
+	AST_FRAME_CNG,
+	AST_FRAME_MODEM,
+	AST_FRAME_DTMF_BEGIN,
+};
+#define AST_FRAME_DTMF AST_FRAME_DTMF_END
+
+enum ast_control_frame_type {
+	AST_CONTROL_HANGUP = 1,
+	AST_CONTROL_RING = 2,
+	AST_CONTROL_RINGING = 3,
+	AST_CONTROL_ANSWER = 4,
+	AST_CONTROL_BUSY = 5,
+	AST_CONTROL_TAKEOFFHOOK = 6,
+	AST_CONTROL_OFFHOOK = 7,
+	AST_CONTROL_CONGESTION = 8,
+	AST_CONTROL_FLASH = 9,
+	AST_CONTROL_WINK = 10,
+	AST_CONTROL_OPTION = 11,
+	AST_CONTROL_RADIO_KEY = 12,
+	AST_CONTROL_RADIO_UNKEY = 13,
+	AST_CONTROL_PROGRESS = 14,
+	AST_CONTROL_PROCEEDING = 15,
+	AST_CONTROL_HOLD = 16,
+	AST_CONTROL_UNHOLD = 17,
+	AST_CONTROL_VIDUPDATE = 18,
+	AST_CONTROL_SRCUPDATE = 20,
+	AST_CONTROL_TRANSFER = 21,
+	AST_CONTROL_CONNECTED_LINE = 22,
+	AST_CONTROL_REDIRECTING = 23,
+	AST_CONTROL_SRCCHANGE = 25,
+	AST_CONTROL_UPDATE_RTP_PEER = 31,
+	AST_CONTROL_MASQUERADE_NOTIFY = 34,
+};
+
+struct ast_frame_subclass {
+	int integer;
+	struct ast_format *format;
+};
+
+struct ast_frame {
+	enum ast_frame_type frametype;
+	struct ast_frame_subclass subclass;
+	int datalen;
+	int samples;
+	int mallocd;
+	size_t mallocd_hdr_len;
+	int offset;
+	const char *src;
+	union {
+		void *ptr;
+		uint32_t uint32;
+		char pad[8];
+	} data;
+	struct timeval delivery;
+	long ts;
+	long len;
+	int seqno;
+};
+
+extern struct ast_frame ast_null_frame;
+
+/* channels */
+enum ast_channel_state {
+	AST_STATE_DOWN,
+	AST_STATE_RESERVED,
+	AST_STATE_OFFHOOK,
+	AST_STATE_DIALING,
+	AST_STATE_RING,
+	AST_STATE_RINGING,
+	AST_STATE_UP,
+	AST_STATE_BUSY,
+	AST_STATE_DIALING_OFFHOOK,
+	AST_STATE_PRERING,
+};
+
+#define AST_CAUSE_NO_ROUTE_DESTINATION 3
+#define AST_CAUSE_NORMAL_CLEARING 16
+#define AST_CAUSE_BUSY 17
+#define AST_CAUSE_SUBSCRIBER_ABSENT 20
+#define AST_CAUSE_CALL_REJECTED 21
+#define AST_CAUSE_CONGESTION 34
+
+#define AST_CHAN_TP_WANTSJITTER (1 << 0)
+#define AST_CHAN_TP_CREATESJITTER (1 << 1)
+
+enum AST_REDIRECTING_REASON {
+	AST_REDIRECTING_REASON_UNKNOWN,
+	AST_REDIRECTING_REASON_USER_BUSY,
+	AST_REDIRECTING_REASON_NO_ANSWER,
+	AST_REDIRECTING_REASON_UNAVAILABLE,
+	AST_REDIRECTING_REASON_UNCONDITIONAL,
+};
+
+struct ast_channel;
+struct ast_assigned_ids {
+	const char *uniqueid;
+	const char *uniqueid2;
+};
+
+struct ast_party_name {
+	char *str;
+	int char_set;
+	int presentation;
+	unsigned char valid;
+};
+
+struct ast_party_number {
+	char *str;
+	int plan;
+	int presentation;
+	unsigned char valid;
+};
+
+struct ast_party_id {
+	struct ast_party_name name;
+	struct ast_party_number number;
+	char *tag;
+};
+
+struct ast_set_party_id {
+	unsigned char name;
+	unsigned char number;
+	unsigned char subaddress;
+};
+
+struct ast_party_connected_line {
+	struct ast_party_id id;
+	struct ast_party_id priv;
+	int source;
+};
+
+struct ast_party_redirecting_reason {
+	char *str;
+	int code;
+};
+
+struct ast_party_redirecting {
+	struct ast_party_id orig;
+	struct ast_party_id from;
+	struct ast_party_id to;
+	struct ast_party_id priv_orig;
+	struct ast_party_id priv_from;
+	struct ast_party_id priv_to;
+	struct ast_party_redirecting_reason orig_reason;
+	struct ast_party_redirecting_reason reason;
+	int count;
+};
+
+struct ast_set_party_redirecting {
+	struct ast_set_party_id orig;
+	struct ast_set_party_id from;
+	struct ast_set_party_id to;
+	struct ast_set_party_id priv_orig;
+	struct ast_set_party_id priv_from;
+	struct ast_set_party_id priv_to;
+};
+
+void ast_party_redirecting_init(struct ast_party_redirecting *init);
+void ast_party_redirecting_free(struct ast_party_redirecting *doomed);
+
+struct ast_channel_tech {
+	const char * const type;
+	const char * const description;
+	struct ast_format_cap *capabilities;
+	int properties;
+	struct ast_channel *(* const requester)(const char *type, struct ast_format_cap *cap, const struct ast_assigned_ids *assignedids,
+			const struct ast_channel *requestor, const char *addr, int *cause);
+	int (* const devicestate)(const char *device_number);
+	int (* const call)(struct ast_channel *chan, const char *addr, int timeout);
+	int (* const hangup)(struct ast_channel *chan);
+	int (* const answer)(struct ast_channel *chan);
+	struct ast_frame *(* const read)(struct ast_channel *chan);
+	int (* const write)(struct ast_channel *chan, struct ast_frame *frame);
+	int (* const indicate)(struct ast_channel *c, int condition, const void *data, size_t datalen);
+	int (* const fixup)(struct ast_channel *oldchan, struct ast_channel *newchan);
+	int (* const send_digit_end)(struct ast_channel *chan, char digit, unsigned int duration);
+	int (* func_channel_read)(struct ast_channel *chan, const char *function, char *data, char *buf, size_t len);
+};
+
+struct ast_channel *__ast_channel_alloc(int needqueue, int state, const char *cid_num, const char *cid_name, const char *acctcode,
+		const char *exten, const char *context, const struct ast_assigned_ids *assignedids, const struct ast_channel *requestor,
+		int amaflag, const char *name_fmt, ...) __attribute__((format(printf, 11, 12)));
+#define ast_channel_alloc(needqueue, state, cid_num, cid_name, acctcode, exten, context, assignedids, requestor, amaflag, ...) \
+	__ast_channel_alloc(needqueue, state, cid_num, cid_name, acctcode, exten, context, assignedids, requestor, amaflag, __VA_ARGS__)
+#define ast_channel_lock(chan) ao2_lock(chan)
+#define ast_channel_unlock(chan) ao2_unlock(chan)
+#define ast_channel_ref(chan) ({ ao2_ref(chan, +1); (chan); })
+#define ast_channel_unref(chan) ({ ao2_cleanup(chan); (struct ast_channel *) NULL; })
+struct ast_channel *ast_channel_release(struct ast_channel *chan);
+void ast_hangup(struct ast_channel *chan);
+
+const char *ast_channel_name(const struct ast_channel *chan);
+const char *ast_channel_uniqueid(const struct ast_channel *chan);
+enum ast_channel_state ast_channel_state(const struct ast_channel *chan);
+void *ast_channel_tech_pvt(const struct ast_channel *chan);
+void ast_channel_tech_pvt_set(struct ast_channel *chan, void *value);
+const struct ast_channel_tech *ast_channel_tech(const struct ast_channel *chan);
+void ast_channel_tech_set(struct ast_channel *chan, const struct ast_channel_tech *value);
+struct ast_format_cap *ast_channel_nativeformats(const struct ast_channel *chan);
+void ast_channel_nativeformats_set(struct ast_channel *chan, struct ast_format_cap *value);
+struct ast_format *ast_channel_readformat(struct ast_channel *chan);
+struct ast_format *ast_channel_writeformat(struct ast_channel *chan);
+void ast_channel_set_readformat(struct ast_channel *chan, struct ast_format *format);
+void ast_channel_set_writeformat(struct ast_channel *chan, struct ast_format *format);
+void ast_channel_set_rawreadformat(struct ast_channel *chan, struct ast_format *format);
+void ast_channel_set_rawwriteformat(struct ast_channel *chan, struct ast_format *format);
+int ast_set_read_format(struct ast_channel *chan, struct ast_format *format);
+int ast_set_write_format(struct ast_channel *chan, struct ast_format *format);
+int ast_channel_fdno(const struct ast_channel *chan);
+void ast_channel_set_fd(struct ast_channel *chan, int which, int value);
+void ast_channel_hangupcause_set(struct ast_channel *chan, int value);
+void ast_channel_call_forward_set(struct ast_channel *chan, const char *value);
+void ast_channel_language_set(struct ast_channel *chan, const char *value);
+void ast_channel_callgroup_set(struct ast_channel *chan, ast_group_t value);
+void ast_channel_pickupgroup_set(struct ast_channel *chan, ast_group_t value);
+void ast_channel_named_callgroups_set(struct ast_channel *chan, struct ast_namedgroups *value);
+void ast_channel_named_pickupgroups_set(struct ast_channel *chan, struct ast_namedgroups *value);
+struct ast_party_connected_line *ast_channel_connected(struct ast_channel *chan);
+struct ast_party_redirecting *ast_channel_redirecting(struct ast_channel *chan);
+void ast_channel_set_redirecting(struct ast_channel *chan, const struct ast_party_redirecting *redirecting, const struct ast_set_party_redirecting *update);
+void ast_channel_stage_snapshot(struct ast_channel *chan);
+void ast_channel_stage_snapshot_done(struct ast_channel *chan);
+int ast_setstate(struct ast_channel *chan, enum ast_channel_state state);
+int ast_queue_frame(struct ast_channel *chan, struct ast_frame *frame);
+int ast_queue_control(struct ast_channel *chan, enum ast_control_frame_type control);
+int ast_queue_hangup(struct ast_channel *chan);
+int ast_queue_hold(struct ast_channel *chan, const char *musicclass);
+int ast_queue_unhold(struct ast_channel *chan);
+int pbx_builtin_setvar_helper(struct ast_channel *chan, const char *name, const char *value);
+
+enum ast_pbx_result {
+	AST_PBX_SUCCESS = 0,
+	AST_PBX_FAILED = -1,
+	AST_PBX_CALL_LIMIT = -2,
+};
+
+enum ast_pbx_result ast_pbx_start(struct ast_channel *c);
+int ast_pickup_call(struct ast_channel *chan);
+int ast_moh_start(struct ast_channel *chan, const char *mclass, const char *interpclass);
+void ast_moh_stop(struct ast_channel *chan);
+
+enum ast_transfer_result {
+	AST_BRIDGE_TRANSFER_SUCCESS,
+	AST_BRIDGE_TRANSFER_NOT_PERMITTED,
+	AST_BRIDGE_TRANSFER_INVALID,
+	AST_BRIDGE_TRANSFER_FAIL,
+};
+
+enum ast_transfer_result ast_bridge_transfer_attended(struct ast_channel *to_transferee, struct ast_channel *to_transfer_target);
+
+struct ast_features_pickup_config {
+	const char *pickupexten;
+};
+
+struct ast_features_pickup_config *ast_get_chan_features_pickup_config(struct ast_channel *chan);
+
+/* device and extension states */
+enum ast_device_state {
+	AST_DEVICE_UNKNOWN,
+	AST_DEVICE_NOT_INUSE,
+	AST_DEVICE_INUSE,
+	AST_DEVICE_BUSY,
+	AST_DEVICE_INVALID,
+	AST_DEVICE_UNAVAILABLE,
+	AST_DEVICE_RINGING,
+	AST_DEVICE_RINGINUSE,
+	AST_DEVICE_ONHOLD,
+	AST_DEVICE_TOTAL,
+};
+
+enum ast_devstate_cache {
+	AST_DEVSTATE_NOT_CACHABLE,
+	AST_DEVSTATE_CACHABLE,
+};
+
+int ast_devstate_changed(enum ast_device_state state, enum ast_devstate_cache cachable, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+enum ast_extension_states {
+	AST_EXTENSION_REMOVED = -2,
+	AST_EXTENSION_DEACTIVATED = -1,
+	AST_EXTENSION_NOT_INUSE = 0,
+	AST_EXTENSION_INUSE = 1 << 0,
+	AST_EXTENSION_BUSY = 1 << 1,
+	AST_EXTENSION_UNAVAILABLE = 1 << 2,
+	AST_EXTENSION_RINGING = 1 << 3,
+	AST_EXTENSION_ONHOLD = 1 << 4,
+};
+
+enum ast_state_cb_update_reason {
+	AST_HINT_UPDATE_DEVICE = 1,
+	AST_HINT_UPDATE_PRESENCE = 2,
+};
+
+struct ast_state_cb_info {
+	enum ast_state_cb_update_reason reason;
+	enum ast_extension_states exten_state;
+};
+
+typedef int (*ast_state_cb_type)(const char *context, const char *exten, struct ast_state_cb_info *info, void *data);
+int ast_extension_state(struct ast_channel *c, const char *context, const char *exten);
+int ast_extension_state_add(const char *context, const char *exten, ast_state_cb_type change_cb, void *data);
+int ast_extension_state_del(int id, ast_state_cb_type change_cb);
+
+/* voicemail */
+int ast_app_inboxcount(const char *mailboxes, int *newmsgs, int *oldmsgs);
+
+/* stasis */
+struct stasis_topic;
+struct stasis_subscription;
+struct stasis_message;
+struct stasis_message_type;
+
+struct ast_mwi_state {
+	int urgent_msgs;
+	int new_msgs;
+	int old_msgs;
+};
+
+typedef void (*stasis_subscription_cb)(void *data, struct stasis_subscription *sub, struct stasis_message *message);
+struct stasis_message_type *ast_mwi_state_type(void);
+struct stasis_topic *ast_mwi_topic(const char *uniqueid);
+struct stasis_message_type *stasis_message_type(const struct stasis_message *msg);
+void *stasis_message_data(const struct stasis_message *msg);
+struct stasis_subscription *stasis_subscribe_pool(struct stasis_topic *topic, stasis_subscription_cb callback, void *data);
+struct stasis_subscription *stasis_unsubscribe_and_join(struct stasis_subscription *subscription);
+
+/* rtp */
+struct ast_rtp_instance;
+struct ast_rtp_codecs;
+
+enum ast_rtp_property {
+	AST_RTP_PROPERTY_NAT = 0,
+	AST_RTP_PROPERTY_DTMF,
+	AST_RTP_PROPERTY_DTMF_COMPENSATE,
+	AST_RTP_PROPERTY_STUN,
+	AST_RTP_PROPERTY_RTCP,
+	AST_RTP_PROPERTY_MAX,
+};
+
+enum ast_rtp_glue_result {
+	AST_RTP_GLUE_RESULT_FORBID = 0,
+	AST_RTP_GLUE_RESULT_REMOTE,
+	AST_RTP_GLUE_RESULT_LOCAL,
+};
+
+struct ast_rtp_glue {
+	const char *type;
+	struct ast_module *mod;
+	enum ast_rtp_glue_result (*get_rtp_info)(struct ast_channel *chan, struct ast_rtp_instance **instance);
+	enum ast_rtp_glue_result (*get_vrtp_info)(struct ast_channel *chan, struct ast_rtp_instance **instance);
+	enum ast_rtp_glue_result (*get_trtp_info)(struct ast_channel *chan, struct ast_rtp_instance **instance);
+	int (*update_peer)(struct ast_channel *chan, struct ast_rtp_instance *instance, struct ast_rtp_instance *vinstance,
+			struct ast_rtp_instance *tinstance, const struct ast_format_cap *cap, int nat_active);
+	void (*get_codec)(struct ast_channel *chan, struct ast_format_cap *result_cap);
+};
+
+struct ast_rtp_instance *ast_rtp_instance_new(const char *engine_name, struct ast_sched_context *sched, const struct ast_sockaddr *sa, void *data);
+int ast_rtp_instance_destroy(struct ast_rtp_instance *instance);
+void ast_rtp_instance_stop(struct ast_rtp_instance *instance);
+int ast_rtp_instance_fd(struct ast_rtp_instance *instance, int rtcp);
+void ast_rtp_instance_set_prop(struct ast_rtp_instance *instance, enum ast_rtp_property property, int value);
+int ast_rtp_instance_set_qos(struct ast_rtp_instance *instance, int tos, int cos, const char *desc);
+void ast_rtp_instance_set_channel_id(struct ast_rtp_instance *instance, const char *uniqueid);
+int ast_rtp_instance_set_remote_address(struct ast_rtp_instance *instance, const struct ast_sockaddr *address);
+void ast_rtp_instance_get_local_address(struct ast_rtp_instance *instance, struct ast_sockaddr *address);
+void ast_rtp_instance_get_remote_address(struct ast_rtp_instance *instance, struct ast_sockaddr *address);
+int ast_rtp_instance_get_and_cmp_remote_address(struct ast_rtp_instance *instance, struct ast_sockaddr *address);
+void ast_rtp_instance_update_source(struct ast_rtp_instance *instance);
+void ast_rtp_instance_change_source(struct ast_rtp_instance *instance);
+int ast_rtp_instance_write(struct ast_rtp_instance *instance, struct ast_frame *frame);
+struct ast_frame *ast_rtp_instance_read(struct ast_rtp_instance *instance, int rtcp);
+struct ast_rtp_codecs *ast_rtp_instance_get_codecs(struct ast_rtp_instance *instance);
+void ast_rtp_codecs_payloads_set_m_type(struct ast_rtp_codecs *codecs, struct ast_rtp_instance *instance, int payload);
+void ast_rtp_codecs_set_framing(struct ast_rtp_codecs *codecs, unsigned int framing);
+
+/* config framework */
+#define PARSE_TYPE 0x000f
+#define PARSE_INT32 0x0001
+#define PARSE_UINT32 0x0002
+#define PARSE_DEFAULT 0x0020
+#define PARSE_IN_RANGE 0x0040
+#define PARSE_OUT_RANGE 0x0080
+
+enum aco_type_t {
+	ACO_GLOBAL,
+	ACO_ITEM,
+	ACO_IGNORE,
+};
+
+enum aco_category_op {
+	ACO_BLACKLIST = 0,
+	ACO_WHITELIST,
+	ACO_BLACKLIST_EXACT,
+	ACO_WHITELIST_EXACT,
+	ACO_BLACKLIST_ARRAY,
+	ACO_WHITELIST_ARRAY,
+};
+
+enum aco_matchtype {
+	ACO_EXACT = 1,
+	ACO_REGEX,
+	ACO_PREFIX,
+};
+
+enum aco_process_status {
+	ACO_PROCESS_OK,
+	ACO_PROCESS_UNCHANGED,
+	ACO_PROCESS_ERROR,
+};
+
+enum aco_option_type {
+	OPT_ACL_T,
+	OPT_BOOL_T,
+	OPT_BOOLFLAG_T,
+	OPT_CHAR_ARRAY_T,
+	OPT_CODEC_T,
+	OPT_CUSTOM_T,
+	OPT_DOUBLE_T,
+	OPT_INT_T,
+	OPT_NOOP_T,
+	OPT_SOCKADDR_T,
+	OPT_STRINGFIELD_T,
+	OPT_UINT_T,
+	OPT_YESNO_T,
+	OPT_TIMELEN_T,
+};
+
+struct aco_option;
+struct aco_info_internal;
+struct aco_type_internal;
+
+typedef void *(*aco_type_item_alloc)(const char *category);
+typedef void *(*aco_type_item_find)(struct ao2_container *newcontainer, const char *category);
+typedef int (*aco_type_item_pre_process)(void *newitem);
+typedef int (*aco_type_prelink)(void *newitem);
+typedef int (*aco_option_handler)(const struct aco_option *opt, struct ast_variable *var, void *obj);
+
+struct aco_type {
+	enum aco_type_t type;
+	const char *name;
+	const char *category;
+	const char *matchfield;
+	const char *matchvalue;
+	int (*matchfunc)(const char *text);
+	enum aco_category_op category_match;
+	size_t item_offset;
+	aco_type_item_alloc item_alloc;
+	aco_type_item_find item_find;
+	aco_type_item_pre_process item_pre_process;
+	aco_type_prelink item_prelink;
+	struct aco_type_internal *internal;
+};
+
+struct aco_file {
+	const char *filename;
+	const char *alias;
+	const char **preload;
+	const char *skip_category;
+	struct aco_type *types[];
+};
+
+struct aco_info {
+	const char *module;
+	int hidden;
+	int (*pre_apply_config)(void);
+	void (*post_apply_config)(void);
+	void *(*snapshot_alloc)(void);
+	struct ao2_global_obj *global_obj;
+	struct aco_info_internal *internal;
+	struct aco_file *files[];
+};
+
+#define ACO_TYPES(...) { __VA_ARGS__, NULL, }
+#define ACO_FILES(...) { __VA_ARGS__, NULL, }
+
+#define CONFIG_INFO_STANDARD(name, arr, alloc, ...) \
+static struct aco_info name = { \
+	.module = AST_MODULE, \
+	.global_obj = &arr, \
+	.snapshot_alloc = alloc, \
+	__VA_ARGS__ \
+};
+
+#define FLDSET(type, field) offsetof(type, field)
+#define CHARFLDSET(type, field) offsetof(type, field), sizeof(((type *) 0)->field)
+
+int aco_info_init(struct aco_info *info);
+void aco_info_destroy(struct aco_info *info);
+void *aco_pending_config(struct aco_info *info);
+enum aco_process_status aco_process_config(struct aco_info *info, int reload);
+int aco_process_var(struct aco_type *type, const char *cat, struct ast_variable *var, void *obj);
+int aco_set_defaults(struct aco_type *type, const char *category, void *obj);
+unsigned int aco_option_get_flags(const struct aco_option *option);
+
+/*
+ * The variable arguments are, depending on the option type: the field offset, then the
+ * min and max values if PARSE_IN_RANGE is set (OPT_INT_T, OPT_UINT_T), or the field size
+ * (OPT_CHAR_ARRAY_T).
+ */
+int aco_option_register(struct aco_info *info, const char *name, enum aco_matchtype matchtype, struct aco_type **types,
+		const char *default_val, enum aco_option_type type, unsigned int flags, ...);
+int aco_option_register_custom(struct aco_info *info, const char *name, enum aco_matchtype matchtype, struct aco_type **types,
+		const char *default_val, aco_option_handler handler, unsigned int flags);
+
+/* harness helpers, not part of the Asterisk API */
+
+/*!
+ * \brief Set the directories ast_config_AST_CONFIG_DIR, _LOG_DIR and _CACHE_DIR point to.
+ */
+void stub_set_dirs(const char *config_dir, const char *log_dir, const char *cache_dir);
+
+/*!
+ * \brief Serve the realtime families from the tables of the same name in a SQLite file.
+ *
+ * \note A NULL path disables realtime.
+ */
+int stub_realtime_set_sqlite(const char *path);
+
+/*!
+ * \brief Start the thread that plays the PBX side of the channels, i.e. hangs up the
+ *        channels queued for hangup once started with ast_pbx_start.
+ */
+int stub_channels_init(void);
+
+/*!
+ * \brief Hang up every started channel and stop the thread.
+ */
+void stub_channels_destroy(void);
+
+struct stub_channel_stats {
+	unsigned int allocated;
+	unsigned int started;
+	unsigned int hungup;
+	unsigned int live;
+	unsigned int frames_queued;
+	unsigned int controls_queued;
+};
+
+void stub_channels_take_stats(struct stub_channel_stats *stats);
+
+/*!
+ * \brief Return a started channel, with its reference count incremented, or NULL.
+ */
+struct ast_channel *stub_channel_find_started(void);
+
+struct stub_rtp_stats {
+	unsigned int instances;
+	unsigned long long frames_written;
+	unsigned long long frames_read;
+};
+
+void stub_rtp_take_stats(struct stub_rtp_stats *stats);
+
+/*!
+ * \brief Call the tech read callback of the channel, with the channel locked, like
+ *        ast_read does.
+ */
+struct ast_frame *stub_channel_read(struct ast_channel *chan, int fdno);
+
+/*!
+ * \brief Call the tech write callback of the channel, with the channel locked, like
+ *        ast_write does.
+ */
+int stub_channel_write(struct ast_channel *chan, struct ast_frame *frame);
+
+#endif /* ASTERISK_STUBS_H_ */
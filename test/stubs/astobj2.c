@@ -0,0 +1,619 @@
+#include <asterisk.h>
+#include <asterisk/astobj2.h>
+
+#define AO2_MAGIC 0x0a020b5e
+
+struct ao2_header {
+	unsigned int magic;
+	unsigned int options;
+	volatile int ref_count;
+	ao2_destructor_fn destructor_fn;
+	pthread_mutex_t lock;
+	/* keeps the user data aligned like malloc does */
+	void *user_data[0] __attribute__((aligned(16)));
+};
+
+struct ao2_node {
+	void *obj;
+	struct ao2_node *next;
+};
+
+/*
+ * Objects unlinked during a traversal only have their node emptied, the nodes are
+ * freed once the outermost traversal ends, so that a callback can unlink objects.
+ */
+struct ao2_container {
+	ao2_hash_fn *hash_fn;
+	ao2_callback_fn *cmp_fn;
+	unsigned int n_buckets;
+	unsigned int options;
+	int count;
+	int traversals;
+	int dead_nodes;
+	struct ao2_node **buckets;
+};
+
+static struct ao2_header *header_of(const void *user_data)
+{
+	struct ao2_header *header;
+
+	if (!user_data) {
+		return NULL;
+	}
+
+	header = (struct ao2_header *) ((char *) user_data - offsetof(struct ao2_header, user_data));
+	if (header->magic != AO2_MAGIC) {
+		fprintf(stderr, "ao2: bad magic for object %p\n", user_data);
+		abort();
+	}
+
+	return header;
+}
+
+void *ao2_alloc_options(size_t data_size, ao2_destructor_fn destructor_fn, unsigned int options)
+{
+	struct ao2_header *header;
+	pthread_mutexattr_t attr;
+
+	header = calloc(1, sizeof(*header) + data_size);
+	if (!header) {
+		return NULL;
+	}
+
+	header->magic = AO2_MAGIC;
+	header->options = options;
+	header->ref_count = 1;
+	header->destructor_fn = destructor_fn;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&header->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	return header->user_data;
+}
+
+int ao2_ref(void *o, int delta)
+{
+	struct ao2_header *header = header_of(o);
+	int old;
+
+	if (!header) {
+		return -1;
+	}
+
+	if (!delta) {
+		return __atomic_load_n(&header->ref_count, __ATOMIC_SEQ_CST);
+	}
+
+	old = __atomic_fetch_add(&header->ref_count, delta, __ATOMIC_SEQ_CST);
+	if (old + delta < 0) {
+		fprintf(stderr, "ao2: negative reference count for object %p\n", o);
+		abort();
+	}
+
+	if (old + delta == 0) {
+		if (header->destructor_fn) {
+			header->destructor_fn(o);
+		}
+
+		pthread_mutex_destroy(&header->lock);
+		header->magic = 0;
+		free(header);
+	}
+
+	return old;
+}
+
+void ao2_cleanup(void *obj)
+{
+	if (obj) {
+		ao2_ref(obj, -1);
+	}
+}
+
+int ao2_lock(void *a)
+{
+	struct ao2_header *header = header_of(a);
+
+	if ((header->options & AO2_ALLOC_OPT_LOCK_MASK) == AO2_ALLOC_OPT_LOCK_NOLOCK) {
+		return 0;
+	}
+
+	return pthread_mutex_lock(&header->lock);
+}
+
+int ao2_unlock(void *a)
+{
+	struct ao2_header *header = header_of(a);
+
+	if ((header->options & AO2_ALLOC_OPT_LOCK_MASK) == AO2_ALLOC_OPT_LOCK_NOLOCK) {
+		return 0;
+	}
+
+	return pthread_mutex_unlock(&header->lock);
+}
+
+int ao2_trylock(void *a)
+{
+	struct ao2_header *header = header_of(a);
+
+	if ((header->options & AO2_ALLOC_OPT_LOCK_MASK) == AO2_ALLOC_OPT_LOCK_NOLOCK) {
+		return 0;
+	}
+
+	return pthread_mutex_trylock(&header->lock);
+}
+
+static void container_destructor(void *obj)
+{
+	struct ao2_container *c = obj;
+	struct ao2_node *node;
+	struct ao2_node *next;
+	unsigned int i;
+
+	for (i = 0; i < c->n_buckets; i++) {
+		for (node = c->buckets[i]; node; node = next) {
+			next = node->next;
+			ao2_cleanup(node->obj);
+			free(node);
+		}
+	}
+
+	free(c->buckets);
+}
+
+struct ao2_container *ao2_container_alloc_hash(unsigned int ao2_options, unsigned int container_options, unsigned int n_buckets,
+		ao2_hash_fn *hash_fn, ao2_sort_fn *sort_fn, ao2_callback_fn *cmp_fn)
+{
+	struct ao2_container *c;
+
+	c = ao2_alloc_options(sizeof(*c), container_destructor, ao2_options);
+	if (!c) {
+		return NULL;
+	}
+
+	if (!hash_fn || !n_buckets) {
+		n_buckets = 1;
+	}
+
+	c->buckets = calloc(n_buckets, sizeof(*c->buckets));
+	if (!c->buckets) {
+		ao2_ref(c, -1);
+		return NULL;
+	}
+
+	c->hash_fn = hash_fn;
+	c->cmp_fn = cmp_fn;
+	c->n_buckets = n_buckets;
+	c->options = ao2_options;
+
+	return c;
+}
+
+static unsigned int container_bucket(struct ao2_container *c, const void *arg, int flags)
+{
+	int hash;
+
+	if (c->n_buckets == 1) {
+		return 0;
+	}
+
+	hash = c->hash_fn(arg, flags);
+	if (hash < 0) {
+		hash = -hash;
+	}
+
+	return (unsigned int) hash % c->n_buckets;
+}
+
+static void container_purge(struct ao2_container *c)
+{
+	struct ao2_node **prev;
+	struct ao2_node *node;
+	unsigned int i;
+
+	if (c->traversals || !c->dead_nodes) {
+		return;
+	}
+
+	for (i = 0; i < c->n_buckets; i++) {
+		prev = &c->buckets[i];
+		while ((node = *prev)) {
+			if (node->obj) {
+				prev = &node->next;
+			} else {
+				*prev = node->next;
+				free(node);
+			}
+		}
+	}
+
+	c->dead_nodes = 0;
+}
+
+int ao2_container_count(struct ao2_container *c)
+{
+	return __atomic_load_n(&c->count, __ATOMIC_RELAXED);
+}
+
+int ao2_link_flags(struct ao2_container *c, void *obj, int flags)
+{
+	struct ao2_node *node;
+	unsigned int bucket;
+
+	node = malloc(sizeof(*node));
+	if (!node) {
+		return 0;
+	}
+
+	if (!(flags & OBJ_NOLOCK)) {
+		ao2_lock(c);
+	}
+
+	bucket = container_bucket(c, obj, OBJ_SEARCH_OBJECT);
+	ao2_ref(obj, +1);
+	node->obj = obj;
+	node->next = c->buckets[bucket];
+	c->buckets[bucket] = node;
+	__atomic_add_fetch(&c->count, 1, __ATOMIC_RELAXED);
+
+	if (!(flags & OBJ_NOLOCK)) {
+		ao2_unlock(c);
+	}
+
+	return 1;
+}
+
+static int match_by_addr(void *obj, void *arg, int flags)
+{
+	return obj == arg ? (CMP_MATCH | CMP_STOP) : 0;
+}
+
+void *ao2_unlink_flags(struct ao2_container *c, void *obj, int flags)
+{
+	flags &= ~OBJ_SEARCH_MASK;
+	flags |= OBJ_SEARCH_OBJECT | OBJ_UNLINK | OBJ_NODATA;
+	ao2_callback(c, flags, match_by_addr, obj);
+
+	return NULL;
+}
+
+struct matches {
+	void **objs;
+	size_t count;
+	size_t size;
+};
+
+static int matches_add(struct matches *matches, void *obj)
+{
+	void **objs;
+	size_t size;
+
+	if (matches->count == matches->size) {
+		size = matches->size ? matches->size * 2 : 16;
+		objs = realloc(matches->objs, size * sizeof(*objs));
+		if (!objs) {
+			return -1;
+		}
+
+		matches->objs = objs;
+		matches->size = size;
+	}
+
+	matches->objs[matches->count++] = obj;
+
+	return 0;
+}
+
+static struct ao2_iterator *iterator_from_matches(struct matches *matches)
+{
+	struct ao2_iterator *iter;
+
+	iter = calloc(1, sizeof(*iter));
+	if (!iter) {
+		return NULL;
+	}
+
+	iter->objs = matches->objs;
+	iter->count = matches->count;
+	iter->flags = AO2_ITERATOR_MALLOCD;
+
+	return iter;
+}
+
+void *ao2_callback(struct ao2_container *c, enum search_flags flags, ao2_callback_fn *cb_fn, void *arg)
+{
+	struct matches matches = { NULL, 0, 0 };
+	struct ao2_node *node;
+	unsigned int first;
+	unsigned int last;
+	unsigned int i;
+	void *found = NULL;
+	void *obj;
+	int search = flags & OBJ_SEARCH_MASK;
+	int stop = 0;
+	int ret;
+
+	if (!(flags & OBJ_NOLOCK)) {
+		ao2_lock(c);
+	}
+
+	if ((search == OBJ_SEARCH_KEY || search == OBJ_SEARCH_OBJECT) && c->n_buckets > 1) {
+		first = container_bucket(c, arg, search);
+		last = first;
+	} else {
+		first = 0;
+		last = c->n_buckets - 1;
+	}
+
+	c->traversals++;
+	for (i = first; i <= last && !stop; i++) {
+		for (node = c->buckets[i]; node && !stop; node = node->next) {
+			obj = node->obj;
+			if (!obj) {
+				continue;
+			}
+
+			ret = cb_fn ? cb_fn(obj, arg, flags) : CMP_MATCH;
+			stop = ret & CMP_STOP;
+			if (!(ret & CMP_MATCH)) {
+				continue;
+			}
+
+			if (!(flags & OBJ_MULTIPLE)) {
+				stop = 1;
+			}
+
+			if (flags & OBJ_UNLINK) {
+				node->obj = NULL;
+				c->dead_nodes++;
+				__atomic_sub_fetch(&c->count, 1, __ATOMIC_RELAXED);
+			} else if (!(flags & OBJ_NODATA)) {
+				ao2_ref(obj, +1);
+			}
+
+			/* the reference of the container is transferred to the caller when unlinking */
+			if (flags & OBJ_NODATA) {
+				if (flags & OBJ_UNLINK) {
+					ao2_ref(obj, -1);
+				}
+			} else if (flags & OBJ_MULTIPLE) {
+				if (matches_add(&matches, obj)) {
+					ao2_ref(obj, -1);
+				}
+			} else {
+				found = obj;
+			}
+		}
+	}
+	c->traversals--;
+	container_purge(c);
+
+	if (!(flags & OBJ_NOLOCK)) {
+		ao2_unlock(c);
+	}
+
+	if ((flags & OBJ_MULTIPLE) && !(flags & OBJ_NODATA)) {
+		found = iterator_from_matches(&matches);
+		if (!found) {
+			for (i = 0; i < matches.count; i++) {
+				ao2_ref(matches.objs[i], -1);
+			}
+
+			free(matches.objs);
+		}
+	}
+
+	return found;
+}
+
+void *ao2_find(struct ao2_container *c, const void *arg, enum search_flags flags)
+{
+	if (!(flags & OBJ_SEARCH_MASK) && arg) {
+		flags |= OBJ_SEARCH_OBJECT;
+	}
+
+	return ao2_callback(c, flags, c->cmp_fn, (void *) arg);
+}
+
+struct ao2_container *ao2_container_clone(struct ao2_container *orig, enum search_flags flags)
+{
+	struct ao2_container *c;
+	struct ao2_node *node;
+	unsigned int i;
+
+	c = ao2_container_alloc_hash(orig->options, 0, orig->n_buckets, orig->hash_fn, NULL, orig->cmp_fn);
+	if (!c) {
+		return NULL;
+	}
+
+	if (!(flags & OBJ_NOLOCK)) {
+		ao2_lock(orig);
+	}
+
+	for (i = 0; i < orig->n_buckets; i++) {
+		for (node = orig->buckets[i]; node; node = node->next) {
+			if (node->obj) {
+				ao2_link_flags(c, node->obj, OBJ_NOLOCK);
+			}
+		}
+	}
+
+	if (!(flags & OBJ_NOLOCK)) {
+		ao2_unlock(orig);
+	}
+
+	return c;
+}
+
+/*
+ * The iterator takes a snapshot of the container on its first call to next; the objects
+ * linked or unlinked afterward are not seen.
+ */
+struct ao2_iterator ao2_iterator_init(struct ao2_container *c, int flags)
+{
+	struct ao2_iterator iter = {
+		.c = c,
+		.flags = flags,
+	};
+
+	ao2_ref(c, +1);
+
+	return iter;
+}
+
+static int iterator_snapshot(struct ao2_iterator *iter)
+{
+	struct matches matches = { NULL, 0, 0 };
+	struct ao2_container *c = iter->c;
+	struct ao2_node *node;
+	unsigned int i;
+
+	if (!(iter->flags & AO2_ITERATOR_DONTLOCK)) {
+		ao2_lock(c);
+	}
+
+	for (i = 0; i < c->n_buckets; i++) {
+		for (node = c->buckets[i]; node; node = node->next) {
+			if (node->obj && !matches_add(&matches, node->obj)) {
+				ao2_ref(node->obj, +1);
+			}
+		}
+	}
+
+	if (!(iter->flags & AO2_ITERATOR_DONTLOCK)) {
+		ao2_unlock(c);
+	}
+
+	iter->objs = matches.objs;
+	iter->count = matches.count;
+	/* the snapshot is taken, even if empty */
+	iter->c = NULL;
+	ao2_ref(c, -1);
+
+	return 0;
+}
+
+void *ao2_iterator_next(struct ao2_iterator *iter)
+{
+	void *obj;
+
+	if (iter->c) {
+		iterator_snapshot(iter);
+	}
+
+	if (iter->pos >= iter->count) {
+		return NULL;
+	}
+
+	/* the reference of the snapshot is transferred to the caller */
+	obj = iter->objs[iter->pos];
+	iter->objs[iter->pos++] = NULL;
+
+	return obj;
+}
+
+void ao2_iterator_destroy(struct ao2_iterator *iter)
+{
+	size_t i;
+
+	if (iter->c) {
+		ao2_ref(iter->c, -1);
+		iter->c = NULL;
+	}
+
+	for (i = iter->pos; i < iter->count; i++) {
+		ao2_cleanup(iter->objs[i]);
+	}
+
+	free(iter->objs);
+	iter->objs = NULL;
+	iter->count = 0;
+	iter->pos = 0;
+
+	if (iter->flags & AO2_ITERATOR_MALLOCD) {
+		free(iter);
+	}
+}
+
+void *__ao2_global_obj_ref(struct ao2_global_obj *holder)
+{
+	void *obj;
+
+	pthread_rwlock_rdlock(&holder->lock);
+	obj = holder->obj;
+	if (obj) {
+		ao2_ref(obj, +1);
+	}
+	pthread_rwlock_unlock(&holder->lock);
+
+	return obj;
+}
+
+void *__ao2_global_obj_replace(struct ao2_global_obj *holder, void *obj)
+{
+	void *old;
+
+	if (obj) {
+		ao2_ref(obj, +1);
+	}
+
+	pthread_rwlock_wrlock(&holder->lock);
+	old = holder->obj;
+	holder->obj = obj;
+	pthread_rwlock_unlock(&holder->lock);
+
+	return old;
+}
+
+int __ao2_global_obj_replace_unref(struct ao2_global_obj *holder, void *obj)
+{
+	void *old;
+
+	old = __ao2_global_obj_replace(holder, obj);
+	if (!old) {
+		return 0;
+	}
+
+	ao2_ref(old, -1);
+
+	return 1;
+}
+
+static int str_hash(const void *obj, int flags)
+{
+	return ast_str_hash(obj);
+}
+
+static int str_cmp(void *obj, void *arg, int flags)
+{
+	return strcmp(obj, arg) ? 0 : (CMP_MATCH | CMP_STOP);
+}
+
+struct ao2_container *ast_str_container_alloc_options(enum ao2_alloc_opts opts, int buckets)
+{
+	return ao2_container_alloc_hash(opts, 0, buckets, str_hash, NULL, str_cmp);
+}
+
+int ast_str_container_add(struct ao2_container *str_container, const char *add)
+{
+	char *str;
+	size_t len = strlen(add) + 1;
+
+	str = ao2_alloc_options(len, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!str) {
+		return -1;
+	}
+
+	memcpy(str, add, len);
+	ao2_link(str_container, str);
+	ao2_ref(str, -1);
+
+	return 0;
+}
+
+void ast_str_container_remove(struct ao2_container *str_container, const char *remove)
+{
+	ao2_find(str_container, remove, OBJ_SEARCH_KEY | OBJ_NODATA | OBJ_UNLINK);
+}
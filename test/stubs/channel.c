@@ -0,0 +1,637 @@
+#include <asterisk.h>
+#include <asterisk/app.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/bridge.h>
+#include <asterisk/channel.h>
+#include <asterisk/devicestate.h>
+#include <asterisk/features_config.h>
+#include <asterisk/format_cap.h>
+#include <asterisk/linkedlists.h>
+#include <asterisk/musiconhold.h>
+#include <asterisk/pbx.h>
+#include <asterisk/pickup.h>
+#include <asterisk/stasis_channels.h>
+
+/*
+ * Channels are ao2 objects. Once started with ast_pbx_start, a channel belongs to the
+ * PBX thread, which hangs it up when a hangup is queued on it, like the PBX would.
+ */
+struct ast_channel {
+	char name[80];
+	char uniqueid[32];
+	char language[MAX_LANGUAGE];
+	enum ast_channel_state state;
+	const struct ast_channel_tech *tech;
+	void *tech_pvt;
+	struct ast_format_cap *nativeformats;
+	struct ast_format *readformat;
+	struct ast_format *writeformat;
+	int fds[2];
+	int fdno;
+	int hangupcause;
+	ast_group_t callgroup;
+	ast_group_t pickupgroup;
+	struct ast_namedgroups *named_callgroups;
+	struct ast_namedgroups *named_pickupgroups;
+	struct ast_party_connected_line connected;
+	struct ast_party_redirecting redirecting;
+	/* protected by pbx_lock */
+	int started;
+	int hangup_queued;
+	AST_LIST_ENTRY(ast_channel) list;
+};
+
+struct ast_frame ast_null_frame = { .frametype = AST_FRAME_NULL };
+
+static pthread_mutex_t pbx_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pbx_cond = PTHREAD_COND_INITIALIZER;
+static AST_LIST_HEAD_NOLOCK(, ast_channel) pbx_channels;
+static int pbx_shutdown;
+static int pbx_running;
+static pthread_t pbx_thread;
+static struct stub_channel_stats channel_stats;
+static int next_uniqueid;
+
+static void party_id_free(struct ast_party_id *id)
+{
+	ast_free(id->name.str);
+	ast_free(id->number.str);
+	ast_free(id->tag);
+	memset(id, 0, sizeof(*id));
+}
+
+static void party_id_copy(struct ast_party_id *dst, const struct ast_party_id *src, const struct ast_set_party_id *update)
+{
+	if (!update || update->name) {
+		ast_free(dst->name.str);
+		dst->name = src->name;
+		dst->name.str = ast_strdup(src->name.str);
+	}
+
+	if (!update || update->number) {
+		ast_free(dst->number.str);
+		dst->number = src->number;
+		dst->number.str = ast_strdup(src->number.str);
+	}
+}
+
+void ast_party_redirecting_init(struct ast_party_redirecting *init)
+{
+	memset(init, 0, sizeof(*init));
+}
+
+void ast_party_redirecting_free(struct ast_party_redirecting *doomed)
+{
+	party_id_free(&doomed->orig);
+	party_id_free(&doomed->from);
+	party_id_free(&doomed->to);
+	party_id_free(&doomed->priv_orig);
+	party_id_free(&doomed->priv_from);
+	party_id_free(&doomed->priv_to);
+	ast_free(doomed->orig_reason.str);
+	ast_free(doomed->reason.str);
+	memset(doomed, 0, sizeof(*doomed));
+}
+
+void ast_channel_set_redirecting(struct ast_channel *chan, const struct ast_party_redirecting *redirecting, const struct ast_set_party_redirecting *update)
+{
+	party_id_copy(&chan->redirecting.orig, &redirecting->orig, update ? &update->orig : NULL);
+	party_id_copy(&chan->redirecting.from, &redirecting->from, update ? &update->from : NULL);
+	party_id_copy(&chan->redirecting.to, &redirecting->to, update ? &update->to : NULL);
+	chan->redirecting.reason.code = redirecting->reason.code;
+	chan->redirecting.count = redirecting->count;
+}
+
+static void channel_destructor(void *obj)
+{
+	struct ast_channel *chan = obj;
+
+	ao2_cleanup(chan->nativeformats);
+	ao2_cleanup(chan->readformat);
+	ao2_cleanup(chan->writeformat);
+	ast_unref_namedgroups(chan->named_callgroups);
+	ast_unref_namedgroups(chan->named_pickupgroups);
+	party_id_free(&chan->connected.id);
+	ast_party_redirecting_free(&chan->redirecting);
+
+	__atomic_sub_fetch(&channel_stats.live, 1, __ATOMIC_RELAXED);
+}
+
+struct ast_channel *__ast_channel_alloc(int needqueue, int state, const char *cid_num, const char *cid_name, const char *acctcode,
+		const char *exten, const char *context, const struct ast_assigned_ids *assignedids, const struct ast_channel *requestor,
+		int amaflag, const char *name_fmt, ...)
+{
+	struct ast_channel *chan;
+	va_list ap;
+
+	chan = ao2_alloc(sizeof(*chan), channel_destructor);
+	if (!chan) {
+		return NULL;
+	}
+
+	va_start(ap, name_fmt);
+	vsnprintf(chan->name, sizeof(chan->name), name_fmt, ap);
+	va_end(ap);
+
+	snprintf(chan->uniqueid, sizeof(chan->uniqueid), "stub-%d", __atomic_add_fetch(&next_uniqueid, 1, __ATOMIC_RELAXED));
+	chan->state = state;
+	chan->fds[0] = -1;
+	chan->fds[1] = -1;
+	chan->connected.id.name.str = ast_strdup(cid_name);
+	chan->connected.id.number.str = ast_strdup(cid_num);
+
+	__atomic_add_fetch(&channel_stats.allocated, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&channel_stats.live, 1, __ATOMIC_RELAXED);
+
+	/* returned locked, like the real one */
+	ao2_lock(chan);
+
+	return chan;
+}
+
+struct ast_channel *ast_channel_release(struct ast_channel *chan)
+{
+	ao2_ref(chan, -1);
+
+	return NULL;
+}
+
+void ast_hangup(struct ast_channel *chan)
+{
+	int started;
+
+	pthread_mutex_lock(&pbx_lock);
+	started = chan->started;
+	if (started) {
+		AST_LIST_REMOVE(&pbx_channels, chan, list);
+		chan->started = 0;
+	}
+	pthread_mutex_unlock(&pbx_lock);
+
+	ao2_lock(chan);
+	if (chan->tech && chan->tech->hangup) {
+		chan->tech->hangup(chan);
+	}
+	ao2_unlock(chan);
+
+	__atomic_add_fetch(&channel_stats.hungup, 1, __ATOMIC_RELAXED);
+
+	/* the reference of the PBX thread */
+	if (started) {
+		ao2_ref(chan, -1);
+	}
+
+	ast_channel_release(chan);
+}
+
+const char *ast_channel_name(const struct ast_channel *chan)
+{
+	return chan->name;
+}
+
+const char *ast_channel_uniqueid(const struct ast_channel *chan)
+{
+	return chan->uniqueid;
+}
+
+enum ast_channel_state ast_channel_state(const struct ast_channel *chan)
+{
+	return chan->state;
+}
+
+void *ast_channel_tech_pvt(const struct ast_channel *chan)
+{
+	return chan->tech_pvt;
+}
+
+void ast_channel_tech_pvt_set(struct ast_channel *chan, void *value)
+{
+	chan->tech_pvt = value;
+}
+
+const struct ast_channel_tech *ast_channel_tech(const struct ast_channel *chan)
+{
+	return chan->tech;
+}
+
+void ast_channel_tech_set(struct ast_channel *chan, const struct ast_channel_tech *value)
+{
+	chan->tech = value;
+}
+
+struct ast_format_cap *ast_channel_nativeformats(const struct ast_channel *chan)
+{
+	return chan->nativeformats;
+}
+
+void ast_channel_nativeformats_set(struct ast_channel *chan, struct ast_format_cap *value)
+{
+	ao2_replace(chan->nativeformats, value);
+}
+
+struct ast_format *ast_channel_readformat(struct ast_channel *chan)
+{
+	return chan->readformat;
+}
+
+struct ast_format *ast_channel_writeformat(struct ast_channel *chan)
+{
+	return chan->writeformat;
+}
+
+void ast_channel_set_readformat(struct ast_channel *chan, struct ast_format *format)
+{
+	ao2_replace(chan->readformat, format);
+}
+
+void ast_channel_set_writeformat(struct ast_channel *chan, struct ast_format *format)
+{
+	ao2_replace(chan->writeformat, format);
+}
+
+void ast_channel_set_rawreadformat(struct ast_channel *chan, struct ast_format *format)
+{
+}
+
+void ast_channel_set_rawwriteformat(struct ast_channel *chan, struct ast_format *format)
+{
+}
+
+int ast_set_read_format(struct ast_channel *chan, struct ast_format *format)
+{
+	ast_channel_set_readformat(chan, format);
+
+	return 0;
+}
+
+int ast_set_write_format(struct ast_channel *chan, struct ast_format *format)
+{
+	ast_channel_set_writeformat(chan, format);
+
+	return 0;
+}
+
+int ast_channel_fdno(const struct ast_channel *chan)
+{
+	return chan->fdno;
+}
+
+void ast_channel_set_fd(struct ast_channel *chan, int which, int value)
+{
+	if (which >= 0 && which < (int) ARRAY_LEN(chan->fds)) {
+		chan->fds[which] = value;
+	}
+}
+
+void ast_channel_hangupcause_set(struct ast_channel *chan, int value)
+{
+	chan->hangupcause = value;
+}
+
+void ast_channel_call_forward_set(struct ast_channel *chan, const char *value)
+{
+}
+
+void ast_channel_language_set(struct ast_channel *chan, const char *value)
+{
+	ast_copy_string(chan->language, value, sizeof(chan->language));
+}
+
+void ast_channel_callgroup_set(struct ast_channel *chan, ast_group_t value)
+{
+	chan->callgroup = value;
+}
+
+void ast_channel_pickupgroup_set(struct ast_channel *chan, ast_group_t value)
+{
+	chan->pickupgroup = value;
+}
+
+void ast_channel_named_callgroups_set(struct ast_channel *chan, struct ast_namedgroups *value)
+{
+	ast_unref_namedgroups(chan->named_callgroups);
+	chan->named_callgroups = ast_ref_namedgroups(value);
+}
+
+void ast_channel_named_pickupgroups_set(struct ast_channel *chan, struct ast_namedgroups *value)
+{
+	ast_unref_namedgroups(chan->named_pickupgroups);
+	chan->named_pickupgroups = ast_ref_namedgroups(value);
+}
+
+struct ast_party_connected_line *ast_channel_connected(struct ast_channel *chan)
+{
+	return &chan->connected;
+}
+
+struct ast_party_redirecting *ast_channel_redirecting(struct ast_channel *chan)
+{
+	return &chan->redirecting;
+}
+
+void ast_channel_stage_snapshot(struct ast_channel *chan)
+{
+}
+
+void ast_channel_stage_snapshot_done(struct ast_channel *chan)
+{
+}
+
+int ast_setstate(struct ast_channel *chan, enum ast_channel_state state)
+{
+	chan->state = state;
+
+	return 0;
+}
+
+int pbx_builtin_setvar_helper(struct ast_channel *chan, const char *name, const char *value)
+{
+	return 0;
+}
+
+int ast_queue_hangup(struct ast_channel *chan)
+{
+	pthread_mutex_lock(&pbx_lock);
+	if (chan->started && !chan->hangup_queued) {
+		chan->hangup_queued = 1;
+		pthread_cond_signal(&pbx_cond);
+	}
+	pthread_mutex_unlock(&pbx_lock);
+
+	return 0;
+}
+
+int ast_queue_frame(struct ast_channel *chan, struct ast_frame *frame)
+{
+	__atomic_add_fetch(&channel_stats.frames_queued, 1, __ATOMIC_RELAXED);
+
+	if (frame->frametype == AST_FRAME_CONTROL && frame->subclass.integer == AST_CONTROL_HANGUP) {
+		return ast_queue_hangup(chan);
+	}
+
+	return 0;
+}
+
+int ast_queue_control(struct ast_channel *chan, enum ast_control_frame_type control)
+{
+	__atomic_add_fetch(&channel_stats.controls_queued, 1, __ATOMIC_RELAXED);
+
+	if (control == AST_CONTROL_HANGUP) {
+		return ast_queue_hangup(chan);
+	}
+
+	return 0;
+}
+
+int ast_queue_hold(struct ast_channel *chan, const char *musicclass)
+{
+	return ast_queue_control(chan, AST_CONTROL_HOLD);
+}
+
+int ast_queue_unhold(struct ast_channel *chan)
+{
+	return ast_queue_control(chan, AST_CONTROL_UNHOLD);
+}
+
+/*
+ * The PBX thread answers nothing and dials nothing, it only hangs up the channels a
+ * hangup has been queued on.
+ */
+static void *pbx_run(void *data)
+{
+	struct ast_channel *chan;
+
+	pthread_mutex_lock(&pbx_lock);
+	for (;;) {
+		AST_LIST_TRAVERSE(&pbx_channels, chan, list) {
+			if (chan->hangup_queued) {
+				break;
+			}
+		}
+
+		if (chan) {
+			/* ast_hangup releases the reference of the PBX thread, and the caller's */
+			ao2_ref(chan, +1);
+			pthread_mutex_unlock(&pbx_lock);
+			ast_hangup(chan);
+			pthread_mutex_lock(&pbx_lock);
+			continue;
+		}
+
+		if (pbx_shutdown) {
+			break;
+		}
+
+		pthread_cond_wait(&pbx_cond, &pbx_lock);
+	}
+	pthread_mutex_unlock(&pbx_lock);
+
+	return NULL;
+}
+
+enum ast_pbx_result ast_pbx_start(struct ast_channel *c)
+{
+	pthread_mutex_lock(&pbx_lock);
+	if (!pbx_running || c->started) {
+		pthread_mutex_unlock(&pbx_lock);
+		return AST_PBX_FAILED;
+	}
+
+	/* the reference of the caller is transferred to the PBX thread */
+	c->started = 1;
+	AST_LIST_INSERT_TAIL(&pbx_channels, c, list);
+	pthread_mutex_unlock(&pbx_lock);
+
+	__atomic_add_fetch(&channel_stats.started, 1, __ATOMIC_RELAXED);
+
+	return AST_PBX_SUCCESS;
+}
+
+int stub_channels_init(void)
+{
+	pbx_shutdown = 0;
+	if (pthread_create(&pbx_thread, NULL, pbx_run, NULL)) {
+		return -1;
+	}
+
+	pbx_running = 1;
+
+	return 0;
+}
+
+void stub_channels_destroy(void)
+{
+	struct ast_channel *chan;
+
+	if (!pbx_running) {
+		return;
+	}
+
+	pthread_mutex_lock(&pbx_lock);
+	AST_LIST_TRAVERSE(&pbx_channels, chan, list) {
+		chan->hangup_queued = 1;
+	}
+
+	pbx_running = 0;
+	pbx_shutdown = 1;
+	pthread_cond_signal(&pbx_cond);
+	pthread_mutex_unlock(&pbx_lock);
+
+	pthread_join(pbx_thread, NULL);
+}
+
+void stub_channels_take_stats(struct stub_channel_stats *stats)
+{
+	stats->allocated = __atomic_load_n(&channel_stats.allocated, __ATOMIC_RELAXED);
+	stats->started = __atomic_load_n(&channel_stats.started, __ATOMIC_RELAXED);
+	stats->hungup = __atomic_load_n(&channel_stats.hungup, __ATOMIC_RELAXED);
+	stats->live = __atomic_load_n(&channel_stats.live, __ATOMIC_RELAXED);
+	stats->frames_queued = __atomic_load_n(&channel_stats.frames_queued, __ATOMIC_RELAXED);
+	stats->controls_queued = __atomic_load_n(&channel_stats.controls_queued, __ATOMIC_RELAXED);
+}
+
+struct ast_channel *stub_channel_find_started(void)
+{
+	struct ast_channel *chan;
+
+	pthread_mutex_lock(&pbx_lock);
+	AST_LIST_TRAVERSE(&pbx_channels, chan, list) {
+		if (!chan->hangup_queued) {
+			ao2_ref(chan, +1);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pbx_lock);
+
+	return chan;
+}
+
+struct ast_frame *stub_channel_read(struct ast_channel *chan, int fdno)
+{
+	struct ast_frame *frame = &ast_null_frame;
+
+	ao2_lock(chan);
+	chan->fdno = fdno;
+	if (chan->tech && chan->tech->read) {
+		frame = chan->tech->read(chan);
+	}
+	chan->fdno = -1;
+	ao2_unlock(chan);
+
+	return frame;
+}
+
+int stub_channel_write(struct ast_channel *chan, struct ast_frame *frame)
+{
+	int ret = -1;
+
+	ao2_lock(chan);
+	if (chan->tech && chan->tech->write) {
+		ret = chan->tech->write(chan, frame);
+	}
+	ao2_unlock(chan);
+
+	return ret;
+}
+
+int ast_pickup_call(struct ast_channel *chan)
+{
+	return -1;
+}
+
+int ast_moh_start(struct ast_channel *chan, const char *mclass, const char *interpclass)
+{
+	return 0;
+}
+
+void ast_moh_stop(struct ast_channel *chan)
+{
+}
+
+enum ast_transfer_result ast_bridge_transfer_attended(struct ast_channel *to_transferee, struct ast_channel *to_transfer_target)
+{
+	return AST_BRIDGE_TRANSFER_INVALID;
+}
+
+struct ast_features_pickup_config *ast_get_chan_features_pickup_config(struct ast_channel *chan)
+{
+	struct ast_features_pickup_config *cfg;
+
+	cfg = ao2_alloc_options(sizeof(*cfg), NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!cfg) {
+		return NULL;
+	}
+
+	cfg->pickupexten = "*8";
+
+	return cfg;
+}
+
+int ast_devstate_changed(enum ast_device_state state, enum ast_devstate_cache cachable, const char *fmt, ...)
+{
+	return 0;
+}
+
+int ast_extension_state(struct ast_channel *c, const char *context, const char *exten)
+{
+	return AST_EXTENSION_NOT_INUSE;
+}
+
+int ast_extension_state_add(const char *context, const char *exten, ast_state_cb_type change_cb, void *data)
+{
+	static int next_id;
+
+	return __atomic_add_fetch(&next_id, 1, __ATOMIC_RELAXED);
+}
+
+int ast_extension_state_del(int id, ast_state_cb_type change_cb)
+{
+	return 0;
+}
+
+int ast_app_inboxcount(const char *mailboxes, int *newmsgs, int *oldmsgs)
+{
+	*newmsgs = 0;
+	*oldmsgs = 0;
+
+	return 0;
+}
+
+/* nothing is ever published, the subscriptions are only tokens */
+struct stasis_subscription {
+	int unused;
+};
+
+struct stasis_message_type *ast_mwi_state_type(void)
+{
+	return NULL;
+}
+
+struct stasis_topic *ast_mwi_topic(const char *uniqueid)
+{
+	static int topic;
+
+	return (struct stasis_topic *) &topic;
+}
+
+struct stasis_message_type *stasis_message_type(const struct stasis_message *msg)
+{
+	return NULL;
+}
+
+void *stasis_message_data(const struct stasis_message *msg)
+{
+	return NULL;
+}
+
+struct stasis_subscription *stasis_subscribe_pool(struct stasis_topic *topic, stasis_subscription_cb callback, void *data)
+{
+	return calloc(1, sizeof(struct stasis_subscription));
+}
+
+struct stasis_subscription *stasis_unsubscribe_and_join(struct stasis_subscription *subscription)
+{
+	free(subscription);
+
+	return NULL;
+}
@@ -0,0 +1,709 @@
+#include <limits.h>
+#include <regex.h>
+#include <sqlite3.h>
+#include <sys/stat.h>
+
+#include <asterisk.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/config.h>
+#include <asterisk/config_options.h>
+#include <asterisk/format_cap.h>
+#include <asterisk/lock.h>
+#include <asterisk/paths.h>
+#include <asterisk/strings.h>
+#include <asterisk/utils.h>
+
+/*
+ * The config framework supports what the driver uses: one file, without templates nor
+ * includes, global and item types matched by category regex and match field, and the
+ * option types registered by the driver.
+ */
+
+struct aco_option {
+	const char *name;
+	enum aco_option_type type;
+	const char *default_val;
+	aco_option_handler handler;
+	unsigned int flags;
+	/* the field offset, then the range or the field size */
+	size_t offset;
+	long long min;
+	long long max;
+	size_t size;
+	struct aco_option *next;
+};
+
+struct aco_type_internal {
+	regex_t regex;
+	struct aco_option *options;
+};
+
+struct aco_info_internal {
+	void *pending;
+	int loaded;
+	struct stat last_stat;
+};
+
+static int type_init(struct aco_type *type)
+{
+	if (type->internal) {
+		return 0;
+	}
+
+	type->internal = ast_calloc(1, sizeof(*type->internal));
+	if (!type->internal) {
+		return -1;
+	}
+
+	if (regcomp(&type->internal->regex, type->category, REG_EXTENDED | REG_NOSUB)) {
+		ast_log(LOG_ERROR, "Invalid category regex '%s' for type %s\n", type->category, type->name);
+		ast_free(type->internal);
+		type->internal = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void type_destroy(struct aco_type *type)
+{
+	struct aco_option *opt;
+
+	if (!type->internal) {
+		return;
+	}
+
+	while ((opt = type->internal->options)) {
+		type->internal->options = opt->next;
+		ast_free(opt);
+	}
+
+	regfree(&type->internal->regex);
+	ast_free(type->internal);
+	type->internal = NULL;
+}
+
+int aco_info_init(struct aco_info *info)
+{
+	size_t i;
+	size_t j;
+
+	info->internal = ast_calloc(1, sizeof(*info->internal));
+	if (!info->internal) {
+		return -1;
+	}
+
+	for (i = 0; info->files[i]; i++) {
+		for (j = 0; info->files[i]->types[j]; j++) {
+			if (type_init(info->files[i]->types[j])) {
+				aco_info_destroy(info);
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+void aco_info_destroy(struct aco_info *info)
+{
+	size_t i;
+	size_t j;
+
+	if (!info->internal) {
+		return;
+	}
+
+	for (i = 0; info->files[i]; i++) {
+		for (j = 0; info->files[i]->types[j]; j++) {
+			type_destroy(info->files[i]->types[j]);
+		}
+	}
+
+	ast_free(info->internal);
+	info->internal = NULL;
+}
+
+void *aco_pending_config(struct aco_info *info)
+{
+	return info->internal->pending;
+}
+
+unsigned int aco_option_get_flags(const struct aco_option *option)
+{
+	return option->flags;
+}
+
+static int register_option(struct aco_type **types, const struct aco_option *template)
+{
+	struct aco_option *opt;
+	size_t i;
+
+	for (i = 0; types[i]; i++) {
+		if (!types[i]->internal) {
+			return -1;
+		}
+
+		opt = ast_malloc(sizeof(*opt));
+		if (!opt) {
+			return -1;
+		}
+
+		*opt = *template;
+		opt->next = types[i]->internal->options;
+		types[i]->internal->options = opt;
+	}
+
+	return 0;
+}
+
+int aco_option_register(struct aco_info *info, const char *name, enum aco_matchtype matchtype, struct aco_type **types,
+		const char *default_val, enum aco_option_type type, unsigned int flags, ...)
+{
+	struct aco_option opt = {
+		.name = name,
+		.type = type,
+		.default_val = default_val,
+		.flags = flags,
+	};
+	va_list ap;
+
+	va_start(ap, flags);
+	switch (type) {
+	case OPT_INT_T:
+	case OPT_UINT_T:
+		opt.offset = va_arg(ap, size_t);
+		if (flags & PARSE_IN_RANGE) {
+			opt.min = va_arg(ap, int);
+			opt.max = va_arg(ap, int);
+		} else {
+			opt.min = type == OPT_INT_T ? INT_MIN : 0;
+			opt.max = type == OPT_INT_T ? INT_MAX : UINT_MAX;
+		}
+		break;
+	case OPT_BOOL_T:
+	case OPT_CODEC_T:
+		opt.offset = va_arg(ap, size_t);
+		break;
+	case OPT_CHAR_ARRAY_T:
+		opt.offset = va_arg(ap, size_t);
+		opt.size = va_arg(ap, size_t);
+		break;
+	case OPT_NOOP_T:
+		break;
+	default:
+		va_end(ap);
+		ast_log(LOG_ERROR, "Option type %d of %s is not supported\n", type, name);
+		return -1;
+	}
+	va_end(ap);
+
+	return register_option(types, &opt);
+}
+
+int aco_option_register_custom(struct aco_info *info, const char *name, enum aco_matchtype matchtype, struct aco_type **types,
+		const char *default_val, aco_option_handler handler, unsigned int flags)
+{
+	struct aco_option opt = {
+		.name = name,
+		.type = OPT_CUSTOM_T,
+		.default_val = default_val,
+		.handler = handler,
+		.flags = flags,
+	};
+
+	return register_option(types, &opt);
+}
+
+static int parse_number(const struct aco_option *opt, const char *value, long long *number)
+{
+	char *end;
+
+	errno = 0;
+	*number = strtoll(value, &end, 0);
+	if (errno || end == value || *ast_skip_blanks(end) != '\0') {
+		return -1;
+	}
+
+	if (*number < opt->min || *number > opt->max) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int apply_option(const struct aco_option *opt, struct ast_variable *var, void *obj)
+{
+	char *field = (char *) obj + opt->offset;
+	long long number;
+
+	switch (opt->type) {
+	case OPT_INT_T:
+		if (parse_number(opt, var->value, &number)) {
+			return -1;
+		}
+
+		*(int *) field = number;
+		return 0;
+	case OPT_UINT_T:
+		if (parse_number(opt, var->value, &number)) {
+			return -1;
+		}
+
+		*(unsigned int *) field = number;
+		return 0;
+	case OPT_BOOL_T:
+		*(unsigned int *) field = opt->flags ? ast_true(var->value) : ast_false(var->value);
+		return 0;
+	case OPT_CHAR_ARRAY_T:
+		if (strlen(var->value) >= opt->size) {
+			return -1;
+		}
+
+		ast_copy_string(field, var->value, opt->size);
+		return 0;
+	case OPT_CODEC_T:
+		return ast_format_cap_update_by_allow_disallow(*(struct ast_format_cap **) field, var->value, opt->flags);
+	case OPT_CUSTOM_T:
+		return opt->handler(opt, var, obj);
+	case OPT_NOOP_T:
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+int aco_process_var(struct aco_type *type, const char *cat, struct ast_variable *var, void *obj)
+{
+	struct aco_option *opt;
+
+	for (opt = type->internal->options; opt; opt = opt->next) {
+		if (!strcasecmp(opt->name, var->name)) {
+			break;
+		}
+	}
+
+	if (!opt) {
+		ast_log(LOG_ERROR, "Could not find option suitable for category '%s' named '%s'\n", cat, var->name);
+		return -1;
+	}
+
+	if (apply_option(opt, var, obj)) {
+		ast_log(LOG_ERROR, "Error parsing %s=%s in category '%s'\n", var->name, var->value, cat);
+		return -1;
+	}
+
+	return 0;
+}
+
+int aco_set_defaults(struct aco_type *type, const char *category, void *obj)
+{
+	struct aco_option *opt;
+	struct ast_variable *var;
+	int ret;
+
+	for (opt = type->internal->options; opt; opt = opt->next) {
+		if (ast_strlen_zero(opt->default_val)) {
+			continue;
+		}
+
+		var = ast_variable_new(opt->name, opt->default_val, "");
+		if (!var) {
+			return -1;
+		}
+
+		ret = apply_option(opt, var, obj);
+		ast_variables_destroy(var);
+		if (ret) {
+			ast_log(LOG_ERROR, "Error setting the default value of %s in category '%s'\n", opt->name, category);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int type_matches(struct aco_type *type, const char *category, struct ast_variable *vars)
+{
+	struct ast_variable *var;
+	int match;
+
+	match = !regexec(&type->internal->regex, category, 0, NULL, 0);
+	if (type->category_match == ACO_BLACKLIST) {
+		match = !match;
+	}
+
+	if (!match) {
+		return 0;
+	}
+
+	if (!type->matchfield) {
+		return 1;
+	}
+
+	for (var = vars; var; var = var->next) {
+		if (!strcasecmp(var->name, type->matchfield)) {
+			return !strcasecmp(var->value, type->matchvalue);
+		}
+	}
+
+	return 0;
+}
+
+static int process_category(struct aco_info *info, struct aco_file *file, const char *category, struct ast_variable *vars)
+{
+	struct ao2_container *container;
+	struct ast_variable *var;
+	struct aco_type *type = NULL;
+	void **field;
+	void *obj;
+	int new = 0;
+	int ret = -1;
+	size_t i;
+
+	for (i = 0; file->types[i]; i++) {
+		if (type_matches(file->types[i], category, vars)) {
+			type = file->types[i];
+			break;
+		}
+	}
+
+	if (!type) {
+		ast_log(LOG_ERROR, "Could not find config type for category '%s' in '%s'\n", category, file->filename);
+		return -1;
+	}
+
+	field = (void **) ((char *) info->internal->pending + type->item_offset);
+	if (type->type == ACO_GLOBAL) {
+		obj = *field;
+		ao2_ref(obj, +1);
+	} else {
+		container = *field;
+		obj = type->item_find(container, category);
+		if (!obj) {
+			obj = type->item_alloc(category);
+			if (!obj) {
+				return -1;
+			}
+
+			if (aco_set_defaults(type, category, obj)) {
+				goto end;
+			}
+
+			new = 1;
+		}
+	}
+
+	if (type->item_pre_process && type->item_pre_process(obj)) {
+		goto end;
+	}
+
+	for (var = vars; var; var = var->next) {
+		if (aco_process_var(type, category, var, obj)) {
+			goto end;
+		}
+	}
+
+	if (type->item_prelink && type->item_prelink(obj)) {
+		goto end;
+	}
+
+	if (new && !ao2_link(*field, obj)) {
+		goto end;
+	}
+
+	ret = 0;
+
+end:
+	ao2_ref(obj, -1);
+
+	return ret;
+}
+
+/*
+ * Parse the file, a category at a time: "[name]" lines, then "name = value" or
+ * "name => value" lines, with ';' starting a comment.
+ */
+static int process_file(struct aco_info *info, struct aco_file *file, FILE *fp)
+{
+	struct ast_variable *vars = NULL;
+	struct ast_variable **tail = &vars;
+	struct ast_variable *var;
+	char *category = NULL;
+	char *line = NULL;
+	size_t line_size = 0;
+	char *value;
+	char *name;
+	char *end;
+	int ret = 0;
+
+	while (!ret && getline(&line, &line_size, fp) != -1) {
+		end = strchr(line, ';');
+		if (end) {
+			*end = '\0';
+		}
+
+		name = ast_strip(line);
+		if (ast_strlen_zero(name)) {
+			continue;
+		}
+
+		if (name[0] == '[') {
+			end = strchr(name, ']');
+			if (!end) {
+				ast_log(LOG_ERROR, "parse error: no closing ']' in '%s'\n", name);
+				ret = -1;
+				break;
+			}
+
+			*end = '\0';
+			if (category) {
+				ret = process_category(info, file, category, vars);
+			}
+
+			ast_variables_destroy(vars);
+			vars = NULL;
+			tail = &vars;
+			ast_free(category);
+			category = ast_strdup(name + 1);
+			if (!category) {
+				ret = -1;
+			}
+
+			continue;
+		}
+
+		value = strchr(name, '=');
+		if (!value || !category) {
+			ast_log(LOG_ERROR, "parse error: no category or value for '%s'\n", name);
+			ret = -1;
+			break;
+		}
+
+		*value++ = '\0';
+		if (*value == '>') {
+			value++;
+		}
+
+		var = ast_variable_new(ast_strip(name), ast_strip(value), file->filename);
+		if (!var) {
+			ret = -1;
+			break;
+		}
+
+		*tail = var;
+		tail = &var->next;
+	}
+
+	if (!ret && category) {
+		ret = process_category(info, file, category, vars);
+	}
+
+	ast_variables_destroy(vars);
+	ast_free(category);
+	free(line);
+
+	return ret;
+}
+
+static int set_global_defaults(struct aco_info *info, struct aco_file *file)
+{
+	struct aco_type *type;
+	size_t i;
+
+	for (i = 0; file->types[i]; i++) {
+		type = file->types[i];
+		if (type->type == ACO_GLOBAL &&
+				aco_set_defaults(type, "", *(void **) ((char *) info->internal->pending + type->item_offset))) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+enum aco_process_status aco_process_config(struct aco_info *info, int reload)
+{
+	struct aco_file *file = info->files[0];
+	char path[PATH_MAX];
+	struct stat st;
+	FILE *fp;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/%s", ast_config_AST_CONFIG_DIR, file->filename);
+	fp = fopen(path, "r");
+	if (!fp || fstat(fileno(fp), &st)) {
+		ast_log(LOG_ERROR, "Unable to load config file '%s'\n", path);
+		if (fp) {
+			fclose(fp);
+		}
+
+		return ACO_PROCESS_ERROR;
+	}
+
+	if (reload && info->internal->loaded && st.st_ino == info->internal->last_stat.st_ino && st.st_size == info->internal->last_stat.st_size &&
+			st.st_mtim.tv_sec == info->internal->last_stat.st_mtim.tv_sec && st.st_mtim.tv_nsec == info->internal->last_stat.st_mtim.tv_nsec) {
+		fclose(fp);
+		return ACO_PROCESS_UNCHANGED;
+	}
+
+	info->internal->pending = info->snapshot_alloc();
+	if (!info->internal->pending) {
+		fclose(fp);
+		return ACO_PROCESS_ERROR;
+	}
+
+	ret = set_global_defaults(info, file);
+	if (!ret) {
+		ret = process_file(info, file, fp);
+	}
+
+	fclose(fp);
+
+	if (!ret && info->pre_apply_config) {
+		ret = info->pre_apply_config();
+	}
+
+	if (ret) {
+		ao2_ref(info->internal->pending, -1);
+		info->internal->pending = NULL;
+		return ACO_PROCESS_ERROR;
+	}
+
+	__ao2_global_obj_replace_unref(info->global_obj, info->internal->pending);
+	if (info->post_apply_config) {
+		info->post_apply_config();
+	}
+
+	ao2_ref(info->internal->pending, -1);
+	info->internal->pending = NULL;
+	info->internal->loaded = 1;
+	info->internal->last_stat = st;
+
+	return ACO_PROCESS_OK;
+}
+
+/*
+ * Realtime is served from a SQLite file, every family being a table of the same name.
+ * The connection is shared and serialized, like a single database handle would be.
+ */
+AST_MUTEX_DEFINE_STATIC(realtime_lock);
+static sqlite3 *realtime_db;
+
+int stub_realtime_set_sqlite(const char *path)
+{
+	int ret = 0;
+
+	ast_mutex_lock(&realtime_lock);
+	if (realtime_db) {
+		sqlite3_close(realtime_db);
+		realtime_db = NULL;
+	}
+
+	if (path && sqlite3_open_v2(path, &realtime_db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+		ast_log(LOG_ERROR, "Unable to open %s: %s\n", path, sqlite3_errmsg(realtime_db));
+		sqlite3_close(realtime_db);
+		realtime_db = NULL;
+		ret = -1;
+	}
+	ast_mutex_unlock(&realtime_lock);
+
+	return ret;
+}
+
+static int table_exists(const char *family)
+{
+	sqlite3_stmt *stmt;
+	int exists;
+
+	if (sqlite3_prepare_v2(realtime_db, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?", -1, &stmt, NULL) != SQLITE_OK) {
+		return 0;
+	}
+
+	sqlite3_bind_text(stmt, 1, family, -1, SQLITE_STATIC);
+	exists = sqlite3_step(stmt) == SQLITE_ROW;
+	sqlite3_finalize(stmt);
+
+	return exists;
+}
+
+int ast_check_realtime(const char *family)
+{
+	int ret;
+
+	ast_mutex_lock(&realtime_lock);
+	ret = realtime_db && table_exists(family);
+	ast_mutex_unlock(&realtime_lock);
+
+	return ret;
+}
+
+/*
+ * The family and column names are not quoted, they come from the driver, not the user.
+ */
+struct ast_variable *ast_load_realtime(const char *family, ...)
+{
+	struct ast_str *sql;
+	struct ast_variable *vars = NULL;
+	struct ast_variable **tail = &vars;
+	struct ast_variable *var;
+	sqlite3_stmt *stmt = NULL;
+	const char *values[8];
+	const char *name;
+	const char *value;
+	va_list ap;
+	int count = 0;
+	int i;
+
+	sql = ast_str_create(128);
+	if (!sql) {
+		return NULL;
+	}
+
+	ast_str_set(&sql, 0, "SELECT * FROM %s WHERE ", family);
+	va_start(ap, family);
+	while ((name = va_arg(ap, const char *)) && count < (int) ARRAY_LEN(values)) {
+		values[count] = va_arg(ap, const char *);
+		ast_str_append(&sql, 0, "%s%s = ?", count ? " AND " : "", name);
+		count++;
+	}
+	va_end(ap);
+	ast_str_append(&sql, 0, " LIMIT 1");
+
+	ast_mutex_lock(&realtime_lock);
+	if (!realtime_db || sqlite3_prepare_v2(realtime_db, ast_str_buffer(sql), -1, &stmt, NULL) != SQLITE_OK) {
+		goto end;
+	}
+
+	for (i = 0; i < count; i++) {
+		sqlite3_bind_text(stmt, i + 1, values[i], -1, SQLITE_STATIC);
+	}
+
+	if (sqlite3_step(stmt) != SQLITE_ROW) {
+		goto end;
+	}
+
+	for (i = 0; i < sqlite3_column_count(stmt); i++) {
+		value = (const char *) sqlite3_column_text(stmt, i);
+		if (ast_strlen_zero(value)) {
+			continue;
+		}
+
+		var = ast_variable_new(sqlite3_column_name(stmt, i), value, "");
+		if (!var) {
+			ast_variables_destroy(vars);
+			vars = NULL;
+			goto end;
+		}
+
+		*tail = var;
+		tail = &var->next;
+	}
+
+end:
+	sqlite3_finalize(stmt);
+	ast_mutex_unlock(&realtime_lock);
+	ast_free(sql);
+
+	return vars;
+}
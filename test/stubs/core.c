@@ -0,0 +1,891 @@
+#include <ctype.h>
+#include <sys/stat.h>
+
+#include <asterisk.h>
+#include <asterisk/astdb.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/cli.h>
+#include <asterisk/heap.h>
+#include <asterisk/lock.h>
+#include <asterisk/logger.h>
+#include <asterisk/network.h>
+#include <asterisk/paths.h>
+#include <asterisk/strings.h>
+#include <asterisk/time.h>
+#include <asterisk/utils.h>
+
+int stub_option_verbose;
+int stub_option_debug;
+
+const char *ast_config_AST_CONFIG_DIR = ".";
+const char *ast_config_AST_LOG_DIR = ".";
+const char *ast_config_AST_CACHE_DIR = ".";
+
+static const char *level_str[] = {
+	[__LOG_DEBUG] = "DEBUG",
+	[__LOG_NOTICE] = "NOTICE",
+	[__LOG_WARNING] = "WARNING",
+	[__LOG_ERROR] = "ERROR",
+};
+
+void ast_log(int level, const char *file, int line, const char *function, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (level == __LOG_NOTICE && stub_option_verbose < 1) {
+		return;
+	}
+
+	flockfile(stderr);
+	fprintf(stderr, "[%s] %s:%d %s: ", level_str[level], file, line, function);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	funlockfile(stderr);
+}
+
+void __ast_verbose(int level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (level > stub_option_verbose) {
+		return;
+	}
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+int ast_asprintf(char **ret, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vasprintf(ret, fmt, ap);
+	va_end(ap);
+
+	if (n < 0) {
+		*ret = NULL;
+	}
+
+	return n;
+}
+
+void stub_set_dirs(const char *config_dir, const char *log_dir, const char *cache_dir)
+{
+	ast_config_AST_CONFIG_DIR = config_dir;
+	ast_config_AST_LOG_DIR = log_dir;
+	ast_config_AST_CACHE_DIR = cache_dir;
+}
+
+int ast_mutex_init(ast_mutex_t *mutex)
+{
+	pthread_mutexattr_t attr;
+	int ret;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	ret = pthread_mutex_init(mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	return ret;
+}
+
+int ast_mutex_destroy(ast_mutex_t *mutex)
+{
+	return pthread_mutex_destroy(mutex);
+}
+
+int ast_pthread_create(pthread_t *thread, pthread_attr_t *attr, void *(*start_routine)(void *), void *data)
+{
+	return pthread_create(thread, attr, start_routine, data);
+}
+
+int ast_pthread_create_detached(pthread_t *thread, pthread_attr_t *attr, void *(*start_routine)(void *), void *data)
+{
+	pthread_attr_t detached;
+	int ret;
+
+	pthread_attr_init(&detached);
+	pthread_attr_setdetachstate(&detached, PTHREAD_CREATE_DETACHED);
+	ret = pthread_create(thread, &detached, start_routine, data);
+	pthread_attr_destroy(&detached);
+
+	return ret;
+}
+
+int ast_atomic_fetchadd_int(volatile int *p, int v)
+{
+	return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST);
+}
+
+int ast_atomic_dec_and_test(volatile int *p)
+{
+	return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST) == 0;
+}
+
+void ast_copy_string(char *dst, const char *src, size_t size)
+{
+	size_t len;
+
+	if (!size) {
+		return;
+	}
+
+	len = strnlen(src, size - 1);
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+}
+
+int ast_true(const char *s)
+{
+	if (ast_strlen_zero(s)) {
+		return 0;
+	}
+
+	return !strcasecmp(s, "yes") || !strcasecmp(s, "true") || !strcasecmp(s, "y") || !strcasecmp(s, "t") ||
+			!strcasecmp(s, "1") || !strcasecmp(s, "on") ? -1 : 0;
+}
+
+int ast_false(const char *s)
+{
+	if (ast_strlen_zero(s)) {
+		return 0;
+	}
+
+	return !strcasecmp(s, "no") || !strcasecmp(s, "false") || !strcasecmp(s, "n") || !strcasecmp(s, "f") ||
+			!strcasecmp(s, "0") || !strcasecmp(s, "off") ? -1 : 0;
+}
+
+char *ast_skip_blanks(const char *str)
+{
+	while (*str && isspace((unsigned char) *str)) {
+		str++;
+	}
+
+	return (char *) str;
+}
+
+char *ast_trim_blanks(char *str)
+{
+	char *work = str;
+
+	if (work) {
+		work += strlen(work) - 1;
+		while (work >= str && isspace((unsigned char) *work)) {
+			*(work--) = '\0';
+		}
+	}
+
+	return str;
+}
+
+char *ast_strip(char *s)
+{
+	if ((s = ast_skip_blanks(s))) {
+		ast_trim_blanks(s);
+	}
+
+	return s;
+}
+
+int ast_str_hash(const char *str)
+{
+	int hash = 5381;
+
+	while (*str) {
+		hash = hash * 33 ^ (unsigned char) *str++;
+	}
+
+	return abs(hash);
+}
+
+int ast_str_case_hash(const char *str)
+{
+	int hash = 5381;
+
+	while (*str) {
+		hash = hash * 33 ^ tolower((unsigned char) *str++);
+	}
+
+	return abs(hash);
+}
+
+int ast_get_encoded_str(const char *stream, char *result, size_t result_len)
+{
+	ast_copy_string(result, stream, result_len);
+
+	return 0;
+}
+
+const char *ast_inet_ntoa(struct in_addr ia)
+{
+	static __thread char buf[INET_ADDRSTRLEN];
+
+	return inet_ntop(AF_INET, &ia, buf, sizeof(buf));
+}
+
+static const struct {
+	const char *name;
+	unsigned int space;
+} dscp_pool1[] = {
+	{ "CS0", 0x00 }, { "CS1", 0x08 }, { "CS2", 0x10 }, { "CS3", 0x18 }, { "CS4", 0x20 }, { "CS5", 0x28 }, { "CS6", 0x30 }, { "CS7", 0x38 },
+	{ "AF11", 0x0A }, { "AF12", 0x0C }, { "AF13", 0x0E }, { "AF21", 0x12 }, { "AF22", 0x14 }, { "AF23", 0x16 },
+	{ "AF31", 0x1A }, { "AF32", 0x1C }, { "AF33", 0x1E }, { "AF41", 0x22 }, { "AF42", 0x24 }, { "AF43", 0x26 },
+	{ "EF", 0x2E },
+};
+
+int ast_str2tos(const char *value, unsigned int *tos)
+{
+	unsigned int fval;
+	size_t i;
+
+	if (sscanf(value, "%30i", &fval) == 1) {
+		*tos = fval & 0xFF;
+		return 0;
+	}
+
+	for (i = 0; i < ARRAY_LEN(dscp_pool1); i++) {
+		if (!strcasecmp(value, dscp_pool1[i].name)) {
+			*tos = dscp_pool1[i].space << 2;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+struct ast_str *ast_str_create(size_t init_len)
+{
+	struct ast_str *buf;
+
+	buf = calloc(1, sizeof(*buf) + init_len);
+	if (!buf) {
+		return NULL;
+	}
+
+	buf->__AST_STR_LEN = init_len;
+
+	return buf;
+}
+
+char *ast_str_buffer(const struct ast_str *buf)
+{
+	return (char *) buf->__AST_STR_STR;
+}
+
+size_t ast_str_strlen(const struct ast_str *buf)
+{
+	return buf->__AST_STR_USED;
+}
+
+void ast_str_reset(struct ast_str *buf)
+{
+	buf->__AST_STR_USED = 0;
+	if (buf->__AST_STR_LEN) {
+		buf->__AST_STR_STR[0] = '\0';
+	}
+}
+
+/*
+ * Strings allocated by ast_str_alloca can't grow, they're truncated instead.
+ */
+static int str_vappend(struct ast_str **buf, ssize_t max_len, int append, const char *fmt, va_list ap)
+{
+	struct ast_str *tmp;
+	va_list aq;
+	size_t offset = append ? (*buf)->__AST_STR_USED : 0;
+	size_t need;
+	int n;
+
+	va_copy(aq, ap);
+	n = vsnprintf(NULL, 0, fmt, aq);
+	va_end(aq);
+	if (n < 0) {
+		return n;
+	}
+
+	need = offset + n + 1;
+	if (max_len > 0 && need > (size_t) max_len) {
+		need = max_len;
+	}
+
+	if (need > (*buf)->__AST_STR_LEN && max_len >= 0) {
+		tmp = realloc(*buf, sizeof(*tmp) + need);
+		if (tmp) {
+			tmp->__AST_STR_LEN = need;
+			*buf = tmp;
+		}
+	}
+
+	if ((*buf)->__AST_STR_LEN <= offset) {
+		return 0;
+	}
+
+	vsnprintf(&(*buf)->__AST_STR_STR[offset], (*buf)->__AST_STR_LEN - offset, fmt, ap);
+	(*buf)->__AST_STR_USED = strlen((*buf)->__AST_STR_STR);
+
+	return (*buf)->__AST_STR_USED;
+}
+
+int ast_str_set(struct ast_str **buf, ssize_t max_len, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = str_vappend(buf, max_len, 0, fmt, ap);
+	va_end(ap);
+
+	return n;
+}
+
+int ast_str_append(struct ast_str **buf, ssize_t max_len, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = str_vappend(buf, max_len, 1, fmt, ap);
+	va_end(ap);
+
+	return n;
+}
+
+struct timeval ast_tvnow(void)
+{
+	struct timeval t;
+
+	gettimeofday(&t, NULL);
+
+	return t;
+}
+
+struct timeval ast_tv(time_t sec, suseconds_t usec)
+{
+	struct timeval t = { sec, usec };
+
+	return t;
+}
+
+int64_t ast_tvdiff_us(struct timeval end, struct timeval start)
+{
+	return (end.tv_sec - start.tv_sec) * (int64_t) 1000000 + end.tv_usec - start.tv_usec;
+}
+
+int64_t ast_tvdiff_ms(struct timeval end, struct timeval start)
+{
+	return ((end.tv_sec - start.tv_sec) * 1000) + (((1000000 + end.tv_usec - start.tv_usec) / 1000) - 1000);
+}
+
+struct timeval ast_tvadd(struct timeval a, struct timeval b)
+{
+	a.tv_sec += b.tv_sec;
+	a.tv_usec += b.tv_usec;
+	if (a.tv_usec >= 1000000) {
+		a.tv_sec++;
+		a.tv_usec -= 1000000;
+	}
+
+	return a;
+}
+
+struct timeval ast_tvsub(struct timeval a, struct timeval b)
+{
+	a.tv_sec -= b.tv_sec;
+	a.tv_usec -= b.tv_usec;
+	if (a.tv_usec < 0) {
+		a.tv_sec--;
+		a.tv_usec += 1000000;
+	}
+
+	return a;
+}
+
+int ast_tvzero(const struct timeval t)
+{
+	return t.tv_sec == 0 && t.tv_usec == 0;
+}
+
+int ast_tvcmp(struct timeval a, struct timeval b)
+{
+	if (a.tv_sec != b.tv_sec) {
+		return a.tv_sec < b.tv_sec ? -1 : 1;
+	}
+
+	if (a.tv_usec != b.tv_usec) {
+		return a.tv_usec < b.tv_usec ? -1 : 1;
+	}
+
+	return 0;
+}
+
+struct timeval ast_samp2tv(unsigned int _nsamp, unsigned int _rate)
+{
+	return ast_tv(_nsamp / _rate, (_nsamp % _rate) * (1000000 / _rate));
+}
+
+struct ast_tm *ast_localtime(const struct timeval *timep, struct ast_tm *p_tm, const char *zone)
+{
+	struct tm tm;
+	time_t t = timep->tv_sec;
+
+	localtime_r(&t, &tm);
+	memset(p_tm, 0, sizeof(*p_tm));
+	memcpy(p_tm, &tm, offsetof(struct tm, tm_gmtoff));
+	p_tm->tm_gmtoff = tm.tm_gmtoff;
+	p_tm->tm_usec = timep->tv_usec;
+
+	return p_tm;
+}
+
+int ast_strftime(char *buf, size_t len, const char *format, const struct ast_tm *tm)
+{
+	struct tm tmp;
+
+	memset(&tmp, 0, sizeof(tmp));
+	memcpy(&tmp, tm, offsetof(struct tm, tm_gmtoff));
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+	return strftime(buf, len, format, &tmp);
+#pragma GCC diagnostic pop
+}
+
+void ast_cli(int fd, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vdprintf(fd, fmt, ap);
+	va_end(ap);
+}
+
+void ast_sockaddr_setnull(struct ast_sockaddr *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+}
+
+int ast_sockaddr_from_sin(struct ast_sockaddr *addr, const struct sockaddr_in *sin)
+{
+	memset(addr, 0, sizeof(*addr));
+	memcpy(&addr->ss, sin, sizeof(*sin));
+	addr->len = sizeof(*sin);
+
+	return 1;
+}
+
+int ast_sockaddr_to_sin(const struct ast_sockaddr *addr, struct sockaddr_in *sin)
+{
+	if (addr->len != sizeof(*sin)) {
+		memset(sin, 0, sizeof(*sin));
+		return 0;
+	}
+
+	memcpy(sin, &addr->ss, sizeof(*sin));
+
+	return 1;
+}
+
+const char *ast_sockaddr_stringify(const struct ast_sockaddr *addr)
+{
+	static __thread char buf[INET_ADDRSTRLEN + 8];
+	const struct sockaddr_in *sin = (const struct sockaddr_in *) &addr->ss;
+	char host[INET_ADDRSTRLEN];
+
+	if (addr->len != sizeof(*sin)) {
+		return "(null)";
+	}
+
+	inet_ntop(AF_INET, &sin->sin_addr, host, sizeof(host));
+	snprintf(buf, sizeof(buf), "%s:%u", host, ntohs(sin->sin_port));
+
+	return buf;
+}
+
+struct ast_variable *ast_variable_new(const char *name, const char *value, const char *filename)
+{
+	struct ast_variable *var;
+	size_t name_len = strlen(name) + 1;
+	size_t value_len = strlen(value) + 1;
+	size_t filename_len = strlen(filename) + 1;
+
+	var = calloc(1, sizeof(*var) + name_len + value_len + filename_len);
+	if (!var) {
+		return NULL;
+	}
+
+	memcpy(var->stuff, name, name_len);
+	memcpy(var->stuff + name_len, value, value_len);
+	memcpy(var->stuff + name_len + value_len, filename, filename_len);
+	var->name = var->stuff;
+	var->value = var->stuff + name_len;
+	var->file = var->stuff + name_len + value_len;
+
+	return var;
+}
+
+void ast_variables_destroy(struct ast_variable *var)
+{
+	struct ast_variable *next;
+
+	for (; var; var = next) {
+		next = var->next;
+		free(var);
+	}
+}
+
+/* the database only lives as long as the process */
+struct db_entry {
+	char *key;
+	char *value;
+	struct db_entry *next;
+};
+
+AST_MUTEX_DEFINE_STATIC(db_lock);
+static struct db_entry *db_entries;
+
+static struct db_entry **db_find(const char *family, const char *key, char *buf, size_t size)
+{
+	struct db_entry **entry;
+
+	snprintf(buf, size, "/%s/%s", family, key);
+	for (entry = &db_entries; *entry; entry = &(*entry)->next) {
+		if (!strcmp((*entry)->key, buf)) {
+			break;
+		}
+	}
+
+	return entry;
+}
+
+int ast_db_get(const char *family, const char *key, char *value, int valuelen)
+{
+	struct db_entry **entry;
+	char buf[256];
+	int ret = -1;
+
+	ast_mutex_lock(&db_lock);
+	entry = db_find(family, key, buf, sizeof(buf));
+	if (*entry) {
+		ast_copy_string(value, (*entry)->value, valuelen);
+		ret = 0;
+	}
+	ast_mutex_unlock(&db_lock);
+
+	return ret;
+}
+
+int ast_db_put(const char *family, const char *key, const char *value)
+{
+	struct db_entry **entry;
+	struct db_entry *new_entry;
+	char buf[256];
+	char *new_value;
+	int ret = -1;
+
+	ast_mutex_lock(&db_lock);
+	entry = db_find(family, key, buf, sizeof(buf));
+	new_value = strdup(value);
+	if (!new_value) {
+		goto end;
+	}
+
+	if (*entry) {
+		free((*entry)->value);
+		(*entry)->value = new_value;
+		ret = 0;
+		goto end;
+	}
+
+	new_entry = calloc(1, sizeof(*new_entry));
+	if (!new_entry || !(new_entry->key = strdup(buf))) {
+		free(new_entry);
+		free(new_value);
+		goto end;
+	}
+
+	new_entry->value = new_value;
+	*entry = new_entry;
+	ret = 0;
+
+end:
+	ast_mutex_unlock(&db_lock);
+
+	return ret;
+}
+
+int ast_db_del(const char *family, const char *key)
+{
+	struct db_entry **entry;
+	struct db_entry *doomed;
+	char buf[256];
+	int ret = -1;
+
+	ast_mutex_lock(&db_lock);
+	entry = db_find(family, key, buf, sizeof(buf));
+	doomed = *entry;
+	if (doomed) {
+		*entry = doomed->next;
+		free(doomed->key);
+		free(doomed->value);
+		free(doomed);
+		ret = 0;
+	}
+	ast_mutex_unlock(&db_lock);
+
+	return ret;
+}
+
+ast_group_t ast_get_group(const char *s)
+{
+	ast_group_t group = 0;
+	char *copy;
+	char *piece;
+	char *c;
+	int start;
+	int finish;
+	int x;
+
+	if (ast_strlen_zero(s)) {
+		return 0;
+	}
+
+	c = copy = strdup(s);
+	if (!copy) {
+		return 0;
+	}
+
+	while ((piece = strsep(&c, ","))) {
+		if (sscanf(piece, "%30d-%30d", &start, &finish) == 2) {
+		} else if (sscanf(piece, "%30d", &start) == 1) {
+			finish = start;
+		} else {
+			continue;
+		}
+
+		for (x = start; x <= finish; x++) {
+			if (x >= 0 && x < 64) {
+				group |= ((ast_group_t) 1 << x);
+			}
+		}
+	}
+
+	free(copy);
+
+	return group;
+}
+
+/* named groups are kept as the string they were parsed from */
+struct ast_namedgroups *ast_get_namedgroups(const char *s)
+{
+	char *groups;
+	size_t len;
+
+	if (ast_strlen_zero(s)) {
+		return NULL;
+	}
+
+	len = strlen(s) + 1;
+	groups = ao2_alloc_options(len, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!groups) {
+		return NULL;
+	}
+
+	memcpy(groups, s, len);
+
+	return (struct ast_namedgroups *) groups;
+}
+
+struct ast_namedgroups *ast_unref_namedgroups(struct ast_namedgroups *groups)
+{
+	ao2_cleanup(groups);
+
+	return NULL;
+}
+
+struct ast_namedgroups *ast_ref_namedgroups(struct ast_namedgroups *groups)
+{
+	if (groups) {
+		ao2_ref(groups, +1);
+	}
+
+	return groups;
+}
+
+char *ast_print_namedgroups(struct ast_str **buf, struct ast_namedgroups *groups)
+{
+	ast_str_set(buf, 0, "%s", groups ? (const char *) groups : "");
+
+	return ast_str_buffer(*buf);
+}
+
+struct ast_heap {
+	ast_heap_cmp_fn cmp_fn;
+	ssize_t index_offset;
+	size_t cur_len;
+	size_t avail_len;
+	void **heap;
+};
+
+static void heap_set(struct ast_heap *h, size_t i, void *elm)
+{
+	h->heap[i - 1] = elm;
+	if (h->index_offset >= 0) {
+		*((ssize_t *) ((char *) elm + h->index_offset)) = i;
+	}
+}
+
+static void heap_swap(struct ast_heap *h, size_t i, size_t j)
+{
+	void *tmp = h->heap[i - 1];
+
+	heap_set(h, i, h->heap[j - 1]);
+	heap_set(h, j, tmp);
+}
+
+/* the element with the greatest value, according to cmp_fn, is at the top */
+static void heap_sift_down(struct ast_heap *h, size_t i)
+{
+	size_t l;
+	size_t r;
+	size_t max;
+
+	for (;;) {
+		l = 2 * i;
+		r = l + 1;
+		max = i;
+		if (l <= h->cur_len && h->cmp_fn(h->heap[l - 1], h->heap[max - 1]) > 0) {
+			max = l;
+		}
+
+		if (r <= h->cur_len && h->cmp_fn(h->heap[r - 1], h->heap[max - 1]) > 0) {
+			max = r;
+		}
+
+		if (max == i) {
+			break;
+		}
+
+		heap_swap(h, i, max);
+		i = max;
+	}
+}
+
+static size_t heap_sift_up(struct ast_heap *h, size_t i)
+{
+	while (i > 1 && h->cmp_fn(h->heap[i - 1], h->heap[i / 2 - 1]) > 0) {
+		heap_swap(h, i, i / 2);
+		i /= 2;
+	}
+
+	return i;
+}
+
+struct ast_heap *ast_heap_create(unsigned int init_height, ast_heap_cmp_fn cmp_fn, ssize_t index_offset)
+{
+	struct ast_heap *h;
+
+	h = calloc(1, sizeof(*h));
+	if (!h) {
+		return NULL;
+	}
+
+	h->cmp_fn = cmp_fn;
+	h->index_offset = index_offset;
+	h->avail_len = (1 << (init_height ? init_height : 8)) - 1;
+	h->heap = calloc(h->avail_len, sizeof(void *));
+	if (!h->heap) {
+		free(h);
+		return NULL;
+	}
+
+	return h;
+}
+
+struct ast_heap *ast_heap_destroy(struct ast_heap *h)
+{
+	if (h) {
+		free(h->heap);
+		free(h);
+	}
+
+	return NULL;
+}
+
+int ast_heap_push(struct ast_heap *h, void *elm)
+{
+	void **tmp;
+
+	if (h->cur_len == h->avail_len) {
+		tmp = realloc(h->heap, (h->avail_len * 2 + 1) * sizeof(void *));
+		if (!tmp) {
+			return -1;
+		}
+
+		h->heap = tmp;
+		h->avail_len = h->avail_len * 2 + 1;
+	}
+
+	h->cur_len++;
+	heap_set(h, h->cur_len, elm);
+	heap_sift_up(h, h->cur_len);
+
+	return 0;
+}
+
+static void *heap_remove_at(struct ast_heap *h, size_t i)
+{
+	void *ret;
+
+	if (!i || i > h->cur_len) {
+		return NULL;
+	}
+
+	ret = h->heap[i - 1];
+	heap_set(h, i, h->heap[h->cur_len - 1]);
+	h->cur_len--;
+	if (i <= h->cur_len) {
+		i = heap_sift_up(h, i);
+		heap_sift_down(h, i);
+	}
+
+	return ret;
+}
+
+void *ast_heap_pop(struct ast_heap *h)
+{
+	return heap_remove_at(h, 1);
+}
+
+void *ast_heap_remove(struct ast_heap *h, void *elm)
+{
+	ssize_t i;
+
+	if (h->index_offset < 0) {
+		return NULL;
+	}
+
+	i = *((ssize_t *) ((char *) elm + h->index_offset));
+	if (i <= 0 || (size_t) i > h->cur_len || h->heap[i - 1] != elm) {
+		return NULL;
+	}
+
+	return heap_remove_at(h, i);
+}
+
+void *ast_heap_peek(struct ast_heap *h, unsigned int index)
+{
+	if (!index || index > h->cur_len) {
+		return NULL;
+	}
+
+	return h->heap[index - 1];
+}
+
+size_t ast_heap_size(struct ast_heap *h)
+{
+	return h->cur_len;
+}
@@ -0,0 +1,321 @@
+#include <asterisk.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/format.h>
+#include <asterisk/format_cache.h>
+#include <asterisk/format_cap.h>
+#include <asterisk/strings.h>
+
+struct ast_format {
+	const char *name;
+	unsigned int codec_id;
+	enum ast_media_type type;
+	unsigned int default_ms;
+};
+
+struct format_framing {
+	struct ast_format *format;
+	unsigned int framing;
+};
+
+struct ast_format_cap {
+	struct format_framing *formats;
+	size_t count;
+	size_t size;
+};
+
+struct ast_format *ast_format_ulaw;
+struct ast_format *ast_format_alaw;
+struct ast_format *ast_format_g722;
+struct ast_format *ast_format_g723;
+struct ast_format *ast_format_g726;
+struct ast_format *ast_format_g729;
+struct ast_format *ast_format_h261;
+struct ast_format *ast_format_h263;
+
+static const struct {
+	struct ast_format **format;
+	const char *name;
+	enum ast_media_type type;
+	unsigned int default_ms;
+} known_formats[] = {
+	{ &ast_format_ulaw, "ulaw", AST_MEDIA_TYPE_AUDIO, 20 },
+	{ &ast_format_alaw, "alaw", AST_MEDIA_TYPE_AUDIO, 20 },
+	{ &ast_format_g722, "g722", AST_MEDIA_TYPE_AUDIO, 20 },
+	{ &ast_format_g723, "g723", AST_MEDIA_TYPE_AUDIO, 30 },
+	{ &ast_format_g726, "g726", AST_MEDIA_TYPE_AUDIO, 20 },
+	{ &ast_format_g729, "g729", AST_MEDIA_TYPE_AUDIO, 20 },
+	{ &ast_format_h261, "h261", AST_MEDIA_TYPE_VIDEO, 0 },
+	{ &ast_format_h263, "h263", AST_MEDIA_TYPE_VIDEO, 0 },
+};
+
+/* the formats live as long as the process, like the ones of the format cache */
+static void __attribute__((constructor)) formats_init(void)
+{
+	struct ast_format *format;
+	size_t i;
+
+	for (i = 0; i < ARRAY_LEN(known_formats); i++) {
+		format = ao2_alloc_options(sizeof(*format), NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!format) {
+			abort();
+		}
+
+		format->name = known_formats[i].name;
+		format->codec_id = i + 1;
+		format->type = known_formats[i].type;
+		format->default_ms = known_formats[i].default_ms;
+		*known_formats[i].format = format;
+	}
+}
+
+const char *ast_format_get_name(const struct ast_format *format)
+{
+	return format->name;
+}
+
+unsigned int ast_format_get_codec_id(const struct ast_format *format)
+{
+	return format->codec_id;
+}
+
+enum ast_media_type ast_format_get_type(const struct ast_format *format)
+{
+	return format->type;
+}
+
+void *ast_format_get_attribute_data(const struct ast_format *format)
+{
+	return NULL;
+}
+
+enum ast_format_cmp_res ast_format_cmp(const struct ast_format *format1, const struct ast_format *format2)
+{
+	if (format1 == format2 || format1->codec_id == format2->codec_id) {
+		return AST_FORMAT_CMP_EQUAL;
+	}
+
+	return AST_FORMAT_CMP_NOT_EQUAL;
+}
+
+struct ast_format *ast_format_cache_get(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_LEN(known_formats); i++) {
+		if (!strcasecmp(known_formats[i].name, name)) {
+			return ao2_bump(*known_formats[i].format);
+		}
+	}
+
+	return NULL;
+}
+
+static void format_cap_destructor(void *obj)
+{
+	struct ast_format_cap *cap = obj;
+	size_t i;
+
+	for (i = 0; i < cap->count; i++) {
+		ao2_ref(cap->formats[i].format, -1);
+	}
+
+	ast_free(cap->formats);
+}
+
+struct ast_format_cap *ast_format_cap_alloc(enum ast_format_cap_flags flags)
+{
+	return ao2_alloc_options(sizeof(struct ast_format_cap), format_cap_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+}
+
+static ssize_t format_cap_find(const struct ast_format_cap *cap, const struct ast_format *format)
+{
+	size_t i;
+
+	for (i = 0; i < cap->count; i++) {
+		if (ast_format_cmp(cap->formats[i].format, format) == AST_FORMAT_CMP_EQUAL) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+int ast_format_cap_append(struct ast_format_cap *cap, struct ast_format *format, unsigned int framing)
+{
+	struct format_framing *tmp;
+	size_t size;
+
+	if (format_cap_find(cap, format) >= 0) {
+		return 0;
+	}
+
+	if (cap->count == cap->size) {
+		size = cap->size ? cap->size * 2 : 4;
+		tmp = ast_realloc(cap->formats, size * sizeof(*tmp));
+		if (!tmp) {
+			return -1;
+		}
+
+		cap->formats = tmp;
+		cap->size = size;
+	}
+
+	cap->formats[cap->count].format = ao2_bump(format);
+	cap->formats[cap->count].framing = framing;
+	cap->count++;
+
+	return 0;
+}
+
+int ast_format_cap_append_by_type(struct ast_format_cap *cap, enum ast_media_type type)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_LEN(known_formats); i++) {
+		if (type == AST_MEDIA_TYPE_UNKNOWN || known_formats[i].type == type) {
+			if (ast_format_cap_append(cap, *known_formats[i].format, 0)) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void format_cap_remove_at(struct ast_format_cap *cap, size_t i)
+{
+	ao2_ref(cap->formats[i].format, -1);
+	memmove(&cap->formats[i], &cap->formats[i + 1], (cap->count - i - 1) * sizeof(*cap->formats));
+	cap->count--;
+}
+
+void ast_format_cap_remove_by_type(struct ast_format_cap *cap, enum ast_media_type type)
+{
+	size_t i = 0;
+
+	while (i < cap->count) {
+		if (type == AST_MEDIA_TYPE_UNKNOWN || cap->formats[i].format->type == type) {
+			format_cap_remove_at(cap, i);
+		} else {
+			i++;
+		}
+	}
+}
+
+int ast_format_cap_update_by_allow_disallow(struct ast_format_cap *cap, const char *list, int allowing)
+{
+	struct ast_format *format;
+	char *parse;
+	char *copy;
+	char *name;
+	ssize_t i;
+	int ret = 0;
+
+	copy = parse = ast_strdup(list);
+	if (!copy) {
+		return -1;
+	}
+
+	while ((name = strsep(&parse, ","))) {
+		name = ast_strip(name);
+		if (ast_strlen_zero(name)) {
+			continue;
+		}
+
+		if (!strcasecmp(name, "all")) {
+			if (allowing) {
+				ast_format_cap_append_by_type(cap, AST_MEDIA_TYPE_UNKNOWN);
+			} else {
+				ast_format_cap_remove_by_type(cap, AST_MEDIA_TYPE_UNKNOWN);
+			}
+
+			continue;
+		}
+
+		format = ast_format_cache_get(name);
+		if (!format) {
+			ast_log(LOG_WARNING, "Cannot %s unknown format '%s'\n", allowing ? "allow" : "disallow", name);
+			ret = -1;
+			continue;
+		}
+
+		if (allowing) {
+			ast_format_cap_append(cap, format, 0);
+		} else if ((i = format_cap_find(cap, format)) >= 0) {
+			format_cap_remove_at(cap, i);
+		}
+
+		ao2_ref(format, -1);
+	}
+
+	ast_free(copy);
+
+	return ret;
+}
+
+size_t ast_format_cap_count(const struct ast_format_cap *cap)
+{
+	return cap->count;
+}
+
+int ast_format_cap_empty(const struct ast_format_cap *cap)
+{
+	return !cap || !cap->count;
+}
+
+struct ast_format *ast_format_cap_get_format(const struct ast_format_cap *cap, int position)
+{
+	if (position < 0 || (size_t) position >= cap->count) {
+		return NULL;
+	}
+
+	return ao2_bump(cap->formats[position].format);
+}
+
+unsigned int ast_format_cap_get_format_framing(const struct ast_format_cap *cap, const struct ast_format *format)
+{
+	ssize_t i = format_cap_find(cap, format);
+
+	if (i < 0 || !cap->formats[i].framing) {
+		return format->default_ms;
+	}
+
+	return cap->formats[i].framing;
+}
+
+int ast_format_cap_get_compatible(const struct ast_format_cap *cap1, const struct ast_format_cap *cap2, struct ast_format_cap *result)
+{
+	size_t i;
+
+	for (i = 0; i < cap1->count; i++) {
+		if (format_cap_find(cap2, cap1->formats[i].format) >= 0) {
+			ast_format_cap_append(result, cap1->formats[i].format, cap1->formats[i].framing);
+		}
+	}
+
+	return 0;
+}
+
+enum ast_format_cmp_res ast_format_cap_iscompatible_format(const struct ast_format_cap *cap, const struct ast_format *format)
+{
+	return format_cap_find(cap, format) >= 0 ? AST_FORMAT_CMP_EQUAL : AST_FORMAT_CMP_NOT_EQUAL;
+}
+
+const char *ast_format_cap_get_names(const struct ast_format_cap *cap, struct ast_str **buf)
+{
+	size_t i;
+
+	ast_str_set(buf, 0, "(");
+	if (!cap || !cap->count) {
+		ast_str_append(buf, 0, "nothing)");
+		return ast_str_buffer(*buf);
+	}
+
+	for (i = 0; i < cap->count; i++) {
+		ast_str_append(buf, 0, "%s%s", i ? "|" : "", cap->formats[i].format->name);
+	}
+
+	ast_str_append(buf, 0, ")");
+
+	return ast_str_buffer(*buf);
+}
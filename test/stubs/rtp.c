@@ -0,0 +1,160 @@
+#include <asterisk.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/frame.h>
+#include <asterisk/network.h>
+#include <asterisk/rtp_engine.h>
+
+/*
+ * RTP instances don't send or receive anything: writes are counted, and reads return a
+ * 20 ms ulaw frame, like a peer streaming audio would. Like in Asterisk, instances are
+ * ao2 objects, and ast_rtp_instance_destroy releases a reference.
+ */
+struct ast_rtp_instance {
+	struct ast_sockaddr local;
+	struct ast_sockaddr remote;
+	struct ast_frame frame;
+	unsigned char payload[160];
+};
+
+struct ast_rtp_codecs {
+	int unused;
+};
+
+static struct ast_rtp_codecs codecs;
+static struct stub_rtp_stats rtp_stats;
+static int next_port = 10000;
+
+static void instance_destructor(void *obj)
+{
+	__atomic_sub_fetch(&rtp_stats.instances, 1, __ATOMIC_RELAXED);
+}
+
+struct ast_rtp_instance *ast_rtp_instance_new(const char *engine_name, struct ast_sched_context *sched, const struct ast_sockaddr *sa, void *data)
+{
+	struct ast_rtp_instance *instance;
+	struct sockaddr_in sin;
+
+	instance = ao2_alloc_options(sizeof(*instance), instance_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!instance) {
+		return NULL;
+	}
+
+	ast_sockaddr_to_sin(sa, &sin);
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(__atomic_fetch_add(&next_port, 2, __ATOMIC_RELAXED));
+	ast_sockaddr_from_sin(&instance->local, &sin);
+
+	instance->frame.frametype = AST_FRAME_VOICE;
+	instance->frame.subclass.format = ast_format_ulaw;
+	instance->frame.datalen = sizeof(instance->payload);
+	instance->frame.samples = sizeof(instance->payload);
+	instance->frame.data.ptr = instance->payload;
+	instance->frame.src = "stub rtp";
+
+	__atomic_add_fetch(&rtp_stats.instances, 1, __ATOMIC_RELAXED);
+
+	return instance;
+}
+
+int ast_rtp_instance_destroy(struct ast_rtp_instance *instance)
+{
+	ao2_ref(instance, -1);
+
+	return 0;
+}
+
+void ast_rtp_instance_stop(struct ast_rtp_instance *instance)
+{
+}
+
+int ast_rtp_instance_fd(struct ast_rtp_instance *instance, int rtcp)
+{
+	return -1;
+}
+
+void ast_rtp_instance_set_prop(struct ast_rtp_instance *instance, enum ast_rtp_property property, int value)
+{
+}
+
+int ast_rtp_instance_set_qos(struct ast_rtp_instance *instance, int tos, int cos, const char *desc)
+{
+	return 0;
+}
+
+void ast_rtp_instance_set_channel_id(struct ast_rtp_instance *instance, const char *uniqueid)
+{
+}
+
+int ast_rtp_instance_set_remote_address(struct ast_rtp_instance *instance, const struct ast_sockaddr *address)
+{
+	instance->remote = *address;
+
+	return 0;
+}
+
+void ast_rtp_instance_get_local_address(struct ast_rtp_instance *instance, struct ast_sockaddr *address)
+{
+	*address = instance->local;
+}
+
+void ast_rtp_instance_get_remote_address(struct ast_rtp_instance *instance, struct ast_sockaddr *address)
+{
+	*address = instance->remote;
+}
+
+int ast_rtp_instance_get_and_cmp_remote_address(struct ast_rtp_instance *instance, struct ast_sockaddr *address)
+{
+	if (address->len == instance->remote.len && !memcmp(&address->ss, &instance->remote.ss, address->len)) {
+		return 0;
+	}
+
+	*address = instance->remote;
+
+	return 1;
+}
+
+void ast_rtp_instance_update_source(struct ast_rtp_instance *instance)
+{
+}
+
+void ast_rtp_instance_change_source(struct ast_rtp_instance *instance)
+{
+}
+
+int ast_rtp_instance_write(struct ast_rtp_instance *instance, struct ast_frame *frame)
+{
+	__atomic_add_fetch(&rtp_stats.frames_written, 1, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+struct ast_frame *ast_rtp_instance_read(struct ast_rtp_instance *instance, int rtcp)
+{
+	if (rtcp) {
+		return &ast_null_frame;
+	}
+
+	__atomic_add_fetch(&rtp_stats.frames_read, 1, __ATOMIC_RELAXED);
+
+	return &instance->frame;
+}
+
+struct ast_rtp_codecs *ast_rtp_instance_get_codecs(struct ast_rtp_instance *instance)
+{
+	return &codecs;
+}
+
+void ast_rtp_codecs_payloads_set_m_type(struct ast_rtp_codecs *codecs, struct ast_rtp_instance *instance, int payload)
+{
+}
+
+void ast_rtp_codecs_set_framing(struct ast_rtp_codecs *codecs, unsigned int framing)
+{
+}
+
+void stub_rtp_take_stats(struct stub_rtp_stats *stats)
+{
+	stats->instances = __atomic_load_n(&rtp_stats.instances, __ATOMIC_RELAXED);
+	stats->frames_written = __atomic_load_n(&rtp_stats.frames_written, __ATOMIC_RELAXED);
+	stats->frames_read = __atomic_load_n(&rtp_stats.frames_read, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,409 @@
+#include <asterisk.h>
+#include <asterisk/linkedlists.h>
+#include <asterisk/lock.h>
+#include <asterisk/sched.h>
+#include <asterisk/taskprocessor.h>
+#include <asterisk/threadpool.h>
+#include <asterisk/utils.h>
+
+#define POOL_MAX_WORKERS 8
+
+struct task {
+	int (*exe)(void *data);
+	void *data;
+	AST_LIST_ENTRY(task) list;
+};
+
+AST_LIST_HEAD_NOLOCK(task_list, task);
+
+struct ast_threadpool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct task_list tasks;
+	int shutdown;
+	int worker_count;
+	pthread_t workers[POOL_MAX_WORKERS];
+};
+
+/*
+ * A taskprocessor either has its own thread, or is a serializer running its tasks one at
+ * a time on a threadpool.
+ */
+struct ast_taskprocessor {
+	char name[AST_TASKPROCESSOR_MAX_NAME];
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct task_list tasks;
+	int ref_count;
+	int shutdown;
+	/* a task is being executed, or for a serializer, scheduled on the pool */
+	int busy;
+	struct ast_threadpool *pool;
+	pthread_t thread;
+	/* for a serializer, the thread executing a task and whether it frees the serializer */
+	pthread_t runner;
+	int free_when_done;
+	AST_LIST_ENTRY(ast_taskprocessor) list;
+};
+
+AST_MUTEX_DEFINE_STATIC(tps_registry_lock);
+static AST_LIST_HEAD_NOLOCK(, ast_taskprocessor) tps_registry;
+
+static struct task *task_alloc(int (*exe)(void *data), void *data)
+{
+	struct task *task;
+
+	task = calloc(1, sizeof(*task));
+	if (!task) {
+		return NULL;
+	}
+
+	task->exe = exe;
+	task->data = data;
+
+	return task;
+}
+
+static void *pool_worker_run(void *data)
+{
+	struct ast_threadpool *pool = data;
+	struct task *task;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		task = AST_LIST_REMOVE_HEAD(&pool->tasks, list);
+		if (!task) {
+			if (pool->shutdown) {
+				break;
+			}
+
+			pthread_cond_wait(&pool->cond, &pool->lock);
+			continue;
+		}
+
+		pthread_mutex_unlock(&pool->lock);
+		task->exe(task->data);
+		free(task);
+		pthread_mutex_lock(&pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+struct ast_threadpool *ast_threadpool_create(const char *name, struct ast_threadpool_listener *listener, const struct ast_threadpool_options *options)
+{
+	struct ast_threadpool *pool;
+	int count;
+	int i;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool) {
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	AST_LIST_HEAD_INIT_NOLOCK(&pool->tasks);
+
+	/* the pool doesn't grow, so it starts with the workers it could grow to */
+	count = MAX(options->initial_size, options->max_size);
+	count = MAX(MIN(count, POOL_MAX_WORKERS), 1);
+	for (i = 0; i < count; i++) {
+		if (pthread_create(&pool->workers[i], NULL, pool_worker_run, pool)) {
+			break;
+		}
+
+		pool->worker_count++;
+	}
+
+	if (!pool->worker_count) {
+		free(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+void ast_threadpool_shutdown(struct ast_threadpool *pool)
+{
+	int i;
+
+	if (!pool) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->worker_count; i++) {
+		pthread_join(pool->workers[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+int ast_threadpool_push(struct ast_threadpool *pool, int (*exe)(void *data), void *data)
+{
+	struct task *task;
+
+	task = task_alloc(exe, data);
+	if (!task) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->shutdown) {
+		pthread_mutex_unlock(&pool->lock);
+		free(task);
+		return -1;
+	}
+
+	AST_LIST_INSERT_TAIL(&pool->tasks, task, list);
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+static struct ast_taskprocessor *tps_alloc(const char *name, struct ast_threadpool *pool)
+{
+	struct ast_taskprocessor *tps;
+
+	tps = calloc(1, sizeof(*tps));
+	if (!tps) {
+		return NULL;
+	}
+
+	ast_copy_string(tps->name, name, sizeof(tps->name));
+	pthread_mutex_init(&tps->lock, NULL);
+	pthread_cond_init(&tps->cond, NULL);
+	AST_LIST_HEAD_INIT_NOLOCK(&tps->tasks);
+	tps->ref_count = 1;
+	tps->pool = pool;
+	tps->runner = AST_PTHREADT_NULL;
+
+	return tps;
+}
+
+static void tps_free(struct ast_taskprocessor *tps)
+{
+	pthread_cond_destroy(&tps->cond);
+	pthread_mutex_destroy(&tps->lock);
+	free(tps);
+}
+
+static void *tps_thread_run(void *data)
+{
+	struct ast_taskprocessor *tps = data;
+	struct task *task;
+
+	pthread_mutex_lock(&tps->lock);
+	for (;;) {
+		task = AST_LIST_REMOVE_HEAD(&tps->tasks, list);
+		if (!task) {
+			if (tps->shutdown) {
+				break;
+			}
+
+			pthread_cond_wait(&tps->cond, &tps->lock);
+			continue;
+		}
+
+		pthread_mutex_unlock(&tps->lock);
+		task->exe(task->data);
+		free(task);
+		pthread_mutex_lock(&tps->lock);
+	}
+	pthread_mutex_unlock(&tps->lock);
+
+	return NULL;
+}
+
+/*
+ * Execute the next task of the serializer, then schedule itself again if there are
+ * other tasks, so that the tasks of other serializers get a chance to run.
+ */
+static int serializer_run(void *data)
+{
+	struct ast_taskprocessor *tps = data;
+	struct task *task;
+
+	pthread_mutex_lock(&tps->lock);
+	task = AST_LIST_REMOVE_HEAD(&tps->tasks, list);
+	tps->runner = pthread_self();
+	pthread_mutex_unlock(&tps->lock);
+
+	if (task) {
+		task->exe(task->data);
+		free(task);
+	}
+
+	pthread_mutex_lock(&tps->lock);
+	tps->runner = AST_PTHREADT_NULL;
+	if (tps->free_when_done) {
+		/* the last reference was released by the task itself */
+		pthread_mutex_unlock(&tps->lock);
+		tps_free(tps);
+		return 0;
+	}
+
+	if (AST_LIST_EMPTY(&tps->tasks) || ast_threadpool_push(tps->pool, serializer_run, tps)) {
+		tps->busy = 0;
+		pthread_cond_broadcast(&tps->cond);
+	}
+	pthread_mutex_unlock(&tps->lock);
+
+	return 0;
+}
+
+struct ast_taskprocessor *ast_threadpool_serializer(const char *name, struct ast_threadpool *pool)
+{
+	return tps_alloc(name, pool);
+}
+
+struct ast_taskprocessor *ast_taskprocessor_get(const char *name, enum ast_tps_options create)
+{
+	struct ast_taskprocessor *tps;
+
+	ast_mutex_lock(&tps_registry_lock);
+	AST_LIST_TRAVERSE(&tps_registry, tps, list) {
+		if (!strcmp(tps->name, name)) {
+			__atomic_add_fetch(&tps->ref_count, 1, __ATOMIC_SEQ_CST);
+			goto end;
+		}
+	}
+
+	if (create & TPS_REF_IF_EXISTS) {
+		goto end;
+	}
+
+	tps = tps_alloc(name, NULL);
+	if (!tps) {
+		goto end;
+	}
+
+	if (pthread_create(&tps->thread, NULL, tps_thread_run, tps)) {
+		tps_free(tps);
+		tps = NULL;
+		goto end;
+	}
+
+	AST_LIST_INSERT_TAIL(&tps_registry, tps, list);
+
+end:
+	ast_mutex_unlock(&tps_registry_lock);
+
+	return tps;
+}
+
+/*
+ * Releasing the last reference waits for the queued tasks to be executed.
+ */
+void *ast_taskprocessor_unreference(struct ast_taskprocessor *tps)
+{
+	if (!tps) {
+		return NULL;
+	}
+
+	if (!tps->pool) {
+		ast_mutex_lock(&tps_registry_lock);
+		if (__atomic_sub_fetch(&tps->ref_count, 1, __ATOMIC_SEQ_CST)) {
+			ast_mutex_unlock(&tps_registry_lock);
+			return NULL;
+		}
+
+		AST_LIST_REMOVE(&tps_registry, tps, list);
+		ast_mutex_unlock(&tps_registry_lock);
+
+		pthread_mutex_lock(&tps->lock);
+		tps->shutdown = 1;
+		pthread_cond_signal(&tps->cond);
+		pthread_mutex_unlock(&tps->lock);
+		pthread_join(tps->thread, NULL);
+		tps_free(tps);
+
+		return NULL;
+	}
+
+	if (__atomic_sub_fetch(&tps->ref_count, 1, __ATOMIC_SEQ_CST)) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&tps->lock);
+	tps->shutdown = 1;
+	if (tps->busy && pthread_equal(tps->runner, pthread_self())) {
+		tps->free_when_done = 1;
+		pthread_mutex_unlock(&tps->lock);
+		return NULL;
+	}
+
+	while (tps->busy) {
+		pthread_cond_wait(&tps->cond, &tps->lock);
+	}
+	pthread_mutex_unlock(&tps->lock);
+	tps_free(tps);
+
+	return NULL;
+}
+
+int ast_taskprocessor_push(struct ast_taskprocessor *tps, int (*task_exe)(void *datap), void *datap)
+{
+	struct task *task;
+	int ret = 0;
+
+	task = task_alloc(task_exe, datap);
+	if (!task) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&tps->lock);
+	AST_LIST_INSERT_TAIL(&tps->tasks, task, list);
+	if (!tps->pool) {
+		pthread_cond_signal(&tps->cond);
+	} else if (!tps->busy) {
+		if (ast_threadpool_push(tps->pool, serializer_run, tps)) {
+			AST_LIST_REMOVE(&tps->tasks, task, list);
+			free(task);
+			ret = -1;
+		} else {
+			tps->busy = 1;
+		}
+	}
+	pthread_mutex_unlock(&tps->lock);
+
+	return ret;
+}
+
+void ast_taskprocessor_build_name(char *buf, unsigned int size, const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	vsnprintf(buf, size, format, ap);
+	va_end(ap);
+}
+
+/* nothing is scheduled by the driver itself, the contexts are only given to RTP instances */
+struct ast_sched_context {
+	int unused;
+};
+
+struct ast_sched_context *ast_sched_context_create(void)
+{
+	return calloc(1, sizeof(struct ast_sched_context));
+}
+
+void ast_sched_context_destroy(struct ast_sched_context *c)
+{
+	free(c);
+}
+
+int ast_sched_start_thread(struct ast_sched_context *con)
+{
+	return 0;
+}
@@ -0,0 +1,413 @@
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <asterisk.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/time.h>
+
+#include "../sccp_config.h"
+#include "harness.h"
+
+/*
+ * Look devices up in realtime, against a local SQLite file, and report the hit rate of
+ * the realtime cache and the lookup latency.
+ *
+ * The checks cover the devices of the configuration file, which are never looked up,
+ * the realtime devices and their line, the unknown devices, the invalidation, and the
+ * eviction and expiration of the cache entries. Then registrations of devices picked
+ * with a skewed distribution, like a box where a few devices reconnect often, measure
+ * the cache.
+ */
+
+#define REALTIME_DEVICES 1000
+#define CACHE_SIZE 200
+/* 80% of the registrations are of the first HOT_DEVICES devices */
+#define HOT_DEVICES 100
+#define REGISTRATIONS 20000
+
+static unsigned int failures;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static int exec_sql(sqlite3 *db, const char *sql)
+{
+	char *errmsg = NULL;
+
+	if (sqlite3_exec(db, sql, NULL, NULL, &errmsg) != SQLITE_OK) {
+		fprintf(stderr, "could not execute \"%s\": %s\n", sql, errmsg);
+		sqlite3_free(errmsg);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Create the realtime families, with columns named after the options of sccp.conf.
+ */
+static int create_realtime_db(const char *path)
+{
+	char sql[512];
+	sqlite3 *db;
+	unsigned int i;
+	int ret = -1;
+
+	if (sqlite3_open(path, &db) != SQLITE_OK) {
+		fprintf(stderr, "could not open %s: %s\n", path, sqlite3_errmsg(db));
+		sqlite3_close(db);
+		return -1;
+	}
+
+	if (exec_sql(db, "CREATE TABLE sccpdevices (name TEXT PRIMARY KEY, line TEXT, speeddial TEXT, voicemail TEXT)") ||
+			exec_sql(db, "CREATE TABLE sccplines (name TEXT PRIMARY KEY, cid_name TEXT, cid_num TEXT, context TEXT, setvar TEXT)") ||
+			exec_sql(db, "BEGIN")) {
+		goto end;
+	}
+
+	for (i = 0; i < REALTIME_DEVICES; i++) {
+		snprintf(sql, sizeof(sql), "INSERT INTO sccpdevices VALUES ('SEP%012u', 'rt%u', %s, NULL)",
+				i, i, i % 2 ? "'sd1; sd2'" : "NULL");
+		if (exec_sql(db, sql)) {
+			goto end;
+		}
+
+		snprintf(sql, sizeof(sql), "INSERT INTO sccplines VALUES ('rt%u', 'Realtime', '%u', 'rt-context', 'A=1;B=2')", i, i);
+		if (exec_sql(db, sql)) {
+			goto end;
+		}
+	}
+
+	if (exec_sql(db, "INSERT INTO sccpdevices VALUES ('SEPNOLINE', 'missing', NULL, NULL)") ||
+			exec_sql(db, "INSERT INTO sccpdevices VALUES ('SEPFILELINE', 'fileline', NULL, NULL)") ||
+			exec_sql(db, "COMMIT")) {
+		goto end;
+	}
+
+	ret = 0;
+
+end:
+	sqlite3_close(db);
+
+	return ret;
+}
+
+static int write_config(const char *dir, int ttl)
+{
+	char path[PATH_MAX + sizeof("/sccp.conf")];
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/sccp.conf", dir);
+	file = fopen(path, "w");
+	if (!file) {
+		fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	fprintf(file,
+		"[general]\n"
+		"realtime = yes\n"
+		"realtime_cache_size = %d\n"
+		"realtime_cache_ttl = %d\n"
+		"\n"
+		"[SEPFILE]\n"
+		"type = device\n"
+		"line = fileline\n"
+		"\n"
+		"[fileline]\n"
+		"type = line\n"
+		"cid_num = 1000\n"
+		"\n"
+		"[sd1]\n"
+		"type = speeddial\n"
+		"extension = 1001\n"
+		"\n"
+		"[sd2]\n"
+		"type = speeddial\n"
+		"extension = 1002\n",
+		CACHE_SIZE, ttl);
+
+	return fclose(file) ? -1 : 0;
+}
+
+static int count_vars(const struct ast_variable *var)
+{
+	int n = 0;
+
+	for (; var; var = var->next) {
+		n++;
+	}
+
+	return n;
+}
+
+static void test_file_device(struct sccp_cfg *cfg)
+{
+	struct sccp_config_realtime_stats stats;
+	struct sccp_device_cfg *device_cfg;
+
+	CHECK(sccp_cfg_try_find_device_or_guest(cfg, "SEPFILE", &device_cfg) == 0);
+	CHECK(device_cfg && !strcmp(device_cfg->line_cfg->name, "fileline"));
+	ao2_cleanup(device_cfg);
+
+	sccp_config_realtime_take_stats(&stats);
+	CHECK(stats.lookups == 0);
+}
+
+static void test_realtime_device(struct sccp_cfg *cfg)
+{
+	struct sccp_config_realtime_stats stats;
+	struct sccp_device_cfg *device_cfg;
+	struct sccp_device_cfg *cached;
+
+	CHECK(sccp_cfg_try_find_device_or_guest(cfg, "SEP000000000001", &device_cfg) == SCCP_CFG_REALTIME_LOOKUP);
+	CHECK(device_cfg == NULL);
+
+	device_cfg = sccp_cfg_lookup_device_or_guest(cfg, "SEP000000000001");
+	CHECK(device_cfg != NULL);
+	if (!device_cfg) {
+		return;
+	}
+
+	CHECK(!strcmp(device_cfg->line_cfg->name, "rt1"));
+	CHECK(!strcmp(device_cfg->line_cfg->cid_name, "Realtime"));
+	CHECK(!strcmp(device_cfg->line_cfg->cid_num, "1"));
+	CHECK(!strcmp(device_cfg->line_cfg->context, "rt-context"));
+	CHECK(count_vars(device_cfg->line_cfg->chanvars) == 2);
+	CHECK(device_cfg->speeddial_count == 2);
+
+	/* the next registration of the device is served from the cache */
+	CHECK(sccp_cfg_try_find_device_or_guest(cfg, "SEP000000000001", &cached) == 0);
+	CHECK(cached == device_cfg);
+	ao2_cleanup(cached);
+
+	sccp_config_realtime_invalidate("SEP000000000001");
+	CHECK(sccp_cfg_try_find_device_or_guest(cfg, "SEP000000000001", &cached) == SCCP_CFG_REALTIME_LOOKUP);
+
+	ao2_ref(device_cfg, -1);
+
+	sccp_config_realtime_take_stats(&stats);
+	CHECK(stats.lookups == 1);
+	CHECK(stats.lookups_found == 1);
+	CHECK(stats.cache.hits == 1);
+}
+
+static void test_invalid_devices(struct sccp_cfg *cfg)
+{
+	struct sccp_config_realtime_stats stats;
+	struct sccp_device_cfg *device_cfg;
+	struct sccp_device_cfg *cached;
+
+	/* no guest device is configured */
+	device_cfg = sccp_cfg_lookup_device_or_guest(cfg, "SEPUNKNOWN");
+	CHECK(device_cfg == NULL);
+	ao2_cleanup(device_cfg);
+
+	device_cfg = sccp_cfg_lookup_device_or_guest(cfg, "SEPNOLINE");
+	CHECK(device_cfg == NULL);
+	ao2_cleanup(device_cfg);
+
+	/* a line of the configuration file can't be used by a realtime device */
+	device_cfg = sccp_cfg_lookup_device_or_guest(cfg, "SEPFILELINE");
+	CHECK(device_cfg == NULL);
+	ao2_cleanup(device_cfg);
+
+	/* the failed lookups are not cached */
+	CHECK(sccp_cfg_try_find_device_or_guest(cfg, "SEPUNKNOWN", &cached) == SCCP_CFG_REALTIME_LOOKUP);
+
+	sccp_config_realtime_take_stats(&stats);
+	CHECK(stats.lookups == 4);
+	CHECK(stats.lookups_found == 1);
+}
+
+static void test_eviction(struct sccp_cfg *cfg)
+{
+	struct sccp_config_realtime_stats stats;
+	struct sccp_device_cfg *device_cfg;
+	char name[SCCP_DEVICE_NAME_MAX];
+	unsigned int i;
+
+	sccp_config_realtime_invalidate(NULL);
+	sccp_config_realtime_take_stats(&stats);
+
+	for (i = 0; i < 2 * CACHE_SIZE; i++) {
+		snprintf(name, sizeof(name), "SEP%012u", i);
+		device_cfg = sccp_cfg_find_device_or_guest(cfg, name);
+		CHECK(device_cfg != NULL);
+		ao2_cleanup(device_cfg);
+	}
+
+	sccp_config_realtime_take_stats(&stats);
+	CHECK(stats.cache.entries == CACHE_SIZE);
+	CHECK(stats.cache.evictions >= CACHE_SIZE);
+
+	/* the oldest devices have been evicted, the newest are still cached */
+	CHECK(sccp_cfg_try_find_device_or_guest(cfg, "SEP000000000000", &device_cfg) == SCCP_CFG_REALTIME_LOOKUP);
+	snprintf(name, sizeof(name), "SEP%012u", 2 * CACHE_SIZE - 1);
+	CHECK(sccp_cfg_try_find_device_or_guest(cfg, name, &device_cfg) == 0);
+	ao2_cleanup(device_cfg);
+}
+
+/*
+ * Register devices like sessions do, i.e. looking the device up only on a cache miss.
+ */
+static void bench_registrations(struct sccp_cfg *cfg)
+{
+	struct sccp_config_realtime_stats before;
+	struct sccp_config_realtime_stats after;
+	struct sccp_device_cfg *device_cfg;
+	char name[SCCP_DEVICE_NAME_MAX];
+	unsigned long long hit_time_total = 0;
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int seed = 1;
+	unsigned int n;
+	unsigned int i;
+	struct timeval start;
+
+	sccp_config_realtime_invalidate(NULL);
+	sccp_config_realtime_take_stats(&before);
+
+	for (i = 0; i < REGISTRATIONS; i++) {
+		if (rand_r(&seed) % 10 < 8) {
+			n = rand_r(&seed) % HOT_DEVICES;
+		} else {
+			n = rand_r(&seed) % REALTIME_DEVICES;
+		}
+
+		snprintf(name, sizeof(name), "SEP%012u", n);
+		start = ast_tvnow();
+		if (sccp_cfg_try_find_device_or_guest(cfg, name, &device_cfg) == SCCP_CFG_REALTIME_LOOKUP) {
+			device_cfg = sccp_cfg_lookup_device_or_guest(cfg, name);
+		} else {
+			hit_time_total += ast_tvdiff_us(ast_tvnow(), start);
+		}
+
+		CHECK(device_cfg != NULL);
+		ao2_cleanup(device_cfg);
+	}
+
+	sccp_config_realtime_take_stats(&after);
+
+	hits = after.cache.hits - before.cache.hits;
+	misses = after.lookups - before.lookups;
+	CHECK(hits + misses == REGISTRATIONS);
+	CHECK(after.lookups_found - before.lookups_found == misses);
+
+	printf("Registrations: %u of %u realtime devices, 80%% of %u devices, cache of %u entries\n",
+		REGISTRATIONS, REALTIME_DEVICES, HOT_DEVICES, CACHE_SIZE);
+	printf("Cache hit rate: %.1f%% (%u hits, %u misses, %u evictions)\n",
+		100.0 * hits / REGISTRATIONS, hits, misses, after.cache.evictions - before.cache.evictions);
+	if (hits) {
+		printf("Cache hit latency: avg %.1f us\n", (double) hit_time_total / hits);
+	}
+	if (misses) {
+		printf("Realtime lookup latency: avg %.1f us, max %d us\n",
+			(double) (after.lookup_time_total - before.lookup_time_total) / misses, after.lookup_time_max);
+	}
+}
+
+/*
+ * Reload with a TTL of 1 second, and check that the entries expire.
+ */
+static void test_expiration(const char *dir)
+{
+	struct sccp_config_realtime_stats stats;
+	struct sccp_device_cfg *device_cfg;
+	struct sccp_cfg *cfg;
+
+	if (write_config(dir, 1) || sccp_config_reload()) {
+		CHECK(!"reload with a TTL of 1 second");
+		return;
+	}
+
+	cfg = sccp_config_get();
+
+	/* the reload emptied the cache */
+	sccp_config_realtime_take_stats(&stats);
+	CHECK(stats.cache.entries == 0);
+	CHECK(stats.cache.ttl == 1);
+
+	device_cfg = sccp_cfg_find_device_or_guest(cfg, "SEP000000000002");
+	CHECK(device_cfg != NULL);
+	ao2_cleanup(device_cfg);
+
+	sleep(2);
+
+	CHECK(sccp_cfg_try_find_device_or_guest(cfg, "SEP000000000002", &device_cfg) == SCCP_CFG_REALTIME_LOOKUP);
+
+	sccp_config_realtime_take_stats(&stats);
+	CHECK(stats.cache.expirations >= 1);
+
+	ao2_ref(cfg, -1);
+}
+
+int main(int argc, char *argv[])
+{
+	char db_path[PATH_MAX + sizeof("/realtime.sqlite3")];
+	char dir[PATH_MAX];
+	struct sccp_cfg *cfg;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		switch (opt) {
+		case 'v':
+			stub_option_verbose = 1;
+			stub_option_debug = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (harness_mkdtemp(dir, sizeof(dir))) {
+		fprintf(stderr, "could not create a temporary directory: %s\n", strerror(errno));
+		return 1;
+	}
+
+	snprintf(db_path, sizeof(db_path), "%s/realtime.sqlite3", dir);
+	if (create_realtime_db(db_path) || stub_realtime_set_sqlite(db_path) || write_config(dir, 300)) {
+		harness_rmdir(dir);
+		return 1;
+	}
+
+	stub_set_dirs(dir, dir, dir);
+
+	if (sccp_config_init() || sccp_config_load()) {
+		fprintf(stderr, "could not load the config\n");
+		harness_rmdir(dir);
+		return 1;
+	}
+
+	cfg = sccp_config_get();
+	test_file_device(cfg);
+	test_realtime_device(cfg);
+	test_invalid_devices(cfg);
+	test_eviction(cfg);
+	bench_registrations(cfg);
+	ao2_ref(cfg, -1);
+
+	test_expiration(dir);
+
+	sccp_config_destroy();
+	stub_realtime_set_sqlite(NULL);
+	harness_rmdir(dir);
+
+	if (failures) {
+		fprintf(stderr, "%u check(s) failed\n", failures);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+
+	return 0;
+}